@@ -0,0 +1,48 @@
+/**
+ * @file bitmap.h
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief allocation bitmaps
+ * @details structs and prototypes of the in-memory copies of the inode
+ * and data bitmaps, the bits are scanned one 64 bit word at a time
+ */
+#ifndef BITMAP_H
+#define BITMAP_H
+#include <stdint.h>
+#include <stdlib.h>
+
+#define BITMAP_WORD_BITS 64 /* no of bits per bitmap word */
+#define BITMAP_NONE UINT32_MAX /* returned when no bit is found */
+
+struct fs_freeidx;
+
+/**
+ * @brief in-memory copy of an allocation bitmap
+ * @details the words have the same layout as the bitmap blocks on the
+ * disk (bit i of the bitmap is bit i%8 of byte i/8) on a little endian
+ * host, so the blocks are loaded and written back as is.
+ */
+struct fs_bitmap {
+	uint64_t* words;          /**< content of the bitmap blocks */
+	uint8_t* dirty;           /**< modified flag of each bitmap block */
+	uint32_t loc;             /**< first bitmap block on the disk */
+	uint32_t stride;          /**< distance between two bitmap blocks on the disk */
+	uint32_t nblocks;         /**< no of bitmap blocks */
+	uint32_t nbits;           /**< no of bits that can be allocated */
+	uint32_t cursor;          /**< next-fit cursor: where the next search starts */
+	struct fs_freeidx* index; /**< free-extent index (NULL if not built) */
+};
+
+int bitmap_test(const struct fs_bitmap* bm, uint32_t bit);
+void bitmap_set(struct fs_bitmap* bm, uint32_t bit);
+void bitmap_clear(struct fs_bitmap* bm, uint32_t bit);
+void bitmap_set_range(struct fs_bitmap* bm, uint32_t start, uint32_t len);
+void bitmap_clear_range(struct fs_bitmap* bm, uint32_t start, uint32_t len);
+uint32_t bitmap_find_zero(const struct fs_bitmap* bm, uint32_t start, uint32_t end);
+uint32_t bitmap_find_one(const struct fs_bitmap* bm, uint32_t start, uint32_t end);
+uint32_t bitmap_find_run(const struct fs_bitmap* bm, uint32_t start, uint32_t end, uint32_t len,
+						 uint32_t* best_start, uint32_t* best_len);
+uint32_t bitmap_alloc(struct fs_bitmap* bm, uint32_t bits[], uint32_t count);
+uint32_t bitmap_count_zeros_range(const struct fs_bitmap* bm, uint32_t start, uint32_t end);
+uint32_t bitmap_count_zeros(const struct fs_bitmap* bm);
+#endif
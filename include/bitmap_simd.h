@@ -0,0 +1,18 @@
+/**
+ * @file bitmap_simd.h
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief word kernels of the allocation bitmaps
+ * @details prototypes of the loops over whole bitmap words, an AVX2
+ * version is picked at the first call if the cpu supports it, else the
+ * scalar version is used
+ */
+#ifndef BITMAP_SIMD_H
+#define BITMAP_SIMD_H
+#include <stdint.h>
+#include <stdlib.h>
+
+uint32_t bitmap_simd_skip(const uint64_t* words, uint32_t first, uint32_t last, uint64_t value);
+uint64_t bitmap_simd_count(const uint64_t* words, uint32_t first, uint32_t last);
+int bitmap_simd_enable(int enable);
+#endif
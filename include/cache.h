@@ -0,0 +1,68 @@
+/**
+ * @file cache.h
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief block buffer cache
+ * @details structs and prototypes of the write-back block cache that sits
+ * between the filesystem and the disk image
+ */
+#ifndef CACHE_H
+#define CACHE_H
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <disk.h>
+
+#define DISK_CACHE_DEFAULT_BLOCKS 256 /* default no of blocks kept in memory */
+
+/**
+ * @brief cache counters
+ * @details counters updated by the cache on each access, they can be
+ * read with disk_cache_stats
+ */
+struct disk_cache_stats {
+	uint64_t hits;       /**< accesses served from memory */
+	uint64_t misses;     /**< accesses that had to read the disk */
+	uint64_t evictions;  /**< blocks dropped to make room for others */
+	uint64_t writebacks; /**< dirty blocks written to the disk */
+};
+
+/**
+ * @brief one cached block
+ */
+struct disk_cache_entry {
+	int blocknum;                   /**< cached block number, -1 if unused */
+	int dirty;                      /**< the block differs from the disk */
+	uint8_t* data;                  /**< content of the block */
+	struct disk_cache_entry* hnext; /**< next entry in the hash chain */
+	struct disk_cache_entry* prev;  /**< previous entry in the lru list */
+	struct disk_cache_entry* next;  /**< next entry in the lru list */
+};
+
+/**
+ * @brief block cache structure
+ * @details a bounded set of blocks indexed by a hash table on the block
+ * number, the least recently used block is evicted when the cache is full
+ */
+struct disk_cache {
+	size_t capacity;                   /**< max no of cached blocks */
+	size_t nbuckets;                   /**< size of the hash table */
+	size_t used;                       /**< no of entries in use */
+	struct disk_cache_entry* entries;  /**< all the entries */
+	struct disk_cache_entry** buckets; /**< hash table */
+	struct disk_cache_entry* lru_head; /**< most recently used entry */
+	struct disk_cache_entry* lru_tail; /**< least recently used entry */
+	uint8_t* pool;                     /**< memory of the cached blocks (block aligned) */
+	struct disk_cache_stats stats;     /**< access counters */
+};
+
+struct disk_cache* cache_create(size_t capacity);
+void cache_destroy(struct disk_cache* cache);
+int cache_read(struct disk_cache* cache, struct fs_filesyst fs, int blocknum, void* blk);
+int cache_write(struct disk_cache* cache, struct fs_filesyst fs, int blocknum,
+				const void* blk, size_t blksize);
+int cache_flush(struct disk_cache* cache, struct fs_filesyst fs);
+int cache_peek(struct disk_cache* cache, int blocknum, void* blk);
+void cache_update(struct disk_cache* cache, int blocknum, const void* blk);
+void cache_discard(struct disk_cache* cache, int blocknum, int count);
+#endif
@@ -24,6 +24,8 @@ typedef struct {
 } DIR_;
 
 int formatdir(struct fs_filesyst fs, struct fs_super_block super, uint32_t* inodenum, uint16_t mode);
+int formatdir_in(struct fs_filesyst fs, struct fs_super_block super, uint32_t parent,
+				 uint32_t* inodenum, uint16_t mode);
 int insertFile(struct fs_filesyst fs, struct fs_super_block super,
 			   uint32_t dirino, struct dirent file);
 int findFile(struct fs_filesyst fs, struct fs_super_block super,
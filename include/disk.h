@@ -10,8 +10,51 @@
 #define DISK_H
 #include <stdint.h>
 #include <stdlib.h>
+#include <sys/types.h>
 
 #define FS_BLOCK_SIZE 4096 			   /* block size in bytes */
+#define DISK_MAX_IOV 64                /* max no of blocks per vectored syscall */
+
+/* mount modes of the disk image */
+#define DISK_DEFAULT 0x0 /* file descriptor I/O through the block cache */
+#define DISK_MMAP    0x1 /* the whole image is mapped in memory */
+#define DISK_URING   0x2 /* vectored I/O is queued to io_uring while plugged */
+#define DISK_DIRECT  0x4 /* O_DIRECT, the host page cache is bypassed */
+#define DISK_RAM     0x8 /* the disk only lives in memory, no file is used */
+
+struct fs_filesyst;
+
+/**
+ * @brief block device interface
+ * @details the operations of a backend of the disk layer (host file,
+ * memory mapped file or RAM disk). the block numbers are checked by the
+ * callers, the buffers hold whole blocks except for write.
+ */
+struct disk_ops {
+	const char* name; /**< name of the backend */
+	/** opens the device, fills the fields of *fs* used by the backend */
+	int (*open)(const char* filename, size_t size, struct fs_filesyst* fs);
+	/** releases the device */
+	void (*close)(struct fs_filesyst* fs);
+	/** reads one block */
+	int (*read)(struct fs_filesyst fs, int blocknum, void* blk);
+	/** writes the *blksize* first bytes of a block */
+	int (*write)(struct fs_filesyst fs, int blocknum, const void* blk, size_t blksize);
+	/** reads *count* contiguous blocks */
+	int (*readv)(struct fs_filesyst fs, int blocknum, int count, void* blks[]);
+	/** writes *count* contiguous blocks */
+	int (*writev)(struct fs_filesyst fs, int blocknum, int count, const void* blks[]);
+	/** makes the written blocks durable */
+	int (*flush)(struct fs_filesyst fs);
+	/** releases the storage of *count* blocks, they read as zeros after */
+	int (*discard)(struct fs_filesyst fs, int blocknum, int count);
+	/** no of blocks of the device */
+	uint32_t (*size)(struct fs_filesyst fs);
+};
+
+extern const struct disk_ops disk_file_ops; /* host file with pread/pwrite */
+extern const struct disk_ops disk_mmap_ops; /* memory mapped host file */
+extern const struct disk_ops disk_ram_ops;  /* anonymous memory */
 
 /**
  * @brief virtual filesystem structure
@@ -19,14 +62,43 @@
  * partition
  */
 struct fs_filesyst{
-	uint32_t fd;      /**< file descriptor */
-	uint32_t tot_size;/**< total size of our file (partition) */
+	const struct disk_ops* ops; /**< backend of the disk */
+	int fd;           /**< file descriptor (-1 without a host file) */
+	uint64_t tot_size;/**< total size of our file (partition) */
 	uint32_t nblocks; /**< number of blocks in disk image*/
+	int flags;        /**< mount mode (DISK_DEFAULT, DISK_MMAP, DISK_URING, DISK_DIRECT, DISK_RAM) */
+	uint8_t* map;     /**< memory of the disk with DISK_MMAP or DISK_RAM (NULL otherwise) */
+	struct disk_cache* cache; /**< block cache shared by all copies (NULL if disabled) */
+	struct disk_uring* uring; /**< io_uring queue with DISK_URING (NULL otherwise) */
+	struct fs_incore* incore; /**< in-core filesystem state shared by all copies */
 };
-int fs_check_magicnum(int fd);
+
+struct disk_cache_stats;
+struct iovec;
+
+int fs_check_magicnum(struct fs_filesyst fs);
 int creatfile(const char* filename, size_t size, struct fs_filesyst* fs);
+int disk_open(const char* filename, size_t size, int flags, struct fs_filesyst* fs);
+void* disk_alloc_blocks(size_t count);
+void* disk_block_ptr(struct fs_filesyst fs, int blocknum);
 int disk_size(struct fs_filesyst fs);
 void disk_close(struct fs_filesyst* fs);
+int disk_sync(struct fs_filesyst fs);
+int disk_discard(struct fs_filesyst fs, int blocknum, int count);
+int disk_cache_init(struct fs_filesyst* fs, size_t nblocks);
+void disk_cache_stats(struct fs_filesyst fs, struct disk_cache_stats* stats);
+void disk_dump_cache(struct fs_filesyst fs);
+void disk_plug(struct fs_filesyst fs);
+int disk_unplug(struct fs_filesyst fs);
+int disk_is_plugged(struct fs_filesyst fs);
+int disk_host_open(const char* filename, size_t size, int oflags);
+int disk_rw_vec(int fd, struct iovec* iov, int cnt, off_t off, int write);
+int disk_read_raw(struct fs_filesyst fs, int blocknum, void* blk);
+int disk_write_raw(struct fs_filesyst fs, int blocknum, const void* blk, size_t blksize);
+int disk_readv_raw(struct fs_filesyst fs, int blocknum, int count, void* blks[]);
+int disk_writev_raw(struct fs_filesyst fs, int blocknum, int count, const void* blks[]);
 int fs_write_block(struct fs_filesyst fs, int blocknum, const void* blk, size_t blksize);
 int fs_read_block(struct fs_filesyst fs, int blocknum, void* blk);
+int fs_read_blocks(struct fs_filesyst fs, int blocknum, int count, void* blks[]);
+int fs_write_blocks(struct fs_filesyst fs, int blocknum, int count, const void* blks[]);
 #endif
@@ -0,0 +1,55 @@
+/**
+ * @file freeidx.h
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief free-extent index of an allocation bitmap
+ * @details structs and prototypes of the segment tree kept over the
+ * words of an in-memory bitmap, it answers the searches of free runs
+ * and the fragmentation queries in O(log n)
+ */
+#ifndef FREEIDX_H
+#define FREEIDX_H
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <bitmap.h>
+
+/**
+ * @brief node of the free-extent index
+ * @details summary of the free bits of a power of 2 range of words,
+ * the bits after the end of the bitmap are counted as allocated
+ */
+struct freeidx_node {
+	uint32_t pre;  /**< no of free bits at the start of the range */
+	uint32_t suf;  /**< no of free bits at the end of the range */
+	uint32_t max;  /**< longest run of free bits */
+	uint32_t runs; /**< no of runs of free bits */
+	uint32_t free; /**< no of free bits */
+};
+
+/**
+ * @brief free-extent index
+ * @details a segment tree stored as an array: node 1 is the root, the
+ * children of node k are 2k and 2k+1 and the leaves are the words
+ */
+struct fs_freeidx {
+	struct freeidx_node* nodes; /**< nodes of the tree */
+	uint32_t leaves;            /**< no of leaves (power of 2) */
+};
+
+/**
+ * @brief free space statistics
+ */
+struct freeidx_stats {
+	uint32_t free;    /**< no of free bits */
+	uint32_t extents; /**< no of runs of free bits */
+	uint32_t largest; /**< longest run of free bits */
+};
+
+int freeidx_build(struct fs_bitmap* bm);
+void freeidx_destroy(struct fs_bitmap* bm);
+void freeidx_update(struct fs_bitmap* bm, uint32_t word);
+uint32_t freeidx_find_run(const struct fs_bitmap* bm, uint32_t start, uint32_t end, uint32_t len);
+uint32_t freeidx_largest(const struct fs_bitmap* bm, uint32_t start, uint32_t end);
+void freeidx_stats(const struct fs_bitmap* bm, struct freeidx_stats* st);
+#endif
@@ -10,16 +10,53 @@
 #include <stdint.h>
 
 #include <disk.h>
+#include <bitmap.h>
+#include <freeidx.h>
 
+struct io_delalloc;
+struct fs_icache;
+struct fs_icache_stats;
 
 #define FS_MAGIC 0xF0F03410 		   /* magic number for our filesystem */
 #define FS_POINTERS_PER_BLOCK 1024     /* no of pointers (used by inodes) per block in bytes*/
-#define FS_INODES_PER_BLOCK 64 		   /* no of inodes per block */
+#define FS_INODES_PER_BLOCK 64 		   /* no of inodes per block (FS_INODE_V0) */
 #define FS_DIRECT_POINTERS_PER_INODE 8 /* no of direct data pointers in each inode */
-#define FS_INODE_RATIO 0.01 /* total ratio of inodes in the fs */
+#define FS_MAX_FILE_BLOCKS (FS_DIRECT_POINTERS_PER_INODE + FS_POINTERS_PER_BLOCK)
+					/* maximum no of data blocks of a file */
+#define FS_INODE_RATIO 0.01 /* total ratio of inodes in the fs (with block groups) */
+#define FS_INITIAL_INODE_RATIO 0.001 /* ratio of the inode table formatted without groups,
+									  * the next inodes are added by chunks */
+#define FS_ICHUNK_BLOCKS 16 /* no of inode table blocks of an inode chunk */
+#define FS_ICHUNK_MAX FS_POINTERS_PER_BLOCK /* max no of inode chunks (one chunk map block),
+											* FS_ICHUNK_MAX * FS_ICHUNK_BLOCKS * FS_DINODES_PER_BLOCK inodes
+											* at most after the inode table */
 #define FS_MAX_INODE_COUNT (NO_BYTES_32 / (FS_BLOCK_SIZE * FS_INODES_PER_BLOCK))
 					/* maximum no of inodes blocks that can be referenced
 					 *  with 32 bits in the directory entries */
+#define FS_SUPER_SYNC_INTERVAL 5 /* max no of seconds the superblock stays modified in memory */
+#define FS_GROUP_BITS (FS_BLOCK_SIZE * 8) /* max no of inodes and of blocks of a group */
+#define FS_DEFAULT_GROUP_BLOCKS FS_GROUP_BITS /* no of blocks of a group by default */
+#define FS_NO_INODE UINT32_MAX /* no inode (eg. no parent directory) */
+
+/* inode flags */
+#define FS_INODE_PREALLOC 0x1 /* the bytes after init_size are preallocated and read as zeros */
+#define FS_INODE_EXTENTS 0x2  /* the blocks are mapped with extents instead of block pointers */
+#define FS_INODE_INLINE 0x4   /* the data is stored in the inode itself, without data block */
+
+/* filesystem features */
+#define FS_FEATURE_EXTENTS 0x1 /* the new inodes are mapped with extents */
+#define FS_FEATURE_INLINE_DATA 0x2 /* the new inodes keep their data inline while it fits */
+#define FS_MAX_EXTENT_FILE_SIZE UINT32_MAX /* maximum size of a file mapped with extents */
+
+/* inode table formats, the other values are refused. the 64-byte records
+ * written between the inode flags and FS_INODE_V1 had no version of their
+ * own, they are not supported */
+#define FS_INODE_V0 0 /* fs_inode_v0 records of the images formatted before the versions */
+#define FS_INODE_V1 1 /* packed fs_dinode records */
+
+/* format modes */
+#define FS_FORMAT_FLAT 1   /* one bitmap, inode table and data area for the whole image */
+#define FS_FORMAT_GROUPS 2 /* the image is split into block groups */
 
 /**
  * @brief super block structure
@@ -49,23 +86,182 @@ struct fs_super_block  {
 	
 	uint32_t mtime;			   /**< time of mount of the filesystem */
 	uint32_t wtime; 		   /**< last write time */
+
+	uint32_t group_blocks;     /**< no of blocks per group, 0 without groups */
+	uint32_t group_count;      /**< no of groups */
+	uint32_t group_inodes;     /**< no of inodes per group */
+	uint32_t gdt_loc;          /**< location of the group descriptors */
+	uint32_t gdt_size;         /**< size of the group descriptors in blocks */
+	uint32_t features;         /**< FS_FEATURE_* flags */
+	uint32_t inode_version;    /**< format of the inode table (FS_INODE_V*) */
+	uint32_t ichunk_map;       /**< data block of the inode chunk map, 0 without chunks */
+	uint32_t ichunk_count;     /**< no of inode chunks added after the inode table */
 };
 
+/**
+ * @brief block group descriptor
+ * @details with block groups, the image is split into groups of
+ * *group_blocks* blocks that each hold an inode bitmap block, a data
+ * bitmap block, a slice of the inode table and data blocks. the inode
+ * and data numbers of group g start at g * FS_GROUP_BITS, the bits of a
+ * group bitmap past its inodes and blocks stay set.
+ */
+struct fs_group_desc {
+	uint32_t free_inode_count; /**< no of free inodes of the group */
+	uint32_t free_data_count;  /**< no of free blocks of the group */
+};
+
+#define FS_GROUP_DESC_PER_BLOCK (FS_BLOCK_SIZE / sizeof(struct fs_group_desc))
+
+/**
+ * @brief in-core filesystem state
+ * @details state of the filesystem kept in memory and shared by all the
+ * copies of the fs_filesyst struct. the superblock, the bitmaps and the
+ * cached inodes kept here are the authority, they are only written by
+ * fs_sync (at sync, at unmount or when they have been modified for
+ * FS_SUPER_SYNC_INTERVAL seconds).
+ */
+struct fs_incore {
+	struct fs_super_block super; /**< current superblock */
+	int super_loaded;            /**< the superblock was read from block 0 */
+	int super_dirty;             /**< the superblock differs from block 0 */
+	uint32_t super_synced;       /**< last time block 0 was written */
+	int bitmaps_loaded;          /**< the bitmaps were read from the disk */
+	struct fs_bitmap inode_map;  /**< inode bitmap */
+	struct fs_bitmap data_map;   /**< data bitmap */
+	int free_batch;              /**< nesting level of fs_free_begin */
+	uint32_t* pending;           /**< data blocks freed in the current batch */
+	size_t npending;             /**< no of pending data blocks */
+	size_t pending_cap;          /**< size of the pending array */
+	struct fs_group_desc* groups;/**< group descriptors (NULL without groups) */
+	int groups_dirty;            /**< the group descriptors were modified */
+	struct io_delalloc* delalloc;/**< files with delayed allocation (NULL if disabled) */
+	struct fs_icache* icache;    /**< in-core inodes (NULL if disabled) */
+	union fs_block* ichunks;     /**< inode chunk map (NULL without chunks) */
+	int sparse;                  /**< the blocks of zeros written over holes stay holes */
+};
+
+/**
+ * @brief extent of a file
+ * @details a run of logical blocks of a file stored in contiguous data
+ * blocks
+ */
+struct fs_file_extent {
+	uint32_t lblk;  /**< first logical block */
+	uint32_t start; /**< first data block number */
+	uint32_t len;   /**< no of blocks */
+};
+
+#define FS_INLINE_EXTENTS 2 /* no of extents kept in the inode */
+#define FS_EXTENTS_PER_BLOCK ((FS_BLOCK_SIZE - 2 * sizeof(uint32_t)) / sizeof(struct fs_file_extent))
+					/* no of extents of an extent block */
+
+/**
+ * @brief extent map of an inode
+ * @details takes the place of the block pointers of the inodes with
+ * FS_INODE_EXTENTS. the extents are sorted by logical block, they are
+ * kept in the inode while they fit, else in an extent block.
+ */
+struct fs_extent_root {
+	uint16_t count;  /**< no of extents of the file */
+	uint16_t depth;  /**< 0 if the extents are in the inode, 1 if they are in *block* */
+	uint32_t block;  /**< extent block (depth 1) */
+	struct fs_file_extent ext[FS_INLINE_EXTENTS]; /**< extents (depth 0) */
+	uint32_t reserved;
+};
+
+/**
+ * @brief extent block
+ * @details the extents of a file that do not fit in its inode
+ */
+struct fs_extent_block {
+	uint32_t count;    /**< no of extents */
+	uint32_t reserved;
+	struct fs_file_extent ext[FS_EXTENTS_PER_BLOCK]; /**< extents sorted by logical block */
+};
+
+#define FS_INLINE_DATA_SIZE 40 /* no of data bytes kept in an inode with FS_INODE_INLINE */
+
 /**
  * @brief inode structure
  * @details the structure of inodes contains information about one file
- * with a total size of 54 bytes.
+ * with a total size of 64 bytes in memory. the data blocks are mapped either with
+ * block pointers or with extents (FS_INODE_EXTENTS). the data of a small
+ * file (FS_INODE_INLINE) takes the place of the mapping and of init_size.
  */
 struct fs_inode {
 	uint16_t mode; 								  /**< file type and permissions */
 	uint16_t uid; 								  /**< id of owner */
 	uint16_t gid; 								  /**< group id of owners */
+	uint16_t flags; 							  /**< FS_INODE_* flags */
 	uint32_t atime; 							  /**< last access time in seconds since the epoch */
 	uint32_t mtime; 							  /**< last modification time in seconds since the epoch*/
 	uint32_t size; 								  /**< size of the file in bytes */
 	uint32_t hcount;							  /**< hard link count for the inode */
-	uint32_t direct[FS_DIRECT_POINTERS_PER_INODE];/**< direct data blocks */
-	uint32_t indirect; 							  /**< indirect data blocks */
+	union {
+		struct {
+			union {
+				struct {
+					uint32_t direct[FS_DIRECT_POINTERS_PER_INODE];/**< direct data blocks */
+					uint32_t indirect; 							  /**< indirect data blocks */
+				};
+				struct fs_extent_root extents;        /**< extents (with FS_INODE_EXTENTS) */
+			};
+			uint32_t init_size; 				  /**< bytes written before the preallocated ones
+												   (with FS_INODE_PREALLOC) */
+		};
+		uint8_t inline_data[FS_INLINE_DATA_SIZE]; /**< data of the file (with FS_INODE_INLINE) */
+	};
+};
+
+/**
+ * @brief on-disk inode record of FS_INODE_V0
+ * @details the inode as the images formatted before the inode versions
+ * store it: 60 bytes with 2 bytes of padding after gid, without flags
+ * nor init_size. the padding is never read.
+ */
+struct fs_inode_v0 {
+	uint16_t mode;
+	uint16_t uid;
+	uint16_t gid;
+	uint16_t pad;
+	uint32_t atime;
+	uint32_t mtime;
+	uint32_t size;
+	uint32_t hcount;
+	uint32_t direct[FS_DIRECT_POINTERS_PER_INODE];
+	uint32_t indirect;
+};
+
+/**
+ * @brief on-disk inode record
+ * @details record of the inode table with FS_INODE_V1, separate from the
+ * in-core fs_inode: it is packed, so its layout does not depend on the
+ * padding of the compiler, and the link count takes 16 bits. *map* holds
+ * the bytes of the block map and init_size, or the inline data.
+ */
+struct fs_dinode {
+	uint16_t mode;
+	uint16_t uid;
+	uint16_t gid;
+	uint16_t flags;
+	uint16_t hcount;
+	uint32_t atime;
+	uint32_t mtime;
+	uint32_t size;
+	uint8_t map[FS_INLINE_DATA_SIZE];
+} __attribute__((packed));
+
+#define FS_DINODES_PER_BLOCK (FS_BLOCK_SIZE / sizeof(struct fs_dinode)) /* 66 */
+#define FS_DINODE_MAX_LINKS UINT16_MAX /* max link count of an inode with FS_INODE_V1 */
+
+/**
+ * @brief extent structure
+ * @details a run of physically contiguous data blocks
+ */
+struct fs_extent {
+	uint32_t start; /**< first data block number */
+	uint32_t len;   /**< no of blocks */
 };
 
 /**
@@ -75,27 +271,64 @@ struct fs_inode {
  */
 union fs_block {
 	struct fs_super_block super; 				/**< super block */
-	struct fs_inode inodes[FS_INODES_PER_BLOCK];/**< array of inodes */
+	struct fs_inode_v0 inodes[FS_INODES_PER_BLOCK];/**< array of inode records (FS_INODE_V0) */
+	struct fs_dinode dinodes[FS_DINODES_PER_BLOCK]; /**< array of inode records (FS_INODE_V1) */
 	uint32_t pointers[FS_POINTERS_PER_BLOCK];   /**< array of pointers */
+	struct fs_group_desc groups[FS_GROUP_DESC_PER_BLOCK]; /**< group descriptors */
+	struct fs_extent_block extents;             /**< extent block */
 	uint8_t data[FS_BLOCK_SIZE]; 				/**< array of data bytes */
-};
+} __attribute__((aligned(FS_BLOCK_SIZE))); /* usable as is with DISK_DIRECT */
 
 /* prototypes */
+struct fs_incore* fs_incore_create();
+void fs_incore_destroy(struct fs_incore* incore);
+struct fs_super_block* fs_get_super(struct fs_filesyst fs);
+int fs_mark_super_dirty(struct fs_filesyst fs);
+int fs_sync_super(struct fs_filesyst fs);
+int fs_load_bitmaps(struct fs_filesyst fs);
+int fs_sync(struct fs_filesyst fs);
+int fs_sync_meta(struct fs_filesyst fs);
 int fs_format_super(struct fs_filesyst fs);
 int fs_dump_super(struct fs_filesyst fs);
 int fs_format(struct fs_filesyst fs);
+int fs_format_groups(struct fs_filesyst fs, uint32_t group_blocks);
+int fs_set_features(struct fs_filesyst fs, uint32_t features);
+uint32_t fs_inodes_per_block(const struct fs_super_block* super);
+uint32_t fs_max_links(const struct fs_super_block* super);
+int fs_has_inode_flags(const struct fs_super_block* super);
+uint32_t fs_inode_blocknum(const struct fs_super_block* super, uint32_t inodenum);
+uint32_t fs_inode_block(struct fs_filesyst fs, uint32_t inodenum);
+void fs_inode_decode(const struct fs_super_block* super, const union fs_block* blk,
+					 uint32_t inodenum, struct fs_inode* inode);
+void fs_inode_encode(const struct fs_super_block* super, union fs_block* blk,
+					 uint32_t inodenum, const struct fs_inode* inode);
+uint32_t fs_data_blocknum(const struct fs_super_block* super, uint32_t datanum);
+uint32_t fs_data_goal(const struct fs_super_block* super, uint32_t inodenum);
 int fs_alloc_inode(struct fs_filesyst fs, struct fs_super_block* super, uint32_t *inodenum);
+int fs_alloc_inode_near(struct fs_filesyst fs, struct fs_super_block* super, uint32_t goal,
+						uint32_t *inodenum);
 int fs_read_inode(struct fs_filesyst fs, struct fs_super_block super,
 				   uint32_t indno, struct fs_inode *inode);
+int fs_iget(struct fs_filesyst fs, uint32_t indno);
+void fs_iput(struct fs_filesyst fs, uint32_t indno);
+int fs_icache_init(struct fs_filesyst fs, size_t ninodes);
+void fs_icache_stats(struct fs_filesyst fs, struct fs_icache_stats* stats);
 int fs_dump_inode(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum);
 int fs_alloc_data(struct fs_filesyst fs, struct fs_super_block* super, uint32_t data[], size_t size);
+int fs_alloc_extents(struct fs_filesyst fs, struct fs_super_block* super, uint32_t goal,
+					 size_t size, struct fs_extent ext[], size_t max_ext);
+int fs_data_frag(struct fs_filesyst fs, struct freeidx_stats* st);
 int fs_write_inode(struct fs_filesyst fs, struct fs_super_block super, uint32_t indno, struct fs_inode *inode);
 int fs_free_inode(struct fs_filesyst fs, struct fs_super_block* super, uint32_t inodenum);
 int fs_free_data(struct fs_filesyst fs, struct fs_super_block* super, uint32_t datanum);
+void fs_free_begin(struct fs_filesyst fs);
+int fs_free_end(struct fs_filesyst fs, struct fs_super_block* super);
+int fs_free_data_batch(struct fs_filesyst fs, struct fs_super_block* super,
+					   const uint32_t data[], size_t count);
 int fs_is_data_allocated(struct fs_filesyst fs, struct fs_super_block super, uint32_t datanum);
 int fs_is_inode_allocated(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum); 
 int fs_write_data(struct fs_filesyst fs, struct fs_super_block super,
-				  union fs_block *data, uint32_t *blknums, size_t size);
+				  const void *data, uint32_t *blknums, size_t size);
 int fs_read_data(struct fs_filesyst fs, struct fs_super_block super,
-				 union fs_block *data, uint32_t *blknums, size_t size);
+				 void *data, uint32_t *blknums, size_t size);
 #endif
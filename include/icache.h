@@ -0,0 +1,71 @@
+/**
+ * @file icache.h
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief in-core inode cache
+ * @details structs and prototypes of the write-back cache of inodes that
+ * sits between the inode users and the inode table
+ */
+#ifndef ICACHE_H
+#define ICACHE_H
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <fs.h>
+
+#define FS_ICACHE_DEFAULT_INODES 1024 /* default no of inodes kept in memory */
+
+/**
+ * @brief inode cache counters
+ * @details counters updated by the cache on each access, they can be
+ * read with fs_icache_stats
+ */
+struct fs_icache_stats {
+	uint64_t hits;       /**< accesses served from memory */
+	uint64_t misses;     /**< accesses that had to read the inode table */
+	uint64_t evictions;  /**< inodes dropped to make room for others */
+	uint64_t writebacks; /**< dirty inodes written to the inode table */
+};
+
+/**
+ * @brief one in-core inode
+ */
+struct fs_icache_entry {
+	uint32_t inodenum;             /**< cached inode number, FS_NO_INODE if unused */
+	int refcount;                  /**< no of references (open file descriptors) */
+	int dirty;                     /**< the inode differs from the inode table */
+	struct fs_inode inode;         /**< content of the inode */
+	struct fs_icache_entry* hnext; /**< next entry in the hash chain */
+	struct fs_icache_entry* prev;  /**< previous entry in the lru list */
+	struct fs_icache_entry* next;  /**< next entry in the lru list */
+};
+
+/**
+ * @brief inode cache structure
+ * @details a bounded set of inodes indexed by a hash table on the inode
+ * number. the inodes with references are never evicted, the others are
+ * evicted in least recently used order (written back first if dirty).
+ */
+struct fs_icache {
+	size_t capacity;                  /**< max no of cached inodes */
+	size_t nbuckets;                  /**< size of the hash table */
+	size_t used;                      /**< no of entries in use */
+	struct fs_icache_entry* entries;  /**< all the entries */
+	struct fs_icache_entry** buckets; /**< hash table */
+	struct fs_icache_entry* lru_head; /**< most recently used entry */
+	struct fs_icache_entry* lru_tail; /**< least recently used entry */
+	struct fs_icache_stats stats;     /**< access counters */
+};
+
+struct fs_icache* icache_create(size_t capacity);
+void icache_destroy(struct fs_icache* ic);
+int icache_read(struct fs_icache* ic, struct fs_filesyst fs, uint32_t inodenum,
+				struct fs_inode* inode);
+int icache_write(struct fs_icache* ic, struct fs_filesyst fs, uint32_t inodenum,
+				 const struct fs_inode* inode);
+int icache_get(struct fs_icache* ic, struct fs_filesyst fs, uint32_t inodenum);
+void icache_put(struct fs_icache* ic, uint32_t inodenum);
+void icache_forget(struct fs_icache* ic, uint32_t inodenum);
+void icache_reset(struct fs_icache* ic);
+int icache_flush(struct fs_icache* ic, struct fs_filesyst fs);
+#endif
@@ -12,28 +12,97 @@ struct io_filedesc {
 	uint32_t offset;
 	uint32_t mode;
 	uint32_t inodenum;
+	int pinned; /* the fd holds a reference on the in-core inode */
 };
 
 struct io_filedesc_table {
 	struct io_filedesc fds[IO_MAX_FILEDESC];
 };
+
+#define IO_DELALLOC_MAX_PAGES 1024 /* no of dirty pages kept before they are written */
+
+/* whence of io_llseek */
+#define IO_SEEK_SET 0  /* the offset is set to *off* */
+#define IO_SEEK_DATA 3 /* the offset is set to the first data at or after *off* */
+#define IO_SEEK_HOLE 4 /* the offset is set to the first hole at or after *off*
+						* (the end of the file is a hole) */
+#define IO_SEEK_NONE 1 /* returned by io_seek_ino when there is no data (or hole) after *off* */
+#define IO_SEEK_BATCH 256 /* no of blocks mapped at once by the data and hole searches */
+
+/**
+ * @brief dirty pages of a file with delayed allocation
+ * @details each page holds the whole content of a logical block of the
+ * file, its data block is only allocated when the page is written
+ */
+struct io_dirty_file {
+	uint32_t inodenum;          /**< inode of the file */
+	uint32_t npages;            /**< no of dirty pages */
+	uint32_t pages_cap;         /**< size of the pages array */
+	union fs_block** pages;     /**< page of each logical block (NULL if clean) */
+	struct io_dirty_file* next; /**< next file with dirty pages */
+};
+
+/**
+ * @brief delayed allocation state of a filesystem
+ */
+struct io_delalloc {
+	struct io_dirty_file* files; /**< files with dirty pages */
+	size_t npages;               /**< no of dirty pages of all the files */
+	int flushing;                /**< the pages are being written */
+};
+
+/**
+ * @brief extents of a file loaded in memory
+ * @details a copy of the extents of an inode with FS_INODE_EXTENTS (from
+ * the inode or from its extent block), sorted by logical block
+ */
+struct io_extent_map {
+	uint32_t count;                                  /**< no of extents */
+	struct fs_file_extent ext[FS_EXTENTS_PER_BLOCK]; /**< extents */
+};
+
 int io_open_fd(uint32_t inodenum);
 int io_close_fd(int fd);
+int io_close(struct fs_filesyst fs, int fd);
 int io_iopen(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum);
 int io_open_creat(struct fs_filesyst fs, struct fs_super_block super, uint16_t mode,
 					uint32_t* inodenum);
+int io_open_creat_in(struct fs_filesyst fs, struct fs_super_block super, uint32_t parent,
+					 uint16_t mode, uint32_t* inodenum);
 int io_write_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
 			 void* data, uint32_t off, size_t size);
 int io_write(struct fs_filesyst fs, struct fs_super_block super, int fd,
 			 void* data, size_t size);
+int io_lazy_alloc(struct fs_filesyst fs, struct fs_super_block super,
+				  uint32_t inodenum, struct fs_inode *ind, size_t off, size_t size);
+int io_fallocate_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
+					 uint32_t off, size_t len);
+int io_fallocate(struct fs_filesyst fs, struct fs_super_block super, int fd,
+				 uint32_t off, size_t len);
+int io_truncate_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
+					uint32_t len);
+int io_truncate(struct fs_filesyst fs, struct fs_super_block super, int fd, uint32_t len);
+int io_punch_hole_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
+					  uint32_t off, size_t len);
+int io_punch_hole(struct fs_filesyst fs, struct fs_super_block super, int fd,
+				  uint32_t off, size_t len);
 int io_read_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
 			 void* data, uint32_t off, size_t size);
 int io_read(struct fs_filesyst fs, struct fs_super_block super, int fd,
 			 void* data, size_t size);
 int io_lseek(struct fs_filesyst fs, struct fs_super_block super, int fd,
 			  size_t new_off);
+int io_seek_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
+				uint32_t off, int whence, uint32_t* res);
+int64_t io_llseek(struct fs_filesyst fs, struct fs_super_block super, int fd,
+				  uint32_t off, int whence);
 int io_rm_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum);
 int io_rm(struct fs_filesyst fs, struct fs_super_block super, int fd);
+int io_delalloc_enable(struct fs_filesyst fs, int enable);
+int io_delalloc_flush(struct fs_filesyst fs);
+int io_sparse_enable(struct fs_filesyst fs, int enable);
+void io_delalloc_discard(struct io_delalloc* da);
+void io_delalloc_release(struct io_delalloc* da);
 uint32_t io_getino(int fd);
 size_t io_getoff(int fd);
 #endif
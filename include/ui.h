@@ -3,12 +3,18 @@
 #include <dirent.h>
 
 int initfs(char* filename, size_t size, int format);
+int mountfs(char* filename, size_t size, int format, int flags);
 int lsl_(const char* dir);
 int ls_(const char* dir);
 int ln_(const char* src, const char* dest);
 int lseek_(int fd, uint32_t newoff);
+int64_t llseek_(int fd, uint32_t off, int whence);
 int write_(int fd, void* data, int size);
 int read_(int fd, void* data, int size);
+int fallocate_(int fd, uint32_t off, uint32_t len);
+int truncate_(const char* filename, uint32_t len);
+int ftruncate_(int fd, uint32_t len);
+int punch_hole_(int fd, uint32_t off, uint32_t len);
 int open_(const char* filename, int creat, uint16_t perms);
 DIR_* opendir_(const char* dirname, int creat, uint16_t perms);
 struct dirent readdir_(DIR_* dir);
@@ -18,6 +24,11 @@ int close_(int fd);
 int closedir_(DIR_* dir);
 int cp_(const char* src, const char* dest);
 int mv_(const char* src, const char* dest);
+int delalloc_(int enable);
+int extents_();
+int inline_data_();
+int sparse_(int enable);
+int sync_();
 void closefs();
 struct fs_inode getInode(const char* path);
 
@@ -0,0 +1,71 @@
+/**
+ * @file uring.h
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief asynchronous block I/O with io_uring
+ * @details structs and prototypes of the io_uring queue used by the disk
+ * layer to keep many block reads and writes in flight
+ */
+#ifndef URING_H
+#define URING_H
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <disk.h>
+
+#define DISK_URING_DEPTH 64 /* max no of requests in flight (power of 2) */
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/**
+ * @brief one queued request
+ * @details the iovecs are kept here because the kernel reads them when
+ * the request is submitted, not when it is queued
+ */
+struct uring_op {
+	int fd;                         /**< file descriptor of the image */
+	int write;                      /**< 1 for a write, 0 for a read */
+	int iovcnt;                     /**< no of buffers */
+	off_t off;                      /**< offset in the image */
+	struct iovec iov[DISK_MAX_IOV]; /**< buffers of the request */
+};
+
+/**
+ * @brief io_uring queue structure
+ * @details the submission and completion rings shared with the kernel
+ * and the requests currently in flight
+ */
+struct disk_uring {
+	int ring_fd;                  /**< io_uring file descriptor */
+	unsigned depth;               /**< no of request slots */
+	unsigned *sq_head;            /**< submission ring head (kernel) */
+	unsigned *sq_tail;            /**< submission ring tail (us) */
+	unsigned *sq_mask;            /**< submission ring mask */
+	unsigned *sq_array;           /**< submission ring index array */
+	struct io_uring_sqe* sqes;    /**< submission entries */
+	unsigned *cq_head;            /**< completion ring head (us) */
+	unsigned *cq_tail;            /**< completion ring tail (kernel) */
+	unsigned *cq_mask;            /**< completion ring mask */
+	struct io_uring_cqe* cqes;    /**< completion entries */
+	void* sq_ptr;                 /**< mapping of the submission ring */
+	size_t sq_len;                /**< size of the submission ring mapping */
+	void* cq_ptr;                 /**< mapping of the completion ring */
+	size_t cq_len;                /**< size of the completion ring mapping */
+	size_t sqes_len;              /**< size of the submission entries mapping */
+	unsigned queued;              /**< requests queued but not submitted */
+	unsigned inflight;            /**< requests queued or submitted, not reaped */
+	int plugged;                  /**< nesting level of disk_plug */
+	struct uring_op* ops;         /**< request slots */
+	int* free_slots;              /**< stack of free request slots */
+	unsigned nfree;               /**< no of free request slots */
+};
+
+struct disk_uring* uring_create(unsigned depth);
+void uring_destroy(struct disk_uring* ring);
+int uring_queue(struct disk_uring* ring, int fd, int write, const struct iovec* iov,
+				int iovcnt, off_t off);
+int uring_wait(struct disk_uring* ring);
+#endif
@@ -0,0 +1,301 @@
+/**
+ * @file bitmap.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief allocation bitmaps
+ * @details searching, allocating and counting the bits of the in-memory
+ * bitmaps, runs of full or empty 64 bit words are skipped with the word
+ * kernels of bitmap_simd.c and the free bits of a word are found with ctz
+ */
+#include <bitmap.h>
+#include <bitmap_simd.h>
+#include <freeidx.h>
+#include <disk.h>
+#include <devutils.h>
+
+/**
+ * @brief utility function to mark the bitmap block holding a bit as modified
+ * @details called after each change of a word, the free-extent index is
+ * updated here
+ */
+static void bitmap_touch(struct fs_bitmap* bm, uint32_t bit) {
+	bm->dirty[bit / (FS_BLOCK_SIZE * BITS_PER_BYTE)] = 1;
+	if(bm->index) {
+		freeidx_update(bm, bit / BITMAP_WORD_BITS);
+	}
+}
+
+/**
+ * @brief utility function to get the free bits of a word
+ * @details the bits of the word *i* out of [start, end) are not returned
+ */
+static uint64_t bitmap_free_bits(const struct fs_bitmap* bm, uint32_t i, uint32_t start, uint32_t end) {
+	uint64_t free = ~bm->words[i];
+	if(i == start / BITMAP_WORD_BITS) {
+		free &= ~0ULL << (start % BITMAP_WORD_BITS);
+	}
+	if(i == end / BITMAP_WORD_BITS) {
+		free &= (1ULL << (end % BITMAP_WORD_BITS)) - 1;
+	}
+	return free;
+}
+
+/**
+ * @brief checks if a bit is set
+ */
+int bitmap_test(const struct fs_bitmap* bm, uint32_t bit) {
+	return (bm->words[bit / BITMAP_WORD_BITS] >> (bit % BITMAP_WORD_BITS)) & 1;
+}
+
+/**
+ * @brief sets a bit (marks it as allocated)
+ */
+void bitmap_set(struct fs_bitmap* bm, uint32_t bit) {
+	bm->words[bit / BITMAP_WORD_BITS] |= 1ULL << (bit % BITMAP_WORD_BITS);
+	bitmap_touch(bm, bit);
+}
+
+/**
+ * @brief clears a bit (marks it as free)
+ */
+void bitmap_clear(struct fs_bitmap* bm, uint32_t bit) {
+	bm->words[bit / BITMAP_WORD_BITS] &= ~(1ULL << (bit % BITMAP_WORD_BITS));
+	bitmap_touch(bm, bit);
+}
+
+/**
+ * @brief utility function to set or clear a range of bits
+ * @details whole words are written at once
+ */
+static void bitmap_fill_range(struct fs_bitmap* bm, uint32_t start, uint32_t len, int set) {
+	uint32_t end = start + len;
+	for(uint32_t i=start/BITMAP_WORD_BITS; start<end && (uint64_t) i*BITMAP_WORD_BITS < end; i++) {
+		uint64_t mask = ~0ULL;
+		if(i == start / BITMAP_WORD_BITS) {
+			mask &= ~0ULL << (start % BITMAP_WORD_BITS);
+		}
+		if(i == end / BITMAP_WORD_BITS) {
+			mask &= (1ULL << (end % BITMAP_WORD_BITS)) - 1;
+		}
+		bm->words[i] = (set)? bm->words[i] | mask: bm->words[i] & ~mask;
+		bitmap_touch(bm, i * BITMAP_WORD_BITS);
+	}
+}
+
+/**
+ * @brief sets *len* bits starting from *start*
+ */
+void bitmap_set_range(struct fs_bitmap* bm, uint32_t start, uint32_t len) {
+	bitmap_fill_range(bm, start, len, 1);
+}
+
+/**
+ * @brief clears *len* bits starting from *start*
+ */
+void bitmap_clear_range(struct fs_bitmap* bm, uint32_t start, uint32_t len) {
+	bitmap_fill_range(bm, start, len, 0);
+}
+
+/**
+ * @brief finds the first free bit in a range
+ * @param start first bit of the range
+ * @param end   bit after the last one of the range
+ * @return the free bit or BITMAP_NONE if the range is full
+ */
+uint32_t bitmap_find_zero(const struct fs_bitmap* bm, uint32_t start, uint32_t end) {
+	if(end > bm->nbits) {
+		end = bm->nbits;
+	}
+	if(start >= end) {
+		return BITMAP_NONE;
+	}
+	uint32_t last = (end - 1) / BITMAP_WORD_BITS;
+	for(uint32_t i=start/BITMAP_WORD_BITS; i<=last; i++) {
+		uint64_t free = bitmap_free_bits(bm, i, start, end);
+		if(free) {
+			return i * BITMAP_WORD_BITS + __builtin_ctzll(free);
+		}
+		/* the full words before the last one are skipped at once */
+		i = bitmap_simd_skip(bm->words, i + 1, last, UINT64_MAX) - 1;
+	}
+	return BITMAP_NONE;
+}
+
+/**
+ * @brief finds the first allocated bit in a range
+ * @return the allocated bit or BITMAP_NONE if the range is free
+ */
+uint32_t bitmap_find_one(const struct fs_bitmap* bm, uint32_t start, uint32_t end) {
+	if(end > bm->nbits) {
+		end = bm->nbits;
+	}
+	if(start >= end) {
+		return BITMAP_NONE;
+	}
+	uint32_t last = (end - 1) / BITMAP_WORD_BITS;
+	for(uint32_t i=start/BITMAP_WORD_BITS; i<=last; i++) {
+		uint64_t used = ~bitmap_free_bits(bm, i, 0, bm->nbits);
+		if(i == start / BITMAP_WORD_BITS) {
+			used &= ~0ULL << (start % BITMAP_WORD_BITS);
+		}
+		if(used) {
+			uint32_t bit = i * BITMAP_WORD_BITS + __builtin_ctzll(used);
+			return (bit < end)? bit: BITMAP_NONE;
+		}
+		/* the empty words before the last one are skipped at once */
+		i = bitmap_simd_skip(bm->words, i + 1, last, 0) - 1;
+	}
+	return BITMAP_NONE;
+}
+
+/**
+ * @brief finds the first run of *len* free bits in a range
+ * @details the free-extent index is used if the bitmap has one. else
+ * the runs of free bits are walked by alternating searches of free and
+ * allocated bits, so full words and long free runs are skipped a word
+ * at a time.
+ * @param best_start start of the run found, or of the first longest run
+ *                   of the range if none is long enough (can be NULL)
+ * @param best_len   length of the run (at least *len*) or of the longest
+ *                   run of the range (can be NULL)
+ * @return the start of the run or BITMAP_NONE
+ */
+uint32_t bitmap_find_run(const struct fs_bitmap* bm, uint32_t start, uint32_t end, uint32_t len,
+						 uint32_t* best_start, uint32_t* best_len)
+{
+	if(end > bm->nbits) {
+		end = bm->nbits;
+	}
+	uint32_t bs = BITMAP_NONE, bl = 0;
+	if(bm->index) {
+		bs = freeidx_find_run(bm, start, end, len);
+		if(bs != BITMAP_NONE) {
+			bl = len;
+		} else if(best_start || best_len) {
+			bl = freeidx_largest(bm, start, end);
+			bs = freeidx_find_run(bm, start, end, bl);
+		}
+		if(best_start) {
+			*best_start = bs;
+		}
+		if(best_len) {
+			*best_len = bl;
+		}
+		return (bl >= len && len > 0)? bs: BITMAP_NONE;
+	}
+	uint32_t pos = start;
+	while(pos < end) {
+		uint32_t zero = bitmap_find_zero(bm, pos, end);
+		if(zero == BITMAP_NONE) {
+			break;
+		}
+		uint32_t one = bitmap_find_one(bm, zero, end);
+		if(one == BITMAP_NONE) {
+			one = end;
+		}
+		if(one - zero > bl) {
+			bs = zero;
+			bl = one - zero;
+		}
+		if(one - zero >= len) {
+			break;
+		}
+		pos = one;
+	}
+	if(best_start) {
+		*best_start = bs;
+	}
+	if(best_len) {
+		*best_len = bl;
+	}
+	return (bl >= len && len > 0)? bs: BITMAP_NONE;
+}
+
+/**
+ * @brief utility function to allocate the free bits of a range
+ * @details the bits are set and appended to *bits* until *count* bits
+ * are allocated, a word with no more free bits than needed is taken at
+ * once
+ * @return the new no of allocated bits
+ */
+static uint32_t bitmap_alloc_range(struct fs_bitmap* bm, uint32_t start, uint32_t end,
+								   uint32_t bits[], uint32_t n, uint32_t count)
+{
+	for(uint32_t i=start/BITMAP_WORD_BITS; n<count && start<end &&
+		(uint64_t) i*BITMAP_WORD_BITS < end; i++)
+	{
+		uint64_t free = bitmap_free_bits(bm, i, start, end);
+		if(free == 0) {
+			i = bitmap_simd_skip(bm->words, i + 1, (end - 1) / BITMAP_WORD_BITS, UINT64_MAX) - 1;
+			continue;
+		}
+		if((uint32_t) __builtin_popcountll(free) <= count - n) {
+			bm->words[i] |= free;
+		}
+		while(free && n < count) {
+			uint32_t b = __builtin_ctzll(free);
+			free &= free - 1;
+			bm->words[i] |= 1ULL << b;
+			bits[n++] = i * BITMAP_WORD_BITS + b;
+		}
+		bitmap_touch(bm, i * BITMAP_WORD_BITS);
+		bm->cursor = bits[n-1] + 1;
+	}
+	return n;
+}
+
+/**
+ * @brief allocates free bits
+ * @details next-fit: the search starts at the cursor (after the last
+ * allocated bit) and wraps around to the start of the bitmap, the bits
+ * are returned in increasing order from the cursor.
+ * @param bits  the allocated bits
+ * @param count the no of bits to allocate
+ * @return the no of allocated bits, less than *count* if the bitmap is
+ * full
+ */
+uint32_t bitmap_alloc(struct fs_bitmap* bm, uint32_t bits[], uint32_t count) {
+	if(bm->cursor >= bm->nbits) {
+		bm->cursor = 0;
+	}
+	uint32_t cursor = bm->cursor;
+	uint32_t n = bitmap_alloc_range(bm, cursor, bm->nbits, bits, 0, count);
+	n = bitmap_alloc_range(bm, 0, cursor, bits, n, count);
+	if(bm->cursor >= bm->nbits) {
+		bm->cursor = 0;
+	}
+	return n;
+}
+
+/**
+ * @brief counts the free bits of a range
+ * @details the set bits of the words inside the range are counted by
+ * the word kernel, the words at the ends are masked
+ */
+uint32_t bitmap_count_zeros_range(const struct fs_bitmap* bm, uint32_t start, uint32_t end) {
+	if(end > bm->nbits) {
+		end = bm->nbits;
+	}
+	if(start >= end) {
+		return 0;
+	}
+	uint32_t first = start / BITMAP_WORD_BITS, last = (end - 1) / BITMAP_WORD_BITS;
+	uint32_t count = __builtin_popcountll(bitmap_free_bits(bm, first, start, end));
+	if(last > first) {
+		count += __builtin_popcountll(bitmap_free_bits(bm, last, start, end));
+		count += (last - first - 1) * BITMAP_WORD_BITS - bitmap_simd_count(bm->words, first + 1, last);
+	}
+	return count;
+}
+
+/**
+ * @brief counts the free bits of the bitmap
+ */
+uint32_t bitmap_count_zeros(const struct fs_bitmap* bm) {
+	if(bm->index) {
+		struct freeidx_stats st;
+		freeidx_stats(bm, &st);
+		return st.free;
+	}
+	return bitmap_count_zeros_range(bm, 0, bm->nbits);
+}
@@ -0,0 +1,135 @@
+/**
+ * @file bitmap_simd.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief word kernels of the allocation bitmaps
+ * @details the searches skip the words equal to a value (full words when
+ * looking for a free bit, empty words when looking for an allocated bit)
+ * and the counts add the set bits of whole words. the AVX2 versions look
+ * at 8 words per step, they are compiled with the target attribute so
+ * the rest of the program does not need AVX2.
+ */
+#include <bitmap_simd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITMAP_SIMD_X86 1
+#endif
+
+/**
+ * @brief scalar version of bitmap_simd_skip
+ */
+static uint32_t bitmap_skip_scalar(const uint64_t* words, uint32_t first, uint32_t last, uint64_t value) {
+	while(first < last && words[first] == value) {
+		first++;
+	}
+	return first;
+}
+
+/**
+ * @brief scalar version of bitmap_simd_count
+ */
+static uint64_t bitmap_count_scalar(const uint64_t* words, uint32_t first, uint32_t last) {
+	uint64_t count = 0;
+	for(uint32_t i=first; i<last; i++) {
+		count += __builtin_popcountll(words[i]);
+	}
+	return count;
+}
+
+#ifdef BITMAP_SIMD_X86
+/**
+ * @brief AVX2 version of bitmap_simd_skip
+ * @details 8 words are compared at once, the first word that differs is
+ * then found in the byte mask of the comparison
+ */
+__attribute__((target("avx2")))
+static uint32_t bitmap_skip_avx2(const uint64_t* words, uint32_t first, uint32_t last, uint64_t value) {
+	__m256i v = _mm256_set1_epi64x((long long) value);
+	while(first + 8 <= last) {
+		__m256i a = _mm256_loadu_si256((const __m256i*) (words + first));
+		__m256i b = _mm256_loadu_si256((const __m256i*) (words + first + 4));
+		uint32_t ma = _mm256_movemask_epi8(_mm256_cmpeq_epi64(a, v));
+		uint32_t mb = _mm256_movemask_epi8(_mm256_cmpeq_epi64(b, v));
+		uint64_t mask = ((uint64_t) mb << 32) | ma;
+		if(mask != UINT64_MAX) {
+			return first + __builtin_ctzll(~mask) / 8;
+		}
+		first += 8;
+	}
+	return bitmap_skip_scalar(words, first, last, value);
+}
+
+/**
+ * @brief AVX2 version of bitmap_simd_count
+ * @details the set bits of each nibble are looked up in a table with
+ * vpshufb, the bytes are summed into 64 bit lanes with vpsadbw
+ */
+__attribute__((target("avx2")))
+static uint64_t bitmap_count_avx2(const uint64_t* words, uint32_t first, uint32_t last) {
+	const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+										   0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low = _mm256_set1_epi8(0x0F);
+	__m256i acc = _mm256_setzero_si256();
+	while(first + 4 <= last) {
+		__m256i v = _mm256_loadu_si256((const __m256i*) (words + first));
+		__m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(v, low));
+		__m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+		first += 4;
+	}
+	uint64_t lanes[4];
+	_mm256_storeu_si256((__m256i*) lanes, acc);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3] + bitmap_count_scalar(words, first, last);
+}
+#endif
+
+/**
+ * @brief the kernels in use, chosen at the first call
+ */
+static struct {
+	int ready;
+	uint32_t (*skip)(const uint64_t*, uint32_t, uint32_t, uint64_t);
+	uint64_t (*count)(const uint64_t*, uint32_t, uint32_t);
+} kernels;
+
+/**
+ * @brief selects the AVX2 or the scalar kernels
+ * @param enable 0 to force the scalar kernels, else AVX2 if the cpu
+ *               supports it
+ * @return 1 if the AVX2 kernels are used, 0 else
+ */
+int bitmap_simd_enable(int enable) {
+	kernels.ready = 1;
+	kernels.skip = bitmap_skip_scalar;
+	kernels.count = bitmap_count_scalar;
+#ifdef BITMAP_SIMD_X86
+	if(enable && __builtin_cpu_supports("avx2")) {
+		kernels.skip = bitmap_skip_avx2;
+		kernels.count = bitmap_count_avx2;
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+/**
+ * @brief finds the first word of [first, last) different from *value*
+ * @return the index of the word or *last*
+ */
+uint32_t bitmap_simd_skip(const uint64_t* words, uint32_t first, uint32_t last, uint64_t value) {
+	if(!kernels.ready) {
+		bitmap_simd_enable(1);
+	}
+	return kernels.skip(words, first, last, value);
+}
+
+/**
+ * @brief counts the set bits of the words of [first, last)
+ */
+uint64_t bitmap_simd_count(const uint64_t* words, uint32_t first, uint32_t last) {
+	if(!kernels.ready) {
+		bitmap_simd_enable(1);
+	}
+	return kernels.count(words, first, last);
+}
@@ -0,0 +1,355 @@
+/**
+ * @file cache.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief block buffer cache
+ * @details keeps the most recently used blocks of the disk image in memory,
+ * writes are kept in memory (dirty) and only written back on eviction or
+ * when the cache is flushed
+ */
+#include <devutils.h>
+#include <disk.h>
+#include <cache.h>
+
+#include <string.h>
+#include <stdio.h>
+
+/**
+ * @brief utility function to get the hash bucket of a block number
+ */
+static size_t cache_hash(struct disk_cache* cache, int blocknum) {
+	return ((uint32_t) blocknum * 2654435761u) & (cache->nbuckets - 1);
+}
+
+/**
+ * @brief utility function to remove an entry from the lru list
+ */
+static void cache_lru_unlink(struct disk_cache* cache, struct disk_cache_entry* e) {
+	if(e->prev) {
+		e->prev->next = e->next;
+	} else {
+		cache->lru_head = e->next;
+	}
+	if(e->next) {
+		e->next->prev = e->prev;
+	} else {
+		cache->lru_tail = e->prev;
+	}
+	e->prev = e->next = NULL;
+}
+
+/**
+ * @brief utility function to put an entry in front of the lru list
+ */
+static void cache_lru_push(struct disk_cache* cache, struct disk_cache_entry* e) {
+	e->prev = NULL;
+	e->next = cache->lru_head;
+	if(cache->lru_head) {
+		cache->lru_head->prev = e;
+	}
+	cache->lru_head = e;
+	if(cache->lru_tail == NULL) {
+		cache->lru_tail = e;
+	}
+}
+
+/**
+ * @brief utility function to remove an entry from its hash chain
+ */
+static void cache_hash_unlink(struct disk_cache* cache, struct disk_cache_entry* e) {
+	struct disk_cache_entry** p = &cache->buckets[cache_hash(cache, e->blocknum)];
+	while(*p && *p != e) {
+		p = &(*p)->hnext;
+	}
+	if(*p) {
+		*p = e->hnext;
+	}
+	e->hnext = NULL;
+}
+
+/**
+ * @brief utility function to find the entry of a block
+ * @return the entry or NULL if the block is not cached
+ */
+static struct disk_cache_entry* cache_lookup(struct disk_cache* cache, int blocknum) {
+	struct disk_cache_entry* e = cache->buckets[cache_hash(cache, blocknum)];
+	while(e && e->blocknum != blocknum) {
+		e = e->hnext;
+	}
+	return e;
+}
+
+/**
+ * @brief utility function to get a free entry for the block *blocknum*
+ * @details takes an unused entry if there is one, otherwise evicts the
+ * least recently used block (writing it back if it is dirty)
+ */
+static struct disk_cache_entry* cache_get_entry(struct disk_cache* cache,
+								struct fs_filesyst fs, int blocknum)
+{
+	struct disk_cache_entry* e;
+	if(cache->used < cache->capacity) {
+		e = cache->entries + cache->used++;
+	} else {
+		e = cache->lru_tail;
+		if(e->dirty) {
+			if(disk_write_raw(fs, e->blocknum, e->data, FS_BLOCK_SIZE) < 0) {
+				fprintf(stderr, "cache_get_entry: disk_write_raw\n");
+				return NULL;
+			}
+			cache->stats.writebacks++;
+		}
+		cache_lru_unlink(cache, e);
+		if(e->blocknum >= 0) {
+			cache_hash_unlink(cache, e);
+			cache->stats.evictions++;
+		}
+	}
+	e->blocknum = blocknum;
+	e->dirty = 0;
+
+	size_t h = cache_hash(cache, blocknum);
+	e->hnext = cache->buckets[h];
+	cache->buckets[h] = e;
+	cache_lru_push(cache, e);
+	return e;
+}
+
+/**
+ * @brief utility function to forget the content of an entry
+ * @details the entry is moved to the end of the lru list so that it is
+ * the next one to be reused
+ */
+static void cache_drop(struct disk_cache* cache, struct disk_cache_entry* e) {
+	cache_hash_unlink(cache, e);
+	cache_lru_unlink(cache, e);
+	e->blocknum = -1;
+	e->dirty = 0;
+	e->prev = cache->lru_tail;
+	if(cache->lru_tail) {
+		cache->lru_tail->next = e;
+	} else {
+		cache->lru_head = e;
+	}
+	cache->lru_tail = e;
+}
+
+/**
+ * @brief creates a block cache
+ * @param capacity the maximum number of blocks kept in memory
+ * @return the cache or NULL in case of an error
+ */
+struct disk_cache* cache_create(size_t capacity) {
+	if(capacity == 0) {
+		fprintf(stderr, "cache_create: null capacity\n");
+		return NULL;
+	}
+	struct disk_cache* cache = calloc(1, sizeof(struct disk_cache));
+	if(cache == NULL) {
+		perror("cache_create: calloc");
+		return NULL;
+	}
+	cache->capacity = capacity;
+	/* the table size is a power of two bigger than the capacity */
+	cache->nbuckets = 1;
+	while(cache->nbuckets < capacity) {
+		cache->nbuckets <<= 1;
+	}
+	cache->entries = calloc(capacity, sizeof(struct disk_cache_entry));
+	cache->buckets = calloc(cache->nbuckets, sizeof(struct disk_cache_entry*));
+	cache->pool = disk_alloc_blocks(capacity); /* aligned for DISK_DIRECT */
+	if(cache->entries == NULL || cache->buckets == NULL || cache->pool == NULL) {
+		perror("cache_create: malloc");
+		cache_destroy(cache);
+		return NULL;
+	}
+	for(size_t i=0; i<capacity; i++) {
+		cache->entries[i].blocknum = -1;
+		cache->entries[i].data = cache->pool + i * FS_BLOCK_SIZE;
+	}
+	return cache;
+}
+
+/**
+ * @brief frees a block cache
+ * @details the dirty blocks are lost, cache_flush has to be called before
+ */
+void cache_destroy(struct disk_cache* cache) {
+	if(cache == NULL) {
+		return;
+	}
+	free(cache->entries);
+	free(cache->buckets);
+	free(cache->pool);
+	free(cache);
+}
+
+/**
+ * @brief reads a block through the cache
+ * @details copies the block *blocknum* into *blk*, the disk is only read
+ * if the block is not already in memory
+ */
+int cache_read(struct disk_cache* cache, struct fs_filesyst fs, int blocknum, void* blk) {
+	struct disk_cache_entry* e = cache_lookup(cache, blocknum);
+	if(e) {
+		cache->stats.hits++;
+		cache_lru_unlink(cache, e);
+		cache_lru_push(cache, e);
+	} else {
+		cache->stats.misses++;
+		e = cache_get_entry(cache, fs, blocknum);
+		if(e == NULL) {
+			fprintf(stderr, "cache_read: cache_get_entry\n");
+			return FUNC_ERROR;
+		}
+		if(disk_read_raw(fs, blocknum, e->data) < 0) {
+			fprintf(stderr, "cache_read: disk_read_raw\n");
+			cache_drop(cache, e);
+			return FUNC_ERROR;
+		}
+	}
+	memcpy(blk, e->data, FS_BLOCK_SIZE);
+	return 0;
+}
+
+/**
+ * @brief writes a block through the cache
+ * @details copies the *blksize* first bytes of *blk* into the cached block
+ * and marks it as dirty, the disk is only written on eviction or flush.
+ * if the write is partial and the block is not in memory it is read first.
+ */
+int cache_write(struct disk_cache* cache, struct fs_filesyst fs, int blocknum,
+				const void* blk, size_t blksize)
+{
+	struct disk_cache_entry* e = cache_lookup(cache, blocknum);
+	if(e) {
+		cache->stats.hits++;
+		cache_lru_unlink(cache, e);
+		cache_lru_push(cache, e);
+	} else {
+		cache->stats.misses++;
+		e = cache_get_entry(cache, fs, blocknum);
+		if(e == NULL) {
+			fprintf(stderr, "cache_write: cache_get_entry\n");
+			return FUNC_ERROR;
+		}
+		if(blksize < FS_BLOCK_SIZE && disk_read_raw(fs, blocknum, e->data) < 0) {
+			fprintf(stderr, "cache_write: disk_read_raw\n");
+			cache_drop(cache, e);
+			return FUNC_ERROR;
+		}
+	}
+	memcpy(e->data, blk, blksize);
+	e->dirty = 1;
+	return 0;
+}
+
+/**
+ * @brief copies a block only if it is cached
+ * @details used by the vectored reads, a missing block is not read
+ * (it will be read directly by the caller)
+ * @return 1 if the block was cached and copied into *blk*, 0 otherwise
+ */
+int cache_peek(struct disk_cache* cache, int blocknum, void* blk) {
+	struct disk_cache_entry* e = cache_lookup(cache, blocknum);
+	if(e == NULL) {
+		cache->stats.misses++;
+		return 0;
+	}
+	cache->stats.hits++;
+	memcpy(blk, e->data, FS_BLOCK_SIZE);
+	return 1;
+}
+
+/**
+ * @brief updates a cached block that was written directly to the disk
+ * @details used by the vectored writes, if the block is cached its content
+ * is replaced by *blk* and it is marked as clean since the disk image
+ * already has the same content
+ */
+void cache_update(struct disk_cache* cache, int blocknum, const void* blk) {
+	struct disk_cache_entry* e = cache_lookup(cache, blocknum);
+	if(e) {
+		memcpy(e->data, blk, FS_BLOCK_SIZE);
+		e->dirty = 0;
+	}
+}
+
+/**
+ * @brief drops the cached copies of a range of blocks
+ * @details used when the blocks are discarded, their dirty content is
+ * not written back
+ */
+void cache_discard(struct disk_cache* cache, int blocknum, int count) {
+	if((size_t) count > cache->capacity) {
+		for(size_t i=0; i<cache->used; i++) {
+			struct disk_cache_entry* e = cache->entries + i;
+			if(e->blocknum >= blocknum && e->blocknum < blocknum + count) {
+				cache_drop(cache, e);
+			}
+		}
+		return;
+	}
+	for(int i=0; i<count; i++) {
+		struct disk_cache_entry* e = cache_lookup(cache, blocknum + i);
+		if(e) {
+			cache_drop(cache, e);
+		}
+	}
+}
+
+/**
+ * @brief utility function to sort entries by block number
+ */
+static int cache_cmp_entries(const void* a, const void* b) {
+	const struct disk_cache_entry* ea = *(struct disk_cache_entry* const*) a;
+	const struct disk_cache_entry* eb = *(struct disk_cache_entry* const*) b;
+	return (ea->blocknum > eb->blocknum) - (ea->blocknum < eb->blocknum);
+}
+
+/**
+ * @brief writes all the dirty blocks to the disk
+ * @details the blocks are written in increasing block number order so the
+ * disk image is written as sequentially as possible, adjacent blocks are
+ * written together with a vectored write (queued to io_uring if enabled)
+ */
+int cache_flush(struct disk_cache* cache, struct fs_filesyst fs) {
+	struct disk_cache_entry** dirty = malloc(sizeof(struct disk_cache_entry*) * cache->used);
+	if(dirty == NULL && cache->used > 0) {
+		perror("cache_flush: malloc");
+		return FUNC_ERROR;
+	}
+	size_t ndirty = 0;
+	for(size_t i=0; i<cache->used; i++) {
+		if(cache->entries[i].blocknum >= 0 && cache->entries[i].dirty) {
+			dirty[ndirty++] = cache->entries + i;
+		}
+	}
+	qsort(dirty, ndirty, sizeof(struct disk_cache_entry*), cache_cmp_entries);
+
+	const void* blks[DISK_MAX_IOV];
+	int ret = 0;
+	disk_plug(fs);
+	for(size_t i=0; ret == 0 && i<ndirty;) {
+		size_t n = 1;
+		while(i+n < ndirty && n < DISK_MAX_IOV && dirty[i+n]->blocknum == dirty[i]->blocknum + n) {
+			n++;
+		}
+		for(size_t j=0; j<n; j++) {
+			blks[j] = dirty[i+j]->data;
+		}
+		ret = disk_writev_raw(fs, dirty[i]->blocknum, n, blks);
+		i += n;
+	}
+	if(disk_unplug(fs) < 0 || ret < 0) {
+		fprintf(stderr, "cache_flush: disk_writev_raw\n");
+		free(dirty);
+		return FUNC_ERROR;
+	}
+	for(size_t i=0; i<ndirty; i++) {
+		dirty[i]->dirty = 0;
+		cache->stats.writebacks++;
+	}
+	free(dirty);
+	return 0;
+}
@@ -15,14 +15,42 @@
 #include <stdint.h>
 #include <stdio.h>
 
+/**
+ * @brief utility function to get the parent directory of a new file
+ * @details only looked up with block groups, where the new inode is
+ * allocated close to its parent
+ * @return the inode of the parent or FS_NO_INODE
+ */
+static uint32_t parent_goal(struct fs_filesyst fs, struct fs_super_block super, const char* filepath) {
+	if(super.group_blocks == 0) {
+		return FS_NO_INODE;
+	}
+	char* path_copy = strdup(filepath);
+	uint32_t parent;
+	int ret = findpath(fs, super, &parent, dirname(path_copy));
+	free(path_copy);
+	return (ret < 0)? FS_NO_INODE: parent;
+}
+
 /**
  * @brief format and empty directory
  * @details allocate the inode for the directory and initialize
  * the size (to 0) in the first byte
  */
 int formatdir(struct fs_filesyst fs, struct fs_super_block super, uint32_t* inodenum, uint16_t mode) {
+	return formatdir_in(fs, super, FS_NO_INODE, inodenum, mode);
+}
+
+/**
+ * @brief format and empty directory close to its parent directory
+ * @details same as formatdir, with block groups the inode is allocated
+ * in the group of *parent*
+ */
+int formatdir_in(struct fs_filesyst fs, struct fs_super_block super, uint32_t parent,
+				 uint32_t* inodenum, uint16_t mode)
+{
 	mode |= S_DIR;
-	if(io_open_creat(fs, super, mode, inodenum) < 0) {
+	if(io_open_creat_in(fs, super, parent, mode, inodenum) < 0) {
 		fprintf(stderr, "formatdir: io_open_creat\n");
 		return FUNC_ERROR;
 	}
@@ -157,7 +185,7 @@ int insertFile(struct fs_filesyst fs, struct fs_super_block super,
 		struct dirent temp = files[i];
 		files[i] = files[i-1];
 		files[i-1] = temp;
-		i++;
+		i--;
 	}
 	//io_lseek(fs, super, dirfd, sizeof(int));
 	if(size > 0 && io_write_ino(fs, super, dirino, files, sizeof(int),
@@ -311,6 +339,10 @@ int opendir_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t dir
 		fprintf(stderr, "opendir_ino: %s is a regular file\n", filepath);
 		return FUNC_ERROR;
 	}
+	if(ind.hcount >= fs_max_links(&super)) {
+		fprintf(stderr, "opendir_ino: too many links to %s\n", filepath);
+		return FUNC_ERROR;
+	}
 	/* todo: verify type and get mode*/
 	struct dirent cur = {0};
 	
@@ -373,7 +405,7 @@ int opendir_creat(struct fs_filesyst fs, struct fs_super_block super, uint32_t*
 {
 	/* increment the inode hardlink count here */
 	perms |= S_DIR;
-	if(formatdir(fs, super, dirino, perms) < 0) {
+	if(formatdir_in(fs, super, parent_goal(fs, super, filepath), dirino, perms) < 0) {
 		fprintf(stderr, "creatdir: formatdir\n");
 		return FUNC_ERROR;
 	}
@@ -407,6 +439,10 @@ int open_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t filein
 		// fprintf(stderr, "open_ino: %ud is a directory\n", fileino);
 		return FUNC_ERROR;
 	}
+	if(ind.hcount >= fs_max_links(&super)) {
+		fprintf(stderr, "open_ino: too many links to %s\n", filepath);
+		return FUNC_ERROR;
+	}
 	/* todo: verify type and mode*/
 	struct dirent cur = {0};
 
@@ -447,7 +483,7 @@ int open_creat(struct fs_filesyst fs, struct fs_super_block super, uint32_t* fil
 {
 	mode &= (~S_DIR);
 	
-	if(io_open_creat(fs, super, mode, fileino) < 0) {
+	if(io_open_creat_in(fs, super, parent_goal(fs, super, filepath), mode, fileino) < 0) {
 		fprintf(stderr, "open_creat: io_open_creat\n");
 		return FUNC_ERROR;
 	}
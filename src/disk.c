@@ -8,25 +8,24 @@
 #include <devutils.h>
 #include <disk.h>
 #include <fs.h>
+#include <cache.h>
+#include <uring.h>
 #include <sys/types.h>
-#include <fcntl.h>
-#include <unistd.h>
 #include <stdio.h>
-#include <sys/types.h>
+#include <string.h>
 
 /**
  * @brief utility function to check the magic number of the file
  * and see if it matches our FS magic number
  */
-int fs_check_magicnum(int fd) {	
-	lseek(fd, 0, SEEK_SET);
-	uint32_t magicnum;
-	if(read(fd, &magicnum, sizeof(uint32_t)) != sizeof(uint32_t)) {
+int fs_check_magicnum(struct fs_filesyst fs) {	
+	union fs_block blk;
+	if(fs_read_block(fs, 0, &blk) < 0) {
 		fprintf(stderr, "fs_check_magicnum: read error\n");
 		return FUNC_ERROR;
 	}
 
-	return (magicnum == FS_MAGIC);
+	return (blk.super.magic == FS_MAGIC);
 }
 
 
@@ -41,50 +40,398 @@ int fs_check_magicnum(int fd) {
  * @param fs virtual filesystem structure
  */
 int creatfile(const char* filename, size_t size, struct fs_filesyst* fs) {
+	return disk_open(filename, size, DISK_DEFAULT, fs);
+}
+
+/**
+ * @brief open a disk image with a given mount mode
+ * @details creates the disk image if needed and initializes the
+ * fs_filesyst struct with the backend selected by *flags*:
+ * - DISK_RAM: the disk only lives in memory, *filename* is not used
+ * - DISK_MMAP: the whole image is mapped in memory and blocks are copied
+ *   from/to the mapping instead of using syscalls
+ * - otherwise the image is read and written with syscalls through the
+ *   block cache. with DISK_URING the vectored reads and writes issued
+ *   between disk_plug and disk_unplug are done asynchronously with
+ *   io_uring (if available). with DISK_DIRECT the image is opened with
+ *   O_DIRECT so its blocks are only cached by the block cache and not by
+ *   the host page cache.
+ *
+ * the block cache is not used for the memory backends (the memory is
+ * the cache).
+ * @param filename partition name
+ * @param size     the size of the partition in bytes
+ * @param flags    the mount mode (DISK_DEFAULT, DISK_MMAP, DISK_URING,
+ *                 DISK_DIRECT, DISK_RAM)
+ * @param fs       virtual filesystem structure
+ */
+int disk_open(const char* filename, size_t size, int flags, struct fs_filesyst* fs) {
 	if(size <= 0) {
 		perror("creatfile: null size");
 		return FUNC_ERROR;
 	}
-	
-	fs->fd = open(filename, O_RDWR | O_CREAT, 0777);
-	if(fs->fd < 0) {
-		perror("creatfile: open");
-		return FUNC_ERROR;
-	}
-	lseek(fs->fd, size-1, SEEK_SET);
-	write(fs->fd, "\0", 1);
 
+	if(flags & DISK_RAM) {
+		fs->ops = &disk_ram_ops;
+	} else if(flags & DISK_MMAP) {
+		fs->ops = &disk_mmap_ops;
+	} else {
+		fs->ops = &disk_file_ops;
+	}
+	fs->fd = -1;
 	fs->tot_size = size;
 	fs->nblocks = size / FS_BLOCK_SIZE;
+	fs->flags = flags;
+	fs->cache = NULL;
+	fs->map = NULL;
+	fs->uring = NULL;
+	fs->incore = NULL;
+
+	if(fs->ops->open(filename, size, fs) < 0) {
+		fprintf(stderr, "creatfile: can't open the %s disk %s\n", fs->ops->name, filename);
+		return FUNC_ERROR;
+	}
+	fs->nblocks = fs->ops->size(*fs);
+
+	if(fs->map == NULL && disk_cache_init(fs, DISK_CACHE_DEFAULT_BLOCKS) < 0) {
+		fprintf(stderr, "creatfile: disk_cache_init\n");
+		fs->ops->close(fs);
+		return FUNC_ERROR;
+	}
+
+	fs->incore = fs_incore_create();
+	if(fs->incore == NULL) {
+		fprintf(stderr, "creatfile: fs_incore_create\n");
+		/* nothing was written through the cache yet */
+		cache_destroy(fs->cache);
+		fs->cache = NULL;
+		fs->ops->close(fs);
+		return FUNC_ERROR;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief allocates memory for *count* blocks
+ * @details the memory is aligned on the block size so it can be used for
+ * I/O on images opened with DISK_DIRECT without a bounce buffer, it is
+ * freed with free.
+ * @return the memory or NULL on error
+ */
+void* disk_alloc_blocks(size_t count) {
+	void* ptr = NULL;
+	if(posix_memalign(&ptr, FS_BLOCK_SIZE, (count > 0)? count * FS_BLOCK_SIZE: FS_BLOCK_SIZE) != 0) {
+		return NULL;
+	}
+	return ptr;
+}
+
+/**
+ * @brief get a pointer to a block of a memory mapped image or a RAM disk
+ * @details allows reading or modifying a block in place without any copy,
+ * the changes are written to the image by disk_sync.
+ * @return the address of the block or NULL if the image is not mapped
+ * or the block number is invalid
+ */
+void* disk_block_ptr(struct fs_filesyst fs, int blocknum) {
+	if(fs.map == NULL || blocknum < 0 || blocknum >= fs.nblocks) {
+		return NULL;
+	}
+	return fs.map + (size_t) blocknum * FS_BLOCK_SIZE;
+}
+
+/**
+ * @brief sets the size of the block cache
+ * @details flushes and replaces the current cache of the filesystem with
+ * a cache that can hold *nblocks* blocks, a size of 0 disables the cache
+ * and all the reads and writes go directly to the disk image.
+ * Note: must be called before the fs_filesyst struct is copied around.
+ * @param fs      virtual filesystem structure
+ * @param nblocks the number of blocks kept in memory
+ */
+int disk_cache_init(struct fs_filesyst* fs, size_t nblocks) {
+	if(fs->cache) {
+		if(cache_flush(fs->cache, *fs) < 0) {
+			fprintf(stderr, "disk_cache_init: cache_flush\n");
+			return FUNC_ERROR;
+		}
+		cache_destroy(fs->cache);
+		fs->cache = NULL;
+	}
+	if(nblocks == 0) {
+		return 0;
+	}
+	fs->cache = cache_create(nblocks);
+	if(fs->cache == NULL) {
+		fprintf(stderr, "disk_cache_init: cache_create\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
 
+/**
+ * @brief writes all the modified blocks to the disk image
+ * @details the in-core superblock and bitmaps are written first
+ * @param fs virtual filesystem structure
+ */
+int disk_sync(struct fs_filesyst fs) {
+	if(fs_sync(fs) < 0) {
+		fprintf(stderr, "disk_sync: fs_sync\n");
+		return FUNC_ERROR;
+	}
+	if(fs.cache && cache_flush(fs.cache, fs) < 0) {
+		fprintf(stderr, "disk_sync: cache_flush\n");
+		return FUNC_ERROR;
+	}
+	if(fs.ops->flush(fs) < 0) {
+		perror("disk_sync: flush");
+		return FUNC_ERROR;
+	}
 	return 0;
 }
 
+/**
+ * @brief releases blocks of the disk
+ * @details the storage of the *count* blocks starting from *blocknum* is
+ * given back to the host (hole in the image, memory of a RAM disk) and
+ * the blocks read as zeros after. their cached copies are dropped.
+ * Note: must not be called while plugged.
+ */
+int disk_discard(struct fs_filesyst fs, int blocknum, int count) {
+	if(blocknum < 0 || count < 0 || (int64_t) blocknum + count > fs.nblocks) {
+		fprintf(stderr,"disk_discard: invalid range %d+%d!\n", blocknum, count);
+		return FUNC_ERROR;
+	}
+	if(count == 0) {
+		return 0;
+	}
+	if(fs.cache) {
+		cache_discard(fs.cache, blocknum, count);
+	}
+	if(fs.ops->discard(fs, blocknum, count) < 0) {
+		perror("disk_discard: discard");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief get the counters of the block cache
+ * @details fills *stats* with the counters of the cache, or with zeros
+ * if the cache is disabled
+ */
+void disk_cache_stats(struct fs_filesyst fs, struct disk_cache_stats* stats) {
+	struct disk_cache_stats nil = {0};
+	*stats = (fs.cache)? fs.cache->stats: nil;
+}
+
+/**
+ * @brief dump the counters of the block cache
+ */
+void disk_dump_cache(struct fs_filesyst fs) {
+	struct disk_cache_stats stats;
+	disk_cache_stats(fs, &stats);
+	printf("Cache: %ld blocks\n", (fs.cache)? fs.cache->capacity: 0);
+	printf("    hits: %lu\n", stats.hits);
+	printf("    misses: %lu\n", stats.misses);
+	printf("    evictions: %lu\n", stats.evictions);
+	printf("    writebacks: %lu\n", stats.writebacks);
+}
+
 /**
 * @brief discover the number of blocks on the disk
 * @param fs virtual filesystem structure
 * @return the virtual filesystem number of blocks
 */
 int disk_size(struct fs_filesyst fs){
-	return fs.nblocks;
+	return fs.ops->size(fs);
 }
 
 /**
 * @brief release the file
-* @details this function close the file descriptor using the virtual filesystem structure 
+* @details writes the in-core superblock and the cached blocks, then closes the disk
 * @param fs virtual filesystem structure
 */
 void disk_close(struct fs_filesyst* fs){
-	if(fs->fd) {
-		close(fs->fd);
-		fs->fd = 0;
+	if(fs->incore) {
+		if(fs_sync(*fs) < 0) {
+			fprintf(stderr, "disk_close: fs_sync\n");
+		}
+		fs_incore_destroy(fs->incore);
+		fs->incore = NULL;
+	}
+	if(fs->cache) {
+		if(cache_flush(fs->cache, *fs) < 0) {
+			fprintf(stderr, "disk_close: cache_flush\n");
+		}
+		cache_destroy(fs->cache);
+		fs->cache = NULL;
 	}
+	fs->ops->close(fs);
+}
+
+/**
+ * @brief starts a batch of asynchronous I/O
+ * @details with DISK_URING the vectored reads and writes done until the
+ * matching disk_unplug are only queued, the buffers they use must stay
+ * valid and must not be read until disk_unplug returns. the calls can be
+ * nested, the requests are waited for by the outermost disk_unplug.
+ * without io_uring this does nothing.
+ */
+void disk_plug(struct fs_filesyst fs) {
+	if(fs.uring) {
+		fs.uring->plugged++;
+	}
+}
+
+/**
+ * @brief ends a batch of asynchronous I/O
+ * @details waits for all the requests queued since the outermost
+ * disk_plug
+ * @return 0 if all the requests were done, -1 otherwise
+ */
+int disk_unplug(struct fs_filesyst fs) {
+	if(fs.uring == NULL || fs.uring->plugged == 0 || --fs.uring->plugged > 0) {
+		return 0;
+	}
+	if(uring_wait(fs.uring) < 0) {
+		fprintf(stderr, "disk_unplug: uring_wait\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief utility function to check if vectored I/O is queued to io_uring
+ */
+int disk_is_plugged(struct fs_filesyst fs) {
+	return fs.uring && fs.uring->plugged;
+}
+
+/**
+ * @brief write a chunk of data into a block of the disk
+ * @details write a block of data blk of size blksize directly into the
+ * disk in block number blocknum, without going through the cache.
+ */
+int disk_write_raw(struct fs_filesyst fs, int blocknum, const void* blk, size_t blksize) {
+	if(fs.ops->write(fs, blocknum, blk, blksize) < 0) {
+		perror("disk_write_raw: write error!\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief read a block from the disk
+ * @details read the block number blocknum directly from the disk into
+ * blk, without going through the cache.
+ */
+int disk_read_raw(struct fs_filesyst fs, int blocknum, void* blk) {
+	if(fs.ops->read(fs, blocknum, blk) < 0) {
+		perror("disk_read_raw: read error!\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief read contiguous blocks from the disk
+ * @details reads the *count* blocks starting from *blocknum* into the
+ * buffers *blks* (one buffer per block) directly from the disk, with
+ * vectored I/O for the file backend (queued to io_uring when plugged).
+ */
+int disk_readv_raw(struct fs_filesyst fs, int blocknum, int count, void* blks[]) {
+	if(fs.ops->readv(fs, blocknum, count, blks) < 0) {
+		perror("disk_readv_raw: readv error!\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief write contiguous blocks into the disk
+ * @details writes the buffers *blks* (one per block) into the *count*
+ * blocks starting from *blocknum* directly into the disk, with vectored
+ * I/O for the file backend (queued to io_uring when plugged).
+ */
+int disk_writev_raw(struct fs_filesyst fs, int blocknum, int count, const void* blks[]) {
+	if(fs.ops->writev(fs, blocknum, count, blks) < 0) {
+		perror("disk_writev_raw: writev error!\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief read contiguous blocks from a filesystem
+ * @details reads the *count* blocks starting from *blocknum* into the
+ * buffers *blks*. a single block goes through the block cache like
+ * fs_read_block, longer runs are read with vectored I/O straight into the
+ * buffers and only the blocks already in the cache are copied from it
+ * (so large sequential reads don't evict the metadata from the cache).
+ * when plugged, single blocks are read like longer runs so they can be
+ * queued to io_uring.
+ */
+int fs_read_blocks(struct fs_filesyst fs, int blocknum, int count, void* blks[]) {
+	if(blocknum < 0 || count < 0 || (int64_t) blocknum + count > fs.nblocks) {
+		fprintf(stderr,"fs_read_blocks: Cannot read blocks, invalid range %d+%d!\n",
+				blocknum, count);
+		return FUNC_ERROR;
+	}
+	if(count == 1 && !disk_is_plugged(fs)) {
+		return fs_read_block(fs, blocknum, blks[0]);
+	}
+	if(fs.cache == NULL) {
+		return disk_readv_raw(fs, blocknum, count, blks);
+	}
+	/* read the runs of blocks that are not cached */
+	int run = 0;
+	for(int i=0; i<=count; i++) {
+		if(i < count && !cache_peek(fs.cache, blocknum + i, blks[i])) {
+			continue;
+		}
+		if(i > run && disk_readv_raw(fs, blocknum + run, i - run, blks + run) < 0) {
+			fprintf(stderr, "fs_read_blocks: disk_readv_raw\n");
+			return FUNC_ERROR;
+		}
+		run = i + 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief write contiguous blocks into a filesystem
+ * @details writes the buffers *blks* into the *count* blocks starting
+ * from *blocknum*. a single block goes through the block cache like
+ * fs_write_block, longer runs are written with vectored I/O and the
+ * copies of these blocks that are in the cache are updated. when plugged,
+ * single blocks are written like longer runs so they can be queued to
+ * io_uring.
+ */
+int fs_write_blocks(struct fs_filesyst fs, int blocknum, int count, const void* blks[]) {
+	if(blocknum < 0 || count < 0 || (int64_t) blocknum + count > fs.nblocks) {
+		fprintf(stderr,"fs_write_blocks: Cannot write blocks, invalid range %d+%d!\n",
+				blocknum, count);
+		return FUNC_ERROR;
+	}
+	if(count == 1 && !disk_is_plugged(fs)) {
+		return fs_write_block(fs, blocknum, blks[0], FS_BLOCK_SIZE);
+	}
+	if(disk_writev_raw(fs, blocknum, count, blks) < 0) {
+		fprintf(stderr, "fs_write_blocks: disk_writev_raw\n");
+		return FUNC_ERROR;
+	}
+	for(int i=0; fs.cache && i<count; i++) {
+		cache_update(fs.cache, blocknum + i, blks[i]);
+	}
+	return 0;
 }
 
 /**
  * @brief write a chunk of data into a block
  * @details write a block of data blk of size blksize into the filesystem fs
- * in block number blocknum
+ * in block number blocknum, the write goes through the block cache
  */
 int fs_write_block(struct fs_filesyst fs, int blocknum, const void* blk, size_t blksize) {
 	/* checking the params */
@@ -101,26 +448,16 @@ int fs_write_block(struct fs_filesyst fs, int blocknum, const void* blk, size_t
 	}
 	
 	/* main functionality */
-	int fd = fs.fd;
-	/* goto the specified block */
-	if(lseek(fd, blocknum * FS_BLOCK_SIZE, SEEK_SET) < 0) {
-		perror("fs_write_block: lseek error!\n");
-		return FUNC_ERROR;
-	}
-	
-	/* write the data */
-	if(write(fd, blk, blksize) != blksize) { /* write didn't write blksize bytes */
-		perror("fs_write_block: write error!\n");
-		return FUNC_ERROR;
+	if(fs.cache) {
+		return cache_write(fs.cache, fs, blocknum, blk, blksize);
 	}
-
-	return 0;
+	return disk_write_raw(fs, blocknum, blk, blksize);
 }
 
 /**
  * @brief read a chunk of data from a filesystem
  * @details read a block of data blk from the filesystem fs
- * from block number blocknum
+ * from block number blocknum, the read goes through the block cache
  */
 int fs_read_block(struct fs_filesyst fs, int blocknum, void* blk) {
 	/* checking the params */
@@ -131,18 +468,8 @@ int fs_read_block(struct fs_filesyst fs, int blocknum, void* blk) {
 	}
 
 	/* main functionality */
-	int fd = fs.fd;
-	
-	/* goto the specified block */
-	if(lseek(fd, blocknum * FS_BLOCK_SIZE, SEEK_SET) < 0) {
-		perror("fs_read_block: lseek error!\n");
-		return FUNC_ERROR;
-	}
-	/* read the data */
-	if(read(fd, blk, FS_BLOCK_SIZE) != FS_BLOCK_SIZE) { /* read didn't read all bytes */
-		perror("fs_read_block: read error!\n");
-		return FUNC_ERROR;		
+	if(fs.cache) {
+		return cache_read(fs.cache, fs, blocknum, blk);
 	}
-
-	return 0;
+	return disk_read_raw(fs, blocknum, blk);
 }
@@ -0,0 +1,334 @@
+/**
+ * @file disk_file.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief host file backend of the disk layer
+ * @details the blocks are read and written with positional syscalls on
+ * the disk image, optionally with O_DIRECT and io_uring
+ */
+#define _GNU_SOURCE /* O_DIRECT, fallocate */
+#include <devutils.h>
+#include <disk.h>
+#include <uring.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+/**
+ * @brief opens a disk image on the host
+ * @details creates the image if needed and grows it to *size* bytes, the
+ * blocks stay sparse on the host
+ * @param oflags extra flags given to open
+ * @return the file descriptor or -1 on error
+ */
+int disk_host_open(const char* filename, size_t size, int oflags) {
+	int fd = open(filename, O_RDWR | O_CREAT | oflags, 0777);
+	if(fd < 0) {
+		return FUNC_ERROR;
+	}
+	struct stat st;
+	if(fstat(fd, &st) < 0) {
+		perror("disk_host_open: fstat");
+		close(fd);
+		return FUNC_ERROR;
+	}
+	if(st.st_size < (off_t) size && ftruncate(fd, size) < 0) {
+		perror("disk_host_open: ftruncate");
+		close(fd);
+		return FUNC_ERROR;
+	}
+	return fd;
+}
+
+/**
+ * @brief utility function to get the byte offset of a block in the image
+ * @details the offset is computed on 64 bits so that images bigger than
+ * 4GiB can be used
+ */
+static off_t disk_block_off(int blocknum) {
+	return (off_t) blocknum * FS_BLOCK_SIZE;
+}
+
+/**
+ * @brief utility function to transfer a vector of blocks
+ * @details calls preadv/pwritev (depending on *write*) until all the
+ * *cnt* buffers of *iov* are transfered, short transfers are resumed
+ * where they stopped.
+ */
+int disk_rw_vec(int fd, struct iovec* iov, int cnt, off_t off, int write) {
+	while(cnt > 0) {
+		ssize_t ret = (write)? pwritev(fd, iov, cnt, off): preadv(fd, iov, cnt, off);
+		if(ret <= 0) {
+			return FUNC_ERROR;
+		}
+		off += ret;
+		/* skip the buffers that are done */
+		while(cnt > 0 && ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+		if(cnt > 0) {
+			iov->iov_base = (uint8_t*) iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief utility function to check if a buffer can be used for I/O as is
+ * @details with DISK_DIRECT the address and the length of the buffers
+ * must be multiples of the block size
+ */
+static int disk_is_aligned(struct fs_filesyst fs, const void* buf, size_t len) {
+	if(!(fs.flags & DISK_DIRECT)) {
+		return 1;
+	}
+	return ((uintptr_t) buf % FS_BLOCK_SIZE) == 0 && (len % FS_BLOCK_SIZE) == 0;
+}
+
+/**
+ * @brief utility function to transfer unaligned buffers with DISK_DIRECT
+ * @details the transfer goes through an aligned bounce buffer, if the
+ * length is not a multiple of the block size the last block is read
+ * first so that its end is kept by a write.
+ */
+static int disk_rw_bounce(struct fs_filesyst fs, const struct iovec* iov, int cnt,
+						  off_t off, int write)
+{
+	size_t len = 0;
+	for(int i=0; i<cnt; i++) {
+		len += iov[i].iov_len;
+	}
+	size_t nblocks = (len + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+	uint8_t* bounce = disk_alloc_blocks(nblocks);
+	if(bounce == NULL) {
+		perror("disk_rw_bounce: posix_memalign");
+		return FUNC_ERROR;
+	}
+
+	int ret = 0;
+	struct iovec biov = { .iov_base = bounce, .iov_len = nblocks * FS_BLOCK_SIZE };
+	if(write && (len % FS_BLOCK_SIZE) != 0) {
+		struct iovec last = { .iov_base = bounce + (nblocks - 1) * FS_BLOCK_SIZE,
+							  .iov_len = FS_BLOCK_SIZE };
+		ret = disk_rw_vec(fs.fd, &last, 1, off + (off_t) (nblocks - 1) * FS_BLOCK_SIZE, 0);
+	}
+	size_t done = 0;
+	if(ret == 0 && write) {
+		for(int i=0; i<cnt; i++) {
+			memcpy(bounce + done, iov[i].iov_base, iov[i].iov_len);
+			done += iov[i].iov_len;
+		}
+	}
+	if(ret == 0) {
+		ret = disk_rw_vec(fs.fd, &biov, 1, off, write);
+	}
+	if(ret == 0 && !write) {
+		for(int i=0; i<cnt; i++) {
+			memcpy(iov[i].iov_base, bounce + done, iov[i].iov_len);
+			done += iov[i].iov_len;
+		}
+	}
+	free(bounce);
+	return ret;
+}
+
+/**
+ * @brief utility function to transfer a vector of blocks of the image
+ * @details the transfer is queued to io_uring when plugged, or done with
+ * disk_rw_vec. with DISK_DIRECT, unaligned buffers are transfered
+ * synchronously through a bounce buffer.
+ */
+static int disk_transfer(struct fs_filesyst fs, struct iovec* iov, int cnt, off_t off, int write) {
+	for(int i=0; i<cnt; i++) {
+		if(!disk_is_aligned(fs, iov[i].iov_base, iov[i].iov_len)) {
+			return disk_rw_bounce(fs, iov, cnt, off, write);
+		}
+	}
+	if(disk_is_plugged(fs)) {
+		return uring_queue(fs.uring, fs.fd, write, iov, cnt, off);
+	}
+	return disk_rw_vec(fs.fd, iov, cnt, off, write);
+}
+
+/**
+ * @brief opens the disk image
+ * @details with DISK_DIRECT the image is opened with O_DIRECT (or without
+ * it if the host filesystem doesn't support it), with DISK_URING an
+ * io_uring queue is created if io_uring is available.
+ */
+static int disk_file_open(const char* filename, size_t size, struct fs_filesyst* fs) {
+	fs->fd = disk_host_open(filename, size, (fs->flags & DISK_DIRECT)? O_DIRECT: 0);
+	if(fs->fd < 0 && (fs->flags & DISK_DIRECT) && errno == EINVAL) {
+		fprintf(stderr, "disk_file_open: O_DIRECT not supported, using the page cache\n");
+		fs->flags &= ~DISK_DIRECT;
+		fs->fd = disk_host_open(filename, size, 0);
+	}
+	if(fs->fd < 0) {
+		perror("disk_file_open: open");
+		return FUNC_ERROR;
+	}
+
+	if(fs->flags & DISK_URING) {
+		fs->uring = uring_create(DISK_URING_DEPTH);
+		if(fs->uring == NULL) {
+			fprintf(stderr, "disk_file_open: io_uring not available, using synchronous I/O\n");
+			fs->flags &= ~DISK_URING;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief closes the disk image
+ */
+static void disk_file_close(struct fs_filesyst* fs) {
+	if(fs->uring) {
+		uring_destroy(fs->uring);
+		fs->uring = NULL;
+	}
+	if(fs->fd >= 0) {
+		close(fs->fd);
+		fs->fd = -1;
+	}
+}
+
+/**
+ * @brief write a chunk of data into a block of the disk image
+ * @details positional writes are used so the file offset of fs.fd is
+ * never used and the function can be called from several threads.
+ */
+static int disk_file_write(struct fs_filesyst fs, int blocknum, const void* blk, size_t blksize) {
+	off_t off = disk_block_off(blocknum);
+	if(!disk_is_aligned(fs, blk, blksize)) {
+		struct iovec iov = { .iov_base = (void*) blk, .iov_len = blksize };
+		return disk_rw_bounce(fs, &iov, 1, off, 1);
+	}
+	size_t done = 0;
+	while(done < blksize) {
+		ssize_t ret = pwrite(fs.fd, (const uint8_t*) blk + done, blksize - done, off + done);
+		if(ret <= 0) { /* write didn't write blksize bytes */
+			return FUNC_ERROR;
+		}
+		done += ret;
+	}
+	return 0;
+}
+
+/**
+ * @brief read a block from the disk image
+ * @details positional read, the file offset of fs.fd is never used
+ */
+static int disk_file_read(struct fs_filesyst fs, int blocknum, void* blk) {
+	off_t off = disk_block_off(blocknum);
+	if(!disk_is_aligned(fs, blk, FS_BLOCK_SIZE)) {
+		struct iovec iov = { .iov_base = blk, .iov_len = FS_BLOCK_SIZE };
+		return disk_rw_bounce(fs, &iov, 1, off, 0);
+	}
+	size_t done = 0;
+	while(done < FS_BLOCK_SIZE) {
+		ssize_t ret = pread(fs.fd, (uint8_t*) blk + done, FS_BLOCK_SIZE - done, off + done);
+		if(ret <= 0) { /* read didn't read all bytes */
+			return FUNC_ERROR;
+		}
+		done += ret;
+	}
+	return 0;
+}
+
+/**
+ * @brief read contiguous blocks from the disk image
+ * @details one preadv per DISK_MAX_IOV blocks, or one io_uring request
+ * when plugged
+ */
+static int disk_file_readv(struct fs_filesyst fs, int blocknum, int count, void* blks[]) {
+	struct iovec iov[DISK_MAX_IOV];
+	for(int i=0; i<count; i+=DISK_MAX_IOV) {
+		int n = (count - i < DISK_MAX_IOV)? count - i: DISK_MAX_IOV;
+		for(int j=0; j<n; j++) {
+			iov[j].iov_base = blks[i+j];
+			iov[j].iov_len = FS_BLOCK_SIZE;
+		}
+		if(disk_transfer(fs, iov, n, disk_block_off(blocknum + i), 0) < 0) {
+			return FUNC_ERROR;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief write contiguous blocks into the disk image
+ * @details one pwritev per DISK_MAX_IOV blocks, or one io_uring request
+ * when plugged
+ */
+static int disk_file_writev(struct fs_filesyst fs, int blocknum, int count, const void* blks[]) {
+	struct iovec iov[DISK_MAX_IOV];
+	for(int i=0; i<count; i+=DISK_MAX_IOV) {
+		int n = (count - i < DISK_MAX_IOV)? count - i: DISK_MAX_IOV;
+		for(int j=0; j<n; j++) {
+			iov[j].iov_base = (void*) blks[i+j];
+			iov[j].iov_len = FS_BLOCK_SIZE;
+		}
+		if(disk_transfer(fs, iov, n, disk_block_off(blocknum + i), 1) < 0) {
+			return FUNC_ERROR;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief makes the written blocks durable
+ */
+static int disk_file_flush(struct fs_filesyst fs) {
+	return fdatasync(fs.fd);
+}
+
+/**
+ * @brief releases the blocks of the image
+ * @details punches a hole in the image, if the host filesystem can't do
+ * it the blocks are overwritten with zeros
+ */
+static int disk_file_discard(struct fs_filesyst fs, int blocknum, int count) {
+	if(fallocate(fs.fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+				 disk_block_off(blocknum), (off_t) count * FS_BLOCK_SIZE) == 0) {
+		return 0;
+	}
+	uint8_t* zero = disk_alloc_blocks(1);
+	if(zero == NULL) {
+		return FUNC_ERROR;
+	}
+	memset(zero, 0, FS_BLOCK_SIZE);
+	int ret = 0;
+	for(int i=0; ret == 0 && i<count; i++) {
+		ret = disk_file_write(fs, blocknum + i, zero, FS_BLOCK_SIZE);
+	}
+	free(zero);
+	return ret;
+}
+
+/**
+ * @brief no of blocks of the disk image
+ */
+static uint32_t disk_file_size(struct fs_filesyst fs) {
+	return fs.tot_size / FS_BLOCK_SIZE;
+}
+
+const struct disk_ops disk_file_ops = {
+	.name = "file",
+	.open = disk_file_open,
+	.close = disk_file_close,
+	.read = disk_file_read,
+	.write = disk_file_write,
+	.readv = disk_file_readv,
+	.writev = disk_file_writev,
+	.flush = disk_file_flush,
+	.discard = disk_file_discard,
+	.size = disk_file_size,
+};
@@ -0,0 +1,144 @@
+/**
+ * @file disk_mmap.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief memory mapped file backend of the disk layer
+ * @details the whole disk image is mapped in memory and the blocks are
+ * copied from/to the mapping instead of using syscalls
+ */
+#define _GNU_SOURCE /* fallocate */
+#include <devutils.h>
+#include <disk.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief utility function to get the address of a block in the mapping
+ */
+static uint8_t* disk_mmap_block(struct fs_filesyst fs, int blocknum) {
+	return fs.map + (size_t) blocknum * FS_BLOCK_SIZE;
+}
+
+/**
+ * @brief opens and maps the disk image
+ */
+static int disk_mmap_open(const char* filename, size_t size, struct fs_filesyst* fs) {
+	if(fs->flags & DISK_DIRECT) {
+		fprintf(stderr, "disk_mmap_open: DISK_DIRECT can't be used with DISK_MMAP\n");
+		return FUNC_ERROR;
+	}
+	fs->fd = disk_host_open(filename, size, 0);
+	if(fs->fd < 0) {
+		perror("disk_mmap_open: open");
+		return FUNC_ERROR;
+	}
+	size_t len = (size_t) fs->nblocks * FS_BLOCK_SIZE;
+	void* map = (len > 0)? mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fs->fd, 0): MAP_FAILED;
+	if(map == MAP_FAILED) {
+		perror("disk_mmap_open: mmap");
+		close(fs->fd);
+		fs->fd = -1;
+		return FUNC_ERROR;
+	}
+	fs->map = map;
+	return 0;
+}
+
+/**
+ * @brief writes the mapping back and unmaps the disk image
+ */
+static void disk_mmap_close(struct fs_filesyst* fs) {
+	if(fs->map) {
+		size_t len = (size_t) fs->nblocks * FS_BLOCK_SIZE;
+		if(msync(fs->map, len, MS_SYNC) < 0) {
+			perror("disk_mmap_close: msync");
+		}
+		munmap(fs->map, len);
+		fs->map = NULL;
+	}
+	if(fs->fd >= 0) {
+		close(fs->fd);
+		fs->fd = -1;
+	}
+}
+
+/**
+ * @brief copies a block from the mapping
+ */
+static int disk_mmap_read(struct fs_filesyst fs, int blocknum, void* blk) {
+	memcpy(blk, disk_mmap_block(fs, blocknum), FS_BLOCK_SIZE);
+	return 0;
+}
+
+/**
+ * @brief copies a chunk of data into a block of the mapping
+ */
+static int disk_mmap_write(struct fs_filesyst fs, int blocknum, const void* blk, size_t blksize) {
+	memcpy(disk_mmap_block(fs, blocknum), blk, blksize);
+	return 0;
+}
+
+/**
+ * @brief copies contiguous blocks from the mapping
+ */
+static int disk_mmap_readv(struct fs_filesyst fs, int blocknum, int count, void* blks[]) {
+	for(int i=0; i<count; i++) {
+		memcpy(blks[i], disk_mmap_block(fs, blocknum + i), FS_BLOCK_SIZE);
+	}
+	return 0;
+}
+
+/**
+ * @brief copies contiguous blocks into the mapping
+ */
+static int disk_mmap_writev(struct fs_filesyst fs, int blocknum, int count, const void* blks[]) {
+	for(int i=0; i<count; i++) {
+		memcpy(disk_mmap_block(fs, blocknum + i), blks[i], FS_BLOCK_SIZE);
+	}
+	return 0;
+}
+
+/**
+ * @brief writes the modified pages of the mapping to the disk image
+ */
+static int disk_mmap_flush(struct fs_filesyst fs) {
+	return msync(fs.map, (size_t) fs.nblocks * FS_BLOCK_SIZE, MS_SYNC);
+}
+
+/**
+ * @brief releases the blocks of the image
+ * @details punches a hole in the image (the mapped pages are dropped with
+ * it), if the host filesystem can't do it the blocks are set to zero
+ */
+static int disk_mmap_discard(struct fs_filesyst fs, int blocknum, int count) {
+	size_t len = (size_t) count * FS_BLOCK_SIZE;
+	if(fallocate(fs.fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+				 (off_t) blocknum * FS_BLOCK_SIZE, len) < 0) {
+		memset(disk_mmap_block(fs, blocknum), 0, len);
+	}
+	return 0;
+}
+
+/**
+ * @brief no of blocks of the mapping
+ */
+static uint32_t disk_mmap_size(struct fs_filesyst fs) {
+	return fs.tot_size / FS_BLOCK_SIZE;
+}
+
+const struct disk_ops disk_mmap_ops = {
+	.name = "mmap",
+	.open = disk_mmap_open,
+	.close = disk_mmap_close,
+	.read = disk_mmap_read,
+	.write = disk_mmap_write,
+	.readv = disk_mmap_readv,
+	.writev = disk_mmap_writev,
+	.flush = disk_mmap_flush,
+	.discard = disk_mmap_discard,
+	.size = disk_mmap_size,
+};
@@ -0,0 +1,125 @@
+/**
+ * @file disk_ram.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief RAM disk backend of the disk layer
+ * @details the disk only lives in anonymous memory, nothing is written
+ * on the host. the pages are only allocated when they are first written,
+ * so a big RAM disk costs nothing until it is used. its content is lost
+ * when it is closed.
+ */
+#include <devutils.h>
+#include <disk.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief utility function to get the address of a block of the RAM disk
+ */
+static uint8_t* disk_ram_block(struct fs_filesyst fs, int blocknum) {
+	return fs.map + (size_t) blocknum * FS_BLOCK_SIZE;
+}
+
+/**
+ * @brief allocates the memory of the RAM disk
+ * @details the file name is not used
+ */
+static int disk_ram_open(const char* filename, size_t size, struct fs_filesyst* fs) {
+	size_t len = (size_t) fs->nblocks * FS_BLOCK_SIZE;
+	void* map = (len > 0)? mmap(NULL, len, PROT_READ | PROT_WRITE,
+								MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0): MAP_FAILED;
+	if(map == MAP_FAILED) {
+		perror("disk_ram_open: mmap");
+		return FUNC_ERROR;
+	}
+	fs->map = map;
+	return 0;
+}
+
+/**
+ * @brief frees the memory of the RAM disk
+ */
+static void disk_ram_close(struct fs_filesyst* fs) {
+	if(fs->map) {
+		munmap(fs->map, (size_t) fs->nblocks * FS_BLOCK_SIZE);
+		fs->map = NULL;
+	}
+}
+
+/**
+ * @brief copies a block from the RAM disk
+ */
+static int disk_ram_read(struct fs_filesyst fs, int blocknum, void* blk) {
+	memcpy(blk, disk_ram_block(fs, blocknum), FS_BLOCK_SIZE);
+	return 0;
+}
+
+/**
+ * @brief copies a chunk of data into a block of the RAM disk
+ */
+static int disk_ram_write(struct fs_filesyst fs, int blocknum, const void* blk, size_t blksize) {
+	memcpy(disk_ram_block(fs, blocknum), blk, blksize);
+	return 0;
+}
+
+/**
+ * @brief copies contiguous blocks from the RAM disk
+ */
+static int disk_ram_readv(struct fs_filesyst fs, int blocknum, int count, void* blks[]) {
+	for(int i=0; i<count; i++) {
+		memcpy(blks[i], disk_ram_block(fs, blocknum + i), FS_BLOCK_SIZE);
+	}
+	return 0;
+}
+
+/**
+ * @brief copies contiguous blocks into the RAM disk
+ */
+static int disk_ram_writev(struct fs_filesyst fs, int blocknum, int count, const void* blks[]) {
+	for(int i=0; i<count; i++) {
+		memcpy(disk_ram_block(fs, blocknum + i), blks[i], FS_BLOCK_SIZE);
+	}
+	return 0;
+}
+
+/**
+ * @brief nothing to do, the RAM disk is never persisted
+ */
+static int disk_ram_flush(struct fs_filesyst fs) {
+	return 0;
+}
+
+/**
+ * @brief gives the memory of the blocks back to the system
+ * @details the pages are dropped and read as zeros after, if the range
+ * is not page aligned on this host the blocks are set to zero instead
+ */
+static int disk_ram_discard(struct fs_filesyst fs, int blocknum, int count) {
+	uint8_t* start = disk_ram_block(fs, blocknum);
+	size_t len = (size_t) count * FS_BLOCK_SIZE;
+	if(madvise(start, len, MADV_DONTNEED) < 0) {
+		memset(start, 0, len);
+	}
+	return 0;
+}
+
+/**
+ * @brief no of blocks of the RAM disk
+ */
+static uint32_t disk_ram_size(struct fs_filesyst fs) {
+	return fs.tot_size / FS_BLOCK_SIZE;
+}
+
+const struct disk_ops disk_ram_ops = {
+	.name = "ram",
+	.open = disk_ram_open,
+	.close = disk_ram_close,
+	.read = disk_ram_read,
+	.write = disk_ram_write,
+	.readv = disk_ram_readv,
+	.writev = disk_ram_writev,
+	.flush = disk_ram_flush,
+	.discard = disk_ram_discard,
+	.size = disk_ram_size,
+};
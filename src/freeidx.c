@@ -0,0 +1,238 @@
+/**
+ * @file freeidx.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief free-extent index of an allocation bitmap
+ * @details each node of the segment tree keeps the free run at the start
+ * and at the end of its range, its longest free run and its no of runs.
+ * the tree is built once from the bitmap and the path of a word is
+ * recomputed each time the word is modified.
+ */
+#include <freeidx.h>
+#include <devutils.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief utility function to get the no of words of the bitmap
+ */
+static uint32_t freeidx_nwords(const struct fs_bitmap* bm) {
+	return (bm->nbits + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+}
+
+/**
+ * @brief utility function to get the free bits of a word in [start, end)
+ */
+static uint64_t freeidx_free_bits(const struct fs_bitmap* bm, uint32_t i, uint32_t start, uint32_t end) {
+	if(end > bm->nbits) {
+		end = bm->nbits;
+	}
+	uint64_t lo = (uint64_t) i * BITMAP_WORD_BITS;
+	if(end <= lo || start >= lo + BITMAP_WORD_BITS) {
+		return 0;
+	}
+	uint64_t free = ~bm->words[i];
+	if(start > lo) {
+		free &= ~0ULL << (start - lo);
+	}
+	if(end < lo + BITMAP_WORD_BITS) {
+		free &= (1ULL << (end - lo)) - 1;
+	}
+	return free;
+}
+
+/**
+ * @brief utility function to summarize the free bits of a word
+ */
+static struct freeidx_node freeidx_leaf(uint64_t free) {
+	struct freeidx_node n;
+	n.pre = (~free == 0)? BITMAP_WORD_BITS: __builtin_ctzll(~free);
+	n.suf = (~free == 0)? BITMAP_WORD_BITS: __builtin_clzll(~free);
+	n.runs = __builtin_popcountll(free & ~(free << 1));
+	n.free = __builtin_popcountll(free);
+	/* each step shortens all the runs by one bit */
+	n.max = 0;
+	for(uint64_t x=free; x; x&=x>>1) {
+		n.max++;
+	}
+	return n;
+}
+
+/**
+ * @brief utility function to summarize two adjacent ranges of *half* bits
+ */
+static struct freeidx_node freeidx_merge(struct freeidx_node l, struct freeidx_node r, uint32_t half) {
+	struct freeidx_node n;
+	n.pre = (l.pre == half)? half + r.pre: l.pre;
+	n.suf = (r.suf == half)? half + l.suf: r.suf;
+	n.max = (l.max > r.max)? l.max: r.max;
+	if(l.suf + r.pre > n.max) {
+		n.max = l.suf + r.pre;
+	}
+	n.runs = l.runs + r.runs - (l.suf > 0 && r.pre > 0);
+	n.free = l.free + r.free;
+	return n;
+}
+
+/**
+ * @brief builds the free-extent index of a bitmap
+ * @details O(n) in the no of words, done when the bitmap is loaded
+ */
+int freeidx_build(struct fs_bitmap* bm) {
+	uint32_t nwords = freeidx_nwords(bm);
+	uint32_t leaves = 1;
+	while(leaves < nwords) {
+		leaves *= 2;
+	}
+	struct fs_freeidx* idx = malloc(sizeof(struct fs_freeidx));
+	struct freeidx_node* nodes = calloc(2 * leaves, sizeof(struct freeidx_node));
+	if(idx == NULL || nodes == NULL) {
+		perror("freeidx_build: malloc");
+		free(idx);
+		free(nodes);
+		return FUNC_ERROR;
+	}
+	idx->nodes = nodes;
+	idx->leaves = leaves;
+	for(uint32_t i=0; i<nwords; i++) {
+		nodes[leaves + i] = freeidx_leaf(freeidx_free_bits(bm, i, 0, bm->nbits));
+	}
+	uint32_t half = BITMAP_WORD_BITS;
+	for(uint32_t first=leaves/2; first>=1; first/=2, half*=2) {
+		for(uint32_t k=first; k<2*first; k++) {
+			nodes[k] = freeidx_merge(nodes[2*k], nodes[2*k+1], half);
+		}
+	}
+	freeidx_destroy(bm);
+	bm->index = idx;
+	return 0;
+}
+
+/**
+ * @brief frees the free-extent index of a bitmap
+ */
+void freeidx_destroy(struct fs_bitmap* bm) {
+	if(bm->index) {
+		free(bm->index->nodes);
+		free(bm->index);
+		bm->index = NULL;
+	}
+}
+
+/**
+ * @brief updates the index after a word of the bitmap was modified
+ * @details O(log n): the leaf of the word and its ancestors
+ */
+void freeidx_update(struct fs_bitmap* bm, uint32_t word) {
+	struct fs_freeidx* idx = bm->index;
+	if(idx == NULL || word >= idx->leaves) {
+		return;
+	}
+	uint32_t k = idx->leaves + word;
+	idx->nodes[k] = freeidx_leaf(freeidx_free_bits(bm, word, 0, bm->nbits));
+	for(uint32_t half=BITMAP_WORD_BITS; k>1; half*=2) {
+		k /= 2;
+		idx->nodes[k] = freeidx_merge(idx->nodes[2*k], idx->nodes[2*k+1], half);
+	}
+}
+
+/**
+ * @brief utility function to summarize the part of a node in [start, end)
+ * @param k    the node
+ * @param lo   first bit of the node
+ * @param size no of bits of the node
+ */
+static struct freeidx_node freeidx_query(const struct fs_bitmap* bm, uint32_t k, uint64_t lo,
+										 uint64_t size, uint32_t start, uint32_t end)
+{
+	if(lo >= end || lo + size <= start) {
+		return (struct freeidx_node) { 0 };
+	}
+	if(start <= lo && lo + size <= end) {
+		return bm->index->nodes[k];
+	}
+	if(size == BITMAP_WORD_BITS) {
+		return freeidx_leaf(freeidx_free_bits(bm, k - bm->index->leaves, start, end));
+	}
+	return freeidx_merge(freeidx_query(bm, 2*k, lo, size / 2, start, end),
+						 freeidx_query(bm, 2*k+1, lo + size / 2, size / 2, start, end), size / 2);
+}
+
+/**
+ * @brief utility function to search the first run of *len* free bits
+ * @details the nodes are visited in order, *carry* is the length of the
+ * free run ending just before the node. a node is only entered if the
+ * run can end in it.
+ * @return the start of the run or BITMAP_NONE
+ */
+static uint32_t freeidx_search(const struct fs_bitmap* bm, uint32_t k, uint64_t lo, uint64_t size,
+							   uint32_t start, uint32_t end, uint32_t len, uint32_t* carry)
+{
+	if(lo >= end || lo + size <= start) {
+		return BITMAP_NONE;
+	}
+	if(start <= lo && lo + size <= end) {
+		const struct freeidx_node* n = bm->index->nodes + k;
+		if(*carry + n->pre >= len) {
+			return lo - *carry;
+		}
+		if(n->max < len) {
+			*carry = (n->pre == size)? *carry + size: n->suf;
+			return BITMAP_NONE;
+		}
+	}
+	if(size == BITMAP_WORD_BITS) {
+		uint64_t free = freeidx_free_bits(bm, k - bm->index->leaves, start, end);
+		for(uint32_t b=0; b<BITMAP_WORD_BITS; b++) {
+			*carry = ((free >> b) & 1)? *carry + 1: 0;
+			if(*carry >= len) {
+				return lo + b + 1 - *carry;
+			}
+		}
+		return BITMAP_NONE;
+	}
+	uint32_t ret = freeidx_search(bm, 2*k, lo, size / 2, start, end, len, carry);
+	if(ret == BITMAP_NONE) {
+		ret = freeidx_search(bm, 2*k+1, lo + size / 2, size / 2, start, end, len, carry);
+	}
+	return ret;
+}
+
+/**
+ * @brief finds the first run of *len* free bits in [start, end)
+ * @return the start of the run or BITMAP_NONE
+ */
+uint32_t freeidx_find_run(const struct fs_bitmap* bm, uint32_t start, uint32_t end, uint32_t len) {
+	if(end > bm->nbits) {
+		end = bm->nbits;
+	}
+	if(len == 0 || start >= end) {
+		return BITMAP_NONE;
+	}
+	uint32_t carry = 0;
+	return freeidx_search(bm, 1, 0, (uint64_t) bm->index->leaves * BITMAP_WORD_BITS,
+						  start, end, len, &carry);
+}
+
+/**
+ * @brief length of the longest run of free bits in [start, end)
+ */
+uint32_t freeidx_largest(const struct fs_bitmap* bm, uint32_t start, uint32_t end) {
+	if(end > bm->nbits) {
+		end = bm->nbits;
+	}
+	if(start >= end) {
+		return 0;
+	}
+	return freeidx_query(bm, 1, 0, (uint64_t) bm->index->leaves * BITMAP_WORD_BITS, start, end).max;
+}
+
+/**
+ * @brief free space statistics of the whole bitmap, O(1)
+ */
+void freeidx_stats(const struct fs_bitmap* bm, struct freeidx_stats* st) {
+	const struct freeidx_node* root = bm->index->nodes + 1;
+	st->free = root->free;
+	st->extents = root->runs;
+	st->largest = root->max;
+}
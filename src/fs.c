@@ -8,14 +8,456 @@
  */
 #include <devutils.h>
 #include <fs.h>
+#include <io.h>
+#include <icache.h>
 
 #include <sys/types.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
-#include <math.h>
 #include <string.h>
 
+/**
+ * @brief creates the in-core state of a filesystem
+ * @details nothing is read from the disk here, the superblock is loaded
+ * by the first call to fs_get_super and the inodes as they are used
+ */
+struct fs_incore* fs_incore_create() {
+	struct fs_incore* incore = calloc(1, sizeof(struct fs_incore));
+	if(incore == NULL) {
+		perror("fs_incore_create: calloc");
+		return NULL;
+	}
+	incore->icache = icache_create(FS_ICACHE_DEFAULT_INODES);
+	if(incore->icache == NULL) {
+		fprintf(stderr, "fs_incore_create: icache_create\n");
+		free(incore);
+		return NULL;
+	}
+	return incore;
+}
+
+/**
+ * @brief utility function to free the memory of an in-memory bitmap
+ */
+static void fs_bitmap_release(struct fs_bitmap* bm) {
+	freeidx_destroy(bm);
+	free(bm->words);
+	free(bm->dirty);
+	memset(bm, 0, sizeof(*bm));
+}
+
+/**
+ * @brief utility function to get the no of bitmap blocks transfered at once
+ * @details only adjacent blocks are transfered together
+ */
+static uint32_t fs_bitmap_run(const struct fs_bitmap* bm, uint32_t i) {
+	if(bm->stride != 1) {
+		return 1;
+	}
+	return (bm->nblocks - i < DISK_MAX_IOV)? bm->nblocks - i: DISK_MAX_IOV;
+}
+
+/**
+ * @brief utility function to read a bitmap into memory
+ * @param loc     first bitmap block
+ * @param stride  distance between two bitmap blocks (1 if adjacent)
+ * @param nblocks no of bitmap blocks
+ * @param nbits   no of bits that can be allocated
+ */
+static int fs_bitmap_load(struct fs_filesyst fs, struct fs_bitmap* bm, uint32_t loc,
+						  uint32_t stride, uint32_t nblocks, uint32_t nbits)
+{
+	bm->words = disk_alloc_blocks(nblocks);
+	bm->dirty = calloc(nblocks, sizeof(uint8_t));
+	if(bm->words == NULL || bm->dirty == NULL) {
+		perror("fs_bitmap_load: malloc");
+		fs_bitmap_release(bm);
+		return FUNC_ERROR;
+	}
+	bm->loc = loc;
+	bm->stride = stride;
+	bm->nblocks = nblocks;
+	bm->nbits = nbits;
+	if(bm->nbits > nblocks * FS_BLOCK_SIZE * BITS_PER_BYTE) {
+		bm->nbits = nblocks * FS_BLOCK_SIZE * BITS_PER_BYTE;
+	}
+	bm->cursor = 0;
+
+	void* blks[DISK_MAX_IOV];
+	int ret = 0;
+	disk_plug(fs);
+	for(uint32_t i=0; ret == 0 && i<nblocks;) {
+		uint32_t n = fs_bitmap_run(bm, i);
+		for(uint32_t j=0; j<n; j++) {
+			blks[j] = (uint8_t*) bm->words + (size_t) (i + j) * FS_BLOCK_SIZE;
+		}
+		ret = fs_read_blocks(fs, loc + i * stride, n, blks);
+		i += n;
+	}
+	if(disk_unplug(fs) < 0 || ret < 0) {
+		fprintf(stderr, "fs_bitmap_load: fs_read_blocks\n");
+		fs_bitmap_release(bm);
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief utility function to write the modified blocks of a bitmap
+ * @details adjacent modified blocks are written together
+ */
+static int fs_bitmap_sync(struct fs_filesyst fs, struct fs_bitmap* bm) {
+	const void* blks[DISK_MAX_IOV];
+	int ret = 0;
+	disk_plug(fs);
+	for(uint32_t i=0; ret == 0 && i<bm->nblocks;) {
+		if(!bm->dirty[i]) {
+			i++;
+			continue;
+		}
+		uint32_t max = fs_bitmap_run(bm, i);
+		uint32_t n = 0;
+		while(n < max && bm->dirty[i+n]) {
+			blks[n] = (uint8_t*) bm->words + (size_t) (i + n) * FS_BLOCK_SIZE;
+			bm->dirty[i+n] = 0;
+			n++;
+		}
+		ret = fs_write_blocks(fs, bm->loc + i * bm->stride, n, blks);
+		i += n;
+	}
+	if(disk_unplug(fs) < 0 || ret < 0) {
+		fprintf(stderr, "fs_bitmap_sync: fs_write_blocks\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief utility function to read or write the group descriptors
+ */
+static int fs_groups_io(struct fs_filesyst fs, struct fs_super_block* super, int write) {
+	int ret = 0;
+	disk_plug(fs);
+	for(uint32_t i=0; ret == 0 && i<super->gdt_size; i+=DISK_MAX_IOV) {
+		uint32_t n = (super->gdt_size - i < DISK_MAX_IOV)? super->gdt_size - i: DISK_MAX_IOV;
+		void* blks[DISK_MAX_IOV];
+		for(uint32_t j=0; j<n; j++) {
+			blks[j] = (uint8_t*) fs.incore->groups + (size_t) (i + j) * FS_BLOCK_SIZE;
+		}
+		ret = (write)? fs_write_blocks(fs, super->gdt_loc + i, n, (const void**) blks):
+			fs_read_blocks(fs, super->gdt_loc + i, n, blks);
+	}
+	if(disk_unplug(fs) < 0 || ret < 0) {
+		fprintf(stderr, "fs_groups_io: %s\n", (write)? "fs_write_blocks": "fs_read_blocks");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief utility function to update the free counters of a group
+ * @param map   the bitmap of the inode or data number
+ * @param bit   the bit of the inode or data number in *map*
+ * @param delta the change of the no of free inodes or blocks
+ */
+static void fs_group_count(struct fs_filesyst fs, struct fs_bitmap* map, uint32_t bit, int delta) {
+	if(fs.incore->groups == NULL) {
+		return;
+	}
+	struct fs_group_desc* desc = fs.incore->groups + bit / FS_GROUP_BITS;
+	if(map == &fs.incore->inode_map) {
+		desc->free_inode_count += delta;
+	} else {
+		desc->free_data_count += delta;
+	}
+	fs.incore->groups_dirty = 1;
+}
+
+/**
+ * @brief utility function to check the free counters against the bitmaps
+ * @details done once when the bitmaps are loaded, a counter that differs
+ * from the no of free bits (eg. after a crash between the writes of the
+ * bitmaps and of block 0) is replaced by the bitmap count
+ * @return the no of counters that were fixed
+ */
+static int fs_check_counts(struct fs_filesyst fs, struct fs_super_block* super) {
+	int fixed = 0;
+	uint32_t free_inodes = bitmap_count_zeros(&fs.incore->inode_map);
+	uint32_t free_data = bitmap_count_zeros(&fs.incore->data_map);
+	if(free_inodes != super->free_inode_count || free_data != super->free_data_count) {
+		fprintf(stderr, "fs_check_counts: free counts %u/%u, bitmaps %u/%u, fixed\n",
+				super->free_inode_count, super->free_data_count, free_inodes, free_data);
+		super->free_inode_count = free_inodes;
+		super->free_data_count = free_data;
+		fs.incore->super_dirty = 1;
+		fixed++;
+	}
+	for(uint32_t g=0; fs.incore->groups && g<super->group_count; g++) {
+		struct fs_group_desc* desc = fs.incore->groups + g;
+		uint32_t first = g * FS_GROUP_BITS;
+		free_inodes = bitmap_count_zeros_range(&fs.incore->inode_map, first, first + FS_GROUP_BITS);
+		free_data = bitmap_count_zeros_range(&fs.incore->data_map, first, first + FS_GROUP_BITS);
+		if(free_inodes != desc->free_inode_count || free_data != desc->free_data_count) {
+			fprintf(stderr, "fs_check_counts: group %u free counts %u/%u, bitmaps %u/%u, fixed\n",
+					g, desc->free_inode_count, desc->free_data_count, free_inodes, free_data);
+			desc->free_inode_count = free_inodes;
+			desc->free_data_count = free_data;
+			fs.incore->groups_dirty = 1;
+			fixed++;
+		}
+	}
+	return fixed;
+}
+
+/**
+ * @brief utility function to get the first inode of the inode chunks
+ * @details the inodes of the chunks follow the inodes of the inode table
+ * made at format
+ */
+static uint32_t fs_ichunk_first(const struct fs_super_block* super) {
+	return super->inode_count * fs_inodes_per_block(super);
+}
+
+/**
+ * @brief frees the in-core state of a filesystem
+ * @details fs_sync has to be called before, otherwise the changes of the
+ * superblock and of the bitmaps are lost
+ */
+void fs_incore_destroy(struct fs_incore* incore) {
+	if(incore == NULL) {
+		return;
+	}
+	fs_bitmap_release(&incore->inode_map);
+	fs_bitmap_release(&incore->data_map);
+	free(incore->pending);
+	free(incore->groups);
+	free(incore->ichunks);
+	io_delalloc_release(incore->delalloc);
+	icache_destroy(incore->icache);
+	free(incore);
+}
+
+/**
+ * @brief get the in-core superblock
+ * @details the superblock is read from block 0 the first time, after
+ * that the in-core copy is the authority: the allocation counters are
+ * only updated there. an image with an unknown inode table format is
+ * refused.
+ * @return the superblock or NULL on error
+ */
+struct fs_super_block* fs_get_super(struct fs_filesyst fs) {
+	if(fs.incore == NULL) {
+		fprintf(stderr, "fs_get_super: filesystem not opened\n");
+		return NULL;
+	}
+	if(!fs.incore->super_loaded) {
+		union fs_block blk;
+		if(fs_read_block(fs, 0, &blk) < 0) {
+			fprintf(stderr, "fs_get_super: fs_read_block\n");
+			return NULL;
+		}
+		if(blk.super.inode_version > FS_INODE_V1) {
+			fprintf(stderr, "fs_get_super: unknown inode table format %u\n",
+					blk.super.inode_version);
+			return NULL;
+		}
+		fs.incore->super = blk.super;
+		fs.incore->super_loaded = 1;
+		fs.incore->super_synced = get_cur_time();
+	}
+	return &fs.incore->super;
+}
+
+/**
+ * @brief reads the inode and data bitmaps into memory
+ * @details done once, after that the in-memory bitmaps are the authority
+ * and only their modified blocks are written back by fs_sync
+ */
+int fs_load_bitmaps(struct fs_filesyst fs) {
+	if(fs.incore == NULL) {
+		fprintf(stderr, "fs_load_bitmaps: filesystem not opened\n");
+		return FUNC_ERROR;
+	}
+	if(fs.incore->bitmaps_loaded) {
+		return 0;
+	}
+	struct fs_super_block* super = fs_get_super(fs);
+	if(super == NULL) {
+		fprintf(stderr, "fs_load_bitmaps: fs_get_super\n");
+		return FUNC_ERROR;
+	}
+	/* with groups, one bitmap block per group and FS_GROUP_BITS bits per group */
+	uint32_t stride = 1, inode_bits = fs_ichunk_first(super) +
+		super->ichunk_count * FS_ICHUNK_BLOCKS * fs_inodes_per_block(super);
+	uint32_t data_bits = super->data_count;
+	if(super->group_blocks) {
+		stride = super->group_blocks;
+		inode_bits = data_bits = super->group_count * FS_GROUP_BITS;
+		fs.incore->groups = disk_alloc_blocks(super->gdt_size);
+		if(fs.incore->groups == NULL || fs_groups_io(fs, super, 0) < 0) {
+			fprintf(stderr, "fs_load_bitmaps: can't read the group descriptors\n");
+			free(fs.incore->groups);
+			fs.incore->groups = NULL;
+			return FUNC_ERROR;
+		}
+	}
+	if(fs_bitmap_load(fs, &fs.incore->inode_map, super->inode_bitmap_loc, stride,
+					  super->inode_bitmap_size, inode_bits) < 0 ||
+	   fs_bitmap_load(fs, &fs.incore->data_map, super->data_bitmap_loc, stride,
+					  super->data_bitmap_size, data_bits) < 0)
+	{
+		fprintf(stderr, "fs_load_bitmaps: fs_bitmap_load\n");
+		fs_bitmap_release(&fs.incore->inode_map);
+		free(fs.incore->groups);
+		fs.incore->groups = NULL;
+		return FUNC_ERROR;
+	}
+	if(super->ichunk_map) {
+		fs.incore->ichunks = disk_alloc_blocks(1);
+		if(fs.incore->ichunks == NULL ||
+		   fs_read_block(fs, fs_data_blocknum(super, super->ichunk_map), fs.incore->ichunks) < 0)
+		{
+			fprintf(stderr, "fs_load_bitmaps: can't read the inode chunk map\n");
+			free(fs.incore->ichunks);
+			fs.incore->ichunks = NULL;
+			fs_bitmap_release(&fs.incore->inode_map);
+			fs_bitmap_release(&fs.incore->data_map);
+			return FUNC_ERROR;
+		}
+	}
+	fs_check_counts(fs, super);
+	/* the data allocations search free runs */
+	if(freeidx_build(&fs.incore->data_map) < 0) {
+		fprintf(stderr, "fs_load_bitmaps: freeidx_build\n");
+		fs_bitmap_release(&fs.incore->inode_map);
+		fs_bitmap_release(&fs.incore->data_map);
+		return FUNC_ERROR;
+	}
+	fs.incore->bitmaps_loaded = 1;
+	return 0;
+}
+
+/**
+ * @brief marks the in-core superblock as modified
+ * @details the superblock and the bitmaps are written if they have not
+ * been written for FS_SUPER_SYNC_INTERVAL seconds
+ */
+int fs_mark_super_dirty(struct fs_filesyst fs) {
+	fs.incore->super_dirty = 1;
+	if(get_cur_time() - fs.incore->super_synced >= FS_SUPER_SYNC_INTERVAL) {
+		return fs_sync_meta(fs);
+	}
+	return 0;
+}
+
+/**
+ * @brief writes the modified in-core state of the filesystem
+ * @details the data of the files with delayed allocation (their blocks
+ * are allocated now), then the metadata with fs_sync_meta
+ */
+int fs_sync(struct fs_filesyst fs) {
+	if(fs.incore == NULL) {
+		return 0;
+	}
+	if(io_delalloc_flush(fs) < 0) {
+		fprintf(stderr, "fs_sync: io_delalloc_flush\n");
+		return FUNC_ERROR;
+	}
+	return fs_sync_meta(fs);
+}
+
+/**
+ * @brief writes the modified metadata of the filesystem
+ * @details the dirty in-core inodes, the modified bitmap blocks, the
+ * group descriptors then the superblock. the data waiting for delayed allocation is left in memory,
+ * this is what runs in the middle of an allocation.
+ */
+int fs_sync_meta(struct fs_filesyst fs) {
+	if(fs.incore == NULL) {
+		return 0;
+	}
+	if(fs.incore->icache && icache_flush(fs.incore->icache, fs) < 0) {
+		fprintf(stderr, "fs_sync: icache_flush\n");
+		return FUNC_ERROR;
+	}
+	if(fs.incore->bitmaps_loaded &&
+	   (fs_bitmap_sync(fs, &fs.incore->inode_map) < 0 ||
+		fs_bitmap_sync(fs, &fs.incore->data_map) < 0))
+	{
+		fprintf(stderr, "fs_sync: fs_bitmap_sync\n");
+		return FUNC_ERROR;
+	}
+	if(fs.incore->groups_dirty) {
+		if(fs_groups_io(fs, &fs.incore->super, 1) < 0) {
+			fprintf(stderr, "fs_sync: fs_groups_io\n");
+			return FUNC_ERROR;
+		}
+		fs.incore->groups_dirty = 0;
+	}
+	return fs_sync_super(fs);
+}
+
+/**
+ * @brief writes the in-core superblock into block 0 if it was modified
+ */
+int fs_sync_super(struct fs_filesyst fs) {
+	if(fs.incore == NULL || !fs.incore->super_dirty) {
+		return 0;
+	}
+	struct fs_super_block* super = &fs.incore->super;
+	super->wtime = get_cur_time();
+	if(fs_write_block(fs, 0, super, sizeof(*super)) < 0) {
+		fprintf(stderr, "fs_sync_super: fs_write_block!\n");
+		return FUNC_ERROR;
+	}
+	fs.incore->super_dirty = 0;
+	fs.incore->super_synced = super->wtime;
+	return 0;
+}
+
+/**
+ * @brief utility function to reset the in-core state to a new superblock
+ * @details the bitmaps and the group descriptors are reloaded once they
+ * are written by the format. the dirty pages of the delayed allocation
+ * and the data blocks of a pending free batch belong to the old
+ * filesystem, they are dropped.
+ */
+static void fs_format_incore(struct fs_filesyst fs, const struct fs_super_block* super) {
+	if(fs.incore == NULL) {
+		return;
+	}
+	fs.incore->super = *super;
+	fs.incore->super_loaded = 1;
+	fs.incore->super_dirty = 0;
+	fs.incore->super_synced = super->wtime;
+	fs_bitmap_release(&fs.incore->inode_map);
+	fs_bitmap_release(&fs.incore->data_map);
+	fs.incore->bitmaps_loaded = 0;
+	free(fs.incore->groups);
+	fs.incore->groups = NULL;
+	fs.incore->groups_dirty = 0;
+	free(fs.incore->ichunks);
+	fs.incore->ichunks = NULL;
+	if(fs.incore->icache) {
+		icache_reset(fs.incore->icache);
+	}
+	io_delalloc_discard(fs.incore->delalloc);
+	fs.incore->npending = 0;
+	fs.incore->free_batch = 0;
+}
+
+/**
+ * @brief utility function to get the no of data blocks of a group
+ * @details all the groups have the same no of data blocks except the
+ * last one which ends the image
+ */
+static uint32_t fs_group_ndata(const struct fs_super_block* super, uint32_t g) {
+	uint32_t meta = super->data_loc - super->inode_bitmap_loc; /* bitmaps and inode table */
+	uint32_t full = super->group_blocks - meta;
+	return (g == super->group_count - 1)? super->data_count - g * full: full;
+}
+
 /**
  * @brief format the superblock into the virtual filesystem
  * @details format and calculate the positions and sizes of each section
@@ -24,6 +466,7 @@
  */
 int fs_format_super(struct fs_filesyst fs) {
 	struct fs_super_block super;
+	memset(&super, 0, sizeof(super)); /* no groups */
 	/* initializing the log values */
 	super.magic = FS_MAGIC;
 	super.nreads = 0;
@@ -32,20 +475,28 @@ int fs_format_super(struct fs_filesyst fs) {
 	
 	super.mtime = get_cur_time();
 	super.wtime = super.mtime;
+	super.inode_version = FS_INODE_V1;
 	
 	/* calculating the positions of sections */
 	/* inode count is prefixed with a ratio, it cannot be null*/
 	uint32_t nblocks = fs.nblocks - 1; /* for the super block */
-	super.inode_count = SET_MINMAX(nblocks*FS_INODE_RATIO, 1, FS_MAX_INODE_COUNT);
+	super.inode_count = SET_MINMAX(nblocks*FS_INITIAL_INODE_RATIO, 1, FS_MAX_INODE_COUNT);
 	
-	/* calculating the number of bits needed to rep inode count */
-	uint32_t bits_to_rep = FS_INODES_PER_BLOCK*super.inode_count;
+	/* calculating the number of bits needed to rep inode count, with
+	 * the inodes of all the chunks that can be added: the chunk map is
+	 * one block, so at most FS_ICHUNK_MAX chunks (about 1.08M inodes),
+	 * and fewer if the data blocks can't hold that many */
+	uint64_t bits_to_rep = (uint64_t) fs_inodes_per_block(&super) * super.inode_count;
+	uint32_t max_chunks = (nblocks - super.inode_count) / FS_ICHUNK_BLOCKS;
+	max_chunks = (max_chunks < FS_ICHUNK_MAX)? max_chunks: FS_ICHUNK_MAX;
+	bits_to_rep += (uint64_t) max_chunks * FS_ICHUNK_BLOCKS * fs_inodes_per_block(&super);
 	uint32_t bits_per_block = FS_BLOCK_SIZE*BITS_PER_BYTE;
-	super.inode_bitmap_size = NOT_NULL(bits_to_rep/bits_per_block);
+	super.inode_bitmap_size = NOT_NULL((bits_to_rep + bits_per_block - 1)/bits_per_block);
 	
 	/* the rest is for data and data bitmap */
 	uint32_t blocks_left = nblocks - (super.inode_count + super.inode_bitmap_size);
-	super.data_bitmap_size = NOT_NULL((int) log2(blocks_left / (FS_BLOCK_SIZE*BITS_PER_BYTE))); /* approximation */
+	/* each bitmap block covers bits_per_block data blocks */
+	super.data_bitmap_size = NOT_NULL((blocks_left + bits_per_block) / (bits_per_block + 1));
 
 	super.data_count = NOT_NULL(blocks_left - super.data_bitmap_size);
 	
@@ -73,7 +524,7 @@ int fs_format_super(struct fs_filesyst fs) {
 	
 	/* all blocks are free */
 	super.free_data_count = super.data_count;
-	super.free_inode_count = super.inode_count * FS_INODES_PER_BLOCK;
+	super.free_inode_count = super.inode_count * fs_inodes_per_block(&super);
 	
 	/* getting the locations */
 	super.inode_bitmap_loc = 1; /* directly after the superblock */
@@ -85,6 +536,7 @@ int fs_format_super(struct fs_filesyst fs) {
 		fprintf(stderr, "fs_format_super: cannot write super!\n");
 		return FUNC_ERROR;
 	}
+	fs_format_incore(fs, &super);
 	return 0;
 }
 
@@ -93,13 +545,13 @@ int fs_format_super(struct fs_filesyst fs) {
  * @details prints a human readable superblock from teh filesystem fs
  */
 int fs_dump_super(struct fs_filesyst fs) {
-	/* read the super block */
-	union fs_block blk;
-	if(fs_read_block(fs, 0, &blk) < 0) {
+	/* get the super block */
+	struct fs_super_block* sb = fs_get_super(fs);
+	if(sb == NULL) {
 		fprintf(stderr, "fd_dump_super: dump failed, cannot read!\n");
 		return FUNC_ERROR;
 	}
-	struct fs_super_block super = blk.super;
+	struct fs_super_block super = *sb;
 	
 	printf("[%d] nblocks: %d\nSuperblock dump:\n", fs.fd, fs.nblocks);
 	printf("Magic: %x\n", super.magic);
@@ -115,6 +567,12 @@ int fs_dump_super(struct fs_filesyst fs) {
 	
 	printf("Data blocks:\f");
 	print_range(super.data_loc, super.data_count);
+
+	if(super.group_blocks) {
+		printf("Groups: %u groups of %u blocks (%u inodes each), descriptors: \f",
+			   super.group_count, super.group_blocks, super.group_inodes);
+		print_range(super.gdt_loc, super.gdt_size);
+	}
 	
 	printf("Log:\n");
 	printf("    number of reads: %d\n", super.nreads);
@@ -129,6 +587,32 @@ int fs_dump_super(struct fs_filesyst fs) {
 	return 0;
 }
 
+/**
+ * @brief utility function to set a range of blocks to 0
+ * @details the blocks are written by runs of DISK_MAX_IOV blocks, all
+ * the runs are in flight at the same time with io_uring
+ */
+static int fs_zero_blocks(struct fs_filesyst fs, uint32_t blocknum, uint32_t count) {
+	union fs_block blk;
+	memset(&blk, 0, FS_BLOCK_SIZE);
+	const void* blks[DISK_MAX_IOV];
+	for(int i=0; i<DISK_MAX_IOV; i++) {
+		blks[i] = &blk;
+	}
+
+	int ret = 0;
+	disk_plug(fs);
+	for(uint32_t i=0; ret == 0 && i<count; i+=DISK_MAX_IOV) {
+		uint32_t n = (count - i < DISK_MAX_IOV)? count - i: DISK_MAX_IOV;
+		ret = fs_write_blocks(fs, blocknum + i, n, blks);
+	}
+	if(disk_unplug(fs) < 0 || ret < 0) {
+		fprintf(stderr, "fs_zero_blocks: fs_write_blocks\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
 /**
  * @brief format the filesystem
  * @details formats the superblock and sets the bitmaps to 0
@@ -151,154 +635,547 @@ int fs_format(struct fs_filesyst fs) {
 	}
 	super = blk.super;
 	
-	/* reset the blk buffer to 0 */
-	memset(&blk, 0, FS_BLOCK_SIZE);
-	
 	/* set the data bitmap to 0 */
-	for(int i=super.data_bitmap_loc; i<super.data_bitmap_loc+super.data_bitmap_size; i++) {
-		if(fs_write_block(fs, i, &blk, FS_BLOCK_SIZE) < 0) {
-			fprintf(stderr, "fs_format: fs_write_block\n");
-			return FUNC_ERROR;
-		}
+	if(fs_zero_blocks(fs, super.data_bitmap_loc, super.data_bitmap_size) < 0) {
+		fprintf(stderr, "fs_format: fs_zero_blocks\n");
+		return FUNC_ERROR;
 	}
 
 	/* set the inode bitmap to 0 */
-	for(int i=super.inode_bitmap_loc; i<super.inode_bitmap_loc+super.inode_bitmap_size; i++) {
-		if(fs_write_block(fs, i, &blk, FS_BLOCK_SIZE) < 0) {
-			fprintf(stderr, "fs_format: fs_write_block\n");
-			return FUNC_ERROR;
-		}
+	if(fs_zero_blocks(fs, super.inode_bitmap_loc, super.inode_bitmap_size) < 0) {
+		fprintf(stderr, "fs_format: fs_zero_blocks\n");
+		return FUNC_ERROR;
 	}
 	
 	return 0;
 }
 
+/**
+ * @brief utility function to set the bits of a bitmap block from *from*
+ */
+static void fs_set_bits_from(union fs_block* blk, uint32_t from) {
+	memset(blk, 0, FS_BLOCK_SIZE);
+	for(uint32_t i=from; i<FS_GROUP_BITS; i++) {
+		blk->data[i / BITS_PER_BYTE] |= 1 << (i % BITS_PER_BYTE);
+	}
+}
+
+/**
+ * @brief utility function to write the group descriptors and bitmaps
+ * @details the bits past the inodes and the data blocks of each group
+ * are set so that they are never allocated
+ */
+static int fs_format_group_blocks(struct fs_filesyst fs, const struct fs_super_block* super) {
+	struct fs_group_desc* gdt = disk_alloc_blocks(super->gdt_size);
+	union fs_block* maps = disk_alloc_blocks(3);
+	if(gdt == NULL || maps == NULL) {
+		perror("fs_format_group_blocks: malloc");
+		free(gdt);
+		free(maps);
+		return FUNC_ERROR;
+	}
+	memset(gdt, 0, (size_t) super->gdt_size * FS_BLOCK_SIZE);
+	uint32_t last = super->group_count - 1;
+	fs_set_bits_from(maps, super->group_inodes);
+	fs_set_bits_from(maps + 1, fs_group_ndata(super, 0));
+	fs_set_bits_from(maps + 2, fs_group_ndata(super, last));
+
+	int ret = 0;
+	disk_plug(fs);
+	for(uint32_t g=0; ret == 0 && g<super->group_count; g++) {
+		gdt[g].free_inode_count = super->group_inodes;
+		gdt[g].free_data_count = fs_group_ndata(super, g);
+		/* the inode bitmap block is followed by the data bitmap block */
+		const void* blks[2] = { maps, maps + ((g == last)? 2: 1) };
+		ret = fs_write_blocks(fs, super->inode_bitmap_loc + g * super->group_blocks, 2, blks);
+	}
+	for(uint32_t i=0; ret == 0 && i<super->gdt_size; i++) {
+		ret = fs_write_block(fs, super->gdt_loc + i, (uint8_t*) gdt + (size_t) i * FS_BLOCK_SIZE,
+							 FS_BLOCK_SIZE);
+	}
+	if(disk_unplug(fs) < 0 || ret < 0) {
+		fprintf(stderr, "fs_format_group_blocks: fs_write_blocks\n");
+		ret = FUNC_ERROR;
+	}
+	free(gdt);
+	free(maps);
+	return ret;
+}
+
+/**
+ * @brief format the filesystem with block groups
+ * @details the image is split into groups of *group_blocks* blocks (at
+ * most FS_GROUP_BITS) after the superblock and the group descriptors.
+ * each group holds its inode bitmap block, its data bitmap block, its
+ * slice of the inode table (FS_INODE_RATIO of its blocks) then its data
+ * blocks. a last group too small to hold data is left unused.
+ * @param group_blocks no of blocks per group, 0 to format without groups
+ * @return this functions returns -1 in case of error and 0 on success
+ */
+int fs_format_groups(struct fs_filesyst fs, uint32_t group_blocks) {
+	if(group_blocks == 0) {
+		return fs_format(fs);
+	}
+	if(group_blocks > FS_GROUP_BITS) {
+		group_blocks = FS_GROUP_BITS;
+	}
+	/* an image smaller than a group is one group (after block 0 and the gdt) */
+	if(fs.nblocks > 2 && group_blocks > fs.nblocks - 2) {
+		group_blocks = fs.nblocks - 2;
+	}
+	struct fs_super_block super;
+	memset(&super, 0, sizeof(super));
+	/* initializing the log values */
+	super.magic = FS_MAGIC;
+	super.mounts = 1;
+	super.mtime = get_cur_time();
+	super.wtime = super.mtime;
+	super.inode_version = FS_INODE_V1;
+	uint32_t ipb = fs_inodes_per_block(&super);
+
+	/* calculating the sizes of a group */
+	uint32_t itable = SET_MINMAX(group_blocks*FS_INODE_RATIO, 1, FS_GROUP_BITS / ipb);
+	uint32_t meta = 2 + itable; /* bitmaps and inode table */
+	if(group_blocks <= meta) {
+		fprintf(stderr, "fs_format_groups: groups of %u blocks are too small\n", group_blocks);
+		return FUNC_ERROR;
+	}
+	uint32_t count = NOT_NULL((fs.nblocks - 1 + group_blocks - 1) / group_blocks);
+	uint32_t gdt_size = (count + FS_GROUP_DESC_PER_BLOCK - 1) / FS_GROUP_DESC_PER_BLOCK;
+	uint32_t avail = (fs.nblocks > 1 + gdt_size)? fs.nblocks - 1 - gdt_size: 0;
+	count = (avail + group_blocks - 1) / group_blocks;
+	if(count > 0 && avail - (count - 1) * group_blocks <= meta) {
+		count--; /* the last group can't hold data */
+	}
+	if(count == 0) {
+		fprintf(stderr, "fs_format_groups: null size\n");
+		return FUNC_ERROR;
+	}
+	uint32_t last_blocks = avail - (count - 1) * group_blocks;
+	if(last_blocks > group_blocks) {
+		last_blocks = group_blocks;
+	}
+
+	super.group_blocks = group_blocks;
+	super.group_count = count;
+	super.group_inodes = itable * ipb;
+	super.gdt_loc = 1; /* directly after the superblock */
+	super.gdt_size = gdt_size;
+
+	/* locations in the first group, the others follow every group_blocks */
+	super.inode_bitmap_loc = super.gdt_loc + gdt_size;
+	super.inode_bitmap_size = count;
+	super.data_bitmap_loc = super.inode_bitmap_loc + 1;
+	super.data_bitmap_size = count;
+	super.inode_loc = super.data_bitmap_loc + 1;
+	super.inode_count = count * itable;
+	super.data_loc = super.inode_loc + itable;
+	super.data_count = (count - 1) * (group_blocks - meta) + last_blocks - meta;
+
+	/* all blocks are free */
+	super.free_data_count = super.data_count;
+	super.free_inode_count = super.inode_count * fs_inodes_per_block(&super);
+
+	if(fs_write_block(fs, 0, &super, sizeof(super)) < 0) {
+		fprintf(stderr, "fs_format_groups: cannot write super!\n");
+		return FUNC_ERROR;
+	}
+	fs_format_incore(fs, &super);
+	if(fs_format_group_blocks(fs, &super) < 0) {
+		fprintf(stderr, "fs_format_groups: fs_format_group_blocks\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief sets the optional features of a filesystem
+ * @details eg. with FS_FEATURE_EXTENTS the inodes created from now on are
+ * mapped with extents, the existing inodes keep their mapping. the
+ * features need an inode table that stores the inode flags
+ */
+int fs_set_features(struct fs_filesyst fs, uint32_t features) {
+	struct fs_super_block* sb = fs_get_super(fs);
+	if(sb == NULL) {
+		fprintf(stderr, "fs_set_features: fs_get_super\n");
+		return FUNC_ERROR;
+	}
+	if(features && !fs_has_inode_flags(sb)) {
+		fprintf(stderr, "fs_set_features: the inode table can't store the inode flags\n");
+		return FUNC_ERROR;
+	}
+	sb->features = features;
+	return fs_mark_super_dirty(fs);
+}
+
+/**
+ * @brief gets the no of inodes of an inode table block
+ * @details it depends on the format of the inode table of the superblock
+ */
+uint32_t fs_inodes_per_block(const struct fs_super_block* super) {
+	return (super->inode_version == FS_INODE_V1)? FS_DINODES_PER_BLOCK: FS_INODES_PER_BLOCK;
+}
+
+/**
+ * @brief gets the max link count of an inode
+ * @details it depends on the format of the inode table of the superblock,
+ * no link can be added to an inode that has that many
+ */
+uint32_t fs_max_links(const struct fs_super_block* super) {
+	return (super->inode_version == FS_INODE_V1)? FS_DINODE_MAX_LINKS: UINT32_MAX;
+}
+
+/**
+ * @brief tells if the inode table can store the flags of the inodes
+ * @details the FS_INODE_V0 records have neither flags nor init_size, so
+ * their inodes can't be preallocated, mapped with extents or inline
+ */
+int fs_has_inode_flags(const struct fs_super_block* super) {
+	return super->inode_version == FS_INODE_V1;
+}
+
+/**
+ * @brief gets the block of the inode table holding an inode
+ */
+uint32_t fs_inode_blocknum(const struct fs_super_block* super, uint32_t inodenum) {
+	uint32_t ipb = fs_inodes_per_block(super);
+	if(super->group_blocks == 0) {
+		return inodenum / ipb + super->inode_loc;
+	}
+	uint32_t g = inodenum / FS_GROUP_BITS;
+	return super->inode_loc + g * super->group_blocks + (inodenum % FS_GROUP_BITS) / ipb;
+}
+
+/**
+ * @brief gets the block holding an inode
+ * @details same as fs_inode_blocknum for the inodes of the inode table,
+ * the blocks of the inodes of the chunks are found with the chunk map
+ * @return the block number or 0 if the inode does not exist
+ */
+uint32_t fs_inode_block(struct fs_filesyst fs, uint32_t inodenum) {
+	const struct fs_super_block* super = &fs.incore->super;
+	uint32_t first = fs_ichunk_first(super);
+	if(super->group_blocks || inodenum < first) {
+		return fs_inode_blocknum(super, inodenum);
+	}
+	uint32_t ipb = fs_inodes_per_block(super);
+	uint32_t c = (inodenum - first) / (FS_ICHUNK_BLOCKS * ipb);
+	if(c >= super->ichunk_count || fs.incore->ichunks == NULL) {
+		return 0;
+	}
+	uint32_t blk = (inodenum - first) % (FS_ICHUNK_BLOCKS * ipb) / ipb;
+	return fs_data_blocknum(super, fs.incore->ichunks->pointers[c]) + blk;
+}
+
+/**
+ * @brief utility function to get the position of an inode in its block
+ * of the inode table
+ */
+static uint32_t fs_inode_slot(const struct fs_super_block* super, uint32_t inodenum) {
+	if(super->group_blocks) {
+		inodenum %= FS_GROUP_BITS;
+	}
+	return inodenum % fs_inodes_per_block(super);
+}
+
+/**
+ * @brief gets an inode from a block of the inode table
+ * @details the record of the inode in *blk* is converted to the in-core
+ * inode *inode*
+ */
+void fs_inode_decode(const struct fs_super_block* super, const union fs_block* blk,
+					 uint32_t inodenum, struct fs_inode* inode)
+{
+	uint32_t slot = fs_inode_slot(super, inodenum);
+	if(super->inode_version != FS_INODE_V1) {
+		const struct fs_inode_v0* v = &blk->inodes[slot];
+		memset(inode, 0, sizeof(*inode)); /* no flags nor init_size */
+		inode->mode = v->mode;
+		inode->uid = v->uid;
+		inode->gid = v->gid;
+		inode->atime = v->atime;
+		inode->mtime = v->mtime;
+		inode->size = v->size;
+		inode->hcount = v->hcount;
+		memcpy(inode->direct, v->direct, sizeof(v->direct));
+		inode->indirect = v->indirect;
+		return;
+	}
+	const struct fs_dinode* d = &blk->dinodes[slot];
+	inode->mode = d->mode;
+	inode->uid = d->uid;
+	inode->gid = d->gid;
+	inode->flags = d->flags;
+	inode->atime = d->atime;
+	inode->mtime = d->mtime;
+	inode->size = d->size;
+	inode->hcount = d->hcount;
+	memcpy(inode->inline_data, d->map, FS_INLINE_DATA_SIZE);
+}
+
+/**
+ * @brief puts an inode in a block of the inode table
+ * @details the in-core inode *inode* is converted to the record of the
+ * format of the inode table. the link count must fit in the record
+ * (fs_max_links) and the flags must be storable (fs_has_inode_flags),
+ * they are never cut here
+ */
+void fs_inode_encode(const struct fs_super_block* super, union fs_block* blk,
+					 uint32_t inodenum, const struct fs_inode* inode)
+{
+	uint32_t slot = fs_inode_slot(super, inodenum);
+	if(super->inode_version != FS_INODE_V1) {
+		struct fs_inode_v0* v = &blk->inodes[slot];
+		v->mode = inode->mode;
+		v->uid = inode->uid;
+		v->gid = inode->gid;
+		v->atime = inode->atime;
+		v->mtime = inode->mtime;
+		v->size = inode->size;
+		v->hcount = inode->hcount;
+		memcpy(v->direct, inode->direct, sizeof(v->direct));
+		v->indirect = inode->indirect;
+		return;
+	}
+	struct fs_dinode* d = &blk->dinodes[slot];
+	d->mode = inode->mode;
+	d->uid = inode->uid;
+	d->gid = inode->gid;
+	d->flags = inode->flags;
+	d->atime = inode->atime;
+	d->mtime = inode->mtime;
+	d->size = inode->size;
+	d->hcount = inode->hcount;
+	memcpy(d->map, inode->inline_data, FS_INLINE_DATA_SIZE);
+}
+
+/**
+ * @brief gets the block of the image of a data block number
+ */
+uint32_t fs_data_blocknum(const struct fs_super_block* super, uint32_t datanum) {
+	if(super->group_blocks == 0) {
+		return datanum - 1 + super->data_loc;
+	}
+	uint32_t g = (datanum - 1) / FS_GROUP_BITS;
+	return super->data_loc + g * super->group_blocks + (datanum - 1) % FS_GROUP_BITS;
+}
+
+/**
+ * @brief gets where the data blocks of a new file are searched
+ * @details with groups, the first data block of the group of the inode.
+ * without groups, a block at the same relative position in the data
+ * section as the inode block in the inode table: the files whose inodes
+ * share a block (usually created together) start from the same goal.
+ */
+uint32_t fs_data_goal(const struct fs_super_block* super, uint32_t inodenum) {
+	if(super->group_blocks) {
+		return inodenum / FS_GROUP_BITS * FS_GROUP_BITS + 1;
+	}
+	/* the inodes of the chunks start over from the first inode block */
+	uint64_t inodeblk = inodenum / fs_inodes_per_block(super) % super->inode_count;
+	return 1 + inodeblk * super->data_count / super->inode_count;
+}
+
+/**
+ * @brief utility function to check if an inode number exists
+ * @details with groups, the bits past the inodes of a group are not inodes
+ */
+static int fs_inode_exists(const struct fs_super_block* super, const struct fs_bitmap* bm,
+						   uint32_t inodenum)
+{
+	if(inodenum >= bm->nbits) {
+		return 0;
+	}
+	return super->group_blocks == 0 || inodenum % FS_GROUP_BITS < super->group_inodes;
+}
+
+/**
+ * @brief utility function to check if a data block number exists
+ * @details with groups, the bits past the data blocks of a group are not
+ * data blocks
+ */
+static int fs_data_exists(const struct fs_super_block* super, const struct fs_bitmap* bm,
+						  uint32_t datanum)
+{
+	if(datanum == 0 || datanum > bm->nbits) {
+		return 0;
+	}
+	uint32_t bit = datanum - 1;
+	return super->group_blocks == 0 ||
+		bit % FS_GROUP_BITS < fs_group_ndata(super, bit / FS_GROUP_BITS);
+}
+
 /**
  * @brief utility function to check if a data block is allocated
+ * @details the in-memory data bitmap is used, no block is read
+ * @return 1 if allocated, 0 if free or out of range, -1 on error
  */
 int fs_is_data_allocated(struct fs_filesyst fs, struct fs_super_block super, uint32_t datanum) {
-	datanum --;
-	uint32_t blkno = datanum / (BITS_PER_BYTE * FS_BLOCK_SIZE) + super.data_bitmap_loc;
-	union fs_block blk;
-	if(fs_read_block(fs, blkno, &blk)) {
-		fprintf(stderr, "fs_free_inode: fs_read_block!\n");
+	if(fs_load_bitmaps(fs) < 0) {
+		fprintf(stderr, "fs_is_data_allocated: fs_load_bitmaps!\n");
 		return FUNC_ERROR;
 	}
-	uint32_t blkoff = datanum % (BITS_PER_BYTE * FS_BLOCK_SIZE);
-	uint32_t byteoff = blkoff % 8;
-	uint8_t byte = blk.data[blkoff / 8];
-	
-	uint8_t mask = 1;
-	mask <<= byteoff;
-
-	return (byte & mask) > 0;
+	struct fs_bitmap* bm = &fs.incore->data_map;
+	if(!fs_data_exists(&fs.incore->super, bm, datanum)) {
+		return 0;
+	}
+	return bitmap_test(bm, datanum - 1);
 }
 
 /**
  * @brief utility function to check if an inode number is allocated
+ * @details the in-memory inode bitmap is used, no block is read
+ * @return 1 if allocated, 0 if free or out of range, -1 on error
  */
 int fs_is_inode_allocated(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum) {
-	uint32_t blkno = inodenum / (BITS_PER_BYTE * FS_BLOCK_SIZE) + super.inode_bitmap_loc;
-	union fs_block blk;
-	if(fs_read_block(fs, blkno, &blk)) {
-		fprintf(stderr, "fs_free_inode: fs_read_block!\n");
+	if(fs_load_bitmaps(fs) < 0) {
+		fprintf(stderr, "fs_is_inode_allocated: fs_load_bitmaps!\n");
 		return FUNC_ERROR;
 	}
-	uint32_t blkoff = inodenum % (BITS_PER_BYTE * FS_BLOCK_SIZE);
-	uint32_t byteoff = blkoff % 8;
-	uint8_t byte = blk.data[blkoff / 8];
-
-	uint8_t mask = 1;
-	mask <<= byteoff;
-
-	return (byte & mask) > 0;
+	struct fs_bitmap* bm = &fs.incore->inode_map;
+	if(!fs_inode_exists(&fs.incore->super, bm, inodenum)) {
+		return 0;
+	}
+	return bitmap_test(bm, inodenum);
 }
 
 /**
  * @brief allocate an inode
- * @details allocates the first free inode in the inode table
+ * @details allocates the next free inode after the last allocated one
+ * (next-fit) in the in-memory inode bitmap
  * @arg fs: the virtual filesystem
  * @arg super: the superblock
  * @arg inodenum: the inode number allocated
  */
 int fs_alloc_inode(struct fs_filesyst fs, struct fs_super_block* super, uint32_t *inodenum) {
-	if(super->free_inode_count == 0){
-		fprintf(stderr, "fs_alloc_inode: no space left!\n");
+	return fs_alloc_inode_near(fs, super, FS_NO_INODE, inodenum);
+}
+
+/**
+ * @brief utility function to add a chunk of inodes
+ * @details without groups, when all the inodes are used, FS_ICHUNK_BLOCKS
+ * contiguous blocks of the data section become inode table blocks. the
+ * first data block of each chunk is kept in the chunk map block
+ * (allocated with the first chunk). the chunks are never freed.
+ */
+static int fs_add_ichunk(struct fs_filesyst fs, struct fs_super_block* sb) {
+	struct fs_bitmap* bm = &fs.incore->inode_map;
+	uint32_t ninodes = FS_ICHUNK_BLOCKS * fs_inodes_per_block(sb);
+	if(sb->group_blocks || sb->ichunk_count >= FS_ICHUNK_MAX ||
+	   (uint64_t) bm->nbits + ninodes > (uint64_t) bm->nblocks * FS_BLOCK_SIZE * BITS_PER_BYTE)
+	{
+		return FUNC_ERROR; /* no room left in the inode bitmap */
+	}
+	struct fs_extent ext;
+	if(fs.incore->ichunks == NULL) {
+		fs.incore->ichunks = disk_alloc_blocks(1);
+		if(fs.incore->ichunks == NULL) {
+			fprintf(stderr, "fs_add_ichunk: disk_alloc_blocks\n");
+			return FUNC_ERROR;
+		}
+		memset(fs.incore->ichunks, 0, FS_BLOCK_SIZE);
+		if(fs_alloc_extents(fs, sb, 1, 1, &ext, 1) < 0) {
+			fprintf(stderr, "fs_add_ichunk: can't allocate the chunk map\n");
+			free(fs.incore->ichunks);
+			fs.incore->ichunks = NULL;
+			return FUNC_ERROR;
+		}
+		/* the superblock never points at a map block that was not written */
+		if(fs_write_block(fs, fs_data_blocknum(sb, ext.start), fs.incore->ichunks,
+						  FS_BLOCK_SIZE) < 0)
+		{
+			fprintf(stderr, "fs_add_ichunk: can't write the chunk map\n");
+			fs_free_data(fs, sb, ext.start);
+			free(fs.incore->ichunks);
+			fs.incore->ichunks = NULL;
+			return FUNC_ERROR;
+		}
+		sb->ichunk_map = ext.start;
+	}
+	/* the chunks are kept at the start of the data section */
+	if(fs_alloc_extents(fs, sb, 1, FS_ICHUNK_BLOCKS, &ext, 1) < 0) {
+		fprintf(stderr, "fs_add_ichunk: can't allocate the chunk\n");
 		return FUNC_ERROR;
 	}
+	fs.incore->ichunks->pointers[sb->ichunk_count] = ext.start;
+	if(fs_zero_blocks(fs, fs_data_blocknum(sb, ext.start), FS_ICHUNK_BLOCKS) < 0 ||
+	   fs_write_block(fs, fs_data_blocknum(sb, sb->ichunk_map), fs.incore->ichunks,
+					  FS_BLOCK_SIZE) < 0)
+	{
+		/* the chunk is given back, it is not in the map */
+		fprintf(stderr, "fs_add_ichunk: can't write the chunk\n");
+		fs.incore->ichunks->pointers[sb->ichunk_count] = 0;
+		uint32_t blks[FS_ICHUNK_BLOCKS];
+		for(uint32_t i=0; i<FS_ICHUNK_BLOCKS; i++) {
+			blks[i] = ext.start + i;
+		}
+		fs_free_data_batch(fs, sb, blks, FS_ICHUNK_BLOCKS);
+		return FUNC_ERROR;
+	}
+	sb->ichunk_count++;
+	bm->nbits += ninodes;
+	sb->free_inode_count += ninodes;
+	return fs_mark_super_dirty(fs);
+}
 
-	uint32_t start = super->inode_bitmap_loc;
-	uint32_t end = super->inode_bitmap_loc + super->inode_bitmap_size;
+/**
+ * @brief allocate an inode near another one
+ * @details with groups, the first free inode of the group of *goal* (eg.
+ * the parent directory) is taken, the next groups are searched if it is
+ * full. without groups or without goal, same as fs_alloc_inode.
+ * @arg goal: the inode the new inode should be close to, or FS_NO_INODE
+ * @arg inodenum: the inode number allocated
+ */
+int fs_alloc_inode_near(struct fs_filesyst fs, struct fs_super_block* super, uint32_t goal,
+						uint32_t *inodenum)
+{
+	struct fs_super_block* sb = fs_get_super(fs);
+	if(sb == NULL || fs_load_bitmaps(fs) < 0) {
+		fprintf(stderr, "fs_alloc_inode: fs_load_bitmaps!\n");
+		return FUNC_ERROR;
+	}
+	if(sb->free_inode_count == 0 && fs_add_ichunk(fs, sb) < 0){
+		fprintf(stderr, "fs_alloc_inode: no space left!\n");
+		return FUNC_ERROR;
+	}
 	if(inodenum == NULL){
 		fprintf(stderr, "fs_alloc_inode: invalid inodenum!\n");
 		return FUNC_ERROR;		
 	}
 
-	if(end <= start) {
-		fprintf(stderr, "fs_alloc_inode: invalid bitmap blocks!\n");
-		return FUNC_ERROR;
-	}
-	
-	int found = 0;
-	uint32_t off; /* offset of the first null bit in the first block containing one */
-	uint32_t blknum;
-	union fs_block blk;
-	/* parse the inode bitmap and look for the first bit in the first block that is free */
-	for(blknum=start; blknum<end && found==0; blknum++) {
-		/* read the block */
-		if(fs_read_block(fs, blknum, &blk) < 0) {
-			fprintf(stderr, "fs_alloc_inode: fs_read_block!\n");
-			return FUNC_ERROR;
+	struct fs_bitmap* bm = &fs.incore->inode_map;
+	uint32_t indno;
+	if(sb->group_blocks && goal < bm->nbits) {
+		uint32_t first = goal - goal % FS_GROUP_BITS;
+		indno = bitmap_find_zero(bm, first, bm->nbits);
+		if(indno == BITMAP_NONE) {
+			indno = bitmap_find_zero(bm, 0, first);
 		}
-		/* parse the block for a null bit */
-		for(int i=0; i<FS_BLOCK_SIZE && found==0; i++) {
-			uint8_t byte = blk.data[i];
-			if(byte != 255) {
-				off = 0;
-				uint8_t temp = byte;
-				while(temp) { /* to get the first one */
-					temp >>= 1;
-					off ++;
-				}
-				/* calculate the marked byte */
-				uint8_t marked_byte = 1;
-				marked_byte <<= off;
-				marked_byte |= byte;
-				off += i * 8; /* add the offset of the byte location in the block */
-				found = 1;
-				/* mark as read */
-				blk.data[i] = marked_byte;
-				
-				/* write to disk */
-				if(fs_write_block(fs, blknum, &blk, FS_BLOCK_SIZE) < 0) {
-					fprintf(stderr, "fs_alloc_inode: fs_write_block!\n");
-					return FUNC_ERROR;
-				}
-			}
+		if(indno != BITMAP_NONE) {
+			bitmap_set(bm, indno);
 		}
+	} else if(bitmap_alloc(bm, &indno, 1) != 1) {
+		indno = BITMAP_NONE;
 	}
-	
-	/* real inode offset in blocks from super->inode_loc */
-	uint32_t indno = ((blknum - start - 1) * FS_BLOCK_SIZE * BITS_PER_BYTE) + off;
-	*inodenum = indno;
-
-	uint32_t blkno = indno / FS_INODES_PER_BLOCK;
-
-	if(!found || blkno >= super->inode_count) {
+	if(indno == BITMAP_NONE) {
 		fprintf(stderr, "fs_alloc_inode: no space left\n");
 		return FUNC_ERROR;
 	}
-	
+	*inodenum = indno;
+
 	struct fs_inode nilino = {0};
-	if(fs_write_inode(fs, *super, indno, &nilino) < 0) {
+	if(fs_write_inode(fs, *sb, indno, &nilino) < 0) {
 		fprintf(stderr, "fs_alloc_inode: can't reinit value\n");
+		bitmap_clear(bm, indno);
 		return FUNC_ERROR;
 	}
-	super->free_inode_count--;
+	fs_group_count(fs, bm, indno, -1);
+	sb->free_inode_count--;
+	super->free_inode_count = sb->free_inode_count;
 
-	/* write to disk */
-	if(fs_write_block(fs, 0, super, sizeof(*super)) < 0) {
-		fprintf(stderr, "fs_alloc_inode: fs_write_block!\n");
+	/* the bitmap and block 0 are written later */
+	if(fs_mark_super_dirty(fs) < 0) {
+		fprintf(stderr, "fs_alloc_inode: fs_mark_super_dirty!\n");
 		return FUNC_ERROR;
 	}
 	return 0;
@@ -306,6 +1183,8 @@ int fs_alloc_inode(struct fs_filesyst fs, struct fs_super_block* super, uint32_t
 
 /**
  * @brief writes an inode struct into an inode block location
+ * @details with the inode cache, only the in-core inode is updated, the
+ * inode table is written by fs_sync
  */
 int fs_write_inode(struct fs_filesyst fs, struct fs_super_block super,
 				   uint32_t indno, struct fs_inode *inode)
@@ -314,13 +1193,16 @@ int fs_write_inode(struct fs_filesyst fs, struct fs_super_block super,
 		fprintf(stderr, "fs_read_inode: invalid arguments!\n");
 		return FUNC_ERROR;
 	}
+	if(inode->flags && !fs_has_inode_flags(&fs.incore->super)) {
+		fprintf(stderr, "fs_write_inode: the inode table can't store the inode flags\n");
+		return FUNC_ERROR;
+	}
+	if(fs.incore->icache) {
+		return icache_write(fs.incore->icache, fs, indno, inode);
+	}
 
-	uint32_t blkno = indno / FS_INODES_PER_BLOCK;
 	/* getting the real block offset from the start */
-	blkno += super.inode_loc;
-	
-	/* offset in the block containing the inode */
-	uint8_t indoff = indno % FS_INODES_PER_BLOCK;
+	uint32_t blkno = fs_inode_block(fs, indno);
 	
 	//~ /* reading the block containing the inode */
 	union fs_block iblk;
@@ -329,7 +1211,7 @@ int fs_write_inode(struct fs_filesyst fs, struct fs_super_block super,
 		return FUNC_ERROR;
 	}
 	//~ /* setting the inode in the block */
-	iblk.inodes[indoff] = *inode;
+	fs_inode_encode(&fs.incore->super, &iblk, indno, inode);
 	
 	/* writing changes to disk */
 	if(fs_write_block(fs, blkno, &iblk, FS_BLOCK_SIZE) < 0) {
@@ -343,6 +1225,8 @@ int fs_write_inode(struct fs_filesyst fs, struct fs_super_block super,
 /**
  * @brief reads an inode from the inode table and puts its content 
  * in a the inode struct
+ * @details with the inode cache, the inode table is only read the first
+ * time the inode is used
  */
 int fs_read_inode(struct fs_filesyst fs, struct fs_super_block super,
 				   uint32_t indno, struct fs_inode *inode)
@@ -351,13 +1235,12 @@ int fs_read_inode(struct fs_filesyst fs, struct fs_super_block super,
 		fprintf(stderr, "fs_read_inode: invalid arguments!\n");
 		return FUNC_ERROR;
 	}
+	if(fs.incore->icache) {
+		return icache_read(fs.incore->icache, fs, indno, inode);
+	}
 	
-	uint32_t blkno = indno / FS_INODES_PER_BLOCK;
 	/* getting the real block offset from the start */
-	blkno += super.inode_loc;
-	
-	/* offset in the block containing the inode */
-	uint8_t indoff = indno % FS_INODES_PER_BLOCK;
+	uint32_t blkno = fs_inode_block(fs, indno);
 	
 	/* reading the block containing the inode */
 	union fs_block iblk;
@@ -366,26 +1249,97 @@ int fs_read_inode(struct fs_filesyst fs, struct fs_super_block super,
 		return FUNC_ERROR;
 	}
 	/* setting the inode in the block */
-	*inode = iblk.inodes[indoff];
+	fs_inode_decode(&fs.incore->super, &iblk, indno, inode);
 	
 	return 0;
 }
 
 /**
- * @brief dump (print) the content of the inode 
+ * @brief takes a reference on an inode
+ * @details the inode is kept in memory until the matching fs_iput (eg.
+ * while a file descriptor is open on it). without the inode cache this
+ * only checks that the inode is allocated.
  */
-int fs_dump_inode(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum) {
-	uint32_t blkno = inodenum / FS_INODES_PER_BLOCK + super.inode_loc;
-	uint8_t indoff = inodenum % FS_INODES_PER_BLOCK;
-	
-	union fs_block blk;
-	if(fs_read_block(fs, blkno, &blk) < 0) {
-		fprintf(stderr, "fd_dump_super: dump failed, cannot read!\n");
+int fs_iget(struct fs_filesyst fs, uint32_t indno) {
+	struct fs_super_block* sb = fs_get_super(fs);
+	if(sb == NULL || fs_is_inode_allocated(fs, *sb, indno) != 1) {
+		fprintf(stderr, "fs_iget: inode %u is not allocated!\n", indno);
 		return FUNC_ERROR;
 	}
-	
+	if(fs.incore->icache) {
+		return icache_get(fs.incore->icache, fs, indno);
+	}
+	return 0;
+}
+
+/**
+ * @brief releases a reference taken by fs_iget
+ */
+void fs_iput(struct fs_filesyst fs, uint32_t indno) {
+	if(fs.incore && fs.incore->icache) {
+		icache_put(fs.incore->icache, indno);
+	}
+}
+
+/**
+ * @brief sets the no of inodes kept in memory
+ * @details the dirty inodes of the current cache are written first, 0
+ * disables the cache (the inode table is read and written at each access)
+ */
+int fs_icache_init(struct fs_filesyst fs, size_t ninodes) {
+	if(fs.incore == NULL) {
+		fprintf(stderr, "fs_icache_init: filesystem not opened\n");
+		return FUNC_ERROR;
+	}
+	if(fs.incore->icache) {
+		if(icache_flush(fs.incore->icache, fs) < 0) {
+			fprintf(stderr, "fs_icache_init: icache_flush\n");
+			return FUNC_ERROR;
+		}
+		icache_destroy(fs.incore->icache);
+		fs.incore->icache = NULL;
+	}
+	if(ninodes == 0) {
+		return 0;
+	}
+	fs.incore->icache = icache_create(ninodes);
+	if(fs.incore->icache == NULL) {
+		fprintf(stderr, "fs_icache_init: icache_create\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief gets the counters of the inode cache
+ * @details all the counters are 0 without inode cache
+ */
+void fs_icache_stats(struct fs_filesyst fs, struct fs_icache_stats* stats) {
+	if(fs.incore && fs.incore->icache) {
+		*stats = fs.incore->icache->stats;
+	} else {
+		memset(stats, 0, sizeof(*stats));
+	}
+}
+
+/**
+ * @brief dump (print) the content of the inode 
+ */
+int fs_dump_inode(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum) {
 	struct fs_inode ind;
-	ind = blk.inodes[indoff];
+	if(fs.incore && fs.incore->icache) {
+		if(icache_read(fs.incore->icache, fs, inodenum, &ind) < 0) {
+			fprintf(stderr, "fd_dump_super: dump failed, cannot read!\n");
+			return FUNC_ERROR;
+		}
+	} else {
+		union fs_block blk;
+		if(fs_read_block(fs, fs_inode_block(fs, inodenum), &blk) < 0) {
+			fprintf(stderr, "fd_dump_super: dump failed, cannot read!\n");
+			return FUNC_ERROR;
+		}
+		fs_inode_decode(&super, &blk, inodenum, &ind);
+	}
 	
 	printf("Inode %d dump:\n", inodenum);
 	printf("mode: %d\n", ind.mode);
@@ -397,81 +1351,146 @@ int fs_dump_inode(struct fs_filesyst fs, struct fs_super_block super, uint32_t i
 	return 0;
 }
 
+/**
+ * @brief utility function to take a run of free bits of the data bitmap
+ * @return the no of extents used, *n* + 1
+ */
+static size_t fs_take_run(struct fs_bitmap* bm, uint32_t start, uint32_t len,
+						  struct fs_extent ext[], size_t n)
+{
+	bitmap_set_range(bm, start, len);
+	bm->cursor = (start + len < bm->nbits)? start + len: 0;
+	ext[n].start = start + 1; /* data block numbers start at 1 */
+	ext[n].len = len;
+	return n + 1;
+}
+
+/**
+ * @brief allocate contiguous runs of data blocks from the data section
+ * @details the first free run of *size* blocks from the goal (wrapping
+ * around) is taken. if there is none, the longest free runs are taken
+ * first so that the blocks are split into the fewest possible extents.
+ * @param goal    the data block number where the search starts, 0 to
+ *                start after the last allocated block
+ * @param size    the number of blocks to allocate
+ * @param ext     the allocated extents, in the order they must be used
+ * @param max_ext the max no of extents of *ext*
+ * @return the no of extents or -1 on error (nothing is allocated)
+ */
+int fs_alloc_extents(struct fs_filesyst fs, struct fs_super_block* super, uint32_t goal,
+					 size_t size, struct fs_extent ext[], size_t max_ext)
+{
+	struct fs_super_block* sb = fs_get_super(fs);
+	if(sb == NULL || fs_load_bitmaps(fs) < 0) {
+		fprintf(stderr, "fs_alloc_extents: fs_load_bitmaps!\n");
+		return FUNC_ERROR;
+	}
+	/* param check */
+	if(ext == NULL || size <= 0 || max_ext <= 0) {
+		fprintf(stderr, "fs_alloc_extents: invalid arguments!\n");
+		return FUNC_ERROR;
+	}
+	if(sb->free_data_count < size) {
+		fprintf(stderr, "fs_alloc_extents: no space left!\n");
+		return FUNC_ERROR;
+	}
+
+	struct fs_bitmap* bm = &fs.incore->data_map;
+	uint32_t cursor = bm->cursor;
+	uint32_t from = (goal > 0)? goal - 1: cursor;
+	if(from >= bm->nbits) {
+		from = 0;
+	}
+	uint32_t start = bitmap_find_run(bm, from, bm->nbits, size, NULL, NULL);
+	if(start == BITMAP_NONE) {
+		/* the run can end after the goal */
+		uint64_t end = (uint64_t) from + size - 1;
+		start = bitmap_find_run(bm, 0, (end < bm->nbits)? end: bm->nbits, size, NULL, NULL);
+	}
+	size_t n = 0;
+	if(start != BITMAP_NONE) {
+		n = fs_take_run(bm, start, size, ext, n);
+	} else {
+		/* fragmented: longest runs first */
+		size_t left = size;
+		while(left > 0) {
+			uint32_t best, len;
+			start = bitmap_find_run(bm, 0, bm->nbits, left, &best, &len);
+			if(start != BITMAP_NONE) {
+				len = left;
+			}
+			if(len == 0 || n == max_ext) {
+				for(size_t i=0; i<n; i++) {
+					bitmap_clear_range(bm, ext[i].start - 1, ext[i].len);
+				}
+				bm->cursor = cursor;
+				fprintf(stderr, "fs_alloc_extents: no space left!\n");
+				return FUNC_ERROR;
+			}
+			n = fs_take_run(bm, best, len, ext, n);
+			left -= len;
+		}
+	}
+	for(size_t i=0; i<n; i++) {
+		fs_group_count(fs, bm, ext[i].start - 1, -(int) ext[i].len);
+	}
+	sb->free_data_count -= size;
+	super->free_data_count = sb->free_data_count;
+
+	/* the bitmap and block 0 are written later */
+	if(fs_mark_super_dirty(fs) < 0) {
+		fprintf(stderr, "fs_alloc_extents: fs_mark_super_dirty!\n");
+		return FUNC_ERROR;
+	}
+	return n;
+}
+
 /**
  * @brief allocate multiple data blocks from the data section
+ * @details the blocks are allocated as extents (see fs_alloc_extents),
+ * they are returned in increasing order inside each extent so that they
+ * are contiguous whenever possible
  * @param data      the array of data block pointers (numbers)
  * @param size      the number of blocks to allocate
  */
 int fs_alloc_data(struct fs_filesyst fs, struct fs_super_block* super, uint32_t data[], size_t size) {
-	/* todo: remove super from argument (read from file directly) and write at the end */
-	if(super->free_data_count < size) {
-		fprintf(stderr, "fs_alloc_data: no space left!\n");
-		return FUNC_ERROR;
-	}
 	/* param check */
 	if(data == NULL || size <= 0) {
 		fprintf(stderr, "fs_alloc_data: invalid arguments!\n");
 		return FUNC_ERROR;
 	}
-
-	uint32_t start = super->data_bitmap_loc;
-	uint32_t end = super->data_bitmap_loc + super->data_bitmap_size;
-	if(end <= start) {
-		fprintf(stderr, "fs_alloc_data: invalid bitmap blocks!\n");
+	struct fs_extent* ext = malloc(sizeof(struct fs_extent) * size);
+	if(ext == NULL) {
+		perror("fs_alloc_data: malloc");
 		return FUNC_ERROR;
 	}
-	
-	int left = size;
-	uint32_t off; /* offset of the first null bit in the first block containing one */
-	uint32_t blknum;
-	union fs_block blk;
-	/* parse the data bitmap and look for the first bit in the first block that is free */
-	for(blknum=start; blknum<end && left>0; blknum++) {
-		/* read the block */
-		if(fs_read_block(fs, blknum, &blk) < 0) {
-			fprintf(stderr, "fs_alloc_data: fs_read_block!\n");
-			return FUNC_ERROR;
-		}
-		/* parse the block for a null bit */
-		for(int i=0; i<FS_BLOCK_SIZE && left>0; i++) {
-			uint8_t byte = blk.data[i];
-			if(byte != 255) {
-				off = 0;
-				uint8_t temp = byte;
-				while(temp) { /* to get the first one */
-					temp >>= 1;
-					off ++;
-				}
-				/* calculate the marked byte */
-				uint8_t marked_byte = 1;
-				marked_byte <<= off;
-				marked_byte |= byte;
-				off += i * 8; /* add the offset of the byte location in the block */
-				/* mark as read */
-				blk.data[i] = marked_byte;
-
-				left --;
-				data[left] = ((blknum - start) * FS_BLOCK_SIZE * BITS_PER_BYTE) + off + 1;
-				/* todo: add test to check if we surpassed the capacity */
-				
-				/* write to disk */
-				if(fs_write_block(fs, blknum, &blk, FS_BLOCK_SIZE) < 0) {
-					fprintf(stderr, "fs_alloc_data: fs_write_block!\n");
-					return FUNC_ERROR;
-				}
-				if(byte != 255 && left != 0) {
-					i--;
-				}
-			}
+	int n = fs_alloc_extents(fs, super, 0, size, ext, size);
+	if(n < 0) {
+		free(ext);
+		fprintf(stderr, "fs_alloc_data: fs_alloc_extents!\n");
+		return FUNC_ERROR;
+	}
+	size_t k = 0;
+	for(int i=0; i<n; i++) {
+		for(uint32_t j=0; j<ext[i].len; j++) {
+			data[k++] = ext[i].start + j;
 		}
 	}
-	super->free_data_count -= size;
+	free(ext);
+	return 0;
+}
 
-	/* write to disk */
-	if(fs_write_block(fs, 0, super, sizeof(*super)) < 0) {
-		fprintf(stderr, "fs_alloc_data: fs_write_block!\n");
+/**
+ * @brief free space statistics of the data section
+ * @details read from the free-extent index in O(1), the fragmentation
+ * of the free space is given by its no of extents and the longest one
+ */
+int fs_data_frag(struct fs_filesyst fs, struct freeidx_stats* st) {
+	if(fs_load_bitmaps(fs) < 0) {
+		fprintf(stderr, "fs_data_frag: fs_load_bitmaps!\n");
 		return FUNC_ERROR;
 	}
+	freeidx_stats(&fs.incore->data_map, st);
 	return 0;
 }
 
@@ -479,118 +1498,237 @@ int fs_alloc_data(struct fs_filesyst fs, struct fs_super_block* super, uint32_t
  * @brief free an inode from the inode bitmap
  */
 int fs_free_inode(struct fs_filesyst fs, struct fs_super_block* super, uint32_t inodenum){
-	uint32_t blkno = inodenum / (FS_INODES_PER_BLOCK * FS_BLOCK_SIZE) + super->inode_bitmap_loc;
-	union fs_block blk;
-	if(fs_read_block(fs, blkno, &blk)) {
-		fprintf(stderr, "fs_free_inode: fs_read_block!\n");
+	struct fs_super_block* sb = fs_get_super(fs);
+	if(sb == NULL || fs_load_bitmaps(fs) < 0) {
+		fprintf(stderr, "fs_free_inode: fs_load_bitmaps!\n");
 		return FUNC_ERROR;
 	}
-	uint32_t blkoff = inodenum % (BITS_PER_BYTE * FS_BLOCK_SIZE);
-	uint32_t byteoff = blkoff % 8;
-
-	uint8_t byte = blk.data[blkoff/8];
-	uint8_t unmarked_byte = 1;
-	unmarked_byte <<=  byteoff;
-	unmarked_byte = ~unmarked_byte;
-	unmarked_byte &= byte;
-	
-	blk.data[blkoff/8] = unmarked_byte;
-	super->free_inode_count++;
-	
-	/* write to disk */
-	if(fs_write_block(fs, blkno, &blk, FS_BLOCK_SIZE) < 0) {
-		fprintf(stderr, "fs_free_inode: fs_write_block!\n");
+	struct fs_bitmap* bm = &fs.incore->inode_map;
+	if(!fs_inode_exists(sb, bm, inodenum) || !bitmap_test(bm, inodenum)) {
+		fprintf(stderr, "fs_free_inode: inode %u is not allocated!\n", inodenum);
 		return FUNC_ERROR;
 	}
-	if(fs_write_block(fs, 0, super, sizeof(*super)) < 0) {
-		fprintf(stderr, "fs_free_inode: fs_write_block!\n");
-		return FUNC_ERROR;	
+	bitmap_clear(bm, inodenum);
+	fs_group_count(fs, bm, inodenum, 1);
+	if(fs.incore->icache) {
+		icache_forget(fs.incore->icache, inodenum); /* its content is not written back */
 	}
-	return 0;
+
+	sb->free_inode_count++;
+	super->free_inode_count = sb->free_inode_count;
+	return fs_mark_super_dirty(fs);
 }
 
 /**
  * @brief free a data block from the data bitmap
  */
 int fs_free_data(struct fs_filesyst fs, struct fs_super_block* super, uint32_t datanum) {
-	datanum --;
-	uint32_t blkno = datanum / (BITS_PER_BYTE * FS_BLOCK_SIZE) + super->data_bitmap_loc;
-	union fs_block blk;
-	if(fs_read_block(fs, blkno, &blk)) {
-		fprintf(stderr, "fs_free_inode: fs_read_block!\n");
+	struct fs_super_block* sb = fs_get_super(fs);
+	if(sb == NULL || fs_load_bitmaps(fs) < 0) {
+		fprintf(stderr, "fs_free_data: fs_load_bitmaps!\n");
 		return FUNC_ERROR;
 	}
-	uint32_t blkoff = datanum % (BITS_PER_BYTE * FS_BLOCK_SIZE);
-	uint32_t byteoff = blkoff % 8;
+	struct fs_bitmap* bm = &fs.incore->data_map;
+	if(!fs_data_exists(sb, bm, datanum) || !bitmap_test(bm, datanum - 1)) {
+		fprintf(stderr, "fs_free_data: data block %u is not allocated!\n", datanum);
+		return FUNC_ERROR;
+	}
+	bitmap_clear(bm, datanum - 1);
+	fs_group_count(fs, bm, datanum - 1, 1);
 
-	uint8_t byte = blk.data[blkoff/8];
-	uint8_t unmarked_byte = 1;
-	unmarked_byte <<= byteoff;
-	unmarked_byte = ~unmarked_byte;
-	unmarked_byte &= byte;
-	
-	blk.data[blkoff/8] = unmarked_byte;
-	super->free_data_count++;
-	
-	/* write to disk */
-	if(fs_write_block(fs, blkno, &blk, FS_BLOCK_SIZE) < 0) {
-		fprintf(stderr, "fs_free_inode: fs_write_block!\n");
+	sb->free_data_count++;
+	super->free_data_count = sb->free_data_count;
+	return fs_mark_super_dirty(fs);
+}
+
+/**
+ * @brief starts a batch of data block frees
+ * @details the blocks given to fs_free_data_batch are only freed by the
+ * outermost fs_free_end, all together. batches can be nested.
+ */
+void fs_free_begin(struct fs_filesyst fs) {
+	fs.incore->free_batch++;
+}
+
+/**
+ * @brief utility function to compare two data block numbers (for qsort)
+ */
+static int fs_cmp_datanum(const void* a, const void* b) {
+	uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * @brief ends a batch of data block frees
+ * @details at the outermost call the pending blocks are sorted, so that
+ * the bits of each bitmap block are cleared in a single pass (a whole
+ * run of contiguous blocks at once), and the counters are updated once.
+ * @return 0 on success, -1 if a block was given twice
+ */
+int fs_free_end(struct fs_filesyst fs, struct fs_super_block* super) {
+	struct fs_incore* incore = fs.incore;
+	if(incore->free_batch == 0 || --incore->free_batch > 0 || incore->npending == 0) {
+		return 0;
+	}
+	struct fs_super_block* sb = fs_get_super(fs);
+	if(sb == NULL) {
+		fprintf(stderr, "fs_free_end: fs_get_super!\n");
 		return FUNC_ERROR;
 	}
-	if(fs_write_block(fs, 0, super, sizeof(*super)) < 0) {
-		fprintf(stderr, "fs_free_inode: fs_write_block!\n");
-		return FUNC_ERROR;	
+	uint32_t* blks = incore->pending;
+	size_t n = incore->npending;
+	incore->npending = 0;
+	qsort(blks, n, sizeof(uint32_t), fs_cmp_datanum);
+
+	int ret = 0;
+	uint32_t freed = 0;
+	for(size_t i=0; i<n;) {
+		if(i > 0 && blks[i] == blks[i-1]) {
+			fprintf(stderr, "fs_free_end: data block %u is freed twice!\n", blks[i]);
+			ret = FUNC_ERROR;
+			i++;
+			continue;
+		}
+		size_t len = 1;
+		while(i + len < n && blks[i+len] == blks[i] + len) {
+			len++;
+		}
+		bitmap_clear_range(&incore->data_map, blks[i] - 1, len);
+		fs_group_count(fs, &incore->data_map, blks[i] - 1, len);
+		freed += len;
+		i += len;
 	}
-	return 0;
+	sb->free_data_count += freed;
+	super->free_data_count = sb->free_data_count;
+	if(fs_mark_super_dirty(fs) < 0) {
+		fprintf(stderr, "fs_free_end: fs_mark_super_dirty!\n");
+		return FUNC_ERROR;
+	}
+	return ret;
+}
+
+/**
+ * @brief free a list of data blocks from the data bitmap
+ * @details the blocks are checked then freed by fs_free_end, at the end
+ * of the current batch or right away if no batch is started
+ * @param data  the data block numbers, in any order
+ * @param count the no of blocks
+ */
+int fs_free_data_batch(struct fs_filesyst fs, struct fs_super_block* super,
+					   const uint32_t data[], size_t count)
+{
+	struct fs_super_block* sb = fs_get_super(fs);
+	if(sb == NULL || fs_load_bitmaps(fs) < 0) {
+		fprintf(stderr, "fs_free_data_batch: fs_load_bitmaps!\n");
+		return FUNC_ERROR;
+	}
+	struct fs_incore* incore = fs.incore;
+	struct fs_bitmap* bm = &incore->data_map;
+	for(size_t i=0; i<count; i++) {
+		if(!fs_data_exists(sb, bm, data[i]) || !bitmap_test(bm, data[i] - 1)) {
+			fprintf(stderr, "fs_free_data_batch: data block %u is not allocated!\n", data[i]);
+			return FUNC_ERROR;
+		}
+	}
+	if(incore->npending + count > incore->pending_cap) {
+		size_t cap = incore->pending_cap * 2 + count;
+		uint32_t* pending = realloc(incore->pending, sizeof(uint32_t) * cap);
+		if(pending == NULL) {
+			perror("fs_free_data_batch: realloc");
+			return FUNC_ERROR;
+		}
+		incore->pending = pending;
+		incore->pending_cap = cap;
+	}
+	memcpy(incore->pending + incore->npending, data, sizeof(uint32_t) * count);
+	incore->npending += count;
+
+	fs_free_begin(fs);
+	return fs_free_end(fs, super);
+}
+
+/**
+ * @brief utility function to get the length of a run of contiguous blocks
+ * @details counts how many data block numbers of *blknums* following
+ * the first one are physically adjacent, the run is bounded to
+ * DISK_MAX_IOV blocks
+ */
+static size_t fs_contiguous_run(uint32_t *blknums, size_t size) {
+	size_t n = 1;
+	while(n < size && n < DISK_MAX_IOV && blknums[n] == blknums[n-1] + 1) {
+		n++;
+	}
+	return n;
 }
 
 /**
  * @brief write multiple data blocks into the data section
+ * @details the runs of physically contiguous blocks are written with a
+ * single vectored write, with io_uring all the runs are in flight at the
+ * same time
  * @param blknums   the array of data block pointers (numbers)
  * @param size      the number of blocks to write
- * @param data      the array of data to write
+ * @param data      the data to write, *size* blocks (no alignment needed)
  */
 int fs_write_data(struct fs_filesyst fs, struct fs_super_block super,
-				  union fs_block *data, uint32_t *blknums, size_t size)
+				  const void *data, uint32_t *blknums, size_t size)
 {
 	if(data == NULL || blknums == NULL) {
 		fprintf(stderr, "fs_write_data: invalid arguments!\n");
 		return FUNC_ERROR;
 	}
 	
-	for(int i=0; i<size; i++) {
-		uint32_t blknum = blknums[i] - 1 + super.data_loc;
-		union fs_block* d = data + i;
-		//~ printf("%d\n", blknums[i]);
-		if(fs_write_block(fs, blknum, d, FS_BLOCK_SIZE) < 0) {
-			fprintf(stderr, "fs_write_data: fs_write_block\n");
-			return FUNC_ERROR;
+	const void* blks[DISK_MAX_IOV];
+	int ret = 0;
+	disk_plug(fs);
+	for(size_t i=0; ret == 0 && i<size;) {
+		size_t n = fs_contiguous_run(blknums + i, size - i);
+		uint32_t blknum = fs_data_blocknum(&super, blknums[i]);
+		for(size_t j=0; j<n; j++) {
+			blks[j] = (const uint8_t*) data + (i + j) * FS_BLOCK_SIZE;
 		}
+		ret = fs_write_blocks(fs, blknum, n, blks);
+		i += n;
+	}
+	if(disk_unplug(fs) < 0 || ret < 0) {
+		fprintf(stderr, "fs_write_data: fs_write_blocks\n");
+		return FUNC_ERROR;
 	}
 	return 0;
 }
 
 /**
  * @brief read multiple data blocks into the data section
+ * @details the runs of physically contiguous blocks are read with a
+ * single vectored read, with io_uring all the runs are in flight at the
+ * same time
  * @param blknums   the array of data block pointers (numbers)
  * @param size      the number of blocks to read
- * @param data      the array of data to read
+ * @param data      the buffer of *size* blocks to read into (no alignment needed)
  */
 int fs_read_data(struct fs_filesyst fs, struct fs_super_block super,
-				 union fs_block *data, uint32_t *blknums, size_t size)
+				 void *data, uint32_t *blknums, size_t size)
 {
 	if(data == NULL || blknums == NULL) {
 		fprintf(stderr, "fs_read_data: invalid arguments!\n");
 		return FUNC_ERROR;
 	}
 	
-	for(int i=0; i<size; i++) {
-		uint32_t blknum = blknums[i] - 1 + super.data_loc;
-		union fs_block* d = data + i;
-		if(fs_read_block(fs, blknum, d) < 0) {
-			fprintf(stderr, "fs_read_data: fs_read_block\n");
-			return FUNC_ERROR;
+	void* blks[DISK_MAX_IOV];
+	int ret = 0;
+	disk_plug(fs);
+	for(size_t i=0; ret == 0 && i<size;) {
+		size_t n = fs_contiguous_run(blknums + i, size - i);
+		uint32_t blknum = fs_data_blocknum(&super, blknums[i]);
+		for(size_t j=0; j<n; j++) {
+			blks[j] = (uint8_t*) data + (i + j) * FS_BLOCK_SIZE;
 		}
+		ret = fs_read_blocks(fs, blknum, n, blks);
+		i += n;
+	}
+	if(disk_unplug(fs) < 0 || ret < 0) {
+		fprintf(stderr, "fs_read_data: fs_read_blocks\n");
+		return FUNC_ERROR;
 	}
 	return 0;
 }
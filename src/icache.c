@@ -0,0 +1,401 @@
+/**
+ * @file icache.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief in-core inode cache
+ * @details keeps the most recently used inodes in memory, the updates of
+ * an inode are kept in memory (dirty) and the inode table is only written
+ * on eviction or when the cache is flushed, once per dirty inode
+ */
+#include <devutils.h>
+#include <fs.h>
+#include <icache.h>
+
+#include <string.h>
+#include <stdio.h>
+
+/**
+ * @brief utility function to get the hash bucket of an inode number
+ */
+static size_t icache_hash(struct fs_icache* ic, uint32_t inodenum) {
+	return (inodenum * 2654435761u) & (ic->nbuckets - 1);
+}
+
+/**
+ * @brief utility function to remove an entry from the lru list
+ */
+static void icache_lru_unlink(struct fs_icache* ic, struct fs_icache_entry* e) {
+	if(e->prev) {
+		e->prev->next = e->next;
+	} else {
+		ic->lru_head = e->next;
+	}
+	if(e->next) {
+		e->next->prev = e->prev;
+	} else {
+		ic->lru_tail = e->prev;
+	}
+	e->prev = e->next = NULL;
+}
+
+/**
+ * @brief utility function to put an entry in front of the lru list
+ */
+static void icache_lru_push(struct fs_icache* ic, struct fs_icache_entry* e) {
+	e->prev = NULL;
+	e->next = ic->lru_head;
+	if(ic->lru_head) {
+		ic->lru_head->prev = e;
+	}
+	ic->lru_head = e;
+	if(ic->lru_tail == NULL) {
+		ic->lru_tail = e;
+	}
+}
+
+/**
+ * @brief utility function to remove an entry from its hash chain
+ */
+static void icache_hash_unlink(struct fs_icache* ic, struct fs_icache_entry* e) {
+	struct fs_icache_entry** p = &ic->buckets[icache_hash(ic, e->inodenum)];
+	while(*p && *p != e) {
+		p = &(*p)->hnext;
+	}
+	if(*p) {
+		*p = e->hnext;
+	}
+	e->hnext = NULL;
+}
+
+/**
+ * @brief utility function to find the entry of an inode
+ * @return the entry or NULL if the inode is not cached
+ */
+static struct fs_icache_entry* icache_lookup(struct fs_icache* ic, uint32_t inodenum) {
+	struct fs_icache_entry* e = ic->buckets[icache_hash(ic, inodenum)];
+	while(e && e->inodenum != inodenum) {
+		e = e->hnext;
+	}
+	return e;
+}
+
+/**
+ * @brief utility function to read or write one inode of the inode table
+ * @details a write reads the block holding the inode, replaces the inode
+ * and writes the block back
+ */
+static int icache_table_io(struct fs_filesyst fs, uint32_t inodenum, struct fs_inode* inode,
+						   int write)
+{
+	uint32_t blkno = fs_inode_block(fs, inodenum);
+	union fs_block iblk;
+	if(fs_read_block(fs, blkno, &iblk) < 0) {
+		fprintf(stderr, "icache_table_io: fs_read_block!\n");
+		return FUNC_ERROR;
+	}
+	if(!write) {
+		fs_inode_decode(&fs.incore->super, &iblk, inodenum, inode);
+		return 0;
+	}
+	fs_inode_encode(&fs.incore->super, &iblk, inodenum, inode);
+	if(fs_write_block(fs, blkno, &iblk, FS_BLOCK_SIZE) < 0) {
+		fprintf(stderr, "icache_table_io: fs_write_block!\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief utility function to forget the content of an entry
+ * @details the entry is moved to the end of the lru list so that it is
+ * the next one to be reused
+ */
+static void icache_drop(struct fs_icache* ic, struct fs_icache_entry* e) {
+	icache_hash_unlink(ic, e);
+	icache_lru_unlink(ic, e);
+	e->inodenum = FS_NO_INODE;
+	e->refcount = 0;
+	e->dirty = 0;
+	e->prev = ic->lru_tail;
+	if(ic->lru_tail) {
+		ic->lru_tail->next = e;
+	} else {
+		ic->lru_head = e;
+	}
+	ic->lru_tail = e;
+}
+
+/**
+ * @brief utility function to get a free entry for the inode *inodenum*
+ * @details takes an unused entry if there is one, otherwise evicts the
+ * least recently used inode without references (writing it back if it
+ * is dirty)
+ * @return the entry or NULL if all the inodes are referenced or on error
+ */
+static struct fs_icache_entry* icache_get_entry(struct fs_icache* ic, struct fs_filesyst fs,
+												uint32_t inodenum)
+{
+	struct fs_icache_entry* e;
+	if(ic->used < ic->capacity) {
+		e = ic->entries + ic->used++;
+	} else {
+		e = ic->lru_tail;
+		while(e && e->refcount > 0) {
+			e = e->prev;
+		}
+		if(e == NULL) {
+			return NULL;
+		}
+		if(e->dirty) {
+			if(icache_table_io(fs, e->inodenum, &e->inode, 1) < 0) {
+				fprintf(stderr, "icache_get_entry: icache_table_io\n");
+				return NULL;
+			}
+			ic->stats.writebacks++;
+		}
+		icache_lru_unlink(ic, e);
+		if(e->inodenum != FS_NO_INODE) {
+			icache_hash_unlink(ic, e);
+			ic->stats.evictions++;
+		}
+	}
+	e->inodenum = inodenum;
+	e->refcount = 0;
+	e->dirty = 0;
+
+	size_t h = icache_hash(ic, inodenum);
+	e->hnext = ic->buckets[h];
+	ic->buckets[h] = e;
+	icache_lru_push(ic, e);
+	return e;
+}
+
+/**
+ * @brief utility function to get the entry of an inode, read if needed
+ * @return the entry or NULL if the inode can't be cached
+ */
+static struct fs_icache_entry* icache_entry(struct fs_icache* ic, struct fs_filesyst fs,
+											uint32_t inodenum)
+{
+	struct fs_icache_entry* e = icache_lookup(ic, inodenum);
+	if(e) {
+		ic->stats.hits++;
+		icache_lru_unlink(ic, e);
+		icache_lru_push(ic, e);
+		return e;
+	}
+	ic->stats.misses++;
+	e = icache_get_entry(ic, fs, inodenum);
+	if(e == NULL) {
+		return NULL;
+	}
+	if(icache_table_io(fs, inodenum, &e->inode, 0) < 0) {
+		fprintf(stderr, "icache_entry: icache_table_io\n");
+		icache_drop(ic, e);
+		return NULL;
+	}
+	return e;
+}
+
+/**
+ * @brief creates an inode cache
+ * @param capacity the maximum number of inodes kept in memory
+ * @return the cache or NULL in case of an error
+ */
+struct fs_icache* icache_create(size_t capacity) {
+	if(capacity == 0) {
+		fprintf(stderr, "icache_create: null capacity\n");
+		return NULL;
+	}
+	struct fs_icache* ic = calloc(1, sizeof(struct fs_icache));
+	if(ic == NULL) {
+		perror("icache_create: calloc");
+		return NULL;
+	}
+	ic->capacity = capacity;
+	/* the table size is a power of two bigger than the capacity */
+	ic->nbuckets = 1;
+	while(ic->nbuckets < capacity) {
+		ic->nbuckets <<= 1;
+	}
+	ic->entries = calloc(capacity, sizeof(struct fs_icache_entry));
+	ic->buckets = calloc(ic->nbuckets, sizeof(struct fs_icache_entry*));
+	if(ic->entries == NULL || ic->buckets == NULL) {
+		perror("icache_create: calloc");
+		icache_destroy(ic);
+		return NULL;
+	}
+	for(size_t i=0; i<capacity; i++) {
+		ic->entries[i].inodenum = FS_NO_INODE;
+	}
+	return ic;
+}
+
+/**
+ * @brief frees an inode cache
+ * @details the dirty inodes are lost, icache_flush has to be called before
+ */
+void icache_destroy(struct fs_icache* ic) {
+	if(ic == NULL) {
+		return;
+	}
+	free(ic->entries);
+	free(ic->buckets);
+	free(ic);
+}
+
+/**
+ * @brief reads an inode through the cache
+ * @details the inode table is only read if the inode is not already in
+ * memory. if all the cached inodes are referenced, the inode is read
+ * from the inode table without being cached.
+ */
+int icache_read(struct fs_icache* ic, struct fs_filesyst fs, uint32_t inodenum,
+				struct fs_inode* inode)
+{
+	struct fs_icache_entry* e = icache_entry(ic, fs, inodenum);
+	if(e == NULL) {
+		return icache_table_io(fs, inodenum, inode, 0);
+	}
+	*inode = e->inode;
+	return 0;
+}
+
+/**
+ * @brief writes an inode through the cache
+ * @details the in-core inode is replaced and marked as dirty, the inode
+ * table is only written on eviction or flush. if all the cached inodes
+ * are referenced, the inode is written to the inode table directly.
+ */
+int icache_write(struct fs_icache* ic, struct fs_filesyst fs, uint32_t inodenum,
+				 const struct fs_inode* inode)
+{
+	struct fs_icache_entry* e = icache_lookup(ic, inodenum);
+	if(e) {
+		ic->stats.hits++;
+		icache_lru_unlink(ic, e);
+		icache_lru_push(ic, e);
+	} else {
+		/* the whole inode is replaced, nothing to read */
+		ic->stats.misses++;
+		e = icache_get_entry(ic, fs, inodenum);
+		if(e == NULL) {
+			struct fs_inode copy = *inode;
+			return icache_table_io(fs, inodenum, &copy, 1);
+		}
+	}
+	e->inode = *inode;
+	e->dirty = 1;
+	return 0;
+}
+
+/**
+ * @brief takes a reference on an inode
+ * @details the inode is read if needed and stays in memory until the
+ * matching icache_put
+ */
+int icache_get(struct fs_icache* ic, struct fs_filesyst fs, uint32_t inodenum) {
+	struct fs_icache_entry* e = icache_entry(ic, fs, inodenum);
+	if(e == NULL) {
+		fprintf(stderr, "icache_get: can't keep inode %u in memory\n", inodenum);
+		return FUNC_ERROR;
+	}
+	e->refcount++;
+	return 0;
+}
+
+/**
+ * @brief releases a reference taken by icache_get
+ * @details the inode stays cached, it can be evicted once it has no
+ * references
+ */
+void icache_put(struct fs_icache* ic, uint32_t inodenum) {
+	struct fs_icache_entry* e = icache_lookup(ic, inodenum);
+	if(e && e->refcount > 0) {
+		e->refcount--;
+	}
+}
+
+/**
+ * @brief drops an inode from the cache
+ * @details used when the inode is freed, its dirty content is not
+ * written back
+ */
+void icache_forget(struct fs_icache* ic, uint32_t inodenum) {
+	struct fs_icache_entry* e = icache_lookup(ic, inodenum);
+	if(e) {
+		icache_drop(ic, e);
+	}
+}
+
+/**
+ * @brief drops all the inodes of the cache
+ * @details used when the filesystem is formatted, nothing is written back
+ */
+void icache_reset(struct fs_icache* ic) {
+	for(size_t i=0; i<ic->used; i++) {
+		if(ic->entries[i].inodenum != FS_NO_INODE) {
+			icache_drop(ic, ic->entries + i);
+		}
+	}
+}
+
+/**
+ * @brief utility function to sort entries by inode number
+ */
+static int icache_cmp_entries(const void* a, const void* b) {
+	const struct fs_icache_entry* ea = *(struct fs_icache_entry* const*) a;
+	const struct fs_icache_entry* eb = *(struct fs_icache_entry* const*) b;
+	return (ea->inodenum > eb->inodenum) - (ea->inodenum < eb->inodenum);
+}
+
+/**
+ * @brief writes all the dirty inodes to the inode table
+ * @details the inodes are written in increasing inode number order, the
+ * dirty inodes of the same inode table block are written together with
+ * one read and one write of the block
+ */
+int icache_flush(struct fs_icache* ic, struct fs_filesyst fs) {
+	struct fs_icache_entry** dirty = malloc(sizeof(struct fs_icache_entry*) * ic->used);
+	if(dirty == NULL && ic->used > 0) {
+		perror("icache_flush: malloc");
+		return FUNC_ERROR;
+	}
+	size_t ndirty = 0;
+	for(size_t i=0; i<ic->used; i++) {
+		if(ic->entries[i].inodenum != FS_NO_INODE && ic->entries[i].dirty) {
+			dirty[ndirty++] = ic->entries + i;
+		}
+	}
+	qsort(dirty, ndirty, sizeof(struct fs_icache_entry*), icache_cmp_entries);
+
+	const struct fs_super_block* super = &fs.incore->super;
+	union fs_block iblk;
+	for(size_t i=0; i<ndirty;) {
+		uint32_t blkno = fs_inode_block(fs, dirty[i]->inodenum);
+		size_t n = 1;
+		while(i+n < ndirty && fs_inode_block(fs, dirty[i+n]->inodenum) == blkno) {
+			n++;
+		}
+		if(fs_read_block(fs, blkno, &iblk) < 0) {
+			fprintf(stderr, "icache_flush: fs_read_block\n");
+			free(dirty);
+			return FUNC_ERROR;
+		}
+		for(size_t j=0; j<n; j++) {
+			fs_inode_encode(super, &iblk, dirty[i+j]->inodenum, &dirty[i+j]->inode);
+		}
+		if(fs_write_block(fs, blkno, &iblk, FS_BLOCK_SIZE) < 0) {
+			fprintf(stderr, "icache_flush: fs_write_block\n");
+			free(dirty);
+			return FUNC_ERROR;
+		}
+		for(size_t j=0; j<n; j++) {
+			dirty[i+j]->dirty = 0;
+			ic->stats.writebacks++;
+		}
+		i += n;
+	}
+	free(dirty);
+	return 0;
+}
@@ -41,6 +41,7 @@ int io_open_fd(uint32_t inodenum) {
 			filedesc_table.fds[i].is_allocated = 1;
 			filedesc_table.fds[i].offset = 0;
 			filedesc_table.fds[i].inodenum = inodenum;
+			filedesc_table.fds[i].pinned = 0;
 			return i;
 		}
 	}
@@ -62,10 +63,26 @@ int io_close_fd(int fd) {
 	return 0;
 }
 
+/**
+ * @brief closes a file descriptor opened with io_iopen
+ * @details releases the reference the fd holds on the in-core inode
+ */
+int io_close(struct fs_filesyst fs, int fd) {
+	if(fd < 0 || fd >= IO_MAX_FILEDESC) {
+		fprintf(stderr, "io_close: invalid file desciptor!\n");
+		return FUNC_ERROR;
+	}
+	if(filedesc_table.fds[fd].is_allocated && filedesc_table.fds[fd].pinned) {
+		fs_iput(fs, filedesc_table.fds[fd].inodenum);
+		filedesc_table.fds[fd].pinned = 0;
+	}
+	return io_close_fd(fd);
+}
+
 /**
  * @brief opens a new file without creating a new inode
  * @details tries to open the corresponding *inodenum* from the inode
- * table.
+ * table. the fd keeps the inode in memory until io_close.
  * @return returns the fd of the now open file in case of success, 
  * or -1 in case of failure
  */
@@ -78,18 +95,46 @@ int io_iopen(struct fs_filesyst fs, struct fs_super_block super, uint32_t inoden
 	}
 	/* to add modes and uid, gid, open modes*/
 	int fd = io_open_fd(inodenum);
-
+	if(fd >= 0 && !filedesc_table.fds[fd].pinned) {
+		if(fs_iget(fs, inodenum) < 0) {
+			fprintf(stderr, "io_open: fs_iget\n");
+			io_close_fd(fd);
+			return FUNC_ERROR;
+		}
+		filedesc_table.fds[fd].pinned = 1;
+	}
 	return fd;
 }
+
+/**
+ * @brief creates a new inode
+ * @details same as io_open_creat_in without parent directory
+ */
 int io_open_creat(struct fs_filesyst fs, struct fs_super_block super,
 						uint16_t mode, uint32_t* inodenum)
 {
-	if(fs_alloc_inode(fs, &super, inodenum) < 0) {
+	return io_open_creat_in(fs, super, FS_NO_INODE, mode, inodenum);
+}
+
+/**
+ * @brief creates a new inode in a directory
+ * @details the inode is allocated close to its parent directory *parent*
+ * (in its block group)
+ */
+int io_open_creat_in(struct fs_filesyst fs, struct fs_super_block super, uint32_t parent,
+					 uint16_t mode, uint32_t* inodenum)
+{
+	if(fs_alloc_inode_near(fs, &super, parent, inodenum) < 0) {
 		fprintf(stderr, "io_open: can't allocate inode!\n");
 		return FUNC_ERROR;
 	}
 	struct fs_inode ind = {0};
 	ind.mode = mode;
+	if(fs.incore->super.features & FS_FEATURE_INLINE_DATA) {
+		ind.flags |= FS_INODE_INLINE; /* the mapping is chosen when the data moves to blocks */
+	} else if(fs.incore->super.features & FS_FEATURE_EXTENTS) {
+		ind.flags |= FS_INODE_EXTENTS;
+	}
 	/* todo: set ind values */
 	if(fs_write_inode(fs, super, *inodenum, &ind) < 0) {
 		fprintf(stderr, "io_open_creat: fs_write_inode\n");
@@ -109,509 +154,1797 @@ int io_open_creat_fd(struct fs_filesyst fs, struct fs_super_block super, uint16_
 		fprintf(stderr, "io_open_creat_fd: io_open_creat\n");
 		return FUNC_ERROR;
 	}
-	int fd = io_open_fd(inodenum);
+	int fd = io_iopen(fs, super, inodenum);
 	if(fd < 0) {
 		fprintf(stderr, "io_open_creat_fd: io_open_creat\n");
 		return FUNC_ERROR;
 	}
-	return fd;
+	return fd;
+}
+
+/**
+ * @brief utility function to get the maximum size of a file
+ * @details the block pointers map FS_MAX_FILE_BLOCKS blocks, the extents
+ * map any size that fits in the 32 bits size of the inode
+ */
+static uint64_t io_max_size(const struct fs_inode *ind) {
+	if(ind->flags & FS_INODE_EXTENTS) {
+		return FS_MAX_EXTENT_FILE_SIZE;
+	}
+	return (uint64_t) FS_MAX_FILE_BLOCKS * FS_BLOCK_SIZE;
+}
+
+/**
+ * @brief utility function to read the extents of an inode
+ * @details from the inode, or from its extent block (one block read)
+ */
+static int io_extents_load(struct fs_filesyst fs, struct fs_super_block super,
+						   const struct fs_inode *ind, struct io_extent_map *map)
+{
+	const struct fs_extent_root *root = &ind->extents;
+	if(root->depth == 0) {
+		if(root->count > FS_INLINE_EXTENTS) {
+			fprintf(stderr, "io_extents_load: corrupted extents\n");
+			return FUNC_ERROR;
+		}
+		map->count = root->count;
+		memcpy(map->ext, root->ext, sizeof(struct fs_file_extent) * root->count);
+		return 0;
+	}
+	union fs_block blk;
+	uint32_t blknum = root->block;
+	if(fs_read_data(fs, super, &blk, &blknum, 1) < 0) {
+		fprintf(stderr, "io_extents_load: fs_read_data\n");
+		return FUNC_ERROR;
+	}
+	if(blk.extents.count > FS_EXTENTS_PER_BLOCK) {
+		fprintf(stderr, "io_extents_load: corrupted extent block %u\n", blknum);
+		return FUNC_ERROR;
+	}
+	map->count = blk.extents.count;
+	memcpy(map->ext, blk.extents.ext, sizeof(struct fs_file_extent) * map->count);
+	return 0;
+}
+
+/**
+ * @brief utility function to write the extents of an inode
+ * @details the extents go in the inode if they fit, else in its extent
+ * block which is allocated after the last extent of the file the first
+ * time it is needed. *ind* is changed only once the extent block is
+ * written. the inode is not written here.
+ * @param unused set to the extent block that is no longer used once the
+ *               extents fit in the inode again (0 if none), the caller
+ *               frees it after writing the inode
+ */
+static int io_extents_store(struct fs_filesyst fs, struct fs_super_block super,
+							struct fs_inode *ind, const struct io_extent_map *map,
+							uint32_t *unused)
+{
+	struct fs_extent_root *root = &ind->extents;
+	*unused = 0;
+	if(map->count <= FS_INLINE_EXTENTS) {
+		*unused = (root->depth == 1)? root->block: 0;
+		memset(root, 0, sizeof(*root));
+		root->count = map->count;
+		memcpy(root->ext, map->ext, sizeof(struct fs_file_extent) * map->count);
+		return 0;
+	}
+	uint32_t blknum = root->block;
+	if(root->depth == 0) {
+		const struct fs_file_extent *last = &map->ext[map->count - 1];
+		struct fs_extent blk;
+		if(fs_alloc_extents(fs, &super, last->start + last->len, 1, &blk, 1) != 1) {
+			fprintf(stderr, "io_extents_store: fs_alloc_extents\n");
+			return FUNC_ERROR;
+		}
+		blknum = blk.start;
+	}
+	union fs_block blk;
+	memset(&blk, 0, sizeof(blk));
+	blk.extents.count = map->count;
+	memcpy(blk.extents.ext, map->ext, sizeof(struct fs_file_extent) * map->count);
+	if(fs_write_data(fs, super, &blk, &blknum, 1) < 0) {
+		fprintf(stderr, "io_extents_store: fs_write_data\n");
+		if(root->depth == 0) {
+			fs_free_data(fs, &super, blknum);
+		}
+		return FUNC_ERROR;
+	}
+	if(root->depth == 0) {
+		memset(root, 0, sizeof(*root));
+		root->depth = 1;
+		root->block = blknum;
+	}
+	root->count = map->count;
+	return 0;
+}
+
+/**
+ * @brief utility function to give back the blocks of extents
+ * @details the blocks of the *n* extents and the block *extra* (if not 0)
+ * are freed together with fs_free_data_batch
+ */
+static int io_free_extents(struct fs_filesyst fs, struct fs_super_block super,
+						   const struct fs_extent *ext, int n, uint32_t extra)
+{
+	size_t count = (extra != 0);
+	for(int i=0; i<n; i++) {
+		count += ext[i].len;
+	}
+	if(count == 0) {
+		return 0;
+	}
+	uint32_t *blks = malloc(sizeof(uint32_t) * count);
+	if(blks == NULL) {
+		perror("io_free_extents: malloc");
+		return FUNC_ERROR;
+	}
+	size_t k = 0;
+	for(int i=0; i<n; i++) {
+		for(uint32_t j=0; j<ext[i].len; j++) {
+			blks[k++] = ext[i].start + j;
+		}
+	}
+	if(extra) {
+		blks[k++] = extra;
+	}
+	int ret = fs_free_data_batch(fs, &super, blks, k);
+	free(blks);
+	return ret;
+}
+
+/**
+ * @brief utility function to find the extent holding a logical block
+ * @details binary search on the sorted extents
+ * @return the index of the first extent starting after *lblk*, the
+ * extent before it is the only one that can hold *lblk*
+ */
+static uint32_t io_extent_search(const struct io_extent_map *map, uint32_t lblk) {
+	uint32_t lo = 0, hi = map->count;
+	while(lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if(map->ext[mid].lblk <= lblk) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/**
+ * @brief utility function to get the data block of a logical block
+ * @param len set to the no of blocks from *lblk* to the end of its extent,
+ *            or to the end of the hole if *lblk* is not mapped
+ * @return the data block number or 0 if *lblk* is not mapped
+ */
+static uint32_t io_extent_lookup(const struct io_extent_map *map, uint32_t lblk, uint32_t *len) {
+	uint32_t i = io_extent_search(map, lblk);
+	if(i > 0 && lblk - map->ext[i-1].lblk < map->ext[i-1].len) {
+		const struct fs_file_extent *e = &map->ext[i-1];
+		*len = e->len - (lblk - e->lblk);
+		return e->start + (lblk - e->lblk);
+	}
+	*len = (i < map->count)? map->ext[i].lblk - lblk: UINT32_MAX - lblk;
+	return 0;
+}
+
+/**
+ * @brief utility function to map a hole of a file to data blocks
+ * @details the extent is merged with its neighbours when it follows them
+ * both in the file and on the disk
+ * @return 0 on success, -1 if the file has too many extents
+ */
+static int io_extent_insert(struct io_extent_map *map, uint32_t lblk, uint32_t start, uint32_t len) {
+	uint32_t i = io_extent_search(map, lblk);
+	struct fs_file_extent *prev = (i > 0)? &map->ext[i-1]: NULL;
+	struct fs_file_extent *next = (i < map->count)? &map->ext[i]: NULL;
+	int join_next = next && next->lblk == lblk + len && next->start == start + len;
+	if(prev && prev->lblk + prev->len == lblk && prev->start + prev->len == start) {
+		prev->len += len;
+		if(join_next) {
+			prev->len += next->len;
+			memmove(next, next + 1, sizeof(struct fs_file_extent) * (map->count - i - 1));
+			map->count--;
+		}
+		return 0;
+	}
+	if(join_next) {
+		next->lblk = lblk;
+		next->start = start;
+		next->len += len;
+		return 0;
+	}
+	if(map->count == FS_EXTENTS_PER_BLOCK) {
+		return FUNC_ERROR;
+	}
+	memmove(map->ext + i + 1, map->ext + i, sizeof(struct fs_file_extent) * (map->count - i));
+	map->ext[i].lblk = lblk;
+	map->ext[i].start = start;
+	map->ext[i].len = len;
+	map->count++;
+	return 0;
+}
+
+/**
+ * @brief utility function to get where the blocks of a file with extents
+ * are searched
+ * @details the block following the last extent before *lblk*, or the goal
+ * of the inode if there is none
+ */
+static uint32_t io_extent_goal(struct fs_super_block super, uint32_t inodenum,
+							   const struct io_extent_map *map, uint32_t lblk)
+{
+	uint32_t i = io_extent_search(map, lblk);
+	if(i > 0) {
+		const struct fs_file_extent *e = &map->ext[i-1];
+		uint32_t n = (lblk - e->lblk < e->len)? lblk - e->lblk: e->len;
+		return e->start + n;
+	}
+	return fs_data_goal(&super, inodenum);
+}
+
+/**
+ * @brief utility function to allocate the holes of a file with extents
+ * @details same as io_lazy_alloc: all the holes of the logical blocks
+ * [start, end] are allocated at once with fs_alloc_extents, each hole
+ * takes the next allocated blocks and becomes one or more extents
+ */
+static int io_lazy_alloc_extents(struct fs_filesyst fs, struct fs_super_block super,
+								 uint32_t inodenum, struct fs_inode *ind,
+								 uint32_t start, uint32_t end)
+{
+	struct io_extent_map map;
+	if(io_extents_load(fs, super, ind, &map) < 0) {
+		fprintf(stderr, "io_lazy_alloc: io_extents_load\n");
+		return FUNC_ERROR;
+	}
+	uint64_t missing = 0;
+	for(uint64_t lblk=start; lblk<=end;) {
+		uint32_t len;
+		uint32_t blknum = io_extent_lookup(&map, lblk, &len);
+		uint64_t n = (len < end - lblk + 1)? len: end - lblk + 1;
+		missing += (blknum == 0)? n: 0;
+		lblk += n;
+	}
+	if(missing == 0) {
+		return 0; /* no allocation needed */
+	}
+
+	/* a file can't have more extents than an extent block holds */
+	size_t max_ext = (missing < FS_EXTENTS_PER_BLOCK)? missing: FS_EXTENTS_PER_BLOCK;
+	struct fs_extent *ext = malloc(sizeof(struct fs_extent) * max_ext);
+	if(ext == NULL) {
+		fprintf(stderr, "io_lazy_alloc: malloc\n");
+		return FUNC_ERROR;
+	}
+	uint32_t goal = io_extent_goal(super, inodenum, &map, start);
+	int n = fs_alloc_extents(fs, &super, goal, missing, ext, max_ext);
+	if(n < 0) {
+		fprintf(stderr, "io_lazy_alloc: fs_alloc_extents\n");
+		free(ext);
+		return FUNC_ERROR;
+	}
+	/* the old extents are kept to be restored if the inode can't be written */
+	struct io_extent_map old = map;
+	struct fs_extent_root old_root = ind->extents;
+	int i = 0, ret = 0;
+	uint32_t used = 0;
+	for(uint64_t lblk=start; ret == 0 && lblk<=end;) {
+		uint32_t len;
+		uint32_t blknum = io_extent_lookup(&map, lblk, &len);
+		uint64_t hole = (len < end - lblk + 1)? len: end - lblk + 1;
+		if(blknum) {
+			lblk += hole;
+			continue;
+		}
+		while(ret == 0 && hole > 0) {
+			uint32_t take = (hole < ext[i].len - used)? hole: ext[i].len - used;
+			ret = io_extent_insert(&map, lblk, ext[i].start + used, take);
+			lblk += take;
+			hole -= take;
+			used += take;
+			if(used == ext[i].len) {
+				i++;
+				used = 0;
+			}
+		}
+	}
+	if(ret < 0) {
+		fprintf(stderr, "io_lazy_alloc: too many extents for inode %u\n", inodenum);
+	}
+	uint32_t unused = 0;
+	if(ret == 0 && io_extents_store(fs, super, ind, &map, &unused) < 0) {
+		fprintf(stderr, "io_lazy_alloc: io_extents_store\n");
+		ret = FUNC_ERROR;
+	}
+	if(ret == 0 && fs_write_inode(fs, super, inodenum, ind) < 0) {
+		fprintf(stderr, "io_lazy_alloc: fs_write_inode\n");
+		/* the inode keeps its old extents, the old extent block gets them back */
+		uint32_t new_block = (old_root.depth == 0 && ind->extents.depth == 1)? ind->extents.block: 0;
+		ind->extents = old_root;
+		if(old_root.depth == 1 && io_extents_store(fs, super, ind, &old, &unused) < 0) {
+			fprintf(stderr, "io_lazy_alloc: io_extents_store\n");
+		}
+		unused = new_block;
+		ret = FUNC_ERROR;
+	}
+	if(ret < 0) {
+		/* nothing is mapped, the blocks are given back */
+		io_free_extents(fs, super, ext, n, unused);
+		free(ext);
+		return FUNC_ERROR;
+	}
+	free(ext);
+	if(unused && fs_free_data(fs, &super, unused) < 0) {
+		fprintf(stderr, "io_lazy_alloc: fs_free_data\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief utility function to get where the blocks of a file are searched
+ * @details the block following the last block allocated before the
+ * logical block *lblk*, so that appended blocks follow the file. for a
+ * file with no blocks before *lblk*, the goal of its inode given by
+ * fs_data_goal (eg. the group of the inode).
+ * @return the goal data block number
+ */
+static uint32_t io_alloc_goal(struct fs_super_block super, uint32_t inodenum,
+							  struct fs_inode *ind, union fs_block *indirect_data, uint32_t lblk)
+{
+	for(uint32_t i=lblk; i>0; i--) {
+		uint32_t ptr = (i - 1 < FS_DIRECT_POINTERS_PER_INODE)? ind->direct[i - 1]:
+			indirect_data->pointers[i - 1 - FS_DIRECT_POINTERS_PER_INODE];
+		if(ptr != 0) {
+			return ptr + 1;
+		}
+	}
+	return fs_data_goal(&super, inodenum);
+}
+
+/**
+ * @brief allocates blocks based on *off* and *size*
+ * @details a utility functions used by io_write to allocate the least
+ * possible amount of blocks based on the writing offset *off* and the
+ * writing size *size*. all the missing blocks (and the indirect block
+ * if needed) are allocated at once with fs_alloc_extents so a large
+ * write lands on contiguous blocks, in the order of the file. the
+ * indirect block takes the block following the data. the search starts
+ * from the goal given by io_alloc_goal.
+ */
+int io_lazy_alloc(struct fs_filesyst fs, struct fs_super_block super,
+				uint32_t inodenum, struct fs_inode *ind, size_t off, size_t size)
+{
+	if(size == 0) {
+		return 0;
+	}
+	uint32_t start = off / FS_BLOCK_SIZE;
+	uint32_t end = (off + size - 1) / FS_BLOCK_SIZE;
+	if(ind->flags & FS_INODE_EXTENTS) {
+		return io_lazy_alloc_extents(fs, super, inodenum, ind, start, end);
+	}
+	/* sanity check */
+	if(end >= FS_MAX_FILE_BLOCKS) {
+		fprintf(stderr, "io_lazy_alloc: file too big!\n");
+		return FUNC_ERROR;
+	}
+
+	/* read the indirect block */
+	int level1 = (end >= FS_DIRECT_POINTERS_PER_INODE);
+	union fs_block indirect_data;
+	if(level1 && ind->indirect != 0) {
+		if(fs_read_data(fs, super, &indirect_data, &ind->indirect, 1) < 0) {
+			fprintf(stderr, "io_lazy_alloc: fs_read_data\n");
+			return FUNC_ERROR;
+		}
+	} else {
+		memset(&indirect_data, 0, sizeof(indirect_data));
+	}
+
+	/* pointers to fill, in the order of the file */
+	uint32_t *slots[FS_MAX_FILE_BLOCKS];
+	uint32_t allocs_needed = 0;
+	int level1_changed = 0;
+	for(uint32_t i=start; i<=end; i++) {
+		uint32_t *ptr = (i < FS_DIRECT_POINTERS_PER_INODE)? &ind->direct[i]:
+			&indirect_data.pointers[i - FS_DIRECT_POINTERS_PER_INODE];
+		if(*ptr == 0) {
+			slots[allocs_needed++] = ptr;
+			level1_changed |= (i >= FS_DIRECT_POINTERS_PER_INODE);
+		}
+	}
+	int new_indirect = (level1 && ind->indirect == 0);
+	if(new_indirect) {
+		slots[allocs_needed++] = &ind->indirect;
+	}
+	if(allocs_needed == 0) {
+		return 0; /* no allocation needed */
+	}
+
+	/* allocs */
+	struct fs_extent *ext = malloc(sizeof(struct fs_extent) * allocs_needed);
+	if(ext == NULL) {
+		fprintf(stderr, "io_lazy_alloc: malloc\n");
+		return FUNC_ERROR;
+	}
+	uint32_t goal = io_alloc_goal(super, inodenum, ind, &indirect_data, start);
+	int n = fs_alloc_extents(fs, &super, goal, allocs_needed, ext, allocs_needed);
+	if(n < 0) {
+		fprintf(stderr, "io_lazy_alloc: fs_alloc_extents\n");
+		free(ext);
+		return FUNC_ERROR;
+	}
+	for(int i=0, j=0; i<n; i++) {
+		for(uint32_t k=0; k<ext[i].len; k++) {
+			*slots[j++] = ext[i].start + k;
+		}
+	}
+
+	/* write changes to disk */
+	int ret = 0, written = 0;
+	if(level1_changed) {
+		if(fs_write_data(fs, super, &indirect_data, &ind->indirect, 1) < 0) {
+			fprintf(stderr, "io_lazy_alloc: fs_write_data\n");
+			ret = FUNC_ERROR;
+		}
+		written = (ret == 0);
+	}
+	if(ret == 0 && fs_write_inode(fs, super, inodenum, ind) < 0) {
+		fprintf(stderr, "io_lazy_alloc: fs_write_inode\n");
+		ret = FUNC_ERROR;
+	}
+	if(ret < 0) {
+		/* nothing is mapped, the blocks are given back */
+		for(uint32_t i=0; i<allocs_needed; i++) {
+			*slots[i] = 0;
+		}
+		if(written && !new_indirect &&
+		   fs_write_data(fs, super, &indirect_data, &ind->indirect, 1) < 0)
+		{
+			fprintf(stderr, "io_lazy_alloc: fs_write_data\n");
+		}
+		io_free_extents(fs, super, ext, n, 0);
+	}
+	free(ext);
+	return ret;
+}
+
+/**
+ * @brief changes the current offset of the file descriptor
+ * @details changes the offset of the file descriptor *fd* to *new_off*
+ */
+int io_lseek(struct fs_filesyst fs, struct fs_super_block super, int fd,
+			  size_t new_off)
+{
+	filedesc_table.fds[fd].offset = new_off;
+	return 0;
+}
+
+/**
+ * @brief changes the current offset of the file descriptor
+ * @details the new offset is *off* (IO_SEEK_SET), or the start of the
+ * first data (IO_SEEK_DATA) or of the first hole (IO_SEEK_HOLE) at or
+ * after *off*, found with io_seek_ino
+ * @return the new offset, or -1 if there is no data (or hole) after *off*
+ * or in case of an error
+ */
+int64_t io_llseek(struct fs_filesyst fs, struct fs_super_block super, int fd,
+				  uint32_t off, int whence)
+{
+	if(fd < 0 || fd >= IO_MAX_FILEDESC || filedesc_table.fds[fd].is_allocated == 0) {
+		fprintf(stderr, "io_llseek: fd closed!\n");
+		return FUNC_ERROR;
+	}
+	uint32_t res;
+	int ret = io_seek_ino(fs, super, filedesc_table.fds[fd].inodenum, off, whence, &res);
+	if(ret < 0) {
+		fprintf(stderr, "io_llseek: io_seek_ino\n");
+		return FUNC_ERROR;
+	}
+	if(ret == IO_SEEK_NONE) {
+		return FUNC_ERROR; /* the offset is kept */
+	}
+	filedesc_table.fds[fd].offset = res;
+	return res;
+}
+
+/**
+ * @brief utility function to get the data block numbers of a file
+ * @details fills *blknums* with the data block numbers of the logical
+ * blocks [first, first+count) of the inode *ind*, 0 is put for the
+ * blocks that are not allocated. the indirect block is read at most once.
+ */
+static int io_map_blocks(struct fs_filesyst fs, struct fs_super_block super,
+					struct fs_inode *ind, uint32_t first, uint32_t count, uint32_t *blknums)
+{
+	if(ind->flags & FS_INODE_EXTENTS) {
+		struct io_extent_map map;
+		if(io_extents_load(fs, super, ind, &map) < 0) {
+			fprintf(stderr, "io_map_blocks: io_extents_load\n");
+			return FUNC_ERROR;
+		}
+		for(uint32_t i=0; i<count;) {
+			uint32_t len;
+			uint32_t blknum = io_extent_lookup(&map, first + i, &len);
+			for(uint32_t j=0; j<len && i<count; j++, i++) {
+				blknums[i] = (blknum)? blknum + j: 0;
+			}
+		}
+		return 0;
+	}
+	union fs_block indirect_data;
+	int indirect_read = 0;
+	for(uint32_t i=0; i<count; i++) {
+		uint32_t lblk = first + i;
+		if(lblk < FS_DIRECT_POINTERS_PER_INODE) {
+			blknums[i] = ind->direct[lblk];
+			continue;
+		}
+		lblk -= FS_DIRECT_POINTERS_PER_INODE;
+		if(ind->indirect == 0 || lblk >= FS_POINTERS_PER_BLOCK) {
+			blknums[i] = 0;
+			continue;
+		}
+		if(!indirect_read) {
+			if(fs_read_data(fs, super, &indirect_data, &ind->indirect, 1) < 0) {
+				fprintf(stderr, "io_map_blocks: fs_read_data\n");
+				return FUNC_ERROR;
+			}
+			indirect_read = 1;
+		}
+		blknums[i] = indirect_data.pointers[lblk];
+	}
+	return 0;
+}
+
+/**
+ * @brief utility function to check if a block was preallocated and not written
+ * @details the whole logical block *lblk* is after the initialized size
+ * of the inode, it reads as zeros and it is not read from the disk
+ */
+static int io_is_unwritten(const struct fs_inode *ind, uint32_t lblk) {
+	return (ind->flags & FS_INODE_PREALLOC) && (uint64_t) lblk * FS_BLOCK_SIZE >= ind->init_size;
+}
+
+/**
+ * @brief utility function to clear the preallocated bytes of a block read
+ * @details the bytes of the logical block *lblk* after the initialized
+ * size of the inode are set to zero
+ */
+static void io_mask_unwritten(const struct fs_inode *ind, uint32_t lblk, union fs_block *blk) {
+	uint64_t first = (uint64_t) lblk * FS_BLOCK_SIZE;
+	if((ind->flags & FS_INODE_PREALLOC) && ind->init_size < first + FS_BLOCK_SIZE) {
+		uint32_t from = (ind->init_size > first)? ind->init_size - first: 0;
+		memset(blk->data + from, 0, FS_BLOCK_SIZE - from);
+	}
+}
+
+/**
+ * @brief utility function to zero the preallocated blocks before *to*
+ * @details the allocated blocks of [init_size, to) are written with
+ * zeros, so the initialized size of the inode can be moved to *to*
+ */
+static int io_zero_unwritten(struct fs_filesyst fs, struct fs_super_block super,
+							 struct fs_inode *ind, uint32_t to)
+{
+	uint32_t first = ind->init_size / FS_BLOCK_SIZE;
+	uint32_t count = ((uint64_t) to + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE - first;
+	uint32_t *blknums = malloc(sizeof(uint32_t) * count);
+	if(blknums == NULL || io_map_blocks(fs, super, ind, first, count, blknums) < 0) {
+		fprintf(stderr, "io_zero_unwritten: io_map_blocks\n");
+		free(blknums);
+		return FUNC_ERROR;
+	}
+	union fs_block blk;
+	int ret = 0;
+	for(uint32_t i=0; ret == 0 && i<count; i++) {
+		if(blknums[i] == 0) {
+			continue;
+		}
+		if(io_is_unwritten(ind, first + i)) {
+			memset(&blk, 0, FS_BLOCK_SIZE);
+		} else if(fs_read_data(fs, super, &blk, &blknums[i], 1) < 0) {
+			fprintf(stderr, "io_zero_unwritten: fs_read_data\n");
+			ret = FUNC_ERROR;
+			break;
+		}
+		io_mask_unwritten(ind, first + i, &blk);
+		if(fs_write_data(fs, super, &blk, &blknums[i], 1) < 0) {
+			fprintf(stderr, "io_zero_unwritten: fs_write_data\n");
+			ret = FUNC_ERROR;
+		}
+	}
+	free(blknums);
+	return ret;
+}
+
+/**
+ * @brief utility function to write a part of a block of a file
+ * @details the bytes [from, to) of the logical block *lblk* are taken from
+ * *data*, the rest of the block is read first if it was allocated before
+ * the write (*old*), else it is zeroed
+ */
+static int io_write_partial(struct fs_filesyst fs, struct fs_super_block super, struct fs_inode *ind,
+							uint32_t lblk, uint32_t blknum, uint32_t old,
+							const uint8_t* data, uint32_t from, uint32_t to)
+{
+	union fs_block datablk;
+	if(!old || io_is_unwritten(ind, lblk)) {
+		memset(&datablk, 0, FS_BLOCK_SIZE);
+	} else if(fs_read_data(fs, super, &datablk, &blknum, 1) < 0) {
+		fprintf(stderr, "io_write: fs_read_data!\n");
+		return FUNC_ERROR;
+	}
+	io_mask_unwritten(ind, lblk, &datablk);
+	memcpy(datablk.data + from, data, to - from);
+	if(fs_write_data(fs, super, &datablk, &blknum, 1) < 0) {
+		fprintf(stderr, "io_write: fs_write_data!\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief utility function to write data to the blocks of a file
+ * @details *blknums* are the data blocks of the logical blocks written,
+ * *old_s* and *old_e* tell if the first and the last one were allocated
+ * before the write (their current content is kept). only a first or last
+ * block partly covered by the write is read and modified, the fully
+ * covered blocks are written directly from *data* with a single
+ * fs_write_data.
+ */
+static int io_write_blocks(struct fs_filesyst fs, struct fs_super_block super, struct fs_inode *ind,
+						   uint32_t *blknums, uint32_t old_s, uint32_t old_e,
+						   void* data, uint32_t off, size_t size)
+{
+	uint32_t start = off / FS_BLOCK_SIZE, end = (off + size - 1) / FS_BLOCK_SIZE;
+	uint32_t count = end - start + 1;
+	uint32_t range_s = off % FS_BLOCK_SIZE;
+	uint32_t range_e = (off + size - 1) % FS_BLOCK_SIZE + 1;
+	uint32_t head = (range_s != 0 || (start == end && range_e != FS_BLOCK_SIZE));
+	uint32_t tail = (start != end && range_e != FS_BLOCK_SIZE);
+	uint8_t* src = data;
+
+	/* start (it is also the end if the writing fits in one block) */
+	if(head) {
+		uint32_t to = (start == end)? range_e: FS_BLOCK_SIZE;
+		if(io_write_partial(fs, super, ind, start, blknums[0], old_s, src, range_s, to) < 0) {
+			return FUNC_ERROR;
+		}
+		src += to - range_s;
+	}
+	/* the fully covered blocks, written in one go from the caller's buffer */
+	if(count > head + tail &&
+	   fs_write_data(fs, super, src, blknums + head, count - head - tail) < 0)
+	{
+		fprintf(stderr, "io_write: fs_write_data!\n");
+		return FUNC_ERROR;
+	}
+	src += (size_t) (count - head - tail) * FS_BLOCK_SIZE;
+	/* end */
+	if(tail && io_write_partial(fs, super, ind, end, blknums[count-1], old_e, src, 0, range_e) < 0) {
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief utility function to write data to an inode number now
+ * @details writes the data *data* with size *size* starting from the offset
+ * *off* into the inode number *inodenum* with io_write_blocks (contiguous
+ * blocks are written with one syscall).
+ * Note: the lazy allocation is done here.
+ */
+static int io_write_now(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
+						void* data, uint32_t off, size_t size)
+{
+	if(size == 0) {
+		return 0;
+	}
+	struct fs_inode ind;
+	if(fs_read_inode(fs, super, inodenum, &ind) < 0) {
+		fprintf(stderr, "io_write: fs_read_inode\n");
+		return FUNC_ERROR;
+	}
+	if((uint64_t) off + size > io_max_size(&ind)) {
+		fprintf(stderr, "io_write: file too big\n");
+		return FUNC_ERROR;
+	}
+
+	uint32_t start = off / FS_BLOCK_SIZE, end = (off + size - 1) / FS_BLOCK_SIZE;
+	uint32_t count = end - start + 1;
+
+	/* the preallocated blocks skipped by the write are zeroed first */
+	if((ind.flags & FS_INODE_PREALLOC) && ind.init_size < (uint64_t) start * FS_BLOCK_SIZE) {
+		if(io_zero_unwritten(fs, super, &ind, start * FS_BLOCK_SIZE) < 0) {
+			fprintf(stderr, "io_write: io_zero_unwritten\n");
+			return FUNC_ERROR;
+		}
+		ind.init_size = start * FS_BLOCK_SIZE;
+	}
+	
+	/* the first and last blocks that are not allocated yet (or not written
+	 * since their preallocation) are not read, they may still contain the
+	 * data of a deleted file */
+	uint32_t old_s, old_e;
+	if(io_map_blocks(fs, super, &ind, start, 1, &old_s) < 0 ||
+	   io_map_blocks(fs, super, &ind, end, 1, &old_e) < 0) {
+		fprintf(stderr, "io_write: io_map_blocks\n");
+		return FUNC_ERROR;
+	}
+
+	/* lazy allocation */
+	if(io_lazy_alloc(fs, super, inodenum, &ind, off, size) < 0) {
+		fprintf(stderr, "io_write: lazy allocation failed\n");
+		return FUNC_ERROR;
+	}
+	/* actual writing */
+	uint32_t *blknums = malloc(sizeof(uint32_t) * count);
+	if(blknums == NULL || io_map_blocks(fs, super, &ind, start, count, blknums) < 0) {
+		fprintf(stderr, "io_write: io_map_blocks\n");
+		free(blknums);
+		return FUNC_ERROR;
+	}
+	int ret = io_write_blocks(fs, super, &ind, blknums, old_s, old_e, data, off, size);
+	free(blknums);
+	if(ret < 0) {
+		return FUNC_ERROR;
+	}
+
+	ind.size = (ind.size > off+size)? ind.size: off+size;
+	if(ind.flags & FS_INODE_PREALLOC) {
+		ind.init_size = (ind.init_size > off+size)? ind.init_size: off+size;
+		if(ind.init_size >= ind.size) {
+			ind.flags &= ~FS_INODE_PREALLOC; /* no preallocated bytes left */
+		}
+	}
+	if(fs_write_inode(fs, super, inodenum, &ind) < 0) {
+		fprintf(stderr, "io_write: fs_write_inode\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief utility function to get the part of a block in a range of bytes
+ * @details [from, to) are the offsets in the logical block *lblk* of the
+ * bytes of [off, off+size)
+ */
+static void io_block_range(uint32_t lblk, uint32_t off, size_t size, uint32_t* from, uint32_t* to) {
+	uint64_t blk_s = (uint64_t) lblk * FS_BLOCK_SIZE;
+	*from = (off > blk_s)? off - blk_s: 0;
+	*to = ((uint64_t) off + size < blk_s + FS_BLOCK_SIZE)? off + size - blk_s: FS_BLOCK_SIZE;
+}
+
+/**
+ * @brief utility function to find the dirty pages of a file
+ * @return the dirty file or NULL if the file has no dirty page
+ */
+static struct io_dirty_file* io_dirty_find(struct fs_filesyst fs, uint32_t inodenum) {
+	if(fs.incore == NULL || fs.incore->delalloc == NULL) {
+		return NULL;
+	}
+	for(struct io_dirty_file* f=fs.incore->delalloc->files; f; f=f->next) {
+		if(f->inodenum == inodenum) {
+			return f;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief utility function to drop the dirty pages of a file
+ * @details the pages are freed without being written
+ */
+static void io_dirty_drop(struct io_delalloc* da, struct io_dirty_file* f) {
+	struct io_dirty_file** link = &da->files;
+	while(*link != f) {
+		link = &(*link)->next;
+	}
+	*link = f->next;
+	for(uint32_t i=0; i<f->pages_cap; i++) {
+		free(f->pages[i]);
+	}
+	da->npages -= f->npages;
+	free(f->pages);
+	free(f);
+}
+
+/**
+ * @brief utility function to write the dirty pages of a file
+ * @details each run of adjacent dirty pages is written with one
+ * io_write_now, so the blocks of the run are allocated at once by
+ * io_lazy_alloc. the bytes after the end of the file are not written.
+ */
+static int io_dirty_write(struct fs_filesyst fs, struct fs_super_block super, struct io_dirty_file* f) {
+	struct fs_inode ind;
+	if(fs_read_inode(fs, super, f->inodenum, &ind) < 0) {
+		fprintf(stderr, "io_dirty_write: fs_read_inode\n");
+		return FUNC_ERROR;
+	}
+	int ret = 0;
+	for(uint32_t lblk=0; ret == 0 && lblk<f->pages_cap;) {
+		if(f->pages[lblk] == NULL) {
+			lblk++;
+			continue;
+		}
+		uint32_t n = 1;
+		while(lblk + n < f->pages_cap && f->pages[lblk + n]) {
+			n++;
+		}
+		uint64_t from = (uint64_t) lblk * FS_BLOCK_SIZE, to = (uint64_t) (lblk + n) * FS_BLOCK_SIZE;
+		to = (to < ind.size)? to: ind.size;
+		if(to > from) {
+			uint8_t* run = malloc((size_t) n * FS_BLOCK_SIZE);
+			if(run == NULL) {
+				perror("io_dirty_write: malloc");
+				return FUNC_ERROR;
+			}
+			for(uint32_t i=0; i<n; i++) {
+				memcpy(run + (size_t) i * FS_BLOCK_SIZE, f->pages[lblk + i], FS_BLOCK_SIZE);
+			}
+			ret = io_write_now(fs, super, f->inodenum, run, from, to - from);
+			free(run);
+		}
+		lblk += n;
+	}
+	return ret;
+}
+
+/**
+ * @brief enables or disables the delayed allocation
+ * @details with delayed allocation io_write_ino only copies the data in
+ * dirty pages kept in memory, their data blocks are allocated when they
+ * are written by io_delalloc_flush (at sync, or when more than
+ * IO_DELALLOC_MAX_PAGES pages are dirty). disabling it writes the pages.
+ */
+int io_delalloc_enable(struct fs_filesyst fs, int enable) {
+	if(fs.incore == NULL) {
+		fprintf(stderr, "io_delalloc_enable: filesystem not opened\n");
+		return FUNC_ERROR;
+	}
+	if(enable && fs.incore->delalloc == NULL) {
+		fs.incore->delalloc = calloc(1, sizeof(struct io_delalloc));
+		if(fs.incore->delalloc == NULL) {
+			perror("io_delalloc_enable: calloc");
+			return FUNC_ERROR;
+		}
+	} else if(!enable && fs.incore->delalloc) {
+		if(io_delalloc_flush(fs) < 0) {
+			fprintf(stderr, "io_delalloc_enable: io_delalloc_flush\n");
+			return FUNC_ERROR;
+		}
+		io_delalloc_release(fs.incore->delalloc);
+		fs.incore->delalloc = NULL;
+	}
+	return 0;
+}
+
+/**
+ * @brief enables or disables the sparse writes
+ * @details when enabled, the whole blocks of zeros written over holes are
+ * not allocated, they stay holes (and still read as zeros)
+ */
+int io_sparse_enable(struct fs_filesyst fs, int enable) {
+	if(fs.incore == NULL) {
+		fprintf(stderr, "io_sparse_enable: filesystem not opened\n");
+		return FUNC_ERROR;
+	}
+	fs.incore->sparse = enable;
+	return 0;
+}
+
+/**
+ * @brief writes the dirty pages of all the files
+ * @details the blocks of each file are allocated with the whole extent
+ * of its dirty data known. called by fs_sync.
+ */
+int io_delalloc_flush(struct fs_filesyst fs) {
+	struct io_delalloc* da = (fs.incore)? fs.incore->delalloc: NULL;
+	if(da == NULL || da->flushing) {
+		return 0;
+	}
+	struct fs_super_block* super = fs_get_super(fs);
+	if(super == NULL) {
+		fprintf(stderr, "io_delalloc_flush: fs_get_super\n");
+		return FUNC_ERROR;
+	}
+	int ret = 0;
+	da->flushing = 1;
+	while(ret == 0 && da->files) {
+		ret = io_dirty_write(fs, *super, da->files);
+		if(ret == 0) {
+			io_dirty_drop(da, da->files);
+		}
+	}
+	da->flushing = 0;
+	if(ret < 0) {
+		fprintf(stderr, "io_delalloc_flush: io_dirty_write\n");
+	}
+	return ret;
+}
+
+/**
+ * @brief drops all the dirty pages without writing them
+ * @details the delayed allocation stays enabled
+ */
+void io_delalloc_discard(struct io_delalloc* da) {
+	if(da == NULL) {
+		return;
+	}
+	while(da->files) {
+		io_dirty_drop(da, da->files);
+	}
+}
+
+/**
+ * @brief frees the delayed allocation state, the dirty pages are lost
+ */
+void io_delalloc_release(struct io_delalloc* da) {
+	io_delalloc_discard(da);
+	free(da);
+}
+
+/**
+ * @brief utility function to write data in the dirty pages of a file
+ * @details a page that is not fully overwritten is first filled with the
+ * current content of its block. only the size of the inode is written,
+ * no data block is allocated.
+ */
+static int io_delalloc_write(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
+							 void* data, uint32_t off, size_t size)
+{
+	struct io_delalloc* da = fs.incore->delalloc;
+	struct fs_inode ind;
+	if(fs_read_inode(fs, super, inodenum, &ind) < 0) {
+		fprintf(stderr, "io_write: fs_read_inode\n");
+		return FUNC_ERROR;
+	}
+	struct io_dirty_file* f = io_dirty_find(fs, inodenum);
+	if(f == NULL) {
+		f = calloc(1, sizeof(struct io_dirty_file));
+		if(f == NULL) {
+			perror("io_write: calloc");
+			return FUNC_ERROR;
+		}
+		f->inodenum = inodenum;
+		f->next = da->files;
+		da->files = f;
+	}
+
+	uint32_t start = off / FS_BLOCK_SIZE, end = (off + size - 1) / FS_BLOCK_SIZE;
+	if(end >= f->pages_cap) {
+		/* the array of pages grows with the file */
+		uint32_t cap = (f->pages_cap * 2 > end)? f->pages_cap * 2: end + 1;
+		union fs_block** pages = realloc(f->pages, sizeof(union fs_block*) * cap);
+		if(pages == NULL) {
+			perror("io_write: realloc");
+			return FUNC_ERROR;
+		}
+		memset(pages + f->pages_cap, 0, sizeof(union fs_block*) * (cap - f->pages_cap));
+		f->pages = pages;
+		f->pages_cap = cap;
+	}
+	size_t data_index = 0;
+	for(uint32_t lblk=start; lblk<=end; lblk++) {
+		uint32_t from, to;
+		io_block_range(lblk, off, size, &from, &to);
+		if(f->pages[lblk] == NULL) {
+			union fs_block* page = disk_alloc_blocks(1);
+			if(page == NULL) {
+				fprintf(stderr, "io_write: disk_alloc_blocks\n");
+				return FUNC_ERROR;
+			}
+			if((from > 0 || to < FS_BLOCK_SIZE) &&
+			   io_read_ino(fs, super, inodenum, page, lblk * FS_BLOCK_SIZE, FS_BLOCK_SIZE) < 0)
+			{
+				fprintf(stderr, "io_write: io_read_ino\n");
+				free(page);
+				return FUNC_ERROR;
+			}
+			f->pages[lblk] = page;
+			f->npages++;
+			da->npages++;
+		}
+		memcpy(f->pages[lblk]->data + from, (uint8_t*) data + data_index, to - from);
+		data_index += to - from;
+	}
+
+	if(ind.size < off + size) {
+		ind.size = off + size;
+		if(fs_write_inode(fs, super, inodenum, &ind) < 0) {
+			fprintf(stderr, "io_write: fs_write_inode\n");
+			return FUNC_ERROR;
+		}
+	}
+	if(da->npages > IO_DELALLOC_MAX_PAGES && io_delalloc_flush(fs) < 0) {
+		fprintf(stderr, "io_write: io_delalloc_flush\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief utility function to move the inline data of an inode to blocks
+ * @details the inode gets the mapping of the new files (block pointers or
+ * extents) and its data is written again in data blocks. *ind* is
+ * updated with the new inode.
+ */
+static int io_inline_migrate(struct fs_filesyst fs, struct fs_super_block super,
+							 uint32_t inodenum, struct fs_inode *ind)
+{
+	uint8_t data[FS_INLINE_DATA_SIZE];
+	uint32_t size = ind->size;
+	memcpy(data, ind->inline_data, FS_INLINE_DATA_SIZE);
+	memset(ind->inline_data, 0, FS_INLINE_DATA_SIZE);
+	ind->flags &= ~FS_INODE_INLINE;
+	if(fs.incore->super.features & FS_FEATURE_EXTENTS) {
+		ind->flags |= FS_INODE_EXTENTS;
+	}
+	ind->size = 0;
+	if(fs_write_inode(fs, super, inodenum, ind) < 0) {
+		fprintf(stderr, "io_inline_migrate: fs_write_inode\n");
+		return FUNC_ERROR;
+	}
+	if(io_write_ino(fs, super, inodenum, data, 0, size) < 0 ||
+	   fs_read_inode(fs, super, inodenum, ind) < 0)
+	{
+		fprintf(stderr, "io_inline_migrate: io_write_ino\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief utility function to write a range of an inode number
+ * @details in the dirty pages of the file with delayed allocation, else
+ * on the disk with io_write_now
+ */
+static int io_write_range(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
+						  void* data, uint32_t off, size_t size)
+{
+	struct io_delalloc* da = (fs.incore)? fs.incore->delalloc: NULL;
+	if(da && !da->flushing) {
+		return io_delalloc_write(fs, super, inodenum, data, off, size);
+	}
+	return io_write_now(fs, super, inodenum, data, off, size);
+}
+
+/**
+ * @brief utility function to check if a buffer only holds zeros
+ */
+static int io_is_zero(const uint8_t* data, size_t size) {
+	return size == 0 || (data[0] == 0 && memcmp(data, data + 1, size - 1) == 0);
+}
+
+/**
+ * @brief utility function to write a range without filling its holes
+ * with zeros
+ * @details the whole blocks of zeros of [off, off+size) that are holes
+ * (not allocated and without dirty page) are skipped, the data around
+ * them is written with io_write_range. the blocks skipped are chosen
+ * before anything is written. the size of the file still grows to
+ * off+size.
+ */
+static int io_write_sparse(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
+						   struct fs_inode *ind, void* data, uint32_t off, size_t size)
+{
+	uint32_t start = off / FS_BLOCK_SIZE, end = (off + size - 1) / FS_BLOCK_SIZE;
+	uint32_t count = end - start + 1;
+	uint32_t *skip = malloc(sizeof(uint32_t) * count);
+	if(skip == NULL || io_map_blocks(fs, super, ind, start, count, skip) < 0) {
+		fprintf(stderr, "io_write: io_map_blocks\n");
+		free(skip);
+		return FUNC_ERROR;
+	}
+	struct io_dirty_file* f = io_dirty_find(fs, inodenum);
+	for(uint32_t i=0; i<count; i++) {
+		uint64_t blk_s = (uint64_t) (start + i) * FS_BLOCK_SIZE;
+		int page = f && start + i < f->pages_cap && f->pages[start + i];
+		skip[i] = skip[i] == 0 && !page && blk_s >= off &&
+			blk_s + FS_BLOCK_SIZE <= (uint64_t) off + size &&
+			io_is_zero((uint8_t*) data + (blk_s - off), FS_BLOCK_SIZE);
+	}
+	uint64_t done = off; /* the bytes before *done* are written or skipped */
+	int ret = 0;
+	for(uint32_t i=0; ret == 0 && i<count; i++) {
+		uint64_t blk_s = (uint64_t) (start + i) * FS_BLOCK_SIZE;
+		if(!skip[i]) {
+			continue;
+		}
+		if(blk_s > done) {
+			ret = io_write_range(fs, super, inodenum, (uint8_t*) data + (done - off), done, blk_s - done);
+		}
+		done = blk_s + FS_BLOCK_SIZE;
+	}
+	free(skip);
+	if(ret < 0) {
+		return FUNC_ERROR;
+	}
+	if(done < (uint64_t) off + size) {
+		return io_write_range(fs, super, inodenum, (uint8_t*) data + (done - off), done, off + size - done);
+	}
+	/* the range ends with a hole */
+	if(fs_read_inode(fs, super, inodenum, ind) < 0) {
+		fprintf(stderr, "io_write: fs_read_inode\n");
+		return FUNC_ERROR;
+	}
+	if(ind->size < off + size) {
+		ind->size = off + size;
+		return fs_write_inode(fs, super, inodenum, ind);
+	}
+	return 0;
+}
+
+/**
+ * @brief writes data to an inode number
+ * @details writes the data *data* with size *size* starting from the
+ * offset *off* into the inode number *inodenum*, in the inode itself if
+ * the file stays small enough (FS_INODE_INLINE), in the dirty pages of
+ * the file with delayed allocation, else on the disk with io_write_now.
+ */
+int io_write_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
+			 void* data, uint32_t off, size_t size)
+{
+	if(size == 0) {
+		return 0;
+	}
+	struct fs_inode ind;
+	if(fs_read_inode(fs, super, inodenum, &ind) < 0) {
+		fprintf(stderr, "io_write: fs_read_inode\n");
+		return FUNC_ERROR;
+	}
+	if(ind.flags & FS_INODE_INLINE) {
+		if((uint64_t) off + size <= FS_INLINE_DATA_SIZE) {
+			memcpy(ind.inline_data + off, data, size);
+			ind.size = (ind.size > off+size)? ind.size: off+size;
+			return fs_write_inode(fs, super, inodenum, &ind);
+		}
+		/* the file outgrows its inode */
+		if(io_inline_migrate(fs, super, inodenum, &ind) < 0) {
+			fprintf(stderr, "io_write: io_inline_migrate\n");
+			return FUNC_ERROR;
+		}
+	}
+	if((uint64_t) off + size > io_max_size(&ind)) {
+		fprintf(stderr, "io_write: file too big\n");
+		return FUNC_ERROR;
+	}
+	if(fs.incore && fs.incore->sparse) {
+		return io_write_sparse(fs, super, inodenum, &ind, data, off, size);
+	}
+	return io_write_range(fs, super, inodenum, data, off, size);
+}
+
+/**
+ * @brief writes data to a file descriptor
+ * @details does the same thing as *io_write_ino* but for file descriptors
+ */
+int io_write(struct fs_filesyst fs, struct fs_super_block super, int fd,
+			 void* data, size_t size)
+{
+	if(size == 0) {
+		fprintf(stderr, "io_write: invalid argument size\n");
+		return FUNC_ERROR;
+	}
+	if(filedesc_table.fds[fd].is_allocated == 0) {
+		fprintf(stderr, "io_write: fd closed!\n");
+		return FUNC_ERROR;
+	}
+	uint32_t inodenum = filedesc_table.fds[fd].inodenum;
+
+	/* current offset*/
+	uint32_t off = filedesc_table.fds[fd].offset;
+	
+	if(io_write_ino(fs, super, inodenum, data, off, size) < 0) {
+		fprintf(stderr, "io_write: io_write_ino\n");
+		return FUNC_ERROR;
+	}
+	
+	filedesc_table.fds[fd].offset += size;
+	return 0;
+}
+
+/**
+ * @brief preallocates the blocks of a range of an inode
+ * @details all the missing blocks of [off, off+len) are allocated at
+ * once by io_lazy_alloc (contiguous if the free space allows it) and
+ * nothing is written to them: the bytes after the initialized size of
+ * the inode read as zeros until they are written, and writing them
+ * needs no allocation. the size of the file grows to off+len. the holes
+ * filled before the initialized size are zeroed on the disk. the inode
+ * table must store the inode flags (fs_has_inode_flags).
+ */
+int io_fallocate_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
+					 uint32_t off, size_t len)
+{
+	if(len == 0) {
+		return 0;
+	}
+	if(!fs_has_inode_flags(&super)) {
+		fprintf(stderr, "io_fallocate: the inode table can't store the preallocation\n");
+		return FUNC_ERROR;
+	}
+	struct fs_inode ind;
+	if(fs_read_inode(fs, super, inodenum, &ind) < 0) {
+		fprintf(stderr, "io_fallocate: fs_read_inode\n");
+		return FUNC_ERROR;
+	}
+	if((ind.flags & FS_INODE_INLINE) && io_inline_migrate(fs, super, inodenum, &ind) < 0) {
+		fprintf(stderr, "io_fallocate: io_inline_migrate\n");
+		return FUNC_ERROR;
+	}
+	if((uint64_t) off + len > io_max_size(&ind)) {
+		fprintf(stderr, "io_fallocate: file too big\n");
+		return FUNC_ERROR;
+	}
+	if(!(ind.flags & FS_INODE_PREALLOC)) {
+		ind.init_size = ind.size;
+	}
+
+	uint32_t start = off / FS_BLOCK_SIZE, end = (off + len - 1) / FS_BLOCK_SIZE;
+	uint32_t count = end - start + 1;
+	uint32_t *old = malloc(sizeof(uint32_t) * count * 2);
+	uint32_t *blknums = old + count;
+	if(old == NULL ||
+	   io_map_blocks(fs, super, &ind, start, count, old) < 0 ||
+	   io_lazy_alloc(fs, super, inodenum, &ind, off, len) < 0 ||
+	   io_map_blocks(fs, super, &ind, start, count, blknums) < 0)
+	{
+		fprintf(stderr, "io_fallocate: io_lazy_alloc\n");
+		free(old);
+		return FUNC_ERROR;
+	}
+	union fs_block zero;
+	memset(&zero, 0, FS_BLOCK_SIZE);
+	for(uint32_t i=0; i<count; i++) {
+		if(!old[i] && (uint64_t) (start + i) * FS_BLOCK_SIZE < ind.init_size &&
+		   fs_write_data(fs, super, &zero, &blknums[i], 1) < 0)
+		{
+			fprintf(stderr, "io_fallocate: fs_write_data\n");
+			free(old);
+			return FUNC_ERROR;
+		}
+	}
+	free(old);
+
+	ind.size = (ind.size > off+len)? ind.size: off+len;
+	if(ind.init_size < ind.size) {
+		ind.flags |= FS_INODE_PREALLOC;
+	}
+	if(fs_write_inode(fs, super, inodenum, &ind) < 0) {
+		fprintf(stderr, "io_fallocate: fs_write_inode\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief preallocates the blocks of a range of a file descriptor
+ * @details does the same thing as *io_fallocate_ino* but for file descriptors
+ */
+int io_fallocate(struct fs_filesyst fs, struct fs_super_block super, int fd,
+				 uint32_t off, size_t len)
+{
+	if(fd < 0 || fd >= IO_MAX_FILEDESC || filedesc_table.fds[fd].is_allocated == 0) {
+		fprintf(stderr, "io_fallocate: fd closed!\n");
+		return FUNC_ERROR;
+	}
+	return io_fallocate_ino(fs, super, filedesc_table.fds[fd].inodenum, off, len);
+}
+
+/**
+ * @brief utility function to zero a part of a block of a file
+ * @details the bytes [from, to) of the logical block *lblk* are cleared in
+ * its dirty page if it has one and on the disk. on the disk the bytes
+ * after the end of the file, the holes and the preallocated bytes already
+ * read as zeros and are left alone.
+ */
+static int io_zero_partial(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
+						   struct fs_inode *ind, uint32_t lblk, uint32_t from, uint32_t to)
+{
+	struct io_dirty_file* f = io_dirty_find(fs, inodenum);
+	if(f && lblk < f->pages_cap && f->pages[lblk]) {
+		memset(f->pages[lblk]->data + from, 0, to - from);
+	}
+	uint64_t blk_s = (uint64_t) lblk * FS_BLOCK_SIZE;
+	uint64_t written = ((ind->flags & FS_INODE_PREALLOC) && ind->init_size < ind->size)?
+		ind->init_size: ind->size;
+	if(written <= blk_s + from) {
+		return 0;
+	}
+	if(written < blk_s + to) {
+		to = written - blk_s;
+	}
+	uint32_t blknum;
+	if(io_map_blocks(fs, super, ind, lblk, 1, &blknum) < 0) {
+		fprintf(stderr, "io_zero_partial: io_map_blocks\n");
+		return FUNC_ERROR;
+	}
+	if(blknum == 0) {
+		return 0;
+	}
+	union fs_block blk;
+	if(fs_read_data(fs, super, &blk, &blknum, 1) < 0) {
+		fprintf(stderr, "io_zero_partial: fs_read_data\n");
+		return FUNC_ERROR;
+	}
+	memset(blk.data + from, 0, to - from);
+	if(fs_write_data(fs, super, &blk, &blknum, 1) < 0) {
+		fprintf(stderr, "io_zero_partial: fs_write_data\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief utility function to drop the dirty pages of a range of blocks
+ * @details the pages of the logical blocks [first, end) of the file are
+ * freed without being written
+ */
+static void io_dirty_discard(struct fs_filesyst fs, uint32_t inodenum, uint32_t first, uint32_t end) {
+	struct io_dirty_file* f = io_dirty_find(fs, inodenum);
+	if(f == NULL) {
+		return;
+	}
+	struct io_delalloc* da = fs.incore->delalloc;
+	for(uint32_t lblk=first; lblk<end && lblk<f->pages_cap; lblk++) {
+		if(f->pages[lblk]) {
+			free(f->pages[lblk]);
+			f->pages[lblk] = NULL;
+			f->npages--;
+			da->npages--;
+		}
+	}
+	if(f->npages == 0) {
+		io_dirty_drop(da, f);
+	}
+}
+
+/**
+ * @brief utility function to release the blocks of a range of extents
+ * @details the extents are cut at *first* and *end*, an extent holding
+ * the whole range becomes two. the new extents are checked to fit before
+ * anything is freed.
+ */
+static int io_release_extents(struct fs_filesyst fs, struct fs_super_block super,
+							  struct fs_inode *ind, uint32_t first, uint32_t end)
+{
+	struct io_extent_map map, cut;
+	if(io_extents_load(fs, super, ind, &map) < 0) {
+		fprintf(stderr, "io_release: io_extents_load\n");
+		return FUNC_ERROR;
+	}
+	cut.count = 0;
+	size_t count = 0;
+	for(uint32_t i=0; i<map.count; i++) {
+		struct fs_file_extent e = map.ext[i];
+		uint32_t e_end = e.lblk + e.len;
+		struct fs_file_extent keep[2];
+		int nkeep = 0;
+		if(e_end <= first || e.lblk >= end) {
+			keep[nkeep++] = e;
+		} else {
+			uint32_t s = (e.lblk > first)? e.lblk: first;
+			uint32_t t = (e_end < end)? e_end: end;
+			count += t - s;
+			if(e.lblk < first) {
+				keep[nkeep++] = (struct fs_file_extent) {e.lblk, e.start, first - e.lblk};
+			}
+			if(e_end > end) {
+				keep[nkeep++] = (struct fs_file_extent) {end, e.start + (end - e.lblk), e_end - end};
+			}
+		}
+		if(cut.count + nkeep > FS_EXTENTS_PER_BLOCK) {
+			fprintf(stderr, "io_release: too many extents\n");
+			return FUNC_ERROR;
+		}
+		for(int k=0; k<nkeep; k++) {
+			cut.ext[cut.count++] = keep[k];
+		}
+	}
+	if(count == 0) {
+		return 0;
+	}
+	uint32_t *blks = malloc(sizeof(uint32_t) * (count + 1)); /* and the extent block */
+	if(blks == NULL) {
+		perror("io_release: malloc");
+		return FUNC_ERROR;
+	}
+	size_t n = 0;
+	for(uint32_t i=0; i<map.count; i++) {
+		for(uint32_t k=0; k<map.ext[i].len; k++) {
+			uint32_t lblk = map.ext[i].lblk + k;
+			if(lblk >= first && lblk < end) {
+				blks[n++] = map.ext[i].start + k;
+			}
+		}
+	}
+	int ret = 0;
+	uint32_t unused;
+	if(io_extents_store(fs, super, ind, &cut, &unused) < 0) {
+		fprintf(stderr, "io_release: io_extents_store\n");
+		ret = FUNC_ERROR;
+	} else if(unused) {
+		blks[n++] = unused;
+	}
+	if(ret == 0 && fs_free_data_batch(fs, &super, blks, n) < 0) {
+		fprintf(stderr, "io_release: fs_free_data_batch\n");
+		ret = FUNC_ERROR;
+	}
+	free(blks);
+	return ret;
+}
+
+/**
+ * @brief utility function to release the blocks [first, end) of a file
+ * @details the blocks are unmapped from *ind* and freed together with
+ * fs_free_data_batch, the indirect block too once it maps no block. the
+ * inode is not written here.
+ */
+static int io_release_blocks(struct fs_filesyst fs, struct fs_super_block super,
+							 struct fs_inode *ind, uint32_t first, uint32_t end)
+{
+	if(ind->flags & FS_INODE_EXTENTS) {
+		return io_release_extents(fs, super, ind, first, end);
+	}
+	uint32_t blks[FS_MAX_FILE_BLOCKS + 1];
+	size_t count = 0;
+	for(uint32_t i=first; i<end && i<FS_DIRECT_POINTERS_PER_INODE; i++) {
+		if(ind->direct[i]) {
+			blks[count++] = ind->direct[i];
+			ind->direct[i] = 0;
+		}
+	}
+	if(ind->indirect && end > FS_DIRECT_POINTERS_PER_INODE) {
+		union fs_block indirect_data;
+		if(fs_read_data(fs, super, &indirect_data, &ind->indirect, 1) < 0) {
+			fprintf(stderr, "io_release: fs_read_data\n");
+			return FUNC_ERROR;
+		}
+		uint32_t from = (first > FS_DIRECT_POINTERS_PER_INODE)? first - FS_DIRECT_POINTERS_PER_INODE: 0;
+		uint32_t to = end - FS_DIRECT_POINTERS_PER_INODE;
+		int used = 0, changed = 0;
+		for(uint32_t i=0; i<FS_POINTERS_PER_BLOCK; i++) {
+			if(indirect_data.pointers[i] == 0) {
+				continue;
+			}
+			if(i >= from && i < to) {
+				blks[count++] = indirect_data.pointers[i];
+				indirect_data.pointers[i] = 0;
+				changed = 1;
+			} else {
+				used = 1;
+			}
+		}
+		if(!used) {
+			blks[count++] = ind->indirect;
+			ind->indirect = 0;
+		} else if(changed && fs_write_data(fs, super, &indirect_data, &ind->indirect, 1) < 0) {
+			fprintf(stderr, "io_release: fs_write_data\n");
+			return FUNC_ERROR;
+		}
+	}
+	if(count > 0 && fs_free_data_batch(fs, &super, blks, count) < 0) {
+		fprintf(stderr, "io_release: fs_free_data_batch\n");
+		return FUNC_ERROR;
+	}
+	return 0;
 }
 
 /**
- * @brief allocates blocks based on *off* and *size*
- * @details a utility functions used by io_write to allocate the least
- * possible amount of blocks based on the writing offset *off* and the
- * writing size *size*.
+ * @brief changes the size of a file of an inode number
+ * @details a file cut to *len* bytes loses the blocks after the cut, they
+ * are freed in one batch (the indirect block too once it is empty) and
+ * the rest of its last block is zeroed. a file grown by a truncate gets
+ * a hole, nothing is allocated.
  */
-int io_lazy_alloc(struct fs_filesyst fs, struct fs_super_block super,
-				uint32_t inodenum, struct fs_inode *ind, size_t off, size_t size)
+int io_truncate_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
+					uint32_t len)
 {
-	uint32_t direct_off = FS_DIRECT_POINTERS_PER_INODE * FS_BLOCK_SIZE;
-	
-	uint32_t level0range_s, level0range_e;
-	level0range_s = (off < direct_off)? off: direct_off;
-	level0range_e = (off + size < direct_off)? off+size-1: direct_off+FS_BLOCK_SIZE-1;
-
-	uint32_t level1range_s, level1range_e;
-	level1range_s = (off < direct_off)? 0: off-direct_off;
-	level1range_e = (off + size < direct_off)? 0: off+size-direct_off-1;
-	
-	/* sanity check */
-	if(level0range_e < level0range_s || level1range_e < level1range_s) {
-		fprintf(stderr, "fs_lazy_alloc: end smaller than start!\n");
+	struct fs_inode ind;
+	if(fs_read_inode(fs, super, inodenum, &ind) < 0) {
+		fprintf(stderr, "io_truncate: fs_read_inode\n");
 		return FUNC_ERROR;
 	}
-
-	/* level 0 (eg. direct) */
-	uint32_t start = level0range_s / FS_BLOCK_SIZE;
-	uint32_t end = level0range_e / FS_BLOCK_SIZE;
-	int allocs_needed = 0;
-	for(int i=start; i<=end; i++) {
-		if(i == FS_DIRECT_POINTERS_PER_INODE) {
-			allocs_needed += (ind->indirect == 0);
-			continue;
-		}
-		allocs_needed += (ind->direct[i] == 0);
-	}
-
-	if(allocs_needed) {
-		uint32_t *dt = malloc(sizeof(uint32_t) * allocs_needed);
-		if(dt == NULL) {
-			fprintf(stderr, "fs_lazy_alloc: malloc\n");
-			return FUNC_ERROR;
-		}
-		if(fs_alloc_data(fs, &super, dt, allocs_needed) < 0) {
-			fprintf(stderr, "fs_lazy_alloc: fs_alloc_data\n");
-			return FUNC_ERROR;
-		}
-		for(int i=start, j=0; i<=end && j<allocs_needed; i++) {
-			if(i == FS_DIRECT_POINTERS_PER_INODE) {
-				if(ind->indirect == 0) {
-					ind->indirect = dt[j++];
-					union fs_block temp;
-					memset(&temp, 0, sizeof(temp));
-					if(fs_write_data(fs, super, &temp, &ind->indirect, 1) < 0) {
-						fprintf(stderr, "fs_lazy_alloc: fs_write_block\n");
-					}
-				}
-				break;
+	if(ind.flags & FS_INODE_INLINE) {
+		if(len <= FS_INLINE_DATA_SIZE) {
+			if(len < ind.size) {
+				memset(ind.inline_data + len, 0, FS_INLINE_DATA_SIZE - len);
 			}
-			if(ind->direct[i] == 0) {
-				ind->direct[i] = dt[j++];
+			ind.size = len;
+			if(fs_write_inode(fs, super, inodenum, &ind) < 0) {
+				fprintf(stderr, "io_truncate: fs_write_inode\n");
+				return FUNC_ERROR;
 			}
+			return 0;
 		}
-		/* write changes to disk */
-		if(fs_write_inode(fs, super, inodenum, ind) < 0) {
-			fprintf(stderr, "fs_lazy_alloc: fs_write_inode\n"); 
+		if(io_inline_migrate(fs, super, inodenum, &ind) < 0) {
+			fprintf(stderr, "io_truncate: io_inline_migrate\n");
 			return FUNC_ERROR;
 		}
-		free(dt);
-	}
-
-	/* level 1 (eg. indirect) */
-	/* read the indirect block */
-	if(ind->indirect == 0 || level1range_e == -1) {
-		return 0; /* no more allocation needed */
 	}
-	
-	union fs_block indirect_data;
-	if(fs_read_data(fs, super, &indirect_data, &ind->indirect, 1) < 0) {
-		fprintf(stderr, "fs_lazy_alloc: fs_read_data\n");
+	if(len > io_max_size(&ind)) {
+		fprintf(stderr, "io_truncate: file too big\n");
 		return FUNC_ERROR;
 	}
-	/* allocs */
-	start = level1range_s / FS_BLOCK_SIZE;
-	end = level1range_e / FS_BLOCK_SIZE;
-	allocs_needed = 0;
-	for(int i=start; i<=end; i++) {
-		allocs_needed += (indirect_data.pointers[i] == 0);
-	}
-	if(allocs_needed) {
-		uint32_t *dt = malloc(sizeof(uint32_t) * allocs_needed);
-		if(dt == NULL) {
-			fprintf(stderr, "fs_lazy_alloc: malloc\n");
+	if(len < ind.size) {
+		uint32_t first = ((uint64_t) len + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+		if(len % FS_BLOCK_SIZE &&
+		   io_zero_partial(fs, super, inodenum, &ind, len / FS_BLOCK_SIZE,
+						   len % FS_BLOCK_SIZE, FS_BLOCK_SIZE) < 0)
+		{
+			fprintf(stderr, "io_truncate: io_zero_partial\n");
 			return FUNC_ERROR;
 		}
-		if(fs_alloc_data(fs, &super, dt, allocs_needed) < 0) {
-			fprintf(stderr, "fs_lazy_alloc: fs_alloc_data\n");
+		io_dirty_discard(fs, inodenum, first, UINT32_MAX);
+		if(io_release_blocks(fs, super, &ind, first, UINT32_MAX) < 0) {
+			fprintf(stderr, "io_truncate: io_release_blocks\n");
 			return FUNC_ERROR;
 		}
-		for(int i=start, j=0; i<=end && j<allocs_needed; i++) {
-			if(indirect_data.pointers[i] == 0) {
-				indirect_data.pointers[i] = dt[j++];
+		if(ind.flags & FS_INODE_PREALLOC) {
+			ind.init_size = (ind.init_size < len)? ind.init_size: len;
+			if(ind.init_size >= len) {
+				ind.flags &= ~FS_INODE_PREALLOC; /* no preallocated bytes left */
 			}
 		}
-		/* write changes to disk */
-		if(fs_write_data(fs, super, &indirect_data, &ind->indirect, 1) < 0) {
-			fprintf(stderr, "fs_lazy_alloc: fs_write_inode\n"); 
-			return FUNC_ERROR;
-		}
-		free(dt);
+	}
+	ind.size = len;
+	if(fs_write_inode(fs, super, inodenum, &ind) < 0) {
+		fprintf(stderr, "io_truncate: fs_write_inode\n");
+		return FUNC_ERROR;
 	}
 	return 0;
 }
 
 /**
- * @brief changes the current offset of the file descriptor
- * @details changes the offset of the file descriptor *fd* to *new_off*
+ * @brief changes the size of the file of a file descriptor
+ * @details does the same thing as *io_truncate_ino* but for file descriptors,
+ * the offset of the descriptor is not changed
  */
-int io_lseek(struct fs_filesyst fs, struct fs_super_block super, int fd,
-			  size_t new_off)
-{
-	filedesc_table.fds[fd].offset = new_off;
-	return 0;
+int io_truncate(struct fs_filesyst fs, struct fs_super_block super, int fd, uint32_t len) {
+	if(fd < 0 || fd >= IO_MAX_FILEDESC || filedesc_table.fds[fd].is_allocated == 0) {
+		fprintf(stderr, "io_truncate: fd closed!\n");
+		return FUNC_ERROR;
+	}
+	return io_truncate_ino(fs, super, filedesc_table.fds[fd].inodenum, len);
 }
 
 /**
- * @brief writes data to an inode number
- * @details writes the data *data* with size *size* starting from the offset
- * *off* into the inode number *inodenum*
- * Note: the lazy allocation is done here.
+ * @brief punches a hole in a file of an inode number
+ * @details the blocks fully inside [off, off+len) are freed in one batch
+ * (the indirect block too once it is empty) and the rest of the range is
+ * zeroed in its first and last blocks. the range is cut at the end of the
+ * file, the size of the file does not change.
  */
-int io_write_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
-			 void* data, uint32_t off, size_t size)
+int io_punch_hole_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
+					  uint32_t off, size_t len)
 {
 	struct fs_inode ind;
 	if(fs_read_inode(fs, super, inodenum, &ind) < 0) {
-		fprintf(stderr, "io_write: fs_read_inode\n");
-		return FUNC_ERROR;
-	}
-
-	/* lazy allocation */
-	if(io_lazy_alloc(fs, super, inodenum, &ind, off, size) < 0) {
-		fprintf(stderr, "io_write: lazy allocation failed\n");
+		fprintf(stderr, "io_punch_hole: fs_read_inode\n");
 		return FUNC_ERROR;
 	}
-	/* actual writing */
-	uint32_t direct_off = FS_DIRECT_POINTERS_PER_INODE * FS_BLOCK_SIZE;
-
-	// note that level0 and level1 signify direct and indirect respectively
-	uint32_t level0range_s, level0range_e; // the offsets (start and end) for the writing in the direct section 
-	// (the indirect block pointer itself is not included)
-	level0range_s = (off < direct_off)? off: direct_off-1;
-	level0range_e = (off + size < direct_off)? off+size-1: direct_off-1;
-	
-	uint32_t level1range_s, level1range_e;
-	level1range_s = (off < direct_off)? 0: off-direct_off;
-	level1range_e = (off + size < direct_off)? 0: off+size-1-direct_off;
-
-	int data_index = 0;
-	
-	/* direct writing */
-	if(level0range_s == level0range_e) { /* no direct writing needed*/
-		goto indirect_writing; 
-		// the goto is only used to seperate the major sections of writing (direct and indirect)
+	if(len == 0 || off >= ind.size) {
+		return 0;
 	}
-	uint32_t start = level0range_s/FS_BLOCK_SIZE, end = level0range_e/FS_BLOCK_SIZE;
-	
-	if(start == end) {
-		union fs_block datablk;
-		if(fs_read_data(fs, super, &datablk, &ind.direct[start], 1) < 0) {
-			fprintf(stderr, "io_write: fs_read_data!\n");
-			return FUNC_ERROR;
-		}
-		for(int i=level0range_s%FS_BLOCK_SIZE; i<=level0range_e%FS_BLOCK_SIZE; i++) {
-			datablk.data[i] = ((uint8_t*) data) [data_index++];
-		}
-		if(fs_write_data(fs, super, &datablk, &ind.direct[start], 1) < 0) {
-			fprintf(stderr, "io_write: fs_write_data!\n");
-			return FUNC_ERROR;
-		}
+	uint32_t end = (len < ind.size - off)? off + len: ind.size;
+	if(ind.flags & FS_INODE_INLINE) {
+		memset(ind.inline_data + off, 0, end - off);
 	} else {
-		union fs_block datablk_s, datablk_e;
-		if(fs_read_data(fs, super, &datablk_s, &ind.direct[start], 1) < 0) {
-			fprintf(stderr, "io_write: fs_read_data!\n");
-			return FUNC_ERROR;
-		} /* todo: combine the two ifs*/
-		if(fs_read_data(fs, super, &datablk_e, &ind.direct[end], 1) < 0) {
-			fprintf(stderr, "io_write: fs_read_data!\n");
-			return FUNC_ERROR;
-		}
-		/* start */
-		for(int i=level0range_s%FS_BLOCK_SIZE; i<FS_BLOCK_SIZE; i++) {
-			datablk_s.data[i] = ((uint8_t*) data) [data_index++];
-		}
-		if(fs_write_data(fs, super, &datablk_s, &ind.direct[start], 1) < 0) {
-			fprintf(stderr, "io_write: fs_write_data!\n");
-			return FUNC_ERROR;
-		}
-		
-		/* middle */
-		for(uint32_t i=start+1; i<=end-1 && start+1 <= end-1; i++) {
-			union fs_block* datablk;
-			datablk = data  + data_index;
-			data_index += FS_BLOCK_SIZE;
-			if(fs_write_data(fs, super, datablk, &ind.direct[i], 1) < 0) { /* todo: change write and read to do one block at a time*/
-				fprintf(stderr, "io_write: fs_write_data!\n");
+		/* the last block of the file goes too if the range reaches the end */
+		uint32_t first = ((uint64_t) off + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+		uint32_t last = (end == ind.size)? ((uint64_t) end + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE:
+			end / FS_BLOCK_SIZE;
+		if(first < last) {
+			io_dirty_discard(fs, inodenum, first, last);
+			if(io_release_blocks(fs, super, &ind, first, last) < 0) {
+				fprintf(stderr, "io_punch_hole: io_release_blocks\n");
 				return FUNC_ERROR;
 			}
 		}
-		/* end */
-		for(int i=0; i<=level0range_e%FS_BLOCK_SIZE; i++) {
-			datablk_e.data[i] = ((uint8_t*) data) [data_index++];
+		int ret = 0;
+		if(first > last) { /* inside one block */
+			ret = io_zero_partial(fs, super, inodenum, &ind, last, off % FS_BLOCK_SIZE,
+								  end - last * FS_BLOCK_SIZE);
+		} else {
+			if(off % FS_BLOCK_SIZE) {
+				ret = io_zero_partial(fs, super, inodenum, &ind, off / FS_BLOCK_SIZE,
+									  off % FS_BLOCK_SIZE, FS_BLOCK_SIZE);
+			}
+			if(ret == 0 && (uint64_t) last * FS_BLOCK_SIZE < end) {
+				ret = io_zero_partial(fs, super, inodenum, &ind, last, 0,
+									  end - last * FS_BLOCK_SIZE);
+			}
 		}
-		if(fs_write_data(fs, super, &datablk_e, &ind.direct[end], 1) < 0) {
-			fprintf(stderr, "io_write: fs_write_data!\n");
+		if(ret < 0) {
+			fprintf(stderr, "io_punch_hole: io_zero_partial\n");
 			return FUNC_ERROR;
 		}
-
 	}
-	
-	indirect_writing:
-	/* indirect writing */
-	if(level1range_s == level1range_e) { /* no indirect writing needed */
-		goto end_write;
-		// the goto is only used to seperate the major sections of writing (direct and indirect)
+	if(fs_write_inode(fs, super, inodenum, &ind) < 0) {
+		fprintf(stderr, "io_punch_hole: fs_write_inode\n");
+		return FUNC_ERROR;
 	}
-	union fs_block indirect_data;
-	if(fs_read_data(fs, super, &indirect_data, &ind.indirect, 1) < 0) {
-		fprintf(stderr, "io_write: fs_read_data\n");
+	return 0;
+}
+
+/**
+ * @brief punches a hole in the file of a file descriptor
+ * @details does the same thing as *io_punch_hole_ino* but for file descriptors
+ */
+int io_punch_hole(struct fs_filesyst fs, struct fs_super_block super, int fd,
+				  uint32_t off, size_t len)
+{
+	if(fd < 0 || fd >= IO_MAX_FILEDESC || filedesc_table.fds[fd].is_allocated == 0) {
+		fprintf(stderr, "io_punch_hole: fd closed!\n");
 		return FUNC_ERROR;
 	}
+	return io_punch_hole_ino(fs, super, filedesc_table.fds[fd].inodenum, off, len);
+}
 
-	start = level1range_s/FS_BLOCK_SIZE, end = level1range_e/FS_BLOCK_SIZE;
-	if(start == end) {
-		union fs_block datablk;
-		if(fs_read_data(fs, super, &datablk, &indirect_data.pointers[start], 1) < 0) {
-			fprintf(stderr, "io_write: fs_read_data!\n");
-			return FUNC_ERROR;
-		}
-		for(int i=level1range_s%FS_BLOCK_SIZE; i<=level1range_e%FS_BLOCK_SIZE; i++) {
-			datablk.data[i] = ((uint8_t*) data) [data_index++];
-		}
-		if(fs_write_data(fs, super, &datablk, &indirect_data.pointers[start], 1) < 0) {
-			fprintf(stderr, "io_write: fs_write_data!\n");
-			return FUNC_ERROR;
-		}
-	} else {
-		union fs_block datablk_s, datablk_e;
-		if(fs_read_data(fs, super, &datablk_s, &indirect_data.pointers[start], 1) < 0) {
-			fprintf(stderr, "io_write: fs_read_data!\n");
-			return FUNC_ERROR;
-		} /* todo: combine the two ifs*/
-		if(fs_read_data(fs, super, &datablk_e, &indirect_data.pointers[end], 1) < 0) {
-			fprintf(stderr, "io_write: fs_read_data!\n");
-			return FUNC_ERROR;
-		}
-		for(int i=level1range_s%FS_BLOCK_SIZE; i<FS_BLOCK_SIZE; i++) {
-			datablk_s.data[i] = ((uint8_t*) data) [data_index++];
-		}
-		if(fs_write_data(fs, super, &datablk_s, &indirect_data.pointers[start], 1) < 0) {
-			fprintf(stderr, "io_write: fs_write_data!\n");
-			return FUNC_ERROR;
-		} /* todo: combine the two ifs*/
-
-		for(uint32_t i=start+1; i<=end-1 && start+1 <= end-1; i++) {
-			union fs_block* datablk;
-			datablk = data  + data_index;
-			data_index += FS_BLOCK_SIZE;
-			if(fs_write_data(fs, super, datablk, &indirect_data.pointers[i], 1) < 0) { /* todo: change write and read to do one block at a time*/
-				fprintf(stderr, "io_write: fs_write_data!\n");
-				return FUNC_ERROR;
-			}
-		}
-		for(int i=0; i<=level1range_e%FS_BLOCK_SIZE; i++) {
-			datablk_e.data[i] = ((uint8_t*) data) [data_index++];
-		}
-		if(fs_write_data(fs, super, &datablk_e, &indirect_data.pointers[end], 1) < 0) {
-			fprintf(stderr, "io_write: fs_write_data!\n");
-			return FUNC_ERROR;
-		}
+/**
+ * @brief utility function to read a part of a block of a file
+ * @details the bytes [from, to) of the logical block *lblk* are put in
+ * *data*, zeros for a hole (*blknum* 0)
+ */
+static int io_read_partial(struct fs_filesyst fs, struct fs_super_block super, struct fs_inode *ind,
+						   uint32_t lblk, uint32_t blknum, uint8_t* data, uint32_t from, uint32_t to)
+{
+	if(blknum == 0) {
+		memset(data, 0, to - from);
+		return 0;
 	}
-	end_write:
-	ind.size = (ind.size > off+size)? ind.size: off+size;
-	if(fs_write_inode(fs, super, inodenum, &ind) < 0) {
-		fprintf(stderr, "io_write: fs_write_inode\n");
+	union fs_block datablk;
+	if(fs_read_data(fs, super, &datablk, &blknum, 1) < 0) {
+		fprintf(stderr, "io_read: fs_read_data!\n");
 		return FUNC_ERROR;
 	}
+	io_mask_unwritten(ind, lblk, &datablk);
+	memcpy(data, datablk.data + from, to - from);
 	return 0;
 }
 
 /**
- * @brief writes data to a file descriptor
- * @details does the same thing as *io_write_ino* but for file descriptors
+ * @brief utility function to read data from the blocks of a file
+ * @details *blknums* are the data blocks of the logical blocks read (0
+ * for the holes). the blocks fully covered by the read are read directly
+ * into *data*, each run of allocated blocks with a single fs_read_data.
+ * only a partly covered first or last block goes through a block buffer.
+ * the holes are zero-filled without any disk access.
  */
-int io_write(struct fs_filesyst fs, struct fs_super_block super, int fd,
-			 void* data, size_t size)
+static int io_read_blocks(struct fs_filesyst fs, struct fs_super_block super, struct fs_inode *ind,
+						  uint32_t *blknums, void* data, uint32_t off, size_t size)
 {
-	if(size == 0) {
-		fprintf(stderr, "io_write: invalid argument size\n");
-		return FUNC_ERROR;
+	uint32_t start = off / FS_BLOCK_SIZE, end = (off + size - 1) / FS_BLOCK_SIZE;
+	uint32_t count = end - start + 1;
+	uint32_t range_s = off % FS_BLOCK_SIZE;
+	uint32_t range_e = (off + size - 1) % FS_BLOCK_SIZE + 1;
+	uint32_t head = (range_s != 0 || (start == end && range_e != FS_BLOCK_SIZE));
+	uint32_t tail = (start != end && range_e != FS_BLOCK_SIZE);
+	uint8_t* dst = data;
+
+	/* start (it is also the end if the reading fits in one block) */
+	if(head) {
+		uint32_t to = (start == end)? range_e: FS_BLOCK_SIZE;
+		if(io_read_partial(fs, super, ind, start, blknums[0], dst, range_s, to) < 0) {
+			return FUNC_ERROR;
+		}
+		dst += to - range_s;
 	}
-	if(filedesc_table.fds[fd].is_allocated == 0) {
-		fprintf(stderr, "io_write: fd closed!\n");
+
+	/* the fully covered blocks, the runs of allocated blocks are read into
+	 * the caller's buffer (all in flight at the same time with io_uring) */
+	int ret = 0;
+	disk_plug(fs);
+	for(uint32_t i=head; ret == 0 && i<count-tail;) {
+		uint32_t n = 1;
+		while(i+n < count-tail && (blknums[i+n] == 0) == (blknums[i] == 0)) {
+			n++;
+		}
+		if(blknums[i] == 0) {
+			memset(dst, 0, (size_t) n * FS_BLOCK_SIZE);
+		} else {
+			ret = fs_read_data(fs, super, dst, blknums + i, n);
+		}
+		dst += (size_t) n * FS_BLOCK_SIZE;
+		i += n;
+	}
+	if(disk_unplug(fs) < 0 || ret < 0) {
+		fprintf(stderr, "io_read: fs_read_data!\n");
 		return FUNC_ERROR;
 	}
-	uint32_t inodenum = filedesc_table.fds[fd].inodenum;
+	/* the preallocated end of the full block holding the initialized size */
+	uint64_t full_s = (uint64_t) (start + head) * FS_BLOCK_SIZE;
+	uint64_t full_e = (uint64_t) (end + 1 - tail) * FS_BLOCK_SIZE;
+	if((ind->flags & FS_INODE_PREALLOC) && ind->init_size > full_s && ind->init_size < full_e) {
+		memset((uint8_t*) data + (ind->init_size - off), 0, full_e - ind->init_size);
+	}
 
-	/* current offset*/
-	uint32_t off = filedesc_table.fds[fd].offset;
-	
-	if(io_write_ino(fs, super, inodenum, data, off, size) < 0) {
-		fprintf(stderr, "io_write: io_write_ino\n");
+	/* end */
+	if(tail && io_read_partial(fs, super, ind, end, blknums[count-1], dst, 0, range_e) < 0) {
 		return FUNC_ERROR;
 	}
-	
-	filedesc_table.fds[fd].offset += size;
 	return 0;
 }
 
 /**
- * @brief read data from an inode number
+ * @brief utility function to read data from the blocks of an inode number
  * @details reads data from the inode number *inodenum* and puts it in
  * the pointer *data* with size *size* starting from the offset *off*
+ * with io_read_blocks.
  * Note: no allocation or deallocation is done here
  */
-int io_read_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
-			 void* data, uint32_t off, size_t size)
+static int io_read_now(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
+					   void* data, uint32_t off, size_t size)
 {
+	if(size == 0) {
+		return 0;
+	}
 	struct fs_inode ind;
 	if(fs_read_inode(fs, super, inodenum, &ind) < 0) {
 		fprintf(stderr, "io_read: fs_read_inode\n");
 		return FUNC_ERROR;
 	}
-
-	uint32_t direct_off = FS_DIRECT_POINTERS_PER_INODE * FS_BLOCK_SIZE; 
-	// note that level0 and level1 signify direct and indirect respectively
-	uint32_t level0range_s, level0range_e; // the offsets for the reading in the direct section 
-	// (the indirect block pointer itself is not included)
-	level0range_s = (off < direct_off)? off: direct_off-1; 
-	level0range_e = (off + size < direct_off)? off+size-1: direct_off-1;
-	
-	uint32_t level1range_s, level1range_e;// the offsets for the reading in the indirect section
-	level1range_s = (off < direct_off)? 0: off-direct_off;
-	level1range_e = (off + size < direct_off)? 0: off+size-1-direct_off;
-
-	int data_index = 0;
-	
-	/* direct reading */
-	if(level0range_s == level0range_e) { /* no direct writing needed*/
-		goto indirect_reading;
-		// the goto is only used to seperate the major sections of reading (direct and indirect)
-	}
-	uint32_t start = level0range_s/FS_BLOCK_SIZE, end = level0range_e/FS_BLOCK_SIZE;
-	if(start == end) {
-		if(!ind.direct[start]) {/* todo: remove second test when adding security to fs_read and fs_write */
-			for(int i=level0range_s % FS_BLOCK_SIZE; i<level0range_e % FS_BLOCK_SIZE; i++) {
-				((uint8_t*) data) [data_index++] = 0;
-			}
-		} else {
-			/* else return values */
-			union fs_block datablk;
-			if(fs_read_data(fs, super, &datablk, &ind.direct[start], 1) < 0) {
-				fprintf(stderr, "io_read: fs_read_data!\n");
-				return FUNC_ERROR;
-			}
-			for(int i=level0range_s % FS_BLOCK_SIZE; i<level0range_e % FS_BLOCK_SIZE; i++) {
-				((uint8_t*) data) [data_index++] = datablk.data[i];
-			}
-		}
-	} else {		
-		union fs_block datablk_s, datablk_e;
-		/* start */
-		if(!ind.direct[start]) {
-			for(int i=level0range_s%FS_BLOCK_SIZE; i<FS_BLOCK_SIZE; i++) {
-				((uint8_t*) data) [data_index++] = 0;
-			}
-		} else {
-			if(fs_read_data(fs, super, &datablk_s, &ind.direct[start], 1) < 0) {
-				fprintf(stderr, "io_read: fs_read_data!\n");
-				return FUNC_ERROR;
-			}
-			for(int i=level0range_s%FS_BLOCK_SIZE; i<FS_BLOCK_SIZE; i++) {
-				((uint8_t*) data) [data_index++] = datablk_s.data[i];
-			}
-		}
-		for(uint32_t i=start+1; i<=end-1 && start+1 <= end-1; i++) {
-			union fs_block datablk;
-			if(!ind.direct[i] || !fs_is_data_allocated(fs, super, ind.direct[i])) {
-				for(uint32_t j=0; j<FS_BLOCK_SIZE; j++) {
-					((uint8_t*) data)[data_index++] = 0;
-				}
-			} else {
-				if(fs_read_data(fs, super, &datablk, &ind.direct[i], 1) < 0) { /* todo: change write and read to do one block at a time*/
-					fprintf(stderr, "io_read: fs_write_data!\n");
-					return FUNC_ERROR;
-				}
-				for(uint32_t j=0; j<FS_BLOCK_SIZE; j++) {
-					((uint8_t*) data)[data_index++] = datablk.data[j];
-				}
-			}
-		}
-		/* end */
-		if(!ind.direct[end] || !fs_is_data_allocated(fs, super, ind.direct[end])) {
-			for(int i=0; i<=level0range_e%FS_BLOCK_SIZE; i++) {
-				((uint8_t*) data) [data_index++] = 0;
-			}			
-		} else {
-			if(fs_read_data(fs, super, &datablk_e, &ind.direct[end], 1) < 0) {
-				fprintf(stderr, "io_read: fs_read_data!\n");
-				return FUNC_ERROR;
-			}
-			for(int i=0; i<=level0range_e%FS_BLOCK_SIZE; i++) {
-				((uint8_t*) data) [data_index++] = datablk_e.data[i];
-			}
-		}
+	if((uint64_t) off + size > io_max_size(&ind)) {
+		fprintf(stderr, "io_read: read past the maximum file size\n");
+		return FUNC_ERROR;
 	}
-	
-	indirect_reading:
-	/* indirect reading */
-	if(level1range_s == level1range_e || ind.indirect == 0) { /* no indirect reading needed */
-		goto end_read;
-		// the goto is only used to seperate the major sections of reading (direct and indirect)
+	if(ind.flags & FS_INODE_INLINE) {
+		/* the data was read with the inode */
+		memset(data, 0, size);
+		if(off < FS_INLINE_DATA_SIZE) {
+			size_t n = ((uint64_t) off + size < FS_INLINE_DATA_SIZE)? size: FS_INLINE_DATA_SIZE - off;
+			memcpy(data, ind.inline_data + off, n);
+		}
+		return 0;
 	}
-	union fs_block indirect_data;
-	if(fs_read_data(fs, super, &indirect_data, &ind.indirect, 1) < 0) {
-		fprintf(stderr, "io_read: fs_read_data\n");
+
+	uint32_t start = off / FS_BLOCK_SIZE, end = (off + size - 1) / FS_BLOCK_SIZE;
+	uint32_t count = end - start + 1;
+	uint32_t *blknums = malloc(sizeof(uint32_t) * count);
+	if(blknums == NULL || io_map_blocks(fs, super, &ind, start, count, blknums) < 0) {
+		fprintf(stderr, "io_read: io_map_blocks\n");
+		free(blknums);
 		return FUNC_ERROR;
 	}
-
-	start = level1range_s/FS_BLOCK_SIZE, end = level1range_e/FS_BLOCK_SIZE;
-	if(start == end) {
-		union fs_block datablk;
-		if(!indirect_data.pointers[start] || !fs_is_data_allocated(fs, super, indirect_data.pointers[start])) {
-			for(int i=level0range_s % FS_BLOCK_SIZE; i<level0range_e % FS_BLOCK_SIZE; i++) {
-				((uint8_t*) data) [data_index++] = 0;
-			}		
-		} else {
-			if(fs_read_data(fs, super, &datablk, &indirect_data.pointers[start], 1) < 0) {
-				fprintf(stderr, "io_read: fs_read_data!\n");
-				return FUNC_ERROR;
-			}
-			for(int i=level0range_s % FS_BLOCK_SIZE; i<level0range_e % FS_BLOCK_SIZE; i++) {
-				((uint8_t*) data) [data_index++] = datablk.data[i];
-			}
-		}
-	} else {
-		union fs_block datablk_s, datablk_e;
-		/* start */
-		if(!indirect_data.pointers[start] || !fs_is_data_allocated(fs, super, indirect_data.pointers[start])) {
-			for(int i=level1range_s%FS_BLOCK_SIZE; i<FS_BLOCK_SIZE; i++) {
-				((uint8_t*) data) [data_index++] = 0;
-			}			
-		} else { 
-			if(fs_read_data(fs, super, &datablk_s, &indirect_data.pointers[start], 1) < 0) {
-				fprintf(stderr, "io_read: fs_read_data!\n");
-				return FUNC_ERROR;
-			}
-			for(int i=level1range_s%FS_BLOCK_SIZE; i<FS_BLOCK_SIZE; i++) {
-				((uint8_t*) data) [data_index++] = datablk_s.data[i];
-			}
+	/* the preallocated blocks are read as holes */
+	for(uint32_t i=0; i<count; i++) {
+		if(io_is_unwritten(&ind, start + i)) {
+			blknums[i] = 0;
 		}
-		
-		/* middle */
-		for(uint32_t i=start+1; i<=end-1 && start+1 <= end-1; i++) {
-			union fs_block datablk;
-			if(!indirect_data.pointers[i] || !fs_is_data_allocated(fs, super, indirect_data.pointers[i])) {
-				for(uint32_t j=0; j<FS_BLOCK_SIZE; j++) {
-					((uint8_t*) data)[data_index++] = 0;
-				}
-			} else {
-				if(fs_read_data(fs, super, &datablk, &indirect_data.pointers[i], 1) < 0) { /* todo: change write and read to do one block at a time*/
-					fprintf(stderr, "io_read: fs_write_data!\n");
-					return FUNC_ERROR;
-				}
-				for(uint32_t j=0; j<FS_BLOCK_SIZE; j++) {
-					((uint8_t*) data)[data_index++] = datablk.data[j];
-				}
-			}
-		}
-		/* end */
-		if(!indirect_data.pointers[end] || !fs_is_data_allocated(fs, super, indirect_data.pointers[end])) {
-			for(int i=0; i<=level1range_e%FS_BLOCK_SIZE; i++) {
-				((uint8_t*) data) [data_index++] = 0;
-			}			
-		} else {
-			if(fs_read_data(fs, super, &datablk_e, &indirect_data.pointers[end], 1) < 0) {
-				fprintf(stderr, "io_read: fs_read_data!\n");
-				return FUNC_ERROR;
-			}
-			for(int i=0; i<=level1range_e%FS_BLOCK_SIZE; i++) {
-				((uint8_t*) data) [data_index++] = datablk_e.data[i];
-			}
+	}
+	int ret = io_read_blocks(fs, super, &ind, blknums, data, off, size);
+	free(blknums);
+	return ret;
+}
+
+/**
+ * @brief read data from an inode number
+ * @details same as io_read_now, the dirty pages of the file (with
+ * delayed allocation) are then copied over the data read
+ */
+int io_read_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
+			 void* data, uint32_t off, size_t size)
+{
+	if(io_read_now(fs, super, inodenum, data, off, size) < 0) {
+		return FUNC_ERROR;
+	}
+	struct io_dirty_file* f = io_dirty_find(fs, inodenum);
+	if(f == NULL || size == 0) {
+		return 0;
+	}
+	uint32_t start = off / FS_BLOCK_SIZE, end = (off + size - 1) / FS_BLOCK_SIZE;
+	for(uint32_t lblk=start; lblk<=end && lblk<f->pages_cap; lblk++) {
+		if(f->pages[lblk]) {
+			uint32_t from, to;
+			io_block_range(lblk, off, size, &from, &to);
+			memcpy((uint8_t*) data + ((uint64_t) lblk * FS_BLOCK_SIZE + from - off),
+				   f->pages[lblk]->data + from, to - from);
 		}
 	}
-	end_read:
 	return 0;
 }
 
@@ -641,17 +1974,138 @@ int io_read(struct fs_filesyst fs, struct fs_super_block super, int fd,
 	filedesc_table.fds[fd].offset += size;	
 	return 0;
 }
+/**
+ * @brief finds the data or the holes of an inode number
+ * @details with IO_SEEK_DATA *res* is the start of the first block at or
+ * after *off* with data (allocated and written, or in a dirty page), with
+ * IO_SEEK_HOLE the start of the first other block, or the size of the
+ * file if there is none. the preallocated blocks that were not written
+ * are holes. the blocks are mapped IO_SEEK_BATCH at a time.
+ * @return 0, IO_SEEK_NONE if *off* is past the end of the file or if there
+ * is no data after *off* (nothing is printed), or -1 in case of an error
+ */
+int io_seek_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum,
+				uint32_t off, int whence, uint32_t* res)
+{
+	if(whence != IO_SEEK_SET && whence != IO_SEEK_DATA && whence != IO_SEEK_HOLE) {
+		fprintf(stderr, "io_seek: invalid whence %d\n", whence);
+		return FUNC_ERROR;
+	}
+	struct fs_inode ind;
+	if(fs_read_inode(fs, super, inodenum, &ind) < 0) {
+		fprintf(stderr, "io_seek: fs_read_inode\n");
+		return FUNC_ERROR;
+	}
+	if(whence == IO_SEEK_SET) {
+		*res = off;
+		return 0;
+	}
+	if(off >= ind.size) {
+		return IO_SEEK_NONE;
+	}
+	if(ind.flags & FS_INODE_INLINE) {
+		*res = (whence == IO_SEEK_DATA)? off: ind.size;
+		return 0;
+	}
+	struct io_dirty_file* f = io_dirty_find(fs, inodenum);
+	uint32_t blknums[IO_SEEK_BATCH];
+	uint32_t last = (ind.size - 1) / FS_BLOCK_SIZE;
+	for(uint32_t lblk=off / FS_BLOCK_SIZE; lblk<=last;) {
+		uint32_t n = (last - lblk + 1 < IO_SEEK_BATCH)? last - lblk + 1: IO_SEEK_BATCH;
+		if(io_map_blocks(fs, super, &ind, lblk, n, blknums) < 0) {
+			fprintf(stderr, "io_seek: io_map_blocks\n");
+			return FUNC_ERROR;
+		}
+		for(uint32_t i=0; i<n; i++) {
+			int data = (blknums[i] && !io_is_unwritten(&ind, lblk + i)) ||
+				(f && lblk + i < f->pages_cap && f->pages[lblk + i]);
+			if(data == (whence == IO_SEEK_DATA)) {
+				uint64_t pos = (uint64_t) (lblk + i) * FS_BLOCK_SIZE;
+				*res = (pos > off)? pos: off;
+				return 0;
+			}
+		}
+		lblk += n;
+	}
+	if(whence == IO_SEEK_DATA) {
+		return IO_SEEK_NONE; /* only holes up to the end */
+	}
+	*res = ind.size;
+	return 0;
+}
+
+/**
+ * @brief utility function to free the blocks of a file with extents
+ * @details the blocks of all the extents and the extent block are freed
+ * together
+ */
+static int io_rm_extents(struct fs_filesyst fs, struct fs_super_block super, struct fs_inode *ind) {
+	struct io_extent_map map;
+	if(io_extents_load(fs, super, ind, &map) < 0) {
+		fprintf(stderr, "io_rm: io_extents_load\n");
+		return FUNC_ERROR;
+	}
+	size_t count = (ind->extents.depth == 1);
+	for(uint32_t i=0; i<map.count; i++) {
+		count += map.ext[i].len;
+	}
+	if(count == 0) {
+		return 0;
+	}
+	uint32_t *blks = malloc(sizeof(uint32_t) * count);
+	if(blks == NULL) {
+		perror("io_rm: malloc");
+		return FUNC_ERROR;
+	}
+	size_t n = 0;
+	for(uint32_t i=0; i<map.count; i++) {
+		for(uint32_t k=0; k<map.ext[i].len; k++) {
+			blks[n++] = map.ext[i].start + k;
+		}
+	}
+	if(ind->extents.depth == 1) {
+		blks[n++] = ind->extents.block;
+	}
+	int ret = fs_free_data_batch(fs, &super, blks, n);
+	free(blks);
+	return ret;
+}
+
 /**
  * @brief removes all from inode number inodenum
  * @details frees the inode *inodenum* along with all the data
  * blocks used by it (direct and indirect)
  */
 int io_rm_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodenum) {
+	/* the dirty pages of the file are never written */
+	struct io_dirty_file* f = io_dirty_find(fs, inodenum);
+	if(f) {
+		io_dirty_drop(fs.incore->delalloc, f);
+	}
 	struct fs_inode ind;
 	if(fs_read_inode(fs, super, inodenum, &ind) < 0) {
 		fprintf(stderr, "io_read: fs_read_inode\n");
 		return FUNC_ERROR;
 	}
+	if(ind.flags & (FS_INODE_EXTENTS | FS_INODE_INLINE)) {
+		if((ind.flags & FS_INODE_EXTENTS) && io_rm_extents(fs, super, &ind) < 0) {
+			fprintf(stderr, "io_rm: io_rm_extents\n");
+			return FUNC_ERROR;
+		}
+		if(fs_free_inode(fs, &super, inodenum) < 0) {
+			fprintf(stderr, "io_rm: fs_free_inode\n");
+			return FUNC_ERROR;
+		}
+		return 0;
+	}
+	/* all the blocks of the file are freed together */
+	uint32_t blks[FS_MAX_FILE_BLOCKS + 1];
+	size_t count = 0;
+	for(int i=0; i<FS_DIRECT_POINTERS_PER_INODE; i++) {
+		if(ind.direct[i]) {
+			blks[count++] = ind.direct[i];
+		}
+	}
 	if(ind.indirect) {
 		union fs_block indirect_data;
 		if(fs_read_data(fs, super, &indirect_data, &ind.indirect, 1) < 0) {
@@ -660,25 +2114,14 @@ int io_rm_ino(struct fs_filesyst fs, struct fs_super_block super, uint32_t inode
 		}
 		for(int i=0; i<FS_POINTERS_PER_BLOCK; i++) {
 			if(indirect_data.pointers[i]) {
-				if(fs_free_data(fs, &super, indirect_data.pointers[i]) < 0) {
-					fprintf(stderr, "io_rm: fs_free_data\n");
-					return FUNC_ERROR;
-				}
+				blks[count++] = indirect_data.pointers[i];
 			}
 		}
-		if(fs_free_data(fs, &super, ind.indirect) < 0) {
-			fprintf(stderr, "io_rm: fs_free_data\n");
-			return FUNC_ERROR;
-		}
+		blks[count++] = ind.indirect;
 	}
-	
-	for(int i=0; i<FS_DIRECT_POINTERS_PER_INODE; i++) {
-		if(ind.direct[i]) {
-			if(fs_free_data(fs, &super, ind.direct[i]) < 0) {
-				fprintf(stderr, "io_rm: fs_free_data\n");
-				return FUNC_ERROR;
-			}
-		}
+	if(count > 0 && fs_free_data_batch(fs, &super, blks, count) < 0) {
+		fprintf(stderr, "io_rm: fs_free_data_batch\n");
+		return FUNC_ERROR;
 	}
 	if(fs_free_inode(fs, &super, inodenum) < 0) {
 		fprintf(stderr, "io_rm: fs_free_inode\n");
@@ -703,8 +2146,8 @@ int io_rm(struct fs_filesyst fs, struct fs_super_block super, int fd) {
 		return FUNC_ERROR;
 	}
 	
-	if(io_close_fd(fd) < 0) {
-		fprintf(stderr, "io_rm: io_close_fd\n");
+	if(io_close(fs, fd) < 0) {
+		fprintf(stderr, "io_rm: io_close\n");
 		return FUNC_ERROR;		
 	}
 	return 0;
@@ -18,36 +18,40 @@
 #include <time.h>
 #include <stdio.h>
 
+#define UI_CP_BUFSIZE (256 * FS_BLOCK_SIZE) /* no of bytes copied at once by cp_ */
+
 struct fs_filesyst fs;
 struct fs_super_block super;
 
 /**
- * @brief initializes the system
- * @details fills the global variables fs and super
- * @param filename    the filename of the fs
- * @param size        the size of the fs
- * @param format      a boolean of wether to format the virtual partition
+ * @brief initializes the system with a mount mode
+ * @details same as *initfs* but the disk image is opened with the mount
+ * mode *flags* (eg. DISK_MMAP to map the whole image in memory). with
+ * *format* set to FS_FORMAT_GROUPS the image is formatted with block
+ * groups.
  * @return 0 in case of success or -1 in case of an error
  */
-int initfs(char* filename, size_t size, int format) {
+int mountfs(char* filename, size_t size, int format, int flags) {
 	srand(time(NULL));
 	printf("Opening filesyst..\n");
 	/* test creatfile */
-	if(creatfile(filename, size, &fs) < 0) {
+	if(disk_open(filename, size, flags, &fs) < 0) {
 		fprintf(stderr, "initfs: can't create file %s\n", filename);
+		return FUNC_ERROR;
 	}
 	
-	if(format) {
+	if(format || (flags & DISK_RAM)) { /* a RAM disk always starts empty */
 		printf("formatting..\n");
-		if(fs_format(fs) < 0) {
+		uint32_t group_blocks = (format == FS_FORMAT_GROUPS)? FS_DEFAULT_GROUP_BLOCKS: 0;
+		if(fs_format_groups(fs, group_blocks) < 0) {
 			fprintf(stderr, "initfs: can't fomat partition to file %s\n", filename);
 		}
-		union fs_block blk;
-		if(fs_read_block(fs, 0, &blk) < 0) {
-			fprintf(stderr, "fs_format: fs_read_block\n");
+		struct fs_super_block* sb = fs_get_super(fs);
+		if(sb == NULL) {
+			fprintf(stderr, "initfs: fs_get_super\n");
 			return FUNC_ERROR;
 		}
-		super = blk.super;
+		super = *sb;
 		
 		uint32_t dirino;
 		if(opendir_creat(fs, super, &dirino, S_DIR, "/") < 0) {
@@ -56,15 +60,15 @@ int initfs(char* filename, size_t size, int format) {
 		}
 		printf("Creating the root directory.. %u\n", dirino);
 	} else {
-		union fs_block blk;
-		if(fs_read_block(fs, 0, &blk) < 0) {
-			fprintf(stderr, "fs_format: fs_read_block\n");
+		struct fs_super_block* sb = fs_get_super(fs);
+		if(sb == NULL) {
+			fprintf(stderr, "initfs: fs_get_super\n");
 			return FUNC_ERROR;
 		}
-		super = blk.super;
+		super = *sb;
 	}
 
-	if(!fs_check_magicnum(fs.fd)) {
+	if(fs_check_magicnum(fs) <= 0) {
 		fprintf(stderr, "Magic number of file doesn't match the FS's\n");
 		return FUNC_ERROR;
 	}
@@ -72,6 +76,18 @@ int initfs(char* filename, size_t size, int format) {
 	return 0;
 }
 
+/**
+ * @brief initializes the system
+ * @details fills the global variables fs and super
+ * @param filename    the filename of the fs
+ * @param size        the size of the fs
+ * @param format      a boolean of wether to format the virtual partition
+ * @return 0 in case of success or -1 in case of an error
+ */
+int initfs(char* filename, size_t size, int format) {
+	return mountfs(filename, size, format, DISK_DEFAULT);
+}
+
 /**
  * @brief a utility function to get the inode of the parent
  * @param parentino the pointer to put the inode in
@@ -114,7 +130,7 @@ DIR_* opendir_(const char* dirname, int creat, uint16_t perms) {
 			return NULL;
 		}
 		free(tempstr);
-		dir->fd = io_open_fd(dirino);
+		dir->fd = io_iopen(fs, super, dirino);
 		if(getFiles(fs, super, dirino, &(dir->files), &(dir->size)) < 0) {
 			fprintf(stderr, "opendir_: cannot read files\n");
 			return NULL;
@@ -133,7 +149,7 @@ DIR_* opendir_(const char* dirname, int creat, uint16_t perms) {
 		return NULL;
 	}
 
-	dir->fd = io_open_fd(dirino);
+	dir->fd = io_iopen(fs, super, dirino);
 	if(dir->fd < 0) {
 		fprintf(stderr, "opendir_: canot create a file descriptor\n");
 		return NULL;
@@ -198,7 +214,7 @@ int closedir_(DIR_* dir) {
 		fprintf(stderr, "closedir_: null dir\n");
 		return FUNC_ERROR;
 	}
-	if(io_close_fd(dir->fd) < 0) {
+	if(io_close(fs, dir->fd) < 0) {
 		fprintf(stderr, "close_: can't close %d\n", dir->fd);
 		return FUNC_ERROR;
 	}
@@ -290,7 +306,7 @@ int open_(const char* filename, int creat, uint16_t perms) {
 		struct fs_inode ind;
 		fs_read_inode(fs, super, fileino, &ind);
 		free(tempstr);
-		return io_open_fd(fileino);
+		return io_iopen(fs, super, fileino);
 	}
 	/* verify type */
 	struct fs_inode ind;
@@ -306,7 +322,7 @@ int open_(const char* filename, int creat, uint16_t perms) {
 
 	free(tempstr);
 	// check perms here
-	return io_open_fd(fileino);
+	return io_iopen(fs, super, fileino);
 }
 
 /**
@@ -314,7 +330,7 @@ int open_(const char* filename, int creat, uint16_t perms) {
  * @return 0 in case of success or -1 in case of an error
  */
 int close_(int fd) {
-	if(io_close_fd(fd) < 0) {
+	if(io_close(fs, fd) < 0) {
 		fprintf(stderr, "close_: can't close %d\n", fd);
 		return FUNC_ERROR;
 	}
@@ -333,6 +349,18 @@ int lseek_(int fd, uint32_t newoff) {
 	}
 	return 0;
 }
+
+/**
+ * @brief changes the current pointer for a file
+ * @details with *whence* IO_SEEK_SET the offset becomes *off*, with
+ * IO_SEEK_DATA (IO_SEEK_HOLE) it becomes the start of the first data
+ * (hole) at or after *off*, the end of the file counts as a hole
+ * @return the new offset, or -1 if there is no data (or hole) after *off*
+ * or in case of an error
+ */
+int64_t llseek_(int fd, uint32_t off, int whence) {
+	return io_llseek(fs, super, fd, off, whence);
+}
 /**
  * @brief write data to a file
  * @details writes *size* bytes from the *data* pointer into the corresponding file
@@ -346,6 +374,79 @@ int write_(int fd, void* data, int size) {
 	}
 	return 0;
 }
+/**
+ * @brief preallocates space for a file
+ * @details reserves the blocks of [off, off+len) of the file of *fd* in
+ * one allocation without writing them, they read as zeros and the
+ * following writes to the range allocate nothing
+ * @return 0 in case of success or -1 in case of an error
+ */
+int fallocate_(int fd, uint32_t off, uint32_t len) {
+	if(io_fallocate(fs, super, fd, off, len) < 0) {
+		fprintf(stderr, "fallocate_: io_fallocate\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief changes the size of a file
+ * @details the file *filename* is cut to *len* bytes, the blocks after
+ * the cut are freed. a file grown by a truncate gets a hole.
+ * @return 0 in case of success or -1 in case of an error
+ */
+int truncate_(const char* filename, uint32_t len) {
+	uint32_t fileino;
+	char* tempstr = strdup(filename);
+	if(findpath(fs, super, &fileino, tempstr) < 0) {
+		fprintf(stderr, "truncate_: file does not exist.\n");
+		free(tempstr);
+		return FUNC_ERROR;
+	}
+	free(tempstr);
+	struct fs_inode ind;
+	if(fs_read_inode(fs, super, fileino, &ind) < 0) {
+		fprintf(stderr, "truncate_: fs_read_inode\n");
+		return FUNC_ERROR;
+	}
+	if(ind.mode & S_DIR) {
+		fprintf(stderr, "truncate_: %s is a directory\n", filename);
+		return FUNC_ERROR;
+	}
+	if(io_truncate_ino(fs, super, fileino, len) < 0) {
+		fprintf(stderr, "truncate_: io_truncate_ino\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief changes the size of an open file
+ * @details same as *truncate_* for the file of *fd*, its offset is kept
+ * @return 0 in case of success or -1 in case of an error
+ */
+int ftruncate_(int fd, uint32_t len) {
+	if(io_truncate(fs, super, fd, len) < 0) {
+		fprintf(stderr, "ftruncate_: io_truncate\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief punches a hole in a file
+ * @details the range [off, off+len) of the file of *fd* reads as zeros
+ * and its blocks are freed, the size of the file does not change
+ * @return 0 in case of success or -1 in case of an error
+ */
+int punch_hole_(int fd, uint32_t off, uint32_t len) {
+	if(io_punch_hole(fs, super, fd, off, len) < 0) {
+		fprintf(stderr, "punch_hole_: io_punch_hole\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
 /**
  * @brief reads data from file
  * @details reads *size* bytes from the corresponding file for the 
@@ -399,15 +500,9 @@ int rm_(const char* filename) {
 }
 
 /**
- * @brief attempts to remove a directory
- * @details attempts to remove the directory from its path, if it doesn't contain
- * it gets deleted, if it does, it gets deleted if the recursive boolean is set
- * to no null else it doesn't.
- * Note that the inode may not
- * get deleted until all hard links to the inode number have been deleted
- * @return 0 in case of success or -1 in case of an error
+ * @brief utility function to remove a directory (see rmdir_)
  */
-int rmdir_(const char* filename, int recursive) {
+static int rmdir_tree(const char* filename, int recursive) {
 	uint32_t fileino;
 	char* tempstr = strdup(filename);
 	if(findpath(fs, super, &fileino, tempstr) < 0) {
@@ -447,7 +542,7 @@ int rmdir_(const char* filename, int recursive) {
 				}
 				strcat(sub, dire->d_name);
 				if(dire->d_type & S_DIR) {
-					if(rmdir_(sub, 1) < 0) {
+					if(rmdir_tree(sub, 1) < 0) {
 						fprintf(stderr, "rmdir_: can't remove %s\n", sub);
 						free(sub);
 						return FUNC_ERROR;
@@ -481,12 +576,34 @@ int rmdir_(const char* filename, int recursive) {
 	return 0;
 }
 
+/**
+ * @brief attempts to remove a directory
+ * @details attempts to remove the directory from its path, if it doesn't contain
+ * it gets deleted, if it does, it gets deleted if the recursive boolean is set
+ * to no null else it doesn't.
+ * Note that the inode may not
+ * get deleted until all hard links to the inode number have been deleted.
+ * the data blocks of the whole tree are freed in a single batch at the end
+ * @return 0 in case of success or -1 in case of an error
+ */
+int rmdir_(const char* filename, int recursive) {
+	fs_free_begin(fs);
+	int ret = rmdir_tree(filename, recursive);
+	if(fs_free_end(fs, &super) < 0) {
+		fprintf(stderr, "rmdir_: fs_free_end\n");
+		ret = FUNC_ERROR;
+	}
+	return ret;
+}
+
 /**
  * @brief copies a file from src to dest
  * @details copies any file or directory from src to dest
  * Note that you have to specify the file name of the destination
  * e.g. cp_("/dir/file", "/") won't work because the destination doesn't 
  * have a specified name like cp_("/dir/file", "/file")
+ * an existing destination is truncated first, copying a file onto
+ * itself (or onto one of its hard links) fails
  * @return 0 in case of success or -1 in case of an error
  */
 int cp_(const char* src, const char* dest) {
@@ -498,29 +615,51 @@ int cp_(const char* src, const char* dest) {
 	}
 	
 	struct fs_inode ind = {0};
-	if(fs_read_inode(fs, super, io_getino(srcfd), &ind)) {
+	uint32_t srcino = io_getino(srcfd), destino = io_getino(destfd);
+	if(srcino == destino) {
+		/* the destination is emptied first, it must not be the source */
+		fprintf(stderr, "cp_: %s and %s are the same file\n", src, dest);
+		close_(srcfd);
+		close_(destfd);
+		return FUNC_ERROR;
+	}
+	uint8_t* data = malloc(UI_CP_BUFSIZE);
+	if(data == NULL || fs_read_inode(fs, super, srcino, &ind) ||
+	   io_truncate_ino(fs, super, destino, 0) < 0)
+	{
 		fprintf(stderr, "cp_: cannot read inode\n");
+		free(data);
 		return FUNC_ERROR;
 	}
 
-	size_t size = ind.size;
-	
-	lseek_(srcfd, 0);
-	void* data = malloc(size);
-	if(io_read(fs, super, srcfd, data, size) < 0) {
-		fprintf(stderr, "cp_: cannot read from the source\n");
-		return FUNC_ERROR;
+	/* only the data is copied, the holes of the source stay holes */
+	int ret = 0, found;
+	uint32_t off = 0, hole;
+	while(ret == 0 && (found = io_seek_ino(fs, super, srcino, off, IO_SEEK_DATA, &off)) != IO_SEEK_NONE) {
+		if(found < 0 || io_seek_ino(fs, super, srcino, off, IO_SEEK_HOLE, &hole) != 0) {
+			fprintf(stderr, "cp_: cannot find the data of the source\n");
+			ret = FUNC_ERROR;
+		}
+		while(ret == 0 && off < hole) {
+			uint32_t n = (hole - off < UI_CP_BUFSIZE)? hole - off: UI_CP_BUFSIZE;
+			if(io_read_ino(fs, super, srcino, data, off, n) < 0 ||
+			   io_write_ino(fs, super, destino, data, off, n) < 0)
+			{
+				fprintf(stderr, "cp_: cannot copy to the destination\n");
+				ret = FUNC_ERROR;
+			}
+			off += n;
+		}
 	}
-	
-	lseek_(destfd, 0);
-	if(io_write(fs, super, destfd, data, size) < 0) {
-		fprintf(stderr, "cp_: cannot write to the destination\n");
-		return FUNC_ERROR;
+	/* the source can end with a hole */
+	if(ret == 0 && io_truncate_ino(fs, super, destino, ind.size) < 0) {
+		fprintf(stderr, "cp_: cannot set the size of the destination\n");
+		ret = FUNC_ERROR;
 	}
-	
+	free(data);
 	close_(srcfd);
 	close_(destfd);
-	return 0;
+	return ret;
 }
 
 /**
@@ -623,8 +762,82 @@ int mv_(const char* src, const char* dest) {
 	return 0;
 }
 
+/**
+ * @brief enables or disables the delayed allocation
+ * @details with delayed allocation the written data stays in memory and
+ * its blocks are allocated at sync, all the data of a file at once
+ * @return 0 in case of success or -1 in case of an error
+ */
+int delalloc_(int enable) {
+	if(io_delalloc_enable(fs, enable) < 0) {
+		fprintf(stderr, "delalloc_: io_delalloc_enable\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief maps the files created from now on with extents
+ * @details a file mapped with extents can grow up to 4 GiB and a
+ * contiguous file is mapped by a single extent, the existing files keep
+ * their block pointers
+ * @return 0 in case of success or -1 in case of an error
+ */
+int extents_() {
+	struct fs_super_block* sb = fs_get_super(fs);
+	if(sb == NULL || fs_set_features(fs, sb->features | FS_FEATURE_EXTENTS) < 0) {
+		fprintf(stderr, "extents_: fs_set_features\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief enables or disables the sparse writes
+ * @details when enabled the whole blocks of zeros written where a file
+ * has no block are not allocated, they stay holes
+ * @return 0 in case of success or -1 in case of an error
+ */
+int sparse_(int enable) {
+	if(io_sparse_enable(fs, enable) < 0) {
+		fprintf(stderr, "sparse_: io_sparse_enable\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief keeps the data of the small files created from now on in their
+ * inode
+ * @details a file of up to FS_INLINE_DATA_SIZE bytes takes no data block
+ * and is read with its inode, it moves to data blocks when it grows
+ * @return 0 in case of success or -1 in case of an error
+ */
+int inline_data_() {
+	struct fs_super_block* sb = fs_get_super(fs);
+	if(sb == NULL || fs_set_features(fs, sb->features | FS_FEATURE_INLINE_DATA) < 0) {
+		fprintf(stderr, "inline_data_: fs_set_features\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
+/**
+ * @brief writes all the pending changes to the disk image
+ * @return 0 in case of success or -1 in case of an error
+ */
+int sync_() {
+	if(disk_sync(fs) < 0) {
+		fprintf(stderr, "sync_: disk_sync\n");
+		return FUNC_ERROR;
+	}
+	return 0;
+}
+
 /**
  * @brief closes the virtual filesystem
+ * @details the modified blocks still in the cache are written before
+ * closing the disk image
  */
 void closefs() {
 	printf("Closing the filesystem..\n");
@@ -0,0 +1,241 @@
+/**
+ * @file uring.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief asynchronous block I/O with io_uring
+ * @details a minimal io_uring queue built directly on the io_uring
+ * syscalls: block reads and writes are queued, submitted in batches and
+ * their completions are reaped together. requests that fail or complete
+ * partially are redone with the synchronous path.
+ */
+#include <devutils.h>
+#include <disk.h>
+#include <uring.h>
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+
+/**
+ * @brief utility function to call io_uring_setup
+ */
+static int uring_setup(unsigned entries, struct io_uring_params* p) {
+	return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+/**
+ * @brief utility function to call io_uring_enter
+ */
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+	return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+/**
+ * @brief creates an io_uring queue
+ * @param depth the maximum number of requests in flight
+ * @return the queue, or NULL if io_uring is not available on this host
+ */
+struct disk_uring* uring_create(unsigned depth) {
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	int fd = uring_setup(depth, &p);
+	if(fd < 0) {
+		return NULL;
+	}
+
+	struct disk_uring* ring = calloc(1, sizeof(struct disk_uring));
+	if(ring == NULL) {
+		perror("uring_create: calloc");
+		close(fd);
+		return NULL;
+	}
+	ring->ring_fd = fd;
+	ring->depth = depth;
+	ring->sq_ptr = ring->cq_ptr = MAP_FAILED;
+	ring->sqes = MAP_FAILED;
+
+	/* map the rings shared with the kernel */
+	ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->sq_len = ring->cq_len = (ring->sq_len > ring->cq_len)? ring->sq_len: ring->cq_len;
+	}
+	ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+						MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if(ring->sq_ptr == MAP_FAILED) {
+		perror("uring_create: mmap");
+		uring_destroy(ring);
+		return NULL;
+	}
+	if(p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ptr = ring->sq_ptr;
+	} else {
+		ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+							MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if(ring->cq_ptr == MAP_FAILED) {
+			perror("uring_create: mmap");
+			uring_destroy(ring);
+			return NULL;
+		}
+	}
+	ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+					  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if(ring->sqes == MAP_FAILED) {
+		perror("uring_create: mmap");
+		uring_destroy(ring);
+		return NULL;
+	}
+
+	uint8_t* sq = ring->sq_ptr;
+	uint8_t* cq = ring->cq_ptr;
+	ring->sq_head = (unsigned*) (sq + p.sq_off.head);
+	ring->sq_tail = (unsigned*) (sq + p.sq_off.tail);
+	ring->sq_mask = (unsigned*) (sq + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned*) (sq + p.sq_off.array);
+	ring->cq_head = (unsigned*) (cq + p.cq_off.head);
+	ring->cq_tail = (unsigned*) (cq + p.cq_off.tail);
+	ring->cq_mask = (unsigned*) (cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+
+	/* request slots */
+	ring->ops = calloc(depth, sizeof(struct uring_op));
+	ring->free_slots = malloc(sizeof(int) * depth);
+	if(ring->ops == NULL || ring->free_slots == NULL) {
+		perror("uring_create: malloc");
+		uring_destroy(ring);
+		return NULL;
+	}
+	for(unsigned i=0; i<depth; i++) {
+		ring->free_slots[i] = depth - 1 - i;
+	}
+	ring->nfree = depth;
+	return ring;
+}
+
+/**
+ * @brief frees an io_uring queue
+ * @details the requests still in flight are waited for first
+ */
+void uring_destroy(struct disk_uring* ring) {
+	if(ring == NULL) {
+		return;
+	}
+	if(ring->inflight && uring_wait(ring) < 0) {
+		fprintf(stderr, "uring_destroy: uring_wait\n");
+	}
+	if(ring->sqes != MAP_FAILED) {
+		munmap(ring->sqes, ring->sqes_len);
+	}
+	if(ring->cq_ptr != MAP_FAILED && ring->cq_ptr != ring->sq_ptr) {
+		munmap(ring->cq_ptr, ring->cq_len);
+	}
+	if(ring->sq_ptr != MAP_FAILED) {
+		munmap(ring->sq_ptr, ring->sq_len);
+	}
+	close(ring->ring_fd);
+	free(ring->ops);
+	free(ring->free_slots);
+	free(ring);
+}
+
+/**
+ * @brief queues a vectored read or write
+ * @details the request is only put in the submission ring, it is sent
+ * to the kernel by uring_wait. if all the slots are used the requests
+ * in flight are waited for first.
+ * Note: the buffers must stay valid until uring_wait returns.
+ */
+int uring_queue(struct disk_uring* ring, int fd, int write, const struct iovec* iov,
+				int iovcnt, off_t off)
+{
+	if(iovcnt <= 0 || iovcnt > DISK_MAX_IOV) {
+		fprintf(stderr, "uring_queue: invalid no of buffers %d\n", iovcnt);
+		return FUNC_ERROR;
+	}
+	if(ring->nfree == 0 && uring_wait(ring) < 0) {
+		fprintf(stderr, "uring_queue: uring_wait\n");
+		return FUNC_ERROR;
+	}
+	int slot = ring->free_slots[--ring->nfree];
+	struct uring_op* op = ring->ops + slot;
+	op->fd = fd;
+	op->write = write;
+	op->iovcnt = iovcnt;
+	op->off = off;
+	memcpy(op->iov, iov, sizeof(struct iovec) * iovcnt);
+
+	unsigned tail = *ring->sq_tail;
+	unsigned idx = tail & *ring->sq_mask;
+	struct io_uring_sqe* sqe = ring->sqes + idx;
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = (write)? IORING_OP_WRITEV: IORING_OP_READV;
+	sqe->fd = fd;
+	sqe->off = off;
+	sqe->addr = (uint64_t) (uintptr_t) op->iov;
+	sqe->len = iovcnt;
+	sqe->user_data = slot;
+	ring->sq_array[idx] = idx;
+	/* the kernel must see the entry before the new tail */
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	ring->queued++;
+	ring->inflight++;
+	return 0;
+}
+
+/**
+ * @brief utility function to finish a request that failed or was short
+ * @details the request is redone with the synchronous path
+ */
+static int uring_complete_sync(struct uring_op* op) {
+	struct iovec iov[DISK_MAX_IOV];
+	memcpy(iov, op->iov, sizeof(struct iovec) * op->iovcnt);
+	return disk_rw_vec(op->fd, iov, op->iovcnt, op->off, op->write);
+}
+
+/**
+ * @brief submits the queued requests and waits for all of them
+ * @return 0 if all the requests were done, -1 otherwise
+ */
+int uring_wait(struct disk_uring* ring) {
+	int ret = 0;
+	while(ring->inflight > 0) {
+		int n = uring_enter(ring->ring_fd, ring->queued, 1, IORING_ENTER_GETEVENTS);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			perror("uring_wait: io_uring_enter");
+			return FUNC_ERROR;
+		}
+		ring->queued -= (n < ring->queued)? n: ring->queued;
+
+		/* reap the completions */
+		unsigned head = *ring->cq_head;
+		unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+		while(head != tail) {
+			struct io_uring_cqe* cqe = ring->cqes + (head & *ring->cq_mask);
+			struct uring_op* op = ring->ops + cqe->user_data;
+			size_t len = 0;
+			for(int i=0; i<op->iovcnt; i++) {
+				len += op->iov[i].iov_len;
+			}
+			if(cqe->res < 0 || (size_t) cqe->res != len) {
+				if(uring_complete_sync(op) < 0) {
+					fprintf(stderr, "uring_wait: request failed\n");
+					ret = FUNC_ERROR;
+				}
+			}
+			ring->free_slots[ring->nfree++] = cqe->user_data;
+			ring->inflight--;
+			head++;
+		}
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	}
+	return ret;
+}
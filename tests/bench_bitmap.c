@@ -0,0 +1,134 @@
+/**
+ * @file bench_bitmap.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief benchmark of the bitmap searches
+ * @details searches the free bits of an almost full bitmap and counts
+ * its free bits with the byte loop the allocators used to run, the
+ * scalar word kernels and the AVX2 word kernels, and prints the scan
+ * rate of each one
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include <bitmap.h>
+#include <bitmap_simd.h>
+#include <disk.h>
+#include <devutils.h>
+
+#define BENCH_BLOCKS 256 /* no of bitmap blocks (32 MiB of data blocks each) */
+#define BENCH_ROUNDS 20  /* no of searches and counts per kernel */
+#define BENCH_HOLES 16   /* no of free bits, all in the last quarter */
+
+/**
+ * @brief utility function to get the time in seconds
+ */
+static double bench_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief the byte loop: the first free bit from *start*
+ */
+static uint32_t byte_find_zero(const struct fs_bitmap* bm, uint32_t start) {
+	const uint8_t* bytes = (const uint8_t*) bm->words;
+	for(uint32_t i=start/BITS_PER_BYTE; i<bm->nbits/BITS_PER_BYTE; i++) {
+		if(bytes[i] == 0xFF) {
+			continue;
+		}
+		for(int b=0; b<BITS_PER_BYTE; b++) {
+			uint32_t bit = i * BITS_PER_BYTE + b;
+			if(bit >= start && !(bytes[i] & (1 << b))) {
+				return bit;
+			}
+		}
+	}
+	return BITMAP_NONE;
+}
+
+/**
+ * @brief the byte loop: the no of free bits
+ */
+static uint32_t byte_count_zeros(const struct fs_bitmap* bm) {
+	const uint8_t* bytes = (const uint8_t*) bm->words;
+	uint32_t count = 0;
+	for(uint32_t i=0; i<bm->nbits/BITS_PER_BYTE; i++) {
+		for(int b=0; b<BITS_PER_BYTE; b++) {
+			count += !(bytes[i] & (1 << b));
+		}
+	}
+	return count;
+}
+
+/**
+ * @brief runs the searches and counts with one kernel
+ * @param simd -1 for the byte loop, 0 for the scalar kernels, 1 for AVX2
+ */
+static void bench_kernel(struct fs_bitmap* bm, int simd, const char* name) {
+	if(simd >= 0 && bitmap_simd_enable(simd) != simd) {
+		printf("%-6s not supported by the cpu\n", name);
+		return;
+	}
+	uint32_t found = 0;
+	double start = bench_now();
+	for(int round=0; round<BENCH_ROUNDS; round++) {
+		/* all the holes, each search starts after the previous one */
+		for(uint32_t bit=0; bit!=BITMAP_NONE; bit++, found++) {
+			bit = (simd < 0)? byte_find_zero(bm, bit): bitmap_find_zero(bm, bit, bm->nbits);
+			if(bit == BITMAP_NONE) {
+				break;
+			}
+		}
+	}
+	double ftime = bench_now() - start;
+	assert(found == BENCH_ROUNDS * BENCH_HOLES);
+
+	uint64_t free = 0;
+	start = bench_now();
+	for(int round=0; round<BENCH_ROUNDS; round++) {
+		free += (simd < 0)? byte_count_zeros(bm): bitmap_count_zeros(bm);
+	}
+	double ctime = bench_now() - start;
+	assert(free == BENCH_ROUNDS * BENCH_HOLES);
+
+	double gb = (double) bm->nbits / BITS_PER_BYTE * BENCH_ROUNDS / (1024 * 1024 * 1024);
+	printf("%-6s search: %8.2f GiB/s   count: %8.2f GiB/s\n", name, gb / ftime, gb / ctime);
+}
+
+/**
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief program to compare the bitmap kernels
+ */
+int main(int argc, char** argv) {
+	struct fs_bitmap bm = { 0 };
+	bm.nblocks = BENCH_BLOCKS;
+	bm.nbits = BENCH_BLOCKS * FS_BLOCK_SIZE * BITS_PER_BYTE;
+	bm.words = disk_alloc_blocks(BENCH_BLOCKS);
+	bm.dirty = calloc(BENCH_BLOCKS, 1);
+	assert(bm.words != NULL && bm.dirty != NULL);
+	memset(bm.words, 0xFF, (size_t) BENCH_BLOCKS * FS_BLOCK_SIZE);
+	srand(15);
+	for(int i=0; i<BENCH_HOLES; i++) {
+		uint32_t bit;
+		do {
+			bit = bm.nbits / 4 * 3 + rand() % (bm.nbits / 4);
+		} while(!bitmap_test(&bm, bit));
+		bitmap_clear(&bm, bit);
+	}
+
+	printf("benchmarking %d bitmap blocks..\n", BENCH_BLOCKS);
+	bench_kernel(&bm, -1, "byte");
+	bench_kernel(&bm, 0, "scalar");
+	bench_kernel(&bm, 1, "avx2");
+
+	free(bm.words);
+	free(bm.dirty);
+	return 0;
+}
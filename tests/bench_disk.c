@@ -0,0 +1,101 @@
+/**
+ * @file bench_disk.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief benchmark of the disk backends
+ * @details writes and reads the whole data section of an image through
+ * fs_write_data and fs_read_data with each mount mode and prints the
+ * throughput of each one
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include <fs.h>
+#include <disk.h>
+#include <devutils.h>
+
+#define BENCH_SIZE (64 * 1024 * 1024) /* size of the benchmarked image */
+#define BENCH_BATCH 256               /* no of blocks per fs_*_data call */
+#define BENCH_READS 4                 /* no of read passes */
+
+/**
+ * @brief utility function to get the time in seconds
+ */
+static double bench_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief runs the benchmark on one mount mode
+ */
+static void bench_mode(const char* filename, int flags, const char* name) {
+	struct fs_filesyst fs;
+	assert(disk_open(filename, BENCH_SIZE, flags, &fs) == 0);
+	assert(fs_format(fs) == 0);
+
+	union fs_block blk;
+	assert(fs_read_block(fs, 0, &blk) == 0);
+	struct fs_super_block super = blk.super;
+
+	uint32_t count = super.data_count - super.data_count % BENCH_BATCH;
+	uint32_t blknums[BENCH_BATCH];
+	union fs_block* data = disk_alloc_blocks(BENCH_BATCH);
+	assert(data != NULL);
+	memset(data, 0xAB, sizeof(union fs_block) * BENCH_BATCH);
+
+	/* write pass */
+	double start = bench_now();
+	for(uint32_t i=0; i<count; i+=BENCH_BATCH) {
+		for(int j=0; j<BENCH_BATCH; j++) {
+			blknums[j] = i + j + 1;
+		}
+		assert(fs_write_data(fs, super, data, blknums, BENCH_BATCH) == 0);
+	}
+	assert(disk_sync(fs) == 0);
+	double wtime = bench_now() - start;
+
+	/* read passes */
+	start = bench_now();
+	for(int pass=0; pass<BENCH_READS; pass++) {
+		for(uint32_t i=0; i<count; i+=BENCH_BATCH) {
+			for(int j=0; j<BENCH_BATCH; j++) {
+				blknums[j] = i + j + 1;
+			}
+			assert(fs_read_data(fs, super, data, blknums, BENCH_BATCH) == 0);
+		}
+	}
+	double rtime = bench_now() - start;
+	assert(data[BENCH_BATCH-1].data[FS_BLOCK_SIZE-1] == 0xAB);
+
+	double mb = (double) count * FS_BLOCK_SIZE / (1024 * 1024);
+	printf("%-6s write: %8.1f MiB/s   read: %8.1f MiB/s\n", name,
+		   mb / wtime, mb * BENCH_READS / rtime);
+
+	free(data);
+	disk_close(&fs);
+}
+
+/**
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief program to compare the disk backends
+ */
+int main(int argc, char** argv) {
+	char filename[512] = "./bin/partition_bench";
+
+	printf("benchmarking %d MiB image..\n", BENCH_SIZE / (1024 * 1024));
+	bench_mode(filename, DISK_DEFAULT, "fd");
+	bench_mode(filename, DISK_MMAP, "mmap");
+	bench_mode(filename, DISK_URING, "uring");
+	bench_mode(filename, DISK_DIRECT, "direct");
+	bench_mode(filename, DISK_RAM, "ram");
+
+	unlink(filename);
+	return 0;
+}
@@ -45,6 +45,8 @@ void __mv(char*, char*);
 void __ln(char*, char*);
 void __write(char*, char*);
 void __cat(char*);
+void __truncate(char*, char*);
+void __punch(char*, char*, char*);
 void __help();
 void getInput();
 void screenfetch();
@@ -52,20 +54,64 @@ void screenfetch();
 int main(int argc, char* argv[])
 {
    int format = 0;
+   int flags = DISK_DEFAULT;
+   int delalloc = 0;
+   int extents = 0;
+   int inline_data = 0;
+   int sparse = 0;
    argval =( char ** ) malloc ( ARGMAX * sizeof ( char *) ) ;
    if(argc < 2) {
-		printf("use: %s [-f --format] <disk>\n",argv[0]);
+		printf("use: %s <disk> [-f --format] [-g --groups] [-a --delalloc] [-e --extents] [-i --inline] [-s --sparse] [-m --mmap] [-u --uring] [-d --direct] [-r --ram]\n",argv[0]);
 		return 1;
 	}
 	for(int opt=1; opt<argc; opt++) {
 		if(!strcmp("-f", argv[opt]) || !strcmp("--format", argv[opt])) {
 			format = 1;
 		}
+		if(!strcmp("-g", argv[opt]) || !strcmp("--groups", argv[opt])) {
+			format = FS_FORMAT_GROUPS;
+		}
+		if(!strcmp("-a", argv[opt]) || !strcmp("--delalloc", argv[opt])) {
+			delalloc = 1;
+		}
+		if(!strcmp("-e", argv[opt]) || !strcmp("--extents", argv[opt])) {
+			extents = 1;
+		}
+		if(!strcmp("-i", argv[opt]) || !strcmp("--inline", argv[opt])) {
+			inline_data = 1;
+		}
+		if(!strcmp("-s", argv[opt]) || !strcmp("--sparse", argv[opt])) {
+			sparse = 1;
+		}
+		if(!strcmp("-m", argv[opt]) || !strcmp("--mmap", argv[opt])) {
+			flags |= DISK_MMAP;
+		}
+		if(!strcmp("-u", argv[opt]) || !strcmp("--uring", argv[opt])) {
+			flags |= DISK_URING;
+		}
+		if(!strcmp("-d", argv[opt]) || !strcmp("--direct", argv[opt])) {
+			flags |= DISK_DIRECT;
+		}
+		if(!strcmp("-r", argv[opt]) || !strcmp("--ram", argv[opt])) {
+			flags |= DISK_RAM;
+		}
 	}
-	if(initfs(argv[1], DEFAULT_SIZE, format) < 0) {
+	if(mountfs(argv[1], DEFAULT_SIZE, format, flags) < 0) {
 			fprintf(stderr,"shell : creatfile %s\n",argv[1]);
 			return 1;
 	}
+	if(delalloc && delalloc_(1) < 0) {
+		return 1;
+	}
+	if(extents && extents_() < 0) {
+		return 1;
+	}
+	if(inline_data && inline_data_() < 0) {
+		return 1;
+	}
+	if(sparse && sparse_(1) < 0) {
+		return 1;
+	}
 	printf("opened emulated disk image \"%s\"\n",argv[1]);
 	strcpy(cwd, "/");
 
@@ -198,6 +244,28 @@ int main(int argc, char* argv[])
                 printf("+--- Error in ln : insufficient parameters\n");
             }
         }
+        else if(strcmp(argval[0],"truncate")==0)
+        {
+            if(argcount > 2 && strlen(argval[1]) > 0 && strlen(argval[2]) > 0)
+            {
+                __truncate(argval[1],argval[2]);
+            }
+            else
+            {
+                printf("+--- Error in truncate : insufficient parameters\n");
+            }
+        }
+        else if(strcmp(argval[0],"punch")==0)
+        {
+            if(argcount > 3 && strlen(argval[1]) > 0 && strlen(argval[2]) > 0 && strlen(argval[3]) > 0)
+            {
+                __punch(argval[1],argval[2],argval[3]);
+            }
+            else
+            {
+                printf("+--- Error in punch : insufficient parameters\n");
+            }
+        }
         else if(strcmp(argval[0],"cat")==0)
         {
             char* filename = argval[1];
@@ -378,6 +446,47 @@ void __write(char* path, char* data) {
 	close_(fd);
 }
 
+/**
+* @breif change the size of a file
+* @param path 	the file path
+* @param len	the new size of the file
+*/
+void __truncate(char* path, char* len) {
+	char* new_path = getPath(cwd, path);
+	if(new_path == NULL) {
+		fprintf(stderr, "cannot resolve path\n");
+		return;
+	}
+	if(truncate_(new_path, strtoul(len, NULL, 10)) < 0) {
+		fprintf(stderr, "cannot truncate the file\n");
+	}
+	free(new_path);
+}
+
+/**
+* @breif punch a hole in a file
+* @param path 	the file path
+* @param off	the offset of the hole
+* @param len	the size of the hole
+*/
+void __punch(char* path, char* off, char* len) {
+	char* new_path = getPath(cwd, path);
+	if(new_path == NULL) {
+		fprintf(stderr, "cannot resolve path\n");
+		return;
+	}
+	int fd = open_(new_path, 0, 0);
+	free(new_path);
+	if(fd < 0) {
+		fprintf(stderr, "cannot open the file\n");
+		return ;
+	}
+	if(punch_hole_(fd, strtoul(off, NULL, 10), strtoul(len, NULL, 10)) < 0) {
+		fprintf(stderr, "cannot punch a hole in the file\n");
+	}
+	close_(fd);
+}
+
 /**
 * @breif copy one file to another 
 * @param file1	name of the first file
@@ -615,6 +724,8 @@ void __pwd(char* cwdstr)
 void __help(){
 	printf("|\t cat <path> : read file \n");
 	printf("|\t write <path> <data> : write the data in the file \n");
+	printf("|\t truncate <path> <len> : change the size of the file \n");
+	printf("|\t punch <path> <off> <len> : free the blocks of a range of the file \n");
 	printf("|\t cp <file1> <file2> : copy one file to another \n");
 	printf("|\t ln <file1> <file2> : create a hard link \n");
 	printf("|\t mv <file1> <file2> : move one file to another \n");
@@ -53,5 +53,27 @@ int main(int argc, char** argv) {
 	/* test disk_close */
 	disk_close(&fs);
 	
+	printf("creating a 5GiB filesyst..\n");
+	/* blocks past 4GiB must not overflow the offsets */
+	char bigname[512] = "./bin/partition_big";
+	size_t bigsize = 5UL * 1024 * 1024 * 1024;
+	ret = creatfile(bigname, bigsize, &fs);
+	assert(ret == 0);
+	assert(fs.tot_size == bigsize);
+	int last = disk_size(fs) - 1;
+	for(int i=0; i<FS_POINTERS_PER_BLOCK; i++) {
+		blk.pointers[i] = last;
+	}
+	assert(fs_write_block(fs, last, &blk, FS_BLOCK_SIZE) == 0);
+	assert(disk_sync(fs) == 0);
+	memset(&blk, 0, FS_BLOCK_SIZE);
+	assert(disk_read_raw(fs, last, &blk) == 0);
+	assert(blk.pointers[0] == last && blk.pointers[FS_POINTERS_PER_BLOCK-1] == last);
+	memset(&blk, 0, FS_BLOCK_SIZE);
+	assert(disk_read_raw(fs, last / 2, &blk) == 0);
+	assert(blk.pointers[0] == 0);
+	disk_close(&fs);
+	unlink(bigname);
+	
 	return 0;
 }
@@ -0,0 +1,263 @@
+/**
+ * @file test10.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+
+#include <fcntl.h>
+
+#include <fs.h>
+#include <disk.h>
+#include <bitmap_simd.h>
+#include <devutils.h>
+
+#define TEST_ALLOCS 100
+
+/**
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief program to test the allocation of inodes and data blocks and
+ * the persistence of the superblock
+ */
+int main(int argc, char** argv) {
+	char filename[512] = "./bin/partition";
+	struct fs_filesyst fs;
+	union fs_block blk;
+
+	printf("Creating filesyst..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	assert(fs_format(fs) == 0);
+	struct fs_super_block super = *fs_get_super(fs);
+	uint32_t free_inodes = super.free_inode_count;
+	uint32_t free_data = super.free_data_count;
+
+	printf("allocating..\n");
+	uint32_t inodes[TEST_ALLOCS], data[TEST_ALLOCS];
+	for(int i=0; i<TEST_ALLOCS; i++) {
+		assert(fs_alloc_inode(fs, &super, inodes + i) == 0);
+		assert(fs_alloc_data(fs, &super, data + i, 1) == 0);
+		assert(fs_is_inode_allocated(fs, super, inodes[i]) == 1);
+		assert(fs_is_data_allocated(fs, super, data[i]) == 1);
+	}
+	for(int i=0; i<TEST_ALLOCS; i++) {
+		for(int j=0; j<i; j++) {
+			assert(inodes[i] != inodes[j] && data[i] != data[j]);
+		}
+	}
+	assert(super.free_inode_count == free_inodes - TEST_ALLOCS);
+	assert(super.free_data_count == free_data - TEST_ALLOCS);
+	assert(fs_get_super(fs)->free_data_count == super.free_data_count);
+
+	printf("superblock written at sync..\n");
+	/* a copy of the superblock taken before the allocations stays valid */
+	struct fs_super_block old = super;
+	assert(fs_free_data(fs, &old, data[0]) == 0);
+	assert(old.free_data_count == free_data - TEST_ALLOCS + 1);
+	assert(fs_is_data_allocated(fs, super, data[0]) == 0);
+	assert(disk_sync(fs) == 0);
+	assert(fs_read_block(fs, 0, &blk) == 0);
+	assert(blk.super.free_data_count == free_data - TEST_ALLOCS + 1);
+	assert(blk.super.free_inode_count == free_inodes - TEST_ALLOCS);
+
+	printf("superblock written at unmount..\n");
+	for(int i=0; i<TEST_ALLOCS; i++) {
+		assert(fs_free_inode(fs, &super, inodes[i]) == 0);
+	}
+	disk_close(&fs);
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	assert(fs_get_super(fs)->free_inode_count == free_inodes);
+	assert(fs_get_super(fs)->free_data_count == free_data - TEST_ALLOCS + 1);
+	assert(fs_is_data_allocated(fs, super, data[0]) == 0);
+	assert(fs_is_data_allocated(fs, super, data[1]) == 1);
+	super = *fs_get_super(fs);
+	assert(fs_is_inode_allocated(fs, super, inodes[1]) == 0);
+
+	printf("next-fit allocation..\n");
+	super = *fs_get_super(fs);
+	uint32_t run[300];
+	assert(fs_alloc_data(fs, &super, run, 1) == 0 && run[0] == data[0]);
+	assert(fs_alloc_data(fs, &super, run, 300) == 0);
+	for(int i=1; i<300; i++) {
+		assert(run[i] == run[i-1] + 1); /* one contiguous run */
+	}
+	assert(run[0] == data[TEST_ALLOCS-1] + 1);
+	uint32_t last = run[299];
+	assert(fs_free_data(fs, &super, data[1]) == 0);
+	assert(fs_alloc_data(fs, &super, run, 300) == 0);
+	assert(run[0] == last + 1); /* the freed data[1] is not reused yet */
+	/* the whole data section is allocated then the search wraps around */
+	uint32_t left = super.free_data_count;
+	uint32_t* all = malloc(sizeof(uint32_t) * left);
+	assert(all != NULL);
+	assert(fs_alloc_data(fs, &super, all, left) == 0);
+	uint32_t kept = all[1];
+	assert(all[left-1] == data[1]);
+	assert(super.free_data_count == 0);
+	assert(fs_alloc_data(fs, &super, run, 1) < 0);
+	assert(fs_free_data(fs, &super, all[0]) == 0);
+	assert(fs_free_data(fs, &super, all[0]) < 0); /* double free */
+	assert(fs_alloc_data(fs, &super, run, 1) == 0 && run[0] == all[0]);
+
+	printf("extent allocation..\n");
+	/* free runs of 10, 50 and 30 blocks */
+	for(int i=0; i<10; i++) {
+		assert(fs_free_data(fs, &super, all[10 + i]) == 0);
+	}
+	for(int i=0; i<50; i++) {
+		assert(fs_free_data(fs, &super, all[100 + i]) == 0);
+	}
+	for(int i=0; i<30; i++) {
+		assert(fs_free_data(fs, &super, all[500 + i]) == 0);
+	}
+	struct fs_extent ext[4];
+	assert(fs_alloc_extents(fs, &super, 0, 40, ext, 4) == 1);
+	assert(ext[0].start == all[100] && ext[0].len == 40);
+	/* no run of 35 blocks left: the longest runs are taken first */
+	assert(fs_alloc_extents(fs, &super, 0, 35, ext, 4) == 2);
+	assert(ext[0].start == all[500] && ext[0].len == 30);
+	assert(ext[1].start == all[10] && ext[1].len == 5);
+	/* 15 blocks left in 2 runs */
+	assert(super.free_data_count == 15);
+	assert(fs_alloc_extents(fs, &super, 0, 15, ext, 1) < 0);
+	assert(super.free_data_count == 15 && fs_is_data_allocated(fs, super, all[15]) == 0);
+	assert(fs_alloc_extents(fs, &super, 0, 15, ext, 4) == 2);
+	assert(ext[0].len + ext[1].len == 15 && super.free_data_count == 0);
+	struct freeidx_stats st;
+	assert(fs_data_frag(fs, &st) == 0);
+	assert(st.free == 0 && st.extents == 0 && st.largest == 0);
+	for(int i=0; i<5; i++) {
+		assert(fs_free_data(fs, &super, all[200 + 2 * i]) == 0);
+		assert(fs_free_data(fs, &super, all[201 + 2 * i]) == 0);
+	}
+	assert(fs_free_data(fs, &super, all[300]) == 0);
+	assert(fs_data_frag(fs, &st) == 0);
+	assert(st.free == 11 && st.extents == 2 && st.largest == 10);
+	assert(fs_alloc_data(fs, &super, run, 11) == 0);
+
+	printf("goal-directed allocation..\n");
+	for(int i=0; i<10; i++) {
+		assert(fs_free_data(fs, &super, all[50 + i]) == 0);
+		assert(fs_free_data(fs, &super, all[400 + i]) == 0);
+	}
+	assert(fs_alloc_extents(fs, &super, all[402], 3, ext, 4) == 1);
+	assert(ext[0].start == all[402] && ext[0].len == 3);
+	/* no room after the goal: wraps around */
+	assert(fs_alloc_extents(fs, &super, all[408], 5, ext, 4) == 1);
+	assert(ext[0].start == all[50] && ext[0].len == 5);
+	assert(fs_alloc_extents(fs, &super, all[400], 2, ext, 4) == 1);
+	assert(ext[0].start == all[400]);
+
+	printf("batched frees..\n");
+	uint32_t batch[6] = { all[700], all[12], all[701], all[699], all[13], all[900] };
+	uint32_t before = super.free_data_count;
+	assert(fs_free_data_batch(fs, &super, batch, 6) == 0);
+	assert(super.free_data_count == before + 6);
+	for(int i=0; i<6; i++) {
+		assert(fs_is_data_allocated(fs, super, batch[i]) == 0);
+	}
+	assert(fs_free_data_batch(fs, &super, batch, 1) < 0); /* not allocated */
+	/* inside a batch the blocks are only freed at the end */
+	assert(fs_alloc_data(fs, &super, batch, 6) == 0);
+	fs_free_begin(fs);
+	assert(fs_free_data_batch(fs, &super, batch, 3) == 0);
+	fs_free_begin(fs);
+	assert(fs_free_data_batch(fs, &super, batch + 3, 3) == 0);
+	assert(fs_free_end(fs, &super) == 0);
+	assert(fs_is_data_allocated(fs, super, batch[0]) == 1);
+	assert(super.free_data_count == before);
+	assert(fs_free_end(fs, &super) == 0);
+	assert(fs_is_data_allocated(fs, super, batch[0]) == 0);
+	assert(super.free_data_count == before + 6);
+	/* a block given twice */
+	assert(fs_alloc_data(fs, &super, batch, 2) == 0);
+	batch[2] = batch[0];
+	assert(fs_free_data_batch(fs, &super, batch, 3) < 0);
+	assert(super.free_data_count == before + 6);
+	free(all);
+	assert(disk_sync(fs) == 0);
+
+	/* the bitmap blocks on the disk match */
+	assert(fs_read_block(fs, super.data_bitmap_loc, &blk) == 0);
+	assert(blk.data[0] == 0xFF && blk.data[(super.data_count - 1) / 8] != 0);
+	uint32_t synced_free = super.free_data_count;
+	disk_close(&fs);
+
+	printf("free counts checked at mount..\n");
+	int fd = open(filename, O_RDWR);
+	assert(fd >= 0 && pread(fd, &blk, FS_BLOCK_SIZE, 0) == FS_BLOCK_SIZE);
+	blk.super.free_data_count += 5;
+	assert(pwrite(fd, &blk, FS_BLOCK_SIZE, 0) == FS_BLOCK_SIZE);
+	close(fd);
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	assert(fs_is_data_allocated(fs, super, kept) == 1);
+	assert(fs_get_super(fs)->free_data_count == synced_free);
+	disk_close(&fs);
+
+	printf("free-extent index..\n");
+	/* the indexed searches match the scans of the same bitmap */
+	srand(10);
+	struct fs_bitmap bm = { 0 };
+	bm.nblocks = 1;
+	bm.nbits = 30000;
+	bm.words = calloc(FS_BLOCK_SIZE, 1);
+	bm.dirty = calloc(1, 1);
+	assert(bm.words != NULL && bm.dirty != NULL);
+	assert(freeidx_build(&bm) == 0);
+	struct fs_freeidx* idx = bm.index;
+	for(int round=0; round<2000; round++) {
+		uint32_t s = rand() % bm.nbits;
+		uint32_t len = 1 + rand() % ((bm.nbits - s < 200)? bm.nbits - s: 200);
+		if(rand() % 3) {
+			bitmap_set_range(&bm, s, len);
+		} else {
+			bitmap_clear_range(&bm, s, len);
+		}
+		uint32_t want = 1 + rand() % 100;
+		uint32_t e = s + rand() % (bm.nbits - s + 1);
+		uint32_t got = bitmap_find_run(&bm, s, e, want, NULL, NULL);
+		uint32_t gotmax = freeidx_largest(&bm, s, e);
+		struct freeidx_stats scan = { 0 };
+		freeidx_stats(&bm, &st);
+		bm.index = NULL;
+		assert(bitmap_find_run(&bm, s, e, want, NULL, NULL) == got);
+		uint32_t maxlen;
+		bitmap_find_run(&bm, s, e, UINT32_MAX, NULL, &maxlen);
+		assert(maxlen == gotmax);
+		for(uint32_t b=0; b<bm.nbits; b++) {
+			if(!bitmap_test(&bm, b)) {
+				scan.free++;
+				scan.extents += (b == 0 || bitmap_test(&bm, b - 1));
+			}
+		}
+		bitmap_find_run(&bm, 0, bm.nbits, UINT32_MAX, NULL, &scan.largest);
+		/* the scalar and the AVX2 word kernels agree with a bit loop */
+		uint32_t zero = bitmap_find_zero(&bm, s, e), one = bitmap_find_one(&bm, s, e);
+		uint32_t zeros = bitmap_count_zeros_range(&bm, s, e);
+		uint32_t bitzero = BITMAP_NONE, bitone = BITMAP_NONE, bitzeros = 0;
+		for(uint32_t b=e; b-->s;) {
+			if(bitmap_test(&bm, b)) {
+				bitone = b;
+			} else {
+				bitzero = b;
+				bitzeros++;
+			}
+		}
+		assert(zero == bitzero && one == bitone && zeros == bitzeros);
+		bitmap_simd_enable(round % 2);
+		assert(bitmap_find_zero(&bm, s, e) == zero && bitmap_find_one(&bm, s, e) == one);
+		assert(bitmap_count_zeros_range(&bm, s, e) == zeros);
+		bm.index = idx;
+		assert(scan.free == st.free && scan.extents == st.extents && scan.largest == st.largest);
+		assert(bitmap_count_zeros(&bm) == st.free);
+	}
+	freeidx_destroy(&bm);
+	free(bm.words);
+	free(bm.dirty);
+
+	return 0;
+}
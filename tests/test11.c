@@ -0,0 +1,117 @@
+/**
+ * @file test11.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+
+#include <fs.h>
+#include <disk.h>
+#include <io.h>
+#include <devutils.h>
+
+#define TEST_GROUP_BLOCKS 512
+#define TEST_FILE_SIZE (40 * FS_BLOCK_SIZE + 123)
+
+/**
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief program to test the block group format: placement of the inodes
+ * and data blocks in groups and persistence of the group descriptors
+ */
+int main(int argc, char** argv) {
+	char filename[512] = "./bin/partition";
+	struct fs_filesyst fs;
+	union fs_block blk;
+
+	printf("Creating filesyst..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	assert(fs_format_groups(fs, TEST_GROUP_BLOCKS) == 0);
+	struct fs_super_block super = *fs_get_super(fs);
+	assert(super.group_blocks == TEST_GROUP_BLOCKS && super.group_count == 4);
+	assert(super.inode_bitmap_loc == super.gdt_loc + super.gdt_size);
+	uint32_t free_inodes = super.free_inode_count;
+	uint32_t free_data = super.free_data_count;
+	assert(free_inodes == super.group_count * super.group_inodes);
+
+	printf("inodes near their parent..\n");
+	uint32_t ino0, ino1, ino2;
+	assert(fs_alloc_inode(fs, &super, &ino0) == 0);
+	assert(ino0 / FS_GROUP_BITS == 0);
+	assert(fs_alloc_inode_near(fs, &super, FS_GROUP_BITS + 5, &ino1) == 0);
+	assert(ino1 == FS_GROUP_BITS);
+	assert(fs_alloc_inode_near(fs, &super, ino1, &ino2) == 0);
+	assert(ino2 == ino1 + 1);
+	assert(fs_inode_blocknum(&super, ino1) == super.inode_loc + TEST_GROUP_BLOCKS);
+	/* the bits past the inodes of a group are not inodes */
+	assert(fs_is_inode_allocated(fs, super, super.group_inodes) == 0);
+	assert(fs_free_inode(fs, &super, super.group_inodes) < 0);
+
+	printf("data in the group of the inode..\n");
+	uint8_t* buf = malloc(TEST_FILE_SIZE);
+	uint8_t* out = malloc(TEST_FILE_SIZE);
+	assert(buf != NULL && out != NULL);
+	for(int i=0; i<TEST_FILE_SIZE; i++) {
+		buf[i] = i * 7;
+	}
+	assert(io_write_ino(fs, super, ino1, buf, 0, TEST_FILE_SIZE) == 0);
+	struct fs_inode ind;
+	assert(fs_read_inode(fs, super, ino1, &ind) == 0);
+	assert(ind.direct[0] == fs_data_goal(&super, ino1));
+	assert((ind.direct[0] - 1) / FS_GROUP_BITS == 1);
+	assert(fs_data_blocknum(&super, ind.direct[0]) == super.data_loc + TEST_GROUP_BLOCKS);
+	assert(fs_read_block(fs, fs_data_blocknum(&super, ind.direct[0]), &blk) == 0);
+	assert(memcmp(blk.data, buf, FS_BLOCK_SIZE) == 0);
+	assert(io_read_ino(fs, super, ino1, out, 0, TEST_FILE_SIZE) == 0);
+	assert(memcmp(buf, out, TEST_FILE_SIZE) == 0);
+	/* the bits past the data blocks of a group are not data blocks */
+	uint32_t ndata = TEST_GROUP_BLOCKS - 2 - (super.data_loc - super.inode_loc);
+	assert(fs_is_data_allocated(fs, super, ndata + 1) == 0);
+	assert(fs_free_data(fs, &super, ndata + 1) < 0);
+	assert(fs_is_data_allocated(fs, super, ndata) == 0);
+
+	printf("group descriptors written at sync..\n");
+	assert(disk_sync(fs) == 0);
+	assert(fs_read_block(fs, super.gdt_loc, &blk) == 0);
+	assert(blk.groups[0].free_inode_count == super.group_inodes - 1);
+	assert(blk.groups[1].free_inode_count == super.group_inodes - 2);
+	assert(blk.groups[1].free_data_count < ndata);
+	assert(blk.groups[2].free_inode_count == super.group_inodes);
+	uint32_t sum = 0;
+	for(uint32_t g=0; g<super.group_count; g++) {
+		sum += blk.groups[g].free_data_count;
+	}
+	assert(sum == fs_get_super(fs)->free_data_count);
+	/* the group bitmaps are in their group */
+	assert(fs_read_block(fs, super.data_bitmap_loc + TEST_GROUP_BLOCKS, &blk) == 0);
+	assert(blk.data[0] == 0xFF && (blk.data[ndata / 8] >> (ndata % 8)) == 0xFF >> (ndata % 8));
+
+	printf("groups after remount..\n");
+	assert(io_rm_ino(fs, super, ino1) == 0);
+	assert(fs_free_inode(fs, &super, ino0) == 0);
+	assert(fs_free_inode(fs, &super, ino2) == 0);
+	disk_close(&fs);
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	super = *fs_get_super(fs);
+	assert(super.group_count == 4);
+	assert(super.free_inode_count == free_inodes && super.free_data_count == free_data);
+	assert(fs_read_block(fs, super.gdt_loc, &blk) == 0);
+	assert(blk.groups[1].free_inode_count == super.group_inodes);
+	assert(blk.groups[1].free_data_count == ndata);
+	/* a full group sends the inodes to the next one */
+	uint32_t last = super.group_count - 1;
+	for(uint32_t i=0; i<super.group_inodes; i++) {
+		assert(fs_alloc_inode_near(fs, &super, last * FS_GROUP_BITS, &ino0) == 0);
+	}
+	assert(fs_alloc_inode_near(fs, &super, last * FS_GROUP_BITS, &ino0) == 0);
+	assert(ino0 == 0);
+	disk_close(&fs);
+
+	free(buf);
+	free(out);
+	return 0;
+}
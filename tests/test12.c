@@ -0,0 +1,196 @@
+/**
+ * @file test12.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+
+#include <fs.h>
+#include <disk.h>
+#include <io.h>
+#include <devutils.h>
+
+#define TEST_BLOCKS 300 /* no of preallocated blocks */
+#define TEST_SIZE (TEST_BLOCKS * FS_BLOCK_SIZE)
+
+/**
+ * @brief utility function to check that a range of a buffer is zero
+ */
+static int is_zero(const uint8_t* buf, size_t size) {
+	for(size_t i=0; i<size; i++) {
+		if(buf[i]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * @brief utility function to put a value at an offset of a block
+ */
+static void put(union fs_block* blk, uint32_t off, uint32_t val, size_t size) {
+	if(size == sizeof(uint16_t)) {
+		uint16_t v = val;
+		memcpy(blk->data + off, &v, size);
+	} else {
+		memcpy(blk->data + off, &val, size);
+	}
+}
+
+/**
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief program to test the preallocation of the blocks of a file: the
+ * preallocated blocks are contiguous, read as zeros even if they hold
+ * old data, and writing them allocates nothing
+ */
+int main(int argc, char** argv) {
+	char filename[512] = "./bin/partition";
+	struct fs_filesyst fs;
+
+	printf("Creating filesyst..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	assert(fs_format(fs) == 0);
+	struct fs_super_block super = *fs_get_super(fs);
+
+	uint8_t* buf = malloc(TEST_SIZE);
+	uint8_t* out = malloc(TEST_SIZE);
+	assert(buf != NULL && out != NULL);
+
+	printf("old data left on the disk..\n");
+	uint32_t old, ino;
+	struct fs_inode ind;
+	union fs_block indirect;
+	memset(buf, 0xAB, TEST_SIZE);
+	assert(io_open_creat(fs, super, 0, &old) == 0);
+	assert(io_write_ino(fs, super, old, buf, 0, TEST_SIZE) == 0);
+	assert(fs_read_inode(fs, super, old, &ind) == 0);
+	uint32_t old_first = ind.direct[0];
+	assert(io_rm_ino(fs, super, old) == 0);
+
+	printf("preallocation..\n");
+	assert(io_open_creat(fs, super, 0, &ino) == 0);
+	uint32_t free_data = fs_get_super(fs)->free_data_count;
+	assert(io_fallocate_ino(fs, super, ino, 0, TEST_SIZE) == 0);
+	/* the data blocks and the indirect block */
+	assert(fs_get_super(fs)->free_data_count == free_data - TEST_BLOCKS - 1);
+	assert(fs_read_inode(fs, super, ino, &ind) == 0);
+	assert(ind.size == TEST_SIZE && (ind.flags & FS_INODE_PREALLOC) && ind.init_size == 0);
+	assert(ind.direct[0] == old_first); /* the blocks of the removed file */
+	assert(fs_read_data(fs, super, &indirect, &ind.indirect, 1) == 0);
+	for(int i=1; i<TEST_BLOCKS; i++) {
+		uint32_t prev = (i - 1 < FS_DIRECT_POINTERS_PER_INODE)? ind.direct[i - 1]:
+			indirect.pointers[i - 1 - FS_DIRECT_POINTERS_PER_INODE];
+		uint32_t cur = (i < FS_DIRECT_POINTERS_PER_INODE)? ind.direct[i]:
+			indirect.pointers[i - FS_DIRECT_POINTERS_PER_INODE];
+		assert(cur == prev + 1); /* one contiguous run */
+	}
+	assert(io_read_ino(fs, super, ino, out, 0, TEST_SIZE) == 0);
+	assert(is_zero(out, TEST_SIZE));
+
+	printf("writes in the preallocated range..\n");
+	free_data = fs_get_super(fs)->free_data_count;
+	for(int i=0; i<TEST_SIZE; i++) {
+		buf[i] = i % 251;
+	}
+	/* a gap between the written bytes: zeroed before the write */
+	size_t off1 = 3 * FS_BLOCK_SIZE + 100, off2 = 20 * FS_BLOCK_SIZE + 7;
+	assert(io_write_ino(fs, super, ino, buf, 0, 10) == 0);
+	assert(io_write_ino(fs, super, ino, buf + off2, off2, 5000) == 0);
+	assert(io_write_ino(fs, super, ino, buf + off1, off1, 50) == 0);
+	assert(fs_get_super(fs)->free_data_count == free_data);
+	assert(fs_read_inode(fs, super, ino, &ind) == 0);
+	assert(ind.init_size == off2 + 5000 && ind.size == TEST_SIZE);
+	memset(out, 0xFF, TEST_SIZE);
+	assert(io_read_ino(fs, super, ino, out, 0, TEST_SIZE) == 0);
+	assert(memcmp(out, buf, 10) == 0 && is_zero(out + 10, off1 - 10));
+	assert(memcmp(out + off1, buf + off1, 50) == 0);
+	assert(is_zero(out + off1 + 50, off2 - off1 - 50));
+	assert(memcmp(out + off2, buf + off2, 5000) == 0);
+	assert(is_zero(out + off2 + 5000, TEST_SIZE - off2 - 5000));
+	/* reads starting in the middle of the block holding init_size */
+	assert(io_read_ino(fs, super, ino, out, off2 + 4000, 3 * FS_BLOCK_SIZE) == 0);
+	assert(memcmp(out, buf + off2 + 4000, 1000) == 0 && is_zero(out + 1000, 3 * FS_BLOCK_SIZE - 1000));
+
+	printf("the whole file written..\n");
+	assert(io_write_ino(fs, super, ino, buf, 0, TEST_SIZE) == 0);
+	assert(fs_get_super(fs)->free_data_count == free_data);
+	assert(fs_read_inode(fs, super, ino, &ind) == 0);
+	assert(!(ind.flags & FS_INODE_PREALLOC));
+	assert(io_read_ino(fs, super, ino, out, 0, TEST_SIZE) == 0);
+	assert(memcmp(out, buf, TEST_SIZE) == 0);
+
+	printf("holes filled before the initialized size..\n");
+	uint32_t sparse;
+	assert(io_open_creat(fs, super, 0, &sparse) == 0);
+	assert(io_write_ino(fs, super, sparse, buf, 0, 100) == 0);
+	assert(io_write_ino(fs, super, sparse, buf, 6 * FS_BLOCK_SIZE, 100) == 0);
+	assert(io_fallocate_ino(fs, super, sparse, 0, 10 * FS_BLOCK_SIZE) == 0);
+	assert(fs_read_inode(fs, super, sparse, &ind) == 0);
+	for(int i=0; i<FS_DIRECT_POINTERS_PER_INODE; i++) {
+		assert(ind.direct[i] != 0);
+	}
+	assert(ind.init_size == 6 * FS_BLOCK_SIZE + 100);
+	assert(io_read_ino(fs, super, sparse, out, 0, 10 * FS_BLOCK_SIZE) == 0);
+	assert(memcmp(out, buf, 100) == 0 && is_zero(out + 100, 6 * FS_BLOCK_SIZE - 100));
+	assert(memcmp(out + 6 * FS_BLOCK_SIZE, buf, 100) == 0);
+	assert(is_zero(out + 6 * FS_BLOCK_SIZE + 100, 4 * FS_BLOCK_SIZE - 100));
+
+	printf("preallocation kept after remount..\n");
+	disk_close(&fs);
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	super = *fs_get_super(fs);
+	assert(fs_read_inode(fs, super, sparse, &ind) == 0);
+	assert((ind.flags & FS_INODE_PREALLOC) && ind.size == 10 * FS_BLOCK_SIZE);
+	assert(io_read_ino(fs, super, sparse, out, 6 * FS_BLOCK_SIZE, 4 * FS_BLOCK_SIZE) == 0);
+	assert(memcmp(out, buf, 100) == 0 && is_zero(out + 100, 4 * FS_BLOCK_SIZE - 100));
+
+	printf("no preallocation with the baseline inode records..\n");
+	/* 60 bytes per inode: mode, uid, gid, padding, atime, mtime, size,
+	 * hcount, direct pointers and indirect pointer */
+	assert(sizeof(struct fs_inode_v0) == 60);
+	struct fs_super_block v0 = super;
+	v0.inode_version = FS_INODE_V0;
+	union fs_block iblk, copy;
+	memset(&iblk, 0, FS_BLOCK_SIZE);
+	for(uint32_t i=0; i<FS_INODES_PER_BLOCK; i++) {
+		uint32_t off = i * 60;
+		put(&iblk, off, i + 1, 2);
+		put(&iblk, off + 2, i + 2, 2);
+		put(&iblk, off + 4, i + 3, 2);
+		put(&iblk, off + 6, 0xFFFF, 2); /* padding, never read */
+		put(&iblk, off + 8, i + 4, 4);
+		put(&iblk, off + 12, i + 5, 4);
+		put(&iblk, off + 16, i + 6, 4);
+		put(&iblk, off + 20, i + 7, 4);
+		for(uint32_t j=0; j<FS_DIRECT_POINTERS_PER_INODE; j++) {
+			put(&iblk, off + 24 + j * 4, i * 100 + j, 4);
+		}
+		put(&iblk, off + 56, i + 8, 4);
+	}
+	memset(&copy, 0, FS_BLOCK_SIZE);
+	for(uint32_t i=0; i<FS_INODES_PER_BLOCK; i++) {
+		fs_inode_decode(&v0, &iblk, i, &ind);
+		assert(ind.mode == i + 1 && ind.uid == i + 2 && ind.gid == i + 3);
+		assert(ind.atime == i + 4 && ind.mtime == i + 5 && ind.size == i + 6 && ind.hcount == i + 7);
+		assert(ind.direct[0] == i * 100 && ind.direct[7] == i * 100 + 7 && ind.indirect == i + 8);
+		assert(ind.flags == 0 && ind.init_size == 0);
+		fs_inode_encode(&v0, &copy, i, &ind);
+		put(&copy, i * 60 + 6, 0xFFFF, 2);
+	}
+	assert(memcmp(&copy, &iblk, FS_BLOCK_SIZE) == 0);
+	fs_get_super(fs)->inode_version = FS_INODE_V0;
+	assert(!fs_has_inode_flags(fs_get_super(fs)));
+	assert(io_fallocate_ino(fs, v0, sparse, 0, 20 * FS_BLOCK_SIZE) < 0);
+	assert(fs_set_features(fs, FS_FEATURE_EXTENTS) < 0);
+	fs_get_super(fs)->inode_version = FS_INODE_V1;
+	disk_close(&fs);
+
+	free(buf);
+	free(out);
+	return 0;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file test13.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+
+#include <fs.h>
+#include <disk.h>
+#include <io.h>
+#include <devutils.h>
+
+#define TEST_WRITES 200  /* no of small writes per file */
+#define TEST_CHUNK 1000  /* size of each small write */
+#define TEST_SIZE (TEST_WRITES * TEST_CHUNK)
+
+/**
+ * @brief utility function to get the data block of a logical block
+ */
+static uint32_t blknum_of(struct fs_filesyst fs, struct fs_super_block super,
+						  struct fs_inode* ind, uint32_t lblk)
+{
+	if(lblk < FS_DIRECT_POINTERS_PER_INODE) {
+		return ind->direct[lblk];
+	}
+	union fs_block indirect;
+	assert(fs_read_data(fs, super, &indirect, &ind->indirect, 1) == 0);
+	return indirect.pointers[lblk - FS_DIRECT_POINTERS_PER_INODE];
+}
+
+/**
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief program to test the delayed allocation: the written data stays
+ * in dirty pages until sync, then each file is allocated contiguously
+ */
+int main(int argc, char** argv) {
+	char filename[512] = "./bin/partition";
+	struct fs_filesyst fs;
+
+	printf("Creating filesyst..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	assert(fs_format(fs) == 0);
+	struct fs_super_block super = *fs_get_super(fs);
+	assert(io_delalloc_enable(fs, 1) == 0);
+
+	uint8_t* buf = malloc(TEST_SIZE);
+	uint8_t* out = malloc(TEST_SIZE + FS_BLOCK_SIZE);
+	assert(buf != NULL && out != NULL);
+	for(int i=0; i<TEST_SIZE; i++) {
+		buf[i] = i % 253;
+	}
+
+	printf("interleaved small writes..\n");
+	uint32_t a, b, gone;
+	assert(io_open_creat(fs, super, 0, &a) == 0);
+	assert(io_open_creat(fs, super, 0, &b) == 0);
+	assert(io_open_creat(fs, super, 0, &gone) == 0);
+	uint32_t free_data = fs_get_super(fs)->free_data_count;
+	for(int i=0; i<TEST_WRITES; i++) {
+		assert(io_write_ino(fs, super, a, buf + i * TEST_CHUNK, i * TEST_CHUNK, TEST_CHUNK) == 0);
+		assert(io_write_ino(fs, super, b, buf + i * TEST_CHUNK, i * TEST_CHUNK, TEST_CHUNK) == 0);
+		assert(io_write_ino(fs, super, gone, buf, i * TEST_CHUNK, TEST_CHUNK) == 0);
+	}
+	/* nothing allocated yet, the data is read from the dirty pages */
+	assert(fs_get_super(fs)->free_data_count == free_data);
+	struct fs_inode ind;
+	assert(fs_read_inode(fs, super, a, &ind) == 0);
+	assert(ind.size == TEST_SIZE && ind.direct[0] == 0);
+	memset(out, 0, TEST_SIZE);
+	assert(io_read_ino(fs, super, a, out, 0, TEST_SIZE) == 0);
+	assert(memcmp(out, buf, TEST_SIZE) == 0);
+	assert(io_read_ino(fs, super, b, out, 1234, 5000) == 0);
+	assert(memcmp(out, buf + 1234, 5000) == 0);
+
+	printf("removed before sync..\n");
+	assert(io_rm_ino(fs, super, gone) == 0);
+	assert(fs_get_super(fs)->free_data_count == free_data);
+
+	printf("allocated at sync..\n");
+	assert(disk_sync(fs) == 0);
+	uint32_t nblocks = (TEST_SIZE + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+	/* the data blocks and the indirect block of the two files */
+	assert(fs_get_super(fs)->free_data_count == free_data - 2 * (nblocks + 1));
+	uint32_t files[2] = { a, b };
+	for(int f=0; f<2; f++) {
+		assert(fs_read_inode(fs, super, files[f], &ind) == 0);
+		uint32_t first = blknum_of(fs, super, &ind, 0);
+		for(uint32_t i=1; i<nblocks; i++) {
+			assert(blknum_of(fs, super, &ind, i) == first + i); /* one run per file */
+		}
+		memset(out, 0, TEST_SIZE);
+		assert(io_read_ino(fs, super, files[f], out, 0, TEST_SIZE) == 0);
+		assert(memcmp(out, buf, TEST_SIZE) == 0);
+	}
+
+	printf("rewrites of allocated blocks..\n");
+	free_data = fs_get_super(fs)->free_data_count;
+	assert(io_write_ino(fs, super, a, buf, 100, 10) == 0);
+	assert(io_write_ino(fs, super, a, buf, TEST_SIZE, 10) == 0);
+	assert(io_read_ino(fs, super, a, out, 0, 200) == 0);
+	assert(memcmp(out, buf, 100) == 0 && memcmp(out + 100, buf, 10) == 0);
+	assert(memcmp(out + 110, buf + 110, 90) == 0);
+	assert(io_delalloc_enable(fs, 0) == 0);
+	assert(fs_get_super(fs)->free_data_count == free_data);
+	disk_close(&fs);
+
+	printf("data kept after remount..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	super = *fs_get_super(fs);
+	assert(io_read_ino(fs, super, a, out, 0, TEST_SIZE + 10) == 0);
+	assert(memcmp(out, buf, 100) == 0 && memcmp(out + 100, buf, 10) == 0);
+	assert(memcmp(out + 110, buf + 110, TEST_SIZE - 110) == 0);
+	assert(memcmp(out + TEST_SIZE, buf, 10) == 0);
+
+	printf("dirty pages dropped by a format..\n");
+	assert(io_delalloc_enable(fs, 1) == 0);
+	assert(io_write_ino(fs, super, a, buf, 0, TEST_SIZE) == 0);
+	assert(fs_format(fs) == 0);
+	super = *fs_get_super(fs);
+	uint32_t fresh;
+	assert(io_open_creat(fs, super, 0, &fresh) == 0);
+	free_data = fs_get_super(fs)->free_data_count;
+	assert(io_delalloc_flush(fs) == 0); /* nothing to write */
+	assert(fs_get_super(fs)->free_data_count == free_data);
+	assert(fs_read_inode(fs, super, fresh, &ind) == 0 && ind.size == 0);
+	assert(io_delalloc_enable(fs, 0) == 0);
+	disk_close(&fs);
+
+	free(buf);
+	free(out);
+	return 0;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file test14.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+
+#include <fs.h>
+#include <disk.h>
+#include <io.h>
+#include <icache.h>
+#include <devutils.h>
+
+#define TEST_WRITES 100 /* no of small writes to the same file */
+#define TEST_FILES 8    /* no of files of the eviction test */
+#define TEST_CACHED 4   /* no of inodes kept in memory for the eviction test */
+
+/**
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief program to test the inode cache: the updates of an inode stay in
+ * memory until sync, the inodes of the open files are never evicted
+ */
+int main(int argc, char** argv) {
+	char filename[512] = "./bin/partition";
+	struct fs_filesyst fs;
+	struct fs_icache_stats st, prev;
+
+	printf("Creating filesyst..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	assert(fs_format(fs) == 0);
+	struct fs_super_block super = *fs_get_super(fs);
+
+	printf("repeated updates of one inode..\n");
+	uint32_t ino;
+	char buf[100];
+	memset(buf, 'x', sizeof(buf));
+	assert(io_open_creat(fs, super, 0, &ino) == 0);
+	assert(disk_sync(fs) == 0);
+	fs_icache_stats(fs, &prev);
+	for(int i=0; i<TEST_WRITES; i++) {
+		assert(io_write_ino(fs, super, ino, buf, i * sizeof(buf), sizeof(buf)) == 0);
+	}
+	fs_icache_stats(fs, &st);
+	assert(st.writebacks == prev.writebacks && st.misses == prev.misses);
+	assert(disk_sync(fs) == 0);
+	fs_icache_stats(fs, &st);
+	assert(st.writebacks == prev.writebacks + 1); /* once per flush */
+	assert(disk_sync(fs) == 0);
+	fs_icache_stats(fs, &prev);
+	assert(prev.writebacks == st.writebacks); /* nothing dirty left */
+
+	printf("freed inodes are not written back..\n");
+	uint32_t gone;
+	assert(io_open_creat(fs, super, 0, &gone) == 0);
+	assert(io_write_ino(fs, super, gone, buf, 0, sizeof(buf)) == 0);
+	assert(io_rm_ino(fs, super, gone) == 0);
+	assert(disk_sync(fs) == 0);
+	fs_icache_stats(fs, &st);
+	assert(st.writebacks == prev.writebacks);
+
+	printf("open files stay in memory..\n");
+	assert(fs_icache_init(fs, TEST_CACHED) == 0);
+	uint32_t files[TEST_FILES];
+	int fds[TEST_CACHED];
+	for(int i=0; i<TEST_FILES; i++) {
+		assert(io_open_creat(fs, super, 0, &files[i]) == 0);
+		assert(io_write_ino(fs, super, files[i], buf, 0, i + 1) == 0);
+	}
+	for(int i=0; i<TEST_CACHED; i++) {
+		fds[i] = io_iopen(fs, super, files[i]);
+		assert(fds[i] >= 0);
+	}
+	struct fs_inode ind;
+	for(int i=TEST_CACHED; i<TEST_FILES; i++) {
+		/* all the entries are referenced: read from the inode table */
+		assert(fs_read_inode(fs, super, files[i], &ind) == 0);
+		assert(ind.size == i + 1);
+	}
+	fs_icache_stats(fs, &prev);
+	for(int i=0; i<TEST_CACHED; i++) {
+		assert(fs_read_inode(fs, super, files[i], &ind) == 0);
+		assert(ind.size == i + 1);
+	}
+	fs_icache_stats(fs, &st);
+	assert(st.hits == prev.hits + TEST_CACHED && st.misses == prev.misses);
+	for(int i=0; i<TEST_CACHED; i++) {
+		assert(io_close(fs, fds[i]) == 0);
+	}
+	/* the closed files can be evicted now */
+	for(int i=TEST_CACHED; i<TEST_FILES; i++) {
+		assert(fs_read_inode(fs, super, files[i], &ind) == 0);
+	}
+	fs_icache_stats(fs, &st);
+	assert(st.evictions >= TEST_CACHED);
+
+	printf("without inode cache..\n");
+	assert(fs_icache_init(fs, 0) == 0);
+	assert(io_write_ino(fs, super, files[0], buf, 0, sizeof(buf)) == 0);
+	assert(fs_read_inode(fs, super, files[0], &ind) == 0);
+	assert(ind.size == sizeof(buf));
+	assert(fs_icache_init(fs, FS_ICACHE_DEFAULT_INODES) == 0);
+	disk_close(&fs);
+
+	printf("inodes kept after remount..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	super = *fs_get_super(fs);
+	assert(fs_read_inode(fs, super, ino, &ind) == 0);
+	assert(ind.size == TEST_WRITES * sizeof(buf));
+	for(int i=1; i<TEST_FILES; i++) {
+		assert(fs_read_inode(fs, super, files[i], &ind) == 0);
+		assert(ind.size == i + 1);
+	}
+	disk_close(&fs);
+	return 0;
+}
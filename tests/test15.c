@@ -0,0 +1,155 @@
+/**
+ * @file test15.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+
+#include <fs.h>
+#include <disk.h>
+#include <io.h>
+#include <devutils.h>
+
+#define TEST_DISK_SIZE (64 * 1024 * 1024)
+#define TEST_BIG_SIZE (16 * 1024 * 1024) /* bigger than the block pointers allow */
+#define TEST_APPENDS 8                   /* no of interleaved appends of a block */
+
+/**
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief program to test the files mapped with extents
+ */
+int main(int argc, char** argv) {
+	char filename[512] = "./bin/partition";
+	struct fs_filesyst fs;
+
+	printf("Creating filesyst..\n");
+	assert(creatfile(filename, TEST_DISK_SIZE, &fs) == 0);
+	assert(fs_format(fs) == 0);
+	struct fs_super_block super = *fs_get_super(fs);
+
+	uint8_t* buf = malloc(TEST_BIG_SIZE);
+	uint8_t* out = malloc(TEST_BIG_SIZE);
+	assert(buf != NULL && out != NULL);
+	for(int i=0; i<TEST_BIG_SIZE; i++) {
+		buf[i] = i % 251;
+	}
+
+	/* a file created before the feature keeps its block pointers */
+	uint32_t old;
+	assert(io_open_creat(fs, super, 0, &old) == 0);
+	assert(fs_set_features(fs, FS_FEATURE_EXTENTS) == 0);
+	assert(io_write_ino(fs, super, old, buf, 0, 3 * FS_BLOCK_SIZE) == 0);
+	assert(io_write_ino(fs, super, old, buf, 0, TEST_BIG_SIZE) < 0); /* too big */
+	struct fs_inode ind;
+	assert(fs_read_inode(fs, super, old, &ind) == 0);
+	assert(!(ind.flags & FS_INODE_EXTENTS) && ind.direct[2] == ind.direct[0] + 2);
+
+	printf("one extent for a contiguous file..\n");
+	uint32_t big;
+	uint32_t free_data = fs_get_super(fs)->free_data_count;
+	assert(io_open_creat(fs, super, 0, &big) == 0);
+	assert(io_write_ino(fs, super, big, buf, 0, TEST_BIG_SIZE) == 0);
+	assert(fs_read_inode(fs, super, big, &ind) == 0);
+	assert((ind.flags & FS_INODE_EXTENTS) && ind.size == TEST_BIG_SIZE);
+	assert(ind.extents.depth == 0 && ind.extents.count == 1);
+	assert(ind.extents.ext[0].lblk == 0 && ind.extents.ext[0].len == TEST_BIG_SIZE / FS_BLOCK_SIZE);
+	assert(fs_get_super(fs)->free_data_count == free_data - TEST_BIG_SIZE / FS_BLOCK_SIZE);
+	memset(out, 0, TEST_BIG_SIZE);
+	assert(io_read_ino(fs, super, big, out, 0, TEST_BIG_SIZE) == 0);
+	assert(memcmp(out, buf, TEST_BIG_SIZE) == 0);
+	/* appending extends the same extent */
+	assert(io_write_ino(fs, super, big, buf, TEST_BIG_SIZE, 10) == 0);
+	assert(fs_read_inode(fs, super, big, &ind) == 0);
+	assert(ind.extents.count == 1 && ind.extents.ext[0].len == TEST_BIG_SIZE / FS_BLOCK_SIZE + 1);
+
+	printf("extent block for fragmented files..\n");
+	uint32_t a, b;
+	assert(io_open_creat(fs, super, 0, &a) == 0);
+	assert(io_open_creat(fs, super, 0, &b) == 0);
+	for(int i=0; i<TEST_APPENDS; i++) {
+		assert(io_write_ino(fs, super, a, buf + i * FS_BLOCK_SIZE, i * FS_BLOCK_SIZE, FS_BLOCK_SIZE) == 0);
+		assert(io_write_ino(fs, super, b, buf, i * FS_BLOCK_SIZE, FS_BLOCK_SIZE) == 0);
+	}
+	assert(fs_read_inode(fs, super, a, &ind) == 0);
+	assert(ind.extents.depth == 1 && ind.extents.count > FS_INLINE_EXTENTS);
+	assert(io_read_ino(fs, super, a, out, 0, TEST_APPENDS * FS_BLOCK_SIZE) == 0);
+	assert(memcmp(out, buf, TEST_APPENDS * FS_BLOCK_SIZE) == 0);
+	free_data = fs_get_super(fs)->free_data_count;
+	assert(io_rm_ino(fs, super, a) == 0);
+	/* the data blocks and the extent block */
+	assert(fs_get_super(fs)->free_data_count == free_data + TEST_APPENDS + 1);
+
+	printf("sparse writes..\n");
+	uint32_t sparse;
+	assert(io_open_creat(fs, super, 0, &sparse) == 0);
+	uint32_t far = 3000 * FS_BLOCK_SIZE + 5;
+	assert(io_write_ino(fs, super, sparse, buf, far, 100) == 0);
+	assert(fs_read_inode(fs, super, sparse, &ind) == 0);
+	assert(ind.extents.count == 1 && ind.extents.ext[0].lblk == 3000 && ind.extents.ext[0].len == 1);
+	memset(out, 0xFF, 2 * FS_BLOCK_SIZE);
+	assert(io_read_ino(fs, super, sparse, out, far - FS_BLOCK_SIZE, FS_BLOCK_SIZE + 100) == 0);
+	for(int i=0; i<FS_BLOCK_SIZE; i++) {
+		assert(out[i] == 0);
+	}
+	assert(memcmp(out + FS_BLOCK_SIZE, buf, 100) == 0);
+
+	printf("blocks given back when the inode can't be written..\n");
+	/* *a* was removed: writing its inode fails after the allocation */
+	uint32_t files[] = {b, sparse, old}; /* *old* has block pointers */
+	uint32_t offs[] = {2990, 2990, 0};
+	for(int i=0; i<3; i++) {
+		struct fs_inode before;
+		assert(fs_read_inode(fs, super, files[i], &ind) == 0);
+		before = ind;
+		free_data = fs_get_super(fs)->free_data_count;
+		assert(io_lazy_alloc(fs, super, a, &ind, offs[i] * FS_BLOCK_SIZE, 20 * FS_BLOCK_SIZE) < 0);
+		assert(fs_get_super(fs)->free_data_count == free_data);
+		assert(memcmp(&ind.extents, &before.extents, sizeof(ind.extents)) == 0);
+	}
+	assert(io_read_ino(fs, super, b, out, 0, TEST_APPENDS * FS_BLOCK_SIZE) == 0);
+	for(int i=0; i<TEST_APPENDS; i++) {
+		assert(memcmp(out + i * FS_BLOCK_SIZE, buf, FS_BLOCK_SIZE) == 0);
+	}
+
+	printf("too many extents..\n");
+	uint32_t frag;
+	assert(io_open_creat(fs, super, 0, &frag) == 0);
+	for(uint32_t i=0; i<FS_EXTENTS_PER_BLOCK; i++) {
+		assert(io_write_ino(fs, super, frag, buf, 2 * i * FS_BLOCK_SIZE, 1) == 0);
+	}
+	free_data = fs_get_super(fs)->free_data_count;
+	assert(io_write_ino(fs, super, frag, buf, 2 * FS_EXTENTS_PER_BLOCK * FS_BLOCK_SIZE, 1) < 0);
+	assert(fs_get_super(fs)->free_data_count == free_data);
+	/* the mapped blocks can still be written */
+	assert(io_write_ino(fs, super, frag, buf, 10, 100) == 0);
+	assert(fs_read_inode(fs, super, frag, &ind) == 0);
+	assert(ind.extents.count == FS_EXTENTS_PER_BLOCK);
+	disk_close(&fs);
+
+	printf("extents kept after remount..\n");
+	assert(creatfile(filename, TEST_DISK_SIZE, &fs) == 0);
+	super = *fs_get_super(fs);
+	assert(super.features & FS_FEATURE_EXTENTS);
+	memset(out, 0, TEST_BIG_SIZE);
+	assert(io_read_ino(fs, super, big, out, 0, TEST_BIG_SIZE) == 0);
+	assert(memcmp(out, buf, TEST_BIG_SIZE) == 0);
+	assert(io_read_ino(fs, super, b, out, 0, TEST_APPENDS * FS_BLOCK_SIZE) == 0);
+	for(int i=0; i<TEST_APPENDS; i++) {
+		assert(memcmp(out + i * FS_BLOCK_SIZE, buf, FS_BLOCK_SIZE) == 0);
+	}
+	assert(io_read_ino(fs, super, old, out, 0, 3 * FS_BLOCK_SIZE) == 0);
+	assert(memcmp(out, buf, 3 * FS_BLOCK_SIZE) == 0);
+	free_data = fs_get_super(fs)->free_data_count;
+	assert(io_rm_ino(fs, super, big) == 0);
+	assert(fs_get_super(fs)->free_data_count == free_data + TEST_BIG_SIZE / FS_BLOCK_SIZE + 1);
+	disk_close(&fs);
+
+	free(buf);
+	free(out);
+	return 0;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file test16.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+
+#include <fs.h>
+#include <disk.h>
+#include <io.h>
+#include <icache.h>
+#include <devutils.h>
+
+#define TEST_SMALL 30   /* size of a file that fits in its inode */
+#define TEST_GROWN 1000 /* size of the file after it outgrows its inode */
+
+/**
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief program to test the inline data of the small files
+ */
+int main(int argc, char** argv) {
+	char filename[512] = "./bin/partition";
+	struct fs_filesyst fs;
+	struct fs_icache_stats st, prev;
+
+	printf("Creating filesyst..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	assert(fs_format(fs) == 0);
+	struct fs_super_block super = *fs_get_super(fs);
+	assert(fs_set_features(fs, FS_FEATURE_INLINE_DATA) == 0);
+
+	uint8_t buf[TEST_GROWN], out[TEST_GROWN];
+	for(int i=0; i<TEST_GROWN; i++) {
+		buf[i] = i % 251 + 1;
+	}
+
+	printf("small files take no data block..\n");
+	uint32_t small, tail;
+	uint32_t free_data = fs_get_super(fs)->free_data_count;
+	assert(io_open_creat(fs, super, 0, &small) == 0);
+	assert(io_write_ino(fs, super, small, buf, 0, TEST_SMALL) == 0);
+	assert(io_open_creat(fs, super, 0, &tail) == 0);
+	assert(io_write_ino(fs, super, tail, buf, FS_INLINE_DATA_SIZE - 5, 5) == 0);
+	assert(fs_get_super(fs)->free_data_count == free_data);
+	struct fs_inode ind;
+	assert(fs_read_inode(fs, super, small, &ind) == 0);
+	assert((ind.flags & FS_INODE_INLINE) && ind.size == TEST_SMALL);
+	assert(io_read_ino(fs, super, small, out, 0, TEST_SMALL) == 0);
+	assert(memcmp(out, buf, TEST_SMALL) == 0);
+	/* the bytes before the write and after the inline area read as zeros */
+	memset(out, 0xFF, sizeof(out));
+	assert(io_read_ino(fs, super, tail, out, 0, FS_INLINE_DATA_SIZE + 10) == 0);
+	for(int i=0; i<FS_INLINE_DATA_SIZE - 5; i++) {
+		assert(out[i] == 0);
+	}
+	assert(memcmp(out + FS_INLINE_DATA_SIZE - 5, buf, 5) == 0);
+	for(int i=FS_INLINE_DATA_SIZE; i<FS_INLINE_DATA_SIZE + 10; i++) {
+		assert(out[i] == 0);
+	}
+
+	printf("read with the inode..\n");
+	assert(fs_icache_init(fs, FS_ICACHE_DEFAULT_INODES) == 0); /* empty cache */
+	fs_icache_stats(fs, &prev);
+	assert(io_read_ino(fs, super, small, out, 0, TEST_SMALL) == 0);
+	fs_icache_stats(fs, &st);
+	assert(st.misses == prev.misses + 1);
+	assert(memcmp(out, buf, TEST_SMALL) == 0);
+
+	printf("growing files move to data blocks..\n");
+	assert(io_write_ino(fs, super, small, buf + TEST_SMALL, TEST_SMALL, TEST_GROWN - TEST_SMALL) == 0);
+	assert(fs_read_inode(fs, super, small, &ind) == 0);
+	assert(!(ind.flags & FS_INODE_INLINE) && ind.size == TEST_GROWN && ind.direct[0] != 0);
+	assert(fs_get_super(fs)->free_data_count == free_data - 1);
+	assert(io_read_ino(fs, super, small, out, 0, TEST_GROWN) == 0);
+	assert(memcmp(out, buf, TEST_GROWN) == 0);
+	/* with extents the moved file gets an extent */
+	uint32_t ext;
+	assert(fs_set_features(fs, FS_FEATURE_INLINE_DATA | FS_FEATURE_EXTENTS) == 0);
+	assert(io_open_creat(fs, super, 0, &ext) == 0);
+	assert(io_write_ino(fs, super, ext, buf, 0, TEST_SMALL) == 0);
+	assert(io_fallocate_ino(fs, super, ext, 0, 2 * FS_BLOCK_SIZE) == 0);
+	assert(fs_read_inode(fs, super, ext, &ind) == 0);
+	assert(!(ind.flags & FS_INODE_INLINE) && (ind.flags & FS_INODE_EXTENTS));
+	assert(ind.extents.count == 1 && ind.extents.ext[0].len == 2);
+	assert(io_read_ino(fs, super, ext, out, 0, TEST_SMALL + 10) == 0);
+	assert(memcmp(out, buf, TEST_SMALL) == 0 && out[TEST_SMALL] == 0);
+
+	printf("removed small files..\n");
+	uint32_t free_inodes = fs_get_super(fs)->free_inode_count;
+	free_data = fs_get_super(fs)->free_data_count;
+	assert(io_rm_ino(fs, super, tail) == 0);
+	assert(fs_get_super(fs)->free_inode_count == free_inodes + 1);
+	assert(fs_get_super(fs)->free_data_count == free_data);
+	uint32_t kept;
+	assert(io_open_creat(fs, super, 0, &kept) == 0);
+	assert(io_write_ino(fs, super, kept, buf, 0, FS_INLINE_DATA_SIZE) == 0);
+	disk_close(&fs);
+
+	printf("inline data kept after remount..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	super = *fs_get_super(fs);
+	assert(fs_read_inode(fs, super, kept, &ind) == 0);
+	assert((ind.flags & FS_INODE_INLINE) && ind.size == FS_INLINE_DATA_SIZE);
+	assert(io_read_ino(fs, super, kept, out, 0, FS_INLINE_DATA_SIZE) == 0);
+	assert(memcmp(out, buf, FS_INLINE_DATA_SIZE) == 0);
+	assert(io_read_ino(fs, super, small, out, 0, TEST_GROWN) == 0);
+	assert(memcmp(out, buf, TEST_GROWN) == 0);
+	disk_close(&fs);
+	return 0;
+}
@@ -0,0 +1,166 @@
+/**
+ * @file test17.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+
+#include <fs.h>
+#include <disk.h>
+#include <io.h>
+#include <dirent.h>
+#include <devutils.h>
+
+#define TEST_INODES 200 /* no of inodes created, over several inode table blocks */
+
+/**
+ * @brief utility function to create inodes with distinct contents
+ */
+static void create_inodes(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodes[]) {
+	for(int i=0; i<TEST_INODES; i++) {
+		assert(io_open_creat(fs, super, i, &inodes[i]) == 0);
+		struct fs_inode ind;
+		assert(fs_read_inode(fs, super, inodes[i], &ind) == 0);
+		ind.uid = i;
+		ind.hcount = i + 1;
+		ind.size = i * 3;
+		ind.direct[0] = i;
+		ind.init_size = i * 5;
+		assert(fs_write_inode(fs, super, inodes[i], &ind) == 0);
+	}
+}
+
+/**
+ * @brief utility function to check the inodes created by create_inodes
+ */
+static void check_inodes(struct fs_filesyst fs, struct fs_super_block super, uint32_t inodes[]) {
+	for(int i=0; i<TEST_INODES; i++) {
+		struct fs_inode ind;
+		assert(fs_read_inode(fs, super, inodes[i], &ind) == 0);
+		assert(ind.mode == i && ind.uid == i && ind.hcount == i + 1 && ind.size == i * 3);
+		assert(ind.direct[0] == i && ind.init_size == i * 5);
+	}
+}
+
+/**
+ * @brief utility function to build an inode table block of a baseline
+ * image: 60 bytes per inode with 2 bytes of padding after gid
+ */
+static void baseline_block(union fs_block* blk) {
+	memset(blk, 0, FS_BLOCK_SIZE);
+	for(uint16_t i=0; i<FS_INODES_PER_BLOCK; i++) {
+		uint8_t* rec = blk->data + i * 60;
+		uint16_t ids[4] = {i, i + 1, i + 2, 0xFFFF};
+		uint32_t fields[4] = {i + 3, i + 4, i * 10, i + 1}; /* times, size, hcount */
+		uint32_t ptrs[FS_DIRECT_POINTERS_PER_INODE + 1] = {i + 100};
+		ptrs[FS_DIRECT_POINTERS_PER_INODE] = i + 200;
+		memcpy(rec, ids, sizeof(ids));
+		memcpy(rec + 8, fields, sizeof(fields));
+		memcpy(rec + 24, ptrs, sizeof(ptrs));
+	}
+}
+
+/**
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief program to test the packed inode table records
+ */
+int main(int argc, char** argv) {
+	char filename[512] = "./bin/partition";
+	struct fs_filesyst fs;
+	uint32_t inodes[TEST_INODES];
+
+	assert(sizeof(struct fs_dinode) == 62 && FS_DINODES_PER_BLOCK == 66);
+	assert(FS_DINODES_PER_BLOCK > FS_INODES_PER_BLOCK);
+
+	printf("Creating filesyst..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	assert(fs_format(fs) == 0);
+	struct fs_super_block super = *fs_get_super(fs);
+	assert(super.inode_version == FS_INODE_V1);
+	assert(super.free_inode_count == super.inode_count * FS_DINODES_PER_BLOCK);
+	assert(fs_inode_blocknum(&super, FS_DINODES_PER_BLOCK) == super.inode_loc + 1);
+
+	printf("inodes over several blocks..\n");
+	create_inodes(fs, super, inodes);
+	check_inodes(fs, super, inodes);
+	disk_close(&fs);
+
+	printf("inodes kept after remount..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	super = *fs_get_super(fs);
+	assert(fs_icache_init(fs, 0) == 0); /* read from the inode table */
+	check_inodes(fs, super, inodes);
+	disk_close(&fs);
+
+	printf("link count limit..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	assert(fs_format(fs) == 0);
+	super = *fs_get_super(fs);
+	assert(fs_max_links(&super) == FS_DINODE_MAX_LINKS);
+	uint32_t root, file;
+	assert(opendir_creat(fs, super, &root, S_DIR, "/") == 0);
+	assert(io_open_creat(fs, super, 0, &file) == 0);
+	struct fs_inode ind;
+	assert(fs_read_inode(fs, super, file, &ind) == 0);
+	ind.hcount = FS_DINODE_MAX_LINKS - 1;
+	assert(fs_write_inode(fs, super, file, &ind) == 0);
+	assert(open_ino(fs, super, file, "/A") == 0);
+	assert(open_ino(fs, super, file, "/B") < 0); /* no more links */
+	disk_close(&fs);
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	super = *fs_get_super(fs);
+	assert(fs_icache_init(fs, 0) == 0);
+	assert(fs_read_inode(fs, super, file, &ind) == 0);
+	assert(ind.hcount == FS_DINODE_MAX_LINKS);
+	disk_close(&fs);
+
+	printf("inodes of a baseline image..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	assert(fs_format(fs) == 0);
+	struct fs_super_block* sb = fs_get_super(fs);
+	assert(fs_icache_init(fs, 0) == 0); /* nothing written back over the block */
+	for(int i=0; i<FS_INODES_PER_BLOCK; i++) {
+		assert(fs_alloc_inode(fs, sb, &inodes[i]) == 0 && inodes[i] == i);
+	}
+	union fs_block iblk;
+	baseline_block(&iblk);
+	assert(fs_write_block(fs, sb->inode_loc, &iblk, FS_BLOCK_SIZE) == 0);
+	sb->inode_version = FS_INODE_V0;
+	assert(fs_mark_super_dirty(fs) == 0);
+	disk_close(&fs);
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	super = *fs_get_super(fs);
+	assert(super.inode_version == FS_INODE_V0);
+	assert(fs_icache_init(fs, 0) == 0);
+	for(int i=0; i<FS_INODES_PER_BLOCK; i++) {
+		assert(fs_read_inode(fs, super, i, &ind) == 0);
+		assert(ind.mode == i && ind.uid == i + 1 && ind.gid == i + 2 && ind.flags == 0);
+		assert(ind.atime == i + 3 && ind.mtime == i + 4 && ind.size == i * 10 && ind.hcount == i + 1);
+		assert(ind.direct[0] == i + 100 && ind.direct[1] == 0 && ind.indirect == i + 200);
+		assert(ind.init_size == 0);
+	}
+	/* an unknown format is refused */
+	fs_get_super(fs)->inode_version = FS_INODE_V1 + 1;
+	assert(fs_mark_super_dirty(fs) == 0);
+	disk_close(&fs);
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	assert(fs_get_super(fs) == NULL);
+	disk_close(&fs);
+
+	printf("inodes of block groups..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	assert(fs_format_groups(fs, 512) == 0);
+	super = *fs_get_super(fs);
+	assert(super.inode_version == FS_INODE_V1);
+	assert(super.group_inodes % FS_DINODES_PER_BLOCK == 0);
+	assert(fs_icache_init(fs, 0) == 0);
+	create_inodes(fs, super, inodes);
+	check_inodes(fs, super, inodes);
+	disk_close(&fs);
+	return 0;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file test18.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+
+#include <fs.h>
+#include <disk.h>
+#include <io.h>
+#include <devutils.h>
+
+#define TEST_DISK_SIZE (8 * 1024 * 1024)
+#define TEST_FILES 2000 /* no of files created, far more than the inode table holds */
+
+/**
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief program to test the inode chunks added after the inode table
+ */
+int main(int argc, char** argv) {
+	char filename[512] = "./bin/partition";
+	struct fs_filesyst fs;
+	uint32_t* files = malloc(sizeof(uint32_t) * TEST_FILES);
+	assert(files != NULL);
+
+	printf("Creating filesyst..\n");
+	assert(creatfile(filename, TEST_DISK_SIZE, &fs) == 0);
+	assert(fs_format(fs) == 0);
+	struct fs_super_block super = *fs_get_super(fs);
+	uint32_t table = super.inode_count * FS_DINODES_PER_BLOCK;
+	assert(super.free_inode_count == table && table < TEST_FILES);
+	assert(super.ichunk_count == 0 && super.ichunk_map == 0);
+
+	printf("inodes of the inode table..\n");
+	uint32_t free_data = fs_get_super(fs)->free_data_count;
+	for(uint32_t i=0; i<table; i++) {
+		assert(io_open_creat(fs, super, 0, &files[i]) == 0);
+	}
+	assert(fs_get_super(fs)->free_inode_count == 0);
+	assert(fs_get_super(fs)->free_data_count == free_data);
+
+	printf("inode chunk added when the table is full..\n");
+	assert(io_open_creat(fs, super, 0, &files[table]) == 0);
+	assert(files[table] >= table);
+	assert(fs_get_super(fs)->ichunk_count == 1);
+	/* the chunk and the chunk map */
+	assert(fs_get_super(fs)->free_data_count == free_data - FS_ICHUNK_BLOCKS - 1);
+	assert(fs_get_super(fs)->free_inode_count == FS_ICHUNK_BLOCKS * FS_DINODES_PER_BLOCK - 1);
+	assert(fs_inode_block(fs, files[table]) >= super.data_loc);
+
+	printf("many files..\n");
+	for(uint32_t i=table+1; i<TEST_FILES; i++) {
+		assert(io_open_creat(fs, super, 0, &files[i]) == 0);
+	}
+	uint32_t chunks = fs_get_super(fs)->ichunk_count;
+	assert(chunks == (TEST_FILES - table + FS_ICHUNK_BLOCKS * FS_DINODES_PER_BLOCK - 1) /
+		   (FS_ICHUNK_BLOCKS * FS_DINODES_PER_BLOCK));
+	for(uint32_t i=0; i<TEST_FILES; i++) {
+		assert(io_write_ino(fs, super, files[i], &i, 0, sizeof(i)) == 0);
+	}
+	/* the freed inodes are used again before adding chunks */
+	assert(io_rm_ino(fs, super, files[TEST_FILES - 1]) == 0);
+	assert(io_rm_ino(fs, super, files[0]) == 0);
+	uint32_t left = fs_get_super(fs)->free_inode_count;
+	for(uint32_t i=0; i<left; i++) {
+		uint32_t ino;
+		assert(io_open_creat(fs, super, 0, &ino) == 0);
+	}
+	assert(fs_get_super(fs)->ichunk_count == chunks);
+	assert(fs_get_super(fs)->free_inode_count == 0);
+	disk_close(&fs);
+
+	printf("chunks kept after remount..\n");
+	assert(creatfile(filename, TEST_DISK_SIZE, &fs) == 0);
+	super = *fs_get_super(fs);
+	assert(super.ichunk_count == chunks);
+	assert(fs_icache_init(fs, 0) == 0); /* read from the chunks */
+	for(uint32_t i=1; i<TEST_FILES - 1; i++) {
+		uint32_t v = 0;
+		assert(io_read_ino(fs, super, files[i], &v, 0, sizeof(v)) == 0);
+		assert(v == i);
+	}
+	disk_close(&fs);
+
+	printf("more inodes than blocks on a small image..\n");
+	assert(creatfile(filename, 1024 * 1024, &fs) == 0);
+	assert(fs_format(fs) == 0);
+	super = *fs_get_super(fs);
+	uint32_t count = 0, ino;
+	while(io_open_creat(fs, super, 0, &ino) == 0) {
+		count++;
+	}
+	/* only the data blocks limit the chunks */
+	assert(count > fs.nblocks);
+	assert(fs_get_super(fs)->free_data_count < FS_ICHUNK_BLOCKS);
+	assert(count == fs_get_super(fs)->ichunk_count * FS_ICHUNK_BLOCKS * FS_DINODES_PER_BLOCK +
+		   super.inode_count * FS_DINODES_PER_BLOCK);
+	disk_close(&fs);
+
+	printf("no chunks with block groups..\n");
+	assert(creatfile(filename, TEST_DISK_SIZE, &fs) == 0);
+	assert(fs_format_groups(fs, 512) == 0);
+	super = *fs_get_super(fs);
+	for(uint32_t i=0; i<super.free_inode_count; i++) {
+		assert(io_open_creat(fs, super, 0, &ino) == 0);
+	}
+	assert(io_open_creat(fs, super, 0, &ino) < 0);
+	assert(fs_get_super(fs)->ichunk_count == 0);
+	disk_close(&fs);
+
+	free(files);
+	return 0;
+}
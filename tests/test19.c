@@ -0,0 +1,130 @@
+/**
+ * @file test19.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+
+#include <fs.h>
+#include <ui.h>
+#include <disk.h>
+#include <io.h>
+#include <devutils.h>
+
+#define TEST_HOLE_BLOCKS 5 /* no of blocks of the hole before the data */
+
+/**
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief program to test the sparse files: holes, data and hole
+ * searches, sparse writes and copies
+ */
+int main(int argc, char** argv) {
+	char filename[512] = "./bin/partition";
+	struct fs_filesyst fs;
+
+	printf("Creating filesyst..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	assert(fs_format(fs) == 0);
+	struct fs_super_block super = *fs_get_super(fs);
+
+	uint8_t* buf = calloc(4 * FS_BLOCK_SIZE, 1);
+	uint8_t* out = malloc(8 * FS_BLOCK_SIZE);
+	assert(buf != NULL && out != NULL);
+
+	printf("holes..\n");
+	uint32_t hole;
+	uint32_t free_data = fs_get_super(fs)->free_data_count;
+	assert(io_open_creat(fs, super, 0, &hole) == 0);
+	uint32_t data_off = TEST_HOLE_BLOCKS * FS_BLOCK_SIZE;
+	assert(io_write_ino(fs, super, hole, "data", data_off + 5, 4) == 0);
+	assert(fs_get_super(fs)->free_data_count == free_data - 1);
+	memset(out, 0xFF, 8 * FS_BLOCK_SIZE);
+	assert(io_read_ino(fs, super, hole, out, 0, data_off + 9) == 0);
+	for(uint32_t i=0; i<data_off + 5; i++) {
+		assert(out[i] == 0);
+	}
+	assert(memcmp(out + data_off + 5, "data", 4) == 0);
+
+	printf("data and hole searches..\n");
+	uint32_t res;
+	assert(io_seek_ino(fs, super, hole, 0, IO_SEEK_DATA, &res) == 0 && res == data_off);
+	assert(io_seek_ino(fs, super, hole, 0, IO_SEEK_HOLE, &res) == 0 && res == 0);
+	assert(io_seek_ino(fs, super, hole, data_off + 1, IO_SEEK_DATA, &res) == 0 && res == data_off + 1);
+	assert(io_seek_ino(fs, super, hole, data_off, IO_SEEK_HOLE, &res) == 0 && res == data_off + 9);
+	assert(io_seek_ino(fs, super, hole, data_off + 9, IO_SEEK_DATA, &res) == IO_SEEK_NONE); /* past the end */
+	assert(io_seek_ino(fs, super, hole, 0, IO_SEEK_SET, &res) == 0 && res == 0);
+	/* preallocated blocks that were not written are holes */
+	uint32_t pre;
+	assert(io_open_creat(fs, super, 0, &pre) == 0);
+	assert(io_write_ino(fs, super, pre, "x", 0, 1) == 0);
+	assert(io_fallocate_ino(fs, super, pre, 0, 3 * FS_BLOCK_SIZE) == 0);
+	assert(io_seek_ino(fs, super, pre, 0, IO_SEEK_HOLE, &res) == 0 && res == FS_BLOCK_SIZE);
+	assert(io_seek_ino(fs, super, pre, 1, IO_SEEK_DATA, &res) == 0 && res == 1);
+	assert(io_seek_ino(fs, super, pre, FS_BLOCK_SIZE, IO_SEEK_DATA, &res) == IO_SEEK_NONE);
+	assert(io_seek_ino(fs, super, pre, 0, 7, &res) < 0); /* invalid whence */
+	/* with file descriptors */
+	int fd = io_iopen(fs, super, hole);
+	assert(fd >= 0);
+	assert(io_llseek(fs, super, fd, 0, IO_SEEK_DATA) == data_off);
+	assert(io_getoff(fd) == data_off);
+	assert(io_close(fs, fd) == 0);
+
+	printf("sparse writes..\n");
+	assert(io_sparse_enable(fs, 1) == 0);
+	uint32_t sparse;
+	assert(io_open_creat(fs, super, 0, &sparse) == 0);
+	/* zeros, data, zeros and a partial block of zeros */
+	memset(buf + FS_BLOCK_SIZE, 'a', FS_BLOCK_SIZE);
+	free_data = fs_get_super(fs)->free_data_count;
+	assert(io_write_ino(fs, super, sparse, buf, 0, 3 * FS_BLOCK_SIZE + 100) == 0);
+	assert(fs_get_super(fs)->free_data_count == free_data - 2);
+	assert(io_read_ino(fs, super, sparse, out, 0, 3 * FS_BLOCK_SIZE + 100) == 0);
+	assert(memcmp(out, buf, 3 * FS_BLOCK_SIZE + 100) == 0);
+	assert(io_seek_ino(fs, super, sparse, 0, IO_SEEK_DATA, &res) == 0 && res == FS_BLOCK_SIZE);
+	assert(io_seek_ino(fs, super, sparse, FS_BLOCK_SIZE, IO_SEEK_HOLE, &res) == 0 &&
+		   res == 2 * FS_BLOCK_SIZE);
+	/* a write ending with a hole still grows the file */
+	struct fs_inode ind;
+	assert(io_write_ino(fs, super, sparse, buf + 2 * FS_BLOCK_SIZE, 4 * FS_BLOCK_SIZE,
+						2 * FS_BLOCK_SIZE) == 0);
+	assert(fs_read_inode(fs, super, sparse, &ind) == 0 && ind.size == 6 * FS_BLOCK_SIZE);
+	assert(fs_get_super(fs)->free_data_count == free_data - 2);
+	/* zeros written over data are written */
+	assert(io_write_ino(fs, super, sparse, buf, FS_BLOCK_SIZE, FS_BLOCK_SIZE) == 0);
+	assert(fs_get_super(fs)->free_data_count == free_data - 2);
+	assert(io_read_ino(fs, super, sparse, out, FS_BLOCK_SIZE, FS_BLOCK_SIZE) == 0);
+	assert(out[0] == 0 && out[FS_BLOCK_SIZE - 1] == 0);
+	assert(io_sparse_enable(fs, 0) == 0);
+	disk_close(&fs);
+
+	printf("copies keep the holes..\n");
+	assert(initfs(filename, 8 * 1024 * 1024, 1) == 0);
+	int src = open_("/SPARSE", 1, 0);
+	assert(src >= 0);
+	assert(llseek_(src, data_off, IO_SEEK_SET) == data_off);
+	assert(write_(src, "data", 4) == 0);
+	assert(close_(src) == 0);
+	assert(cp_("/SPARSE", "/COPY") == 0);
+	ind = getInode("/COPY");
+	assert(ind.size == data_off + 4);
+	for(int i=0; i<TEST_HOLE_BLOCKS; i++) {
+		assert(ind.direct[i] == 0);
+	}
+	assert(ind.direct[TEST_HOLE_BLOCKS] != 0);
+	int copy = open_("/COPY", 0, 0);
+	assert(copy >= 0);
+	assert(llseek_(copy, 0, IO_SEEK_DATA) == data_off);
+	assert(read_(copy, out, 4) == 0 && memcmp(out, "data", 4) == 0);
+	assert(llseek_(copy, data_off + 4, IO_SEEK_DATA) < 0);
+	assert(close_(copy) == 0);
+	closefs();
+
+	free(buf);
+	free(out);
+	return 0;
+}
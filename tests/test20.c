@@ -0,0 +1,208 @@
+/**
+ * @file test20.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+
+#include <fs.h>
+#include <ui.h>
+#include <disk.h>
+#include <io.h>
+#include <devutils.h>
+
+#define TEST_BLOCKS 20 /* no of blocks of the files, some behind the indirect block */
+#define TEST_SMALL 30  /* size of a file that fits in its inode */
+
+/**
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief utility function to check that a range of a file reads as zeros
+ */
+static void test_zeros(struct fs_filesyst fs, struct fs_super_block super, uint32_t ino,
+					   uint8_t* out, uint32_t off, uint32_t size)
+{
+	memset(out, 0xFF, size);
+	assert(io_read_ino(fs, super, ino, out, off, size) == 0);
+	for(uint32_t i=0; i<size; i++) {
+		assert(out[i] == 0);
+	}
+}
+
+/**
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief program to test the truncates and the punched holes
+ */
+int main(int argc, char** argv) {
+	char filename[512] = "./bin/partition";
+	struct fs_filesyst fs;
+	uint32_t size = TEST_BLOCKS * FS_BLOCK_SIZE;
+
+	printf("Creating filesyst..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	assert(fs_format(fs) == 0);
+	struct fs_super_block super = *fs_get_super(fs);
+
+	uint8_t* buf = malloc(size);
+	uint8_t* out = malloc(size);
+	assert(buf != NULL && out != NULL);
+	for(uint32_t i=0; i<size; i++) {
+		buf[i] = i % 251 + 1;
+	}
+
+	printf("truncates..\n");
+	uint32_t ino;
+	struct fs_inode ind;
+	uint32_t free_data = fs_get_super(fs)->free_data_count;
+	assert(io_open_creat(fs, super, 0, &ino) == 0);
+	assert(io_write_ino(fs, super, ino, buf, 0, size) == 0);
+	assert(fs_get_super(fs)->free_data_count == free_data - TEST_BLOCKS - 1);
+	/* a cut behind the indirect block keeps it */
+	assert(io_truncate_ino(fs, super, ino, 12 * FS_BLOCK_SIZE) == 0);
+	assert(fs_read_inode(fs, super, ino, &ind) == 0);
+	assert(ind.size == 12 * FS_BLOCK_SIZE && ind.indirect != 0);
+	assert(fs_get_super(fs)->free_data_count == free_data - 12 - 1);
+	/* the empty indirect block is freed */
+	uint32_t cut = 5 * FS_BLOCK_SIZE + 100;
+	assert(io_truncate_ino(fs, super, ino, cut) == 0);
+	assert(fs_read_inode(fs, super, ino, &ind) == 0);
+	assert(ind.size == cut && ind.indirect == 0 && ind.direct[6] == 0 && ind.direct[5] != 0);
+	assert(fs_get_super(fs)->free_data_count == free_data - 6);
+	assert(io_read_ino(fs, super, ino, out, 0, cut) == 0);
+	assert(memcmp(out, buf, cut) == 0);
+	/* growing makes a hole, the bytes after the cut read as zeros */
+	assert(io_truncate_ino(fs, super, ino, 10 * FS_BLOCK_SIZE) == 0);
+	assert(fs_get_super(fs)->free_data_count == free_data - 6);
+	test_zeros(fs, super, ino, out, cut, 10 * FS_BLOCK_SIZE - cut);
+	assert(io_truncate_ino(fs, super, ino, 0) == 0);
+	assert(fs_get_super(fs)->free_data_count == free_data);
+	/* the preallocated blocks after the cut are freed too */
+	assert(io_write_ino(fs, super, ino, "x", 0, 1) == 0);
+	assert(io_fallocate_ino(fs, super, ino, 0, 4 * FS_BLOCK_SIZE) == 0);
+	assert(io_truncate_ino(fs, super, ino, 2 * FS_BLOCK_SIZE) == 0);
+	assert(fs_read_inode(fs, super, ino, &ind) == 0);
+	assert((ind.flags & FS_INODE_PREALLOC) && ind.init_size == 1);
+	assert(fs_get_super(fs)->free_data_count == free_data - 2);
+	test_zeros(fs, super, ino, out, 1, 2 * FS_BLOCK_SIZE - 1);
+
+	printf("punched holes..\n");
+	uint32_t punch;
+	assert(io_open_creat(fs, super, 0, &punch) == 0);
+	assert(io_write_ino(fs, super, punch, buf, 0, size) == 0);
+	free_data = fs_get_super(fs)->free_data_count;
+	uint32_t off = 2 * FS_BLOCK_SIZE + 10, end = 15 * FS_BLOCK_SIZE;
+	assert(io_punch_hole_ino(fs, super, punch, off, end - off) == 0);
+	assert(fs_get_super(fs)->free_data_count == free_data + 12);
+	assert(fs_read_inode(fs, super, punch, &ind) == 0);
+	assert(ind.size == size && ind.direct[2] != 0 && ind.direct[3] == 0);
+	test_zeros(fs, super, punch, out, off, end - off);
+	assert(io_read_ino(fs, super, punch, out, 0, size) == 0);
+	assert(memcmp(out, buf, off) == 0);
+	assert(memcmp(out + end, buf + end, size - end) == 0);
+	uint32_t res;
+	assert(io_seek_ino(fs, super, punch, off, IO_SEEK_HOLE, &res) == 0 && res == 3 * FS_BLOCK_SIZE);
+	assert(io_seek_ino(fs, super, punch, res, IO_SEEK_DATA, &res) == 0 && res == end);
+	/* a hole inside one block only zeroes it */
+	assert(io_punch_hole_ino(fs, super, punch, 10, 20) == 0);
+	assert(fs_get_super(fs)->free_data_count == free_data + 12);
+	test_zeros(fs, super, punch, out, 10, 20);
+	/* a hole up to the end frees the last blocks and the indirect block */
+	assert(io_punch_hole_ino(fs, super, punch, 8 * FS_BLOCK_SIZE, size) == 0);
+	assert(fs_read_inode(fs, super, punch, &ind) == 0);
+	assert(ind.size == size && ind.indirect == 0);
+	assert(fs_get_super(fs)->free_data_count == free_data + TEST_BLOCKS - 3 + 1);
+
+	printf("extents..\n");
+	assert(fs_set_features(fs, FS_FEATURE_EXTENTS) == 0);
+	uint32_t ext;
+	assert(io_open_creat(fs, super, 0, &ext) == 0);
+	assert(io_write_ino(fs, super, ext, buf, 0, 10 * FS_BLOCK_SIZE) == 0);
+	free_data = fs_get_super(fs)->free_data_count;
+	assert(io_punch_hole_ino(fs, super, ext, 3 * FS_BLOCK_SIZE, 2 * FS_BLOCK_SIZE) == 0);
+	assert(fs_read_inode(fs, super, ext, &ind) == 0);
+	assert(ind.extents.count == 2 && ind.extents.ext[0].len == 3);
+	assert(ind.extents.ext[1].lblk == 5 && ind.extents.ext[1].len == 5);
+	assert(ind.extents.ext[1].start == ind.extents.ext[0].start + 5);
+	assert(fs_get_super(fs)->free_data_count == free_data + 2);
+	assert(io_read_ino(fs, super, ext, out, 0, 10 * FS_BLOCK_SIZE) == 0);
+	assert(memcmp(out + 5 * FS_BLOCK_SIZE, buf + 5 * FS_BLOCK_SIZE, 5 * FS_BLOCK_SIZE) == 0);
+	assert(io_truncate_ino(fs, super, ext, 2 * FS_BLOCK_SIZE) == 0);
+	assert(fs_read_inode(fs, super, ext, &ind) == 0);
+	assert(ind.extents.count == 1 && ind.extents.ext[0].len == 2);
+	assert(fs_get_super(fs)->free_data_count == free_data + 8);
+
+	printf("inline data..\n");
+	assert(fs_set_features(fs, FS_FEATURE_INLINE_DATA) == 0);
+	uint32_t small;
+	free_data = fs_get_super(fs)->free_data_count;
+	assert(io_open_creat(fs, super, 0, &small) == 0);
+	assert(io_write_ino(fs, super, small, buf, 0, TEST_SMALL) == 0);
+	assert(io_truncate_ino(fs, super, small, 10) == 0);
+	assert(io_truncate_ino(fs, super, small, TEST_SMALL) == 0);
+	assert(fs_read_inode(fs, super, small, &ind) == 0);
+	assert((ind.flags & FS_INODE_INLINE) && ind.size == TEST_SMALL);
+	assert(io_read_ino(fs, super, small, out, 0, 10) == 0 && memcmp(out, buf, 10) == 0);
+	test_zeros(fs, super, small, out, 10, TEST_SMALL - 10);
+	assert(fs_get_super(fs)->free_data_count == free_data);
+	assert(fs_set_features(fs, 0) == 0);
+
+	printf("delayed allocation..\n");
+	assert(io_delalloc_enable(fs, 1) == 0);
+	uint32_t da;
+	free_data = fs_get_super(fs)->free_data_count;
+	assert(io_open_creat(fs, super, 0, &da) == 0);
+	assert(io_write_ino(fs, super, da, buf, 0, 4 * FS_BLOCK_SIZE) == 0);
+	assert(io_truncate_ino(fs, super, da, FS_BLOCK_SIZE + 5) == 0);
+	assert(io_delalloc_flush(fs) == 0);
+	assert(fs_get_super(fs)->free_data_count == free_data - 2);
+	assert(io_truncate_ino(fs, super, da, 3 * FS_BLOCK_SIZE) == 0);
+	assert(io_read_ino(fs, super, da, out, 0, FS_BLOCK_SIZE + 5) == 0);
+	assert(memcmp(out, buf, FS_BLOCK_SIZE + 5) == 0);
+	test_zeros(fs, super, da, out, FS_BLOCK_SIZE + 5, 2 * FS_BLOCK_SIZE - 5);
+	assert(io_delalloc_enable(fs, 0) == 0);
+	disk_close(&fs);
+
+	printf("with paths and file descriptors..\n");
+	assert(initfs(filename, 8 * 1024 * 1024, 1) == 0);
+	int fd = open_("/LOG", 1, 0);
+	assert(fd >= 0);
+	assert(write_(fd, buf, 3 * FS_BLOCK_SIZE) == 0);
+	assert(ftruncate_(fd, FS_BLOCK_SIZE) == 0);
+	assert(getInode("/LOG").size == FS_BLOCK_SIZE);
+	assert(punch_hole_(fd, 0, FS_BLOCK_SIZE) == 0);
+	assert(llseek_(fd, 0, IO_SEEK_DATA) < 0);
+	assert(close_(fd) == 0);
+	assert(truncate_("/LOG", 100) == 0);
+	assert(getInode("/LOG").size == 100);
+	assert(truncate_("/NONE", 100) < 0);
+	/* a copy over a bigger file makes it smaller */
+	fd = open_("/BIG", 1, 0);
+	assert(fd >= 0);
+	assert(write_(fd, buf, 2 * FS_BLOCK_SIZE) == 0);
+	assert(close_(fd) == 0);
+	assert(cp_("/LOG", "/BIG") == 0);
+	assert(getInode("/BIG").size == 100);
+	/* a copy onto itself or onto a hard link keeps the data */
+	fd = open_("/BIG", 0, 0);
+	assert(fd >= 0);
+	assert(write_(fd, buf, 100) == 0);
+	assert(close_(fd) == 0);
+	assert(ln_("/BIG", "/LINK") == 0);
+	assert(cp_("/BIG", "/BIG") < 0);
+	assert(cp_("/BIG", "/LINK") < 0);
+	fd = open_("/LINK", 0, 0);
+	assert(fd >= 0);
+	assert(getInode("/LINK").size == 100);
+	assert(read_(fd, out, 100) == 0 && memcmp(out, buf, 100) == 0);
+	assert(close_(fd) == 0);
+	closefs();
+
+	free(buf);
+	free(out);
+	return 0;
+}
@@ -0,0 +1,98 @@
+/**
+ * @file test21.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+
+#include <fs.h>
+#include <disk.h>
+#include <cache.h>
+#include <io.h>
+#include <devutils.h>
+
+#define TEST_BLOCKS 6 /* no of blocks of the file */
+
+/**
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief program to test the reads and writes of whole and partial blocks
+ */
+int main(int argc, char** argv) {
+	char filename[512] = "./bin/partition";
+	struct fs_filesyst fs;
+	uint32_t size = TEST_BLOCKS * FS_BLOCK_SIZE;
+	/* offsets of the first and last bytes: block starts, ends and middles */
+	uint32_t offs[] = {0, 1, FS_BLOCK_SIZE / 2, FS_BLOCK_SIZE - 1, FS_BLOCK_SIZE,
+		FS_BLOCK_SIZE + 1, 3 * FS_BLOCK_SIZE, 3 * FS_BLOCK_SIZE + 7, size - 1};
+	uint32_t noffs = sizeof(offs) / sizeof(offs[0]);
+
+	printf("Creating filesyst..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	assert(fs_format(fs) == 0);
+	struct fs_super_block super = *fs_get_super(fs);
+
+	uint8_t* file = malloc(size);
+	uint8_t* buf = malloc(size);
+	uint8_t* out = malloc(size);
+	assert(file != NULL && buf != NULL && out != NULL);
+	for(uint32_t i=0; i<size; i++) {
+		file[i] = i % 251 + 1;
+		buf[i] = i % 13 + 100;
+	}
+	uint32_t ino;
+	assert(io_open_creat(fs, super, 0, &ino) == 0);
+	assert(io_write_ino(fs, super, ino, file, 0, size) == 0);
+
+	printf("reads and writes of all the alignments..\n");
+	for(uint32_t i=0; i<noffs; i++) {
+		for(uint32_t j=i; j<noffs; j++) {
+			uint32_t off = offs[i], len = offs[j] - offs[i] + 1;
+			memset(out, 0, size);
+			assert(io_read_ino(fs, super, ino, out, off, len) == 0);
+			assert(memcmp(out, file + off, len) == 0);
+			assert(io_write_ino(fs, super, ino, buf + off, off, len) == 0);
+			memcpy(file + off, buf + off, len);
+			assert(io_read_ino(fs, super, ino, out, 0, size) == 0);
+			assert(memcmp(out, file, size) == 0);
+			/* a different content for the next write */
+			for(uint32_t k=0; k<size; k++) {
+				buf[k]++;
+			}
+		}
+	}
+
+	printf("aligned writes read nothing..\n");
+	struct disk_cache_stats prev, st;
+	assert(disk_cache_init(&fs, 64) == 0);
+	disk_cache_stats(fs, &prev);
+	assert(io_write_ino(fs, super, ino, buf, FS_BLOCK_SIZE, 2 * FS_BLOCK_SIZE) == 0);
+	disk_cache_stats(fs, &st);
+	assert(st.hits == prev.hits && st.misses == prev.misses);
+	/* a partial write reads its block */
+	assert(io_write_ino(fs, super, ino, buf, FS_BLOCK_SIZE + 1, 10) == 0);
+	disk_cache_stats(fs, &st);
+	assert(st.hits + st.misses > prev.hits + prev.misses);
+
+	printf("preallocated bytes of full blocks..\n");
+	uint32_t pre;
+	assert(io_open_creat(fs, super, 0, &pre) == 0);
+	assert(io_write_ino(fs, super, pre, file, 0, 100) == 0);
+	assert(io_fallocate_ino(fs, super, pre, 0, 3 * FS_BLOCK_SIZE) == 0);
+	memset(out, 0xFF, size);
+	assert(io_read_ino(fs, super, pre, out, 0, 3 * FS_BLOCK_SIZE) == 0);
+	assert(memcmp(out, file, 100) == 0);
+	for(uint32_t i=100; i<3 * FS_BLOCK_SIZE; i++) {
+		assert(out[i] == 0);
+	}
+	disk_close(&fs);
+
+	free(file);
+	free(buf);
+	free(out);
+	return 0;
+}
@@ -0,0 +1,207 @@
+/**
+ * @file test8.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+
+#include <fs.h>
+#include <disk.h>
+#include <cache.h>
+
+
+/**
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief program to test the block cache
+ */
+int main(int argc, char** argv) {
+	char filename[512] = "./bin/partition";
+	struct fs_filesyst fs;
+	struct disk_cache_stats stats;
+	union fs_block blk;
+
+	printf("Creating filesyst..\n");
+	int ret = creatfile(filename, 100000, &fs);
+	assert(ret == 0);
+	/* a small cache to force evictions */
+	ret = disk_cache_init(&fs, 4);
+	assert(ret == 0);
+	int nblocks = disk_size(fs);
+
+	printf("writing blocks..\n");
+	for(int i=0; i<nblocks; i++) {
+		memset(&blk, i, FS_BLOCK_SIZE);
+		assert(fs_write_block(fs, i, &blk, FS_BLOCK_SIZE) == 0);
+	}
+	disk_cache_stats(fs, &stats);
+	assert(stats.evictions == nblocks - 4);
+	assert(stats.writebacks == nblocks - 4);
+
+	printf("reading cached blocks..\n");
+	for(int i=nblocks-4; i<nblocks; i++) {
+		assert(fs_read_block(fs, i, &blk) == 0);
+		assert(blk.data[0] == (uint8_t) i && blk.data[FS_BLOCK_SIZE-1] == (uint8_t) i);
+	}
+	disk_cache_stats(fs, &stats);
+	assert(stats.hits == 4);
+
+	printf("partial write..\n");
+	uint32_t magic = 0xABCDEF;
+	assert(fs_write_block(fs, 0, &magic, sizeof(magic)) == 0);
+	assert(fs_read_block(fs, 0, &blk) == 0);
+	assert(blk.pointers[0] == magic && blk.data[FS_BLOCK_SIZE-1] == 0);
+
+	printf("syncing..\n");
+	assert(disk_sync(fs) == 0);
+	disk_dump_cache(fs);
+	disk_close(&fs);
+
+	printf("reading without cache..\n");
+	ret = creatfile(filename, 100000, &fs);
+	assert(ret == 0);
+	assert(disk_cache_init(&fs, 0) == 0);
+	for(int i=0; i<nblocks; i++) {
+		assert(fs_read_block(fs, i, &blk) == 0);
+		if(i == 0) {
+			assert(blk.pointers[0] == magic);
+		} else {
+			assert(blk.data[0] == (uint8_t) i && blk.data[FS_BLOCK_SIZE-1] == (uint8_t) i);
+		}
+	}
+	disk_close(&fs);
+
+	printf("reading and writing a mapped image..\n");
+	ret = disk_open(filename, 100000, DISK_MMAP, &fs);
+	assert(ret == 0);
+	assert(fs.cache == NULL && fs.map != NULL);
+	assert(fs_read_block(fs, 1, &blk) == 0);
+	assert(blk.data[0] == 1 && blk.data[FS_BLOCK_SIZE-1] == 1);
+	uint8_t* ptr = disk_block_ptr(fs, 2);
+	assert(ptr != NULL && ptr[0] == 2);
+	ptr[0] = 42;
+	memset(&blk, 7, FS_BLOCK_SIZE);
+	assert(fs_write_block(fs, 3, &blk, FS_BLOCK_SIZE) == 0);
+	disk_close(&fs);
+
+	ret = creatfile(filename, 100000, &fs);
+	assert(ret == 0);
+	assert(fs_read_block(fs, 2, &blk) == 0);
+	assert(blk.data[0] == 42 && blk.data[1] == 2);
+	assert(fs_read_block(fs, 3, &blk) == 0);
+	assert(blk.data[0] == 7 && blk.data[FS_BLOCK_SIZE-1] == 7);
+	disk_close(&fs);
+
+	printf("reading and writing with io_uring..\n");
+	ret = disk_open(filename, 4 * 1024 * 1024, DISK_URING, &fs);
+	assert(ret == 0);
+	assert(fs_format(fs) == 0);
+	assert(fs_read_block(fs, 0, &blk) == 0);
+	struct fs_super_block super = blk.super;
+	/* pairs of blocks in reverse order: many small runs in flight */
+	int count = 300;
+	uint32_t* blknums = malloc(sizeof(uint32_t) * count);
+	union fs_block* data = malloc(sizeof(union fs_block) * count);
+	assert(blknums != NULL && data != NULL);
+	for(int i=0; i<count; i++) {
+		blknums[i] = count - (i ^ 1);
+		memset(data + i, i, FS_BLOCK_SIZE);
+	}
+	assert(fs_write_data(fs, super, data, blknums, count) == 0);
+	memset(data, 0, sizeof(union fs_block) * count);
+	assert(fs_read_data(fs, super, data, blknums, count) == 0);
+	for(int i=0; i<count; i++) {
+		assert(data[i].data[0] == (uint8_t) i && data[i].data[FS_BLOCK_SIZE-1] == (uint8_t) i);
+	}
+	/* dirty cached blocks are flushed in runs */
+	for(int i=1; i<=8; i++) {
+		memset(&blk, 100 + i, FS_BLOCK_SIZE);
+		assert(fs_write_block(fs, super.data_loc + count + i, &blk, FS_BLOCK_SIZE) == 0);
+	}
+	disk_close(&fs);
+
+	ret = creatfile(filename, 4 * 1024 * 1024, &fs);
+	assert(ret == 0);
+	memset(data, 0, sizeof(union fs_block) * count);
+	assert(fs_read_data(fs, super, data, blknums, count) == 0);
+	for(int i=0; i<count; i++) {
+		assert(data[i].data[0] == (uint8_t) i && data[i].data[FS_BLOCK_SIZE-1] == (uint8_t) i);
+	}
+	for(int i=1; i<=8; i++) {
+		assert(fs_read_block(fs, super.data_loc + count + i, &blk) == 0);
+		assert(blk.data[0] == 100 + i && blk.data[FS_BLOCK_SIZE-1] == 100 + i);
+	}
+	disk_close(&fs);
+
+	printf("reading and writing with O_DIRECT..\n");
+	assert(disk_open(filename, 4 * 1024 * 1024, DISK_DIRECT | DISK_MMAP, &fs) < 0);
+	ret = disk_open(filename, 4 * 1024 * 1024, DISK_DIRECT, &fs);
+	assert(ret == 0);
+	/* an unaligned buffer goes through a bounce buffer */
+	uint8_t* raw = malloc(sizeof(union fs_block) * count + 1);
+	assert(raw != NULL);
+	union fs_block* unaligned = (union fs_block*) (raw + 1);
+	assert(fs_read_data(fs, super, unaligned, blknums, count) == 0);
+	for(int i=0; i<count; i++) {
+		assert(unaligned[i].data[0] == (uint8_t) i && unaligned[i].data[FS_BLOCK_SIZE-1] == (uint8_t) i);
+		memset(unaligned + i, 255 - i, FS_BLOCK_SIZE);
+	}
+	assert(fs_write_data(fs, super, unaligned, blknums, count) == 0);
+	/* partial writes without the cache keep the end of the block */
+	assert(disk_cache_init(&fs, 0) == 0);
+	assert(fs_write_block(fs, super.data_loc + count + 1, &magic, sizeof(magic)) == 0);
+	disk_close(&fs);
+
+	ret = disk_open(filename, 4 * 1024 * 1024, DISK_DIRECT | DISK_URING, &fs);
+	assert(ret == 0);
+	assert(fs_read_data(fs, super, data, blknums, count) == 0);
+	for(int i=0; i<count; i++) {
+		assert(data[i].data[0] == (uint8_t) (255 - i) && data[i].data[FS_BLOCK_SIZE-1] == (uint8_t) (255 - i));
+	}
+	assert(fs_read_block(fs, super.data_loc + count + 1, &blk) == 0);
+	assert(blk.pointers[0] == magic && blk.data[FS_BLOCK_SIZE-1] == 101);
+	disk_close(&fs);
+
+	printf("discarding blocks..\n");
+	ret = creatfile(filename, 4 * 1024 * 1024, &fs);
+	assert(ret == 0);
+	assert(fs_read_block(fs, super.data_loc + 10, &blk) == 0 && blk.data[0] != 0);
+	memset(&blk, 9, FS_BLOCK_SIZE);
+	assert(fs_write_block(fs, super.data_loc + 11, &blk, FS_BLOCK_SIZE) == 0);
+	assert(disk_discard(fs, super.data_loc + 10, 4) == 0);
+	for(int i=10; i<14; i++) {
+		assert(fs_read_block(fs, super.data_loc + i, &blk) == 0);
+		assert(blk.data[0] == 0 && blk.data[FS_BLOCK_SIZE-1] == 0);
+	}
+	assert(fs_read_block(fs, super.data_loc + 14, &blk) == 0 && blk.data[0] != 0);
+	assert(disk_discard(fs, fs.nblocks - 1, 2) < 0);
+	disk_close(&fs);
+
+	printf("reading and writing a RAM disk..\n");
+	ret = disk_open(NULL, 4 * 1024 * 1024, DISK_RAM, &fs);
+	assert(ret == 0);
+	assert(fs.cache == NULL && fs.map != NULL && fs.fd < 0);
+	assert(disk_size(fs) == 1024);
+	assert(fs_format(fs) == 0);
+	assert(fs_write_data(fs, super, data, blknums, count) == 0);
+	memset(data, 0, sizeof(union fs_block) * count);
+	assert(fs_read_data(fs, super, data, blknums, count) == 0);
+	for(int i=0; i<count; i++) {
+		assert(data[i].data[0] == (uint8_t) (255 - i) && data[i].data[FS_BLOCK_SIZE-1] == (uint8_t) (255 - i));
+	}
+	ptr = disk_block_ptr(fs, super.data_loc + blknums[0] - 1);
+	assert(ptr != NULL && ptr[0] == 255);
+	assert(disk_discard(fs, super.data_loc + blknums[0] - 1, 1) == 0);
+	assert(ptr[0] == 0);
+	assert(disk_sync(fs) == 0);
+	disk_close(&fs);
+	free(raw);
+	free(blknums);
+	free(data);
+
+	return 0;
+}
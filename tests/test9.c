@@ -0,0 +1,112 @@
+/**
+ * @file test9.c
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include <fs.h>
+#include <disk.h>
+#include <io.h>
+#include <devutils.h>
+
+#define TEST_FILE_SIZE (FS_MAX_FILE_BLOCKS * FS_BLOCK_SIZE)
+#define TEST_ROUNDS 300
+
+/**
+ * @author ABDELMOUMENE Djahid
+ * @author AYAD Ishak
+ * @brief program to test reads and writes of random ranges of a file
+ * against a copy kept in memory
+ */
+int main(int argc, char** argv) {
+	srand(time(NULL));
+	char filename[512] = "./bin/partition";
+	struct fs_filesyst fs;
+
+	printf("Creating filesyst..\n");
+	assert(creatfile(filename, 8 * 1024 * 1024, &fs) == 0);
+	assert(fs_format(fs) == 0);
+
+	union fs_block blk;
+	struct fs_super_block super;
+	assert(fs_read_block(fs, 0, &blk) == 0);
+	super = blk.super;
+
+	uint32_t ino;
+	assert(io_open_creat(fs, super, 0, &ino) == 0);
+
+	uint8_t* shadow = calloc(1, TEST_FILE_SIZE);
+	uint8_t* buf = malloc(TEST_FILE_SIZE);
+	assert(shadow != NULL && buf != NULL);
+
+	printf("large writes are contiguous..\n");
+	uint32_t big;
+	size_t big_size = 100 * FS_BLOCK_SIZE;
+	memset(buf, 0xAB, big_size);
+	assert(io_open_creat(fs, super, 0, &big) == 0);
+	assert(io_write_ino(fs, super, big, buf, 0, big_size) == 0);
+	struct fs_inode ind;
+	union fs_block indirect;
+	assert(fs_read_inode(fs, super, big, &ind) == 0);
+	assert(fs_read_data(fs, super, &indirect, &ind.indirect, 1) == 0);
+	uint32_t expect = ind.direct[0];
+	for(int i=0; i<100; i++, expect++) {
+		uint32_t blknum = (i < FS_DIRECT_POINTERS_PER_INODE)? ind.direct[i]:
+			indirect.pointers[i - FS_DIRECT_POINTERS_PER_INODE];
+		assert(blknum == expect);
+	}
+	assert(ind.indirect == expect); /* after the data */
+	assert(io_rm_ino(fs, super, big) == 0);
+
+	printf("appended blocks follow the file..\n");
+	assert(io_open_creat(fs, super, 0, &big) == 0);
+	assert(io_write_ino(fs, super, big, buf, 0, 4 * FS_BLOCK_SIZE) == 0);
+	assert(fs_read_inode(fs, super, big, &ind) == 0);
+	/* another allocation moves the next-fit cursor away */
+	struct fs_extent far;
+	assert(fs_alloc_extents(fs, &super, ind.direct[3] + 100, 1, &far, 1) == 1);
+	assert(far.start == ind.direct[3] + 100);
+	assert(io_write_ino(fs, super, big, buf, 4 * FS_BLOCK_SIZE, 2 * FS_BLOCK_SIZE) == 0);
+	assert(fs_read_inode(fs, super, big, &ind) == 0);
+	for(int i=1; i<6; i++) {
+		assert(ind.direct[i] == ind.direct[0] + i);
+	}
+	assert(fs_free_data(fs, &super, far.start) == 0);
+	assert(io_rm_ino(fs, super, big) == 0);
+
+	printf("random writes and reads..\n");
+	for(int round=0; round<TEST_ROUNDS; round++) {
+		uint32_t off = rand() % TEST_FILE_SIZE;
+		uint32_t max = TEST_FILE_SIZE - off;
+		/* mostly small writes, some spanning many blocks */
+		uint32_t size = 1 + rand() % ((round % 4 == 0)? max: (max < 3 * FS_BLOCK_SIZE)? max: 3 * FS_BLOCK_SIZE);
+		for(uint32_t i=0; i<size; i++) {
+			buf[i] = rand();
+		}
+		assert(io_write_ino(fs, super, ino, buf, off, size) == 0);
+		memcpy(shadow + off, buf, size);
+
+		off = rand() % TEST_FILE_SIZE;
+		size = 1 + rand() % (TEST_FILE_SIZE - off);
+		assert(io_read_ino(fs, super, ino, buf, off, size) == 0);
+		assert(memcmp(buf, shadow + off, size) == 0);
+	}
+
+	printf("reading the whole file..\n");
+	assert(io_read_ino(fs, super, ino, buf, 0, TEST_FILE_SIZE) == 0);
+	assert(memcmp(buf, shadow, TEST_FILE_SIZE) == 0);
+
+	assert(disk_sync(fs) == 0);
+	assert(io_rm_ino(fs, super, ino) == 0);
+
+	free(shadow);
+	free(buf);
+	disk_close(&fs);
+	return 0;
+}